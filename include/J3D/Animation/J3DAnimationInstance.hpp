@@ -1,11 +1,15 @@
 #pragma once
 
 #include "J3D/Data/J3DBlock.hpp"
+#include "J3D/Util/J3DUtil.hpp"
 
 #include <stdint.h>
 #include <memory>
+#include <string>
+#include <vector>
 
 class J3DModelInstance;
+class J3DMaterial;
 
 namespace bStream {
     class CStream;
@@ -20,6 +24,58 @@ namespace J3DAnimation {
         Yoyo_Loop = 4
     };
 
+    // Parsed animation data. Clips are immutable once loaded, so one clip can be shared by
+    // every instance playing it; each instance only holds its own playback state.
+    struct J3DAnimationClip {
+        ELoopMode LoopMode;
+        uint16_t Length;
+
+        J3DAnimationClip() : LoopMode(ELoopMode::Once), Length(0) { }
+        virtual ~J3DAnimationClip() { }
+    };
+
+    // Maps each material in a material list to the animation entries that target it. Entries are matched
+    // to materials by name once, when the animation is bound, so applying it every frame is an index lookup.
+    class J3DMaterialBinding {
+        // Start of each material's range in mEntryIndices, plus one past the last material.
+        std::vector<uint32_t> mOffsets;
+        std::vector<uint32_t> mEntryIndices;
+
+        // The material list this binding was resolved against.
+        const shared_vector<J3DMaterial>* mMaterials;
+
+        void ResolveNames(const shared_vector<J3DMaterial>& materials, const std::vector<const std::string*>& entryNames, bool firstMatchOnly);
+
+    public:
+        J3DMaterialBinding() : mMaterials(nullptr) { }
+
+        // Resolves the MaterialName of each entry against the given material list. If firstMatchOnly is set, each
+        // material only takes the first entry naming it; otherwise it takes all of them, in entry order.
+        template<typename T>
+        void Resolve(const shared_vector<J3DMaterial>& materials, const std::vector<T>& entries, bool firstMatchOnly) {
+            std::vector<const std::string*> entryNames;
+            entryNames.reserve(entries.size());
+
+            for (const T& entry : entries) {
+                entryNames.push_back(&entry.MaterialName);
+            }
+
+            ResolveNames(materials, entryNames, firstMatchOnly);
+        }
+
+        bool IsBoundTo(const shared_vector<J3DMaterial>& materials) const {
+            return mMaterials == &materials && mOffsets.size() == materials.size() + 1;
+        }
+
+        // Returns the range of entry indices that target the given material. The range is empty for unknown materials.
+        const uint32_t* EntriesBegin(uint32_t materialIndex) const {
+            return materialIndex + 1 < mOffsets.size() ? mEntryIndices.data() + mOffsets[materialIndex] : nullptr;
+        }
+        const uint32_t* EntriesEnd(uint32_t materialIndex) const {
+            return materialIndex + 1 < mOffsets.size() ? mEntryIndices.data() + mOffsets[materialIndex + 1] : nullptr;
+        }
+    };
+
     class J3DAnimationInstance {
     protected:
         ELoopMode mLoopMode;
@@ -29,12 +85,19 @@ namespace J3DAnimation {
         bool mIsPaused;
         bool mIsReversed;
 
+        void SetClipInfo(const J3DAnimationClip& clip) { mLoopMode = clip.LoopMode; mLength = clip.Length; }
+
     public:
         J3DAnimationInstance() : mLoopMode(ELoopMode::Once), mLength(0), mCurrentFrame(0), mIsPaused(false), mIsReversed(false) { }
         virtual ~J3DAnimationInstance() { }
 
         virtual void Deserialize(bStream::CStream& stream) = 0;
 
+        // Returns the clip this instance plays.
+        virtual std::shared_ptr<const J3DAnimationClip> GetClip() const = 0;
+        // Creates a new instance playing the same clip, starting from the first frame.
+        virtual std::shared_ptr<J3DAnimationInstance> Clone() const = 0;
+
         uint16_t GetLength() const;
 
         float GetFrame() const;
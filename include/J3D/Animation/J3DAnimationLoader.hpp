@@ -15,6 +15,9 @@ namespace J3DAnimation {
     protected:
         std::shared_ptr<J3DAnimationInstance> mAnimInstance;
 
+        // Whether joint keyframe animations (BCK) are resampled per frame as they are loaded.
+        bool bBakeJointAnimations;
+
     public:
         J3DAnimationLoader();
 
@@ -30,8 +33,22 @@ namespace J3DAnimation {
             return std::dynamic_pointer_cast<T>(loadedAnimation);
         }
 
+        // Loading from a path or a buffer goes through a clip cache keyed by the hash of the file's contents:
+        // while any instance of a file's clip is alive, every load returns a new instance sharing it instead of parsing the file again.
         std::shared_ptr<J3DAnimationInstance> LoadAnimation(std::filesystem::path filePath);
         std::shared_ptr<J3DAnimationInstance> LoadAnimation(void* buffer, uint32_t size);
+        // Always parses the animation from the stream, bypassing the clip cache.
         std::shared_ptr<J3DAnimationInstance> LoadAnimation(bStream::CStream& stream);
+
+        // Bakes joint keyframe animations (BCK) on load; see J3DJointAnimationInstance::Bake.
+        // Baked and unbaked clips of the same file are cached separately.
+        void SetBakeJointAnimations(bool bake) { bBakeJointAnimations = bake; }
+        bool GetBakeJointAnimations() const { return bBakeJointAnimations; }
+
+        // Returns the number of cached clips. The clip cache doesn't own clips; each one is freed with the last
+        // instance playing it and is parsed again by the next load.
+        static uint32_t GetCachedClipCount();
+        // Forgets every cached clip, so the next loads parse their files again.
+        static void ClearClipCache();
     };
 }
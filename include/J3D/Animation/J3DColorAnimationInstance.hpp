@@ -17,20 +17,40 @@ namespace J3DAnimation {
         uint8_t ColorIndex;
     };
 
-    class J3DColorAnimationInstance : public J3DAnimationInstance {
+    struct J3DColorAnimationClip : public J3DAnimationClip {
         std::vector<J3DColorAnimationData> RegisterEntries;
         std::vector<J3DColorAnimationData> KonstEntries;
+    };
+
+    class J3DColorAnimationInstance : public J3DAnimationInstance {
+        std::shared_ptr<const J3DColorAnimationClip> mClip;
+
+        void SetClip(std::shared_ptr<const J3DColorAnimationClip> clip);
+
+        // Key cursors for the four tracks of each register and konst entry.
+        std::vector<uint32_t> mRegisterTrackCursors;
+        std::vector<uint32_t> mKonstTrackCursors;
 
         void ReadColorTrack(bStream::CStream& stream, J3DHermiteAnimationTrack& track, uint32_t valueTableOffset);
 
     public:
         J3DColorAnimationInstance();
+        J3DColorAnimationInstance(std::shared_ptr<const J3DColorAnimationClip> clip);
 
         virtual void Deserialize(bStream::CStream& stream) override;
 
-        const std::vector<J3DColorAnimationData>& GetRegisterEntries() const { return RegisterEntries; }
-        const std::vector<J3DColorAnimationData>& GetKonstEntries() const { return KonstEntries; }
+        virtual std::shared_ptr<const J3DAnimationClip> GetClip() const override { return mClip; }
+        virtual std::shared_ptr<J3DAnimationInstance> Clone() const override;
+
+        const std::vector<J3DColorAnimationData>& GetRegisterEntries() const { return mClip->RegisterEntries; }
+        const std::vector<J3DColorAnimationData>& GetKonstEntries() const { return mClip->KonstEntries; }
+
+        // Resolves the clip's register and konst entries against the given material list. The bindings belong to the
+        // caller, so one instance can be applied to several models. Each material takes the first entry naming it.
+        void Bind(const shared_vector<J3DMaterial>& materials, J3DMaterialBinding& registerBinding, J3DMaterialBinding& konstBinding) const;
 
-        void ApplyAnimation(std::shared_ptr<J3DMaterial> material);
+        // Applies the animation to the material at the given index of the material list the bindings were resolved against.
+        void ApplyAnimation(std::shared_ptr<J3DMaterial> material, uint32_t materialIndex,
+            const J3DMaterialBinding& registerBinding, const J3DMaterialBinding& konstBinding);
     };
 }
@@ -0,0 +1,73 @@
+#pragma once
+
+#include <algorithm>
+#include <cstdint>
+#include <type_traits>
+#include <vector>
+
+namespace J3DAnimation {
+    // A track with a value for every frame, as stored in full-frame animations (BCA). Values are kept in their
+    // file representation - float for scale and translation, int16_t for rotation - and converted when read.
+    template<typename T>
+    class J3DFullFrameAnimationTrack {
+        std::vector<T> mValues;
+
+        // Multiplier converting stored values to track values, e.g. quantized rotations to degrees.
+        float mValueScale;
+
+    public:
+        J3DFullFrameAnimationTrack() : mValueScale(1.0f) { }
+
+        void SetValueScale(float scale) { mValueScale = scale; }
+        void Reserve(uint32_t frameCount) { mValues.reserve(frameCount); }
+        void AddValue(T value) { mValues.push_back(value); }
+
+        uint32_t GetFrameCount() const { return (uint32_t)mValues.size(); }
+
+        // Returns whether every frame holds the same value.
+        bool IsConstant() const {
+            return std::all_of(mValues.begin(), mValues.end(), [this](T value) { return value == mValues[0]; });
+        }
+
+        // Reduces a constant track to a single value.
+        void Fold() {
+            if (mValues.size() > 1 && IsConstant()) {
+                mValues.resize(1);
+                mValues.shrink_to_fit();
+            }
+        }
+
+        // Returns the value at the given frame, blended linearly towards the next frame by blend.
+        // Tracks hold their last value past their end; a track with a single value is constant.
+        float GetValue(uint32_t frame, float blend) const {
+            if (mValues.empty()) {
+                return 0.0f;
+            }
+
+            uint32_t lastFrame = (uint32_t)mValues.size() - 1;
+            if (frame >= lastFrame) {
+                return mValues[lastFrame] * mValueScale;
+            }
+
+            float a = (float)mValues[frame];
+            float delta;
+
+            if constexpr (std::is_same_v<T, int16_t>) {
+                // Quantized rotations cover a full turn, so blend across the shorter way around the 16-bit circle.
+                delta = (float)(int16_t)(uint16_t)(mValues[frame + 1] - mValues[frame]);
+            }
+            else {
+                delta = (float)mValues[frame + 1] - a;
+            }
+
+            return (a + delta * blend) * mValueScale;
+        }
+
+        float GetValue(float time) const {
+            time = std::max(time, 0.0f);
+
+            uint32_t frame = static_cast<uint32_t>(time);
+            return GetValue(frame, time - (float)frame);
+        }
+    };
+}
@@ -2,6 +2,7 @@
 
 #include "J3D/Animation/J3DAnimationKey.hpp"
 
+#include <cstdint>
 #include <vector>
 
 namespace bStream {
@@ -19,11 +20,52 @@ namespace J3DAnimation {
 
         float InterpolateValue(float time, const J3DAnimationKey* a, const J3DAnimationKey* b) const;
 
+        float GetValueAtKeyIndex(float time, uint32_t index) const;
+
     public:
         J3DHermiteAnimationTrack();
         ~J3DHermiteAnimationTrack();
 
         void AddKey(J3DAnimationKey key);
+        uint32_t GetKeyCount() const { return (uint32_t)mKeys.size(); }
+        const std::vector<J3DAnimationKey>& GetKeys() const { return mKeys; }
+
         float GetValue(float time) const;
+        // Evaluates the track using a cursor kept by the caller between calls. When time moves forward or backward
+        // a little each call, as it does during playback, the key is found in constant time; larger jumps fall back
+        // to a binary search. Cursors should start at 0 and be kept separately for each playback of the track.
+        float GetValue(float time, uint32_t& cursor) const;
     };
+
+    // The keys of many Hermite tracks ("channels") packed into shared structure-of-arrays storage, so that
+    // the keys of a channel are contiguous and every channel can be evaluated in one batch.
+    struct J3DPackedHermiteTracks {
+        // Index of each channel's first key in the key arrays, plus one past the last channel.
+        std::vector<uint32_t> KeyOffsets;
+
+        std::vector<float> Times;
+        std::vector<float> Values;
+        std::vector<float> InTangents;
+        std::vector<float> OutTangents;
+
+        void AddTrack(const J3DHermiteAnimationTrack& track);
+        uint32_t GetChannelCount() const { return KeyOffsets.empty() ? 0 : (uint32_t)KeyOffsets.size() - 1; }
+
+        // Returns whether the channel has the same value at all times: it has at most one key, or every key
+        // has the same value and flat tangents.
+        bool IsChannelConstant(uint32_t channel) const;
+        // Returns the channel's value at its first key, which is its value at all times if it is constant.
+        float GetFirstValue(uint32_t channel) const;
+
+        // Finds the segment of the given channel that contains the time, using and updating a cursor like
+        // J3DHermiteAnimationTrack::GetValue does. Outputs the segment's endpoint values, its tangents scaled by
+        // the segment's length, and the time's position within it, ready to pass to EvaluateHermiteSegments.
+        void GetSegment(uint32_t channel, float time, uint32_t& cursor, float& p0, float& p1, float& m0, float& m1, float& t) const;
+        // Evaluates a single channel at the given time, using and updating a cursor like GetSegment does.
+        float GetValue(uint32_t channel, float time, uint32_t& cursor) const;
+    };
+
+    // Evaluates count Hermite segments, each given by its endpoint values, scaled tangents and position t.
+    // Uses AVX when the library is built with it enabled, eight segments at a time, and otherwise SSE, four at a time.
+    void EvaluateHermiteSegments(const float* p0, const float* p1, const float* m0, const float* m1, const float* t, float* results, size_t count);
 }
@@ -6,6 +6,7 @@
 #include "bstream.h"
 
 #include <glm/glm.hpp>
+#include <mutex>
 #include <vector>
 
 class J3DJoint;
@@ -19,20 +20,96 @@ namespace J3DAnimation {
         J3DHermiteAnimationTrack TranslationX, TranslationY, TranslationZ;
     };
 
+    // Joint transforms sampled at every whole frame of a clip. Each channel is its own array, indexed by
+    // frame * JointCount + joint, so a frame's values for all joints are contiguous.
+    struct J3DBakedJointAnimation {
+        uint32_t JointCount = 0;
+        uint32_t FrameCount = 0;
+
+        std::vector<float> TranslationX, TranslationY, TranslationZ;
+        // Rotation quaternions, with each component quantized to [-32767, 32767].
+        std::vector<int16_t> RotationX, RotationY, RotationZ, RotationW;
+        std::vector<float> ScaleX, ScaleY, ScaleZ;
+    };
+
+    struct J3DJointAnimationClip : public J3DAnimationClip {
+        uint32_t JointCount = 0;
+
+        // The keys of every joint's tracks, nine channels per joint in the order translation XYZ, scale XYZ, rotation XYZ.
+        // This is the only copy of the keys; the tracks they are read into are discarded once packed. Baked clips don't keep them.
+        J3DPackedHermiteTracks PackedTracks;
+
+        // Channels whose value changes over the clip; only these are evaluated during playback.
+        std::vector<uint32_t> AnimatedChannels;
+        // The value of every channel at the first key. Constant channels keep this value for the whole clip.
+        std::vector<float> InitialChannelValues;
+
+        // Entries whose channels are all constant, and their transforms, computed once when the clip is loaded.
+        std::vector<bool> StaticJoints;
+        std::vector<glm::mat4> StaticTransforms;
+        uint32_t StaticJointCount = 0;
+
+        // Finds the clip's constant channels and static joints. Called once the packed tracks are filled in.
+        void AnalyzeChannels();
+
+        // Resampled transforms, if the clip has been baked. Empty otherwise.
+        J3DBakedJointAnimation Baked;
+
+        bool IsBaked() const { return Baked.FrameCount != 0; }
+    };
+
     class J3DJointAnimationInstance : public J3DAnimationInstance {
-        std::vector<J3DJointAnimationData> mEntries;
+        std::shared_ptr<const J3DJointAnimationClip> mClip;
+
+        void SetClip(std::shared_ptr<const J3DJointAnimationClip> clip);
+
+        // Key cursors for each entry's nine tracks, so that playback doesn't search for keys every frame.
+        std::vector<uint32_t> mTrackCursors;
+
+        // Per-channel segment parameters and results, reused between frames.
+        // Segment parameters and results are stored per animated channel, values for every channel.
+        std::vector<float> mSegmentP0, mSegmentP1, mSegmentM0, mSegmentM1, mSegmentT;
+        std::vector<float> mAnimatedValues;
+        std::vector<float> mChannelValues;
+        // An instance can be shared by model instances posed on different threads. Evaluating the curves holds this while
+        // it uses the cursors and buffers above; baked playback only reads the clip, so it doesn't take it.
+        std::mutex mEvaluationLock;
 
         void ReadFloatComponentTrack(bStream::CStream& stream, J3DHermiteAnimationTrack& track, uint32_t valueTableOffset);
         void ReadRotationComponentTrack(bStream::CStream& stream, J3DHermiteAnimationTrack& track, uint32_t valueTableOffset, float scale);
 
+        void GetBakedTransformsAtFrame(float frameTime, std::vector<glm::mat4>& transforms, const std::vector<bool>* skip) const;
+
     public:
         J3DJointAnimationInstance();
+        J3DJointAnimationInstance(std::shared_ptr<const J3DJointAnimationClip> clip);
 
         virtual void Deserialize(bStream::CStream& stream) override;
 
-        const std::vector<J3DJointAnimationData>& GetEntries() const { return mEntries; }
-        uint32_t GetJointCount() const { return (uint32_t)mEntries.size(); }
+        virtual std::shared_ptr<const J3DAnimationClip> GetClip() const override { return mClip; }
+        virtual std::shared_ptr<J3DAnimationInstance> Clone() const override;
+
+        // The clip's keys, nine channels per joint. See J3DJointAnimationClip::PackedTracks.
+        const J3DPackedHermiteTracks& GetPackedTracks() const { return mClip->PackedTracks; }
+        uint32_t GetJointCount() const { return mClip->JointCount; }
+
+        // Per joint, whether the clip leaves its local transform unchanged for the whole animation.
+        const std::vector<bool>& GetStaticJoints() const { return mClip->StaticJoints; }
+        uint32_t GetStaticJointCount() const { return mClip->StaticJointCount; }
+        // Number of channels (nine per joint) that hold one value for the whole animation and are never evaluated.
+        uint32_t GetConstantChannelCount() const { return (uint32_t)(mClip->InitialChannelValues.size() - mClip->AnimatedChannels.size()); }
+
+        // Resamples the clip at every frame, so that playback blends between two stored frames instead of
+        // evaluating the curves. Baked playback is linear between whole frames, which loses a little of the
+        // curves' shape in exchange for constant-time evaluation. The baked clip replaces this instance's clip;
+        // instances cloned from this one share it. Baked clips drop the keys, so GetPackedTracks() is empty.
+        void Bake();
+        bool IsBaked() const { return mClip->IsBaked(); }
 
         virtual std::vector<glm::mat4> GetTransformsAtFrame(float deltaTime);
+        // Writes the transforms into a buffer owned by the caller. Once the buffer has grown to the joint count,
+        // this doesn't allocate. Joints flagged in skip are not evaluated and keep the transform already in the buffer.
+        // May be called from several threads at once.
+        virtual void GetTransformsAtFrame(float deltaTime, std::vector<glm::mat4>& transforms, const std::vector<bool>* skip = nullptr);
     };
 }
\ No newline at end of file
@@ -1,7 +1,7 @@
 #pragma once
 
 #include "J3D/Animation/J3DAnimationInstance.hpp"
-#include "J3D/Animation/J3DDiscreteAnimationTrack.hpp"
+#include "J3D/Animation/J3DFullFrameAnimationTrack.hpp"
 
 #include "bstream.h"
 
@@ -14,25 +14,55 @@ namespace J3DAnimation {
     struct J3DJointFullAnimationData {
         uint8_t JointIndex;
 
-        J3DDiscreteAnimationTrack ScaleX, ScaleY, ScaleZ;
-        J3DDiscreteAnimationTrack RotationX, RotationY, RotationZ;
-        J3DDiscreteAnimationTrack TranslationX, TranslationY, TranslationZ;
+        J3DFullFrameAnimationTrack<float> ScaleX, ScaleY, ScaleZ;
+        // Rotations stay quantized, with a value scale converting them to degrees.
+        J3DFullFrameAnimationTrack<int16_t> RotationX, RotationY, RotationZ;
+        J3DFullFrameAnimationTrack<float> TranslationX, TranslationY, TranslationZ;
+    };
+
+    struct J3DJointFullAnimationClip : public J3DAnimationClip {
+        std::vector<J3DJointFullAnimationData> Entries;
+
+        // Entries whose tracks are all constant, and their transforms, computed once when the clip is loaded.
+        std::vector<bool> StaticJoints;
+        std::vector<glm::mat4> StaticTransforms;
+        uint32_t StaticJointCount = 0;
+        uint32_t ConstantChannelCount = 0;
+
+        // Folds constant tracks to a single value and finds the clip's static joints.
+        void AnalyzeChannels();
     };
 
     class J3DJointFullAnimationInstance : public J3DAnimationInstance {
-        std::vector<J3DJointFullAnimationData> mEntries;
+        std::shared_ptr<const J3DJointFullAnimationClip> mClip;
 
-        void ReadFloatComponentTrack(bStream::CStream& stream, J3DDiscreteAnimationTrack& track, uint32_t valueTableOffset);
-        void ReadRotationComponentTrack(bStream::CStream& stream, J3DDiscreteAnimationTrack& track, uint32_t valueTableOffset, float scale);
+        void SetClip(std::shared_ptr<const J3DJointFullAnimationClip> clip);
+
+        void ReadFloatComponentTrack(bStream::CStream& stream, J3DFullFrameAnimationTrack<float>& track, uint32_t valueTableOffset);
+        void ReadRotationComponentTrack(bStream::CStream& stream, J3DFullFrameAnimationTrack<int16_t>& track, uint32_t valueTableOffset, float scale);
 
     public:
         J3DJointFullAnimationInstance();
+        J3DJointFullAnimationInstance(std::shared_ptr<const J3DJointFullAnimationClip> clip);
 
         virtual void Deserialize(bStream::CStream& stream) override;
 
-        const std::vector<J3DJointFullAnimationData>& GetEntries() const { return mEntries; }
-        uint32_t GetJointCount() const { return (uint32_t)mEntries.size(); }
+        virtual std::shared_ptr<const J3DAnimationClip> GetClip() const override { return mClip; }
+        virtual std::shared_ptr<J3DAnimationInstance> Clone() const override;
+
+        const std::vector<J3DJointFullAnimationData>& GetEntries() const { return mClip->Entries; }
+        uint32_t GetJointCount() const { return (uint32_t)mClip->Entries.size(); }
+
+        // Per joint, whether the clip leaves its local transform unchanged for the whole animation.
+        const std::vector<bool>& GetStaticJoints() const { return mClip->StaticJoints; }
+        uint32_t GetStaticJointCount() const { return mClip->StaticJointCount; }
+        // Number of tracks (nine per joint) that hold one value for the whole animation.
+        uint32_t GetConstantChannelCount() const { return mClip->ConstantChannelCount; }
 
         virtual std::vector<glm::mat4> GetTransformsAtFrame(float deltaTime);
+        // Writes the transforms into a buffer owned by the caller. Once the buffer has grown to the joint count,
+        // this doesn't allocate. Joints flagged in skip are not evaluated and keep the transform already in the buffer.
+        // Only reads the instance and its clip, so it may be called from several threads at once.
+        virtual void GetTransformsAtFrame(float deltaTime, std::vector<glm::mat4>& transforms, const std::vector<bool>* skip = nullptr);
     };
 }
@@ -0,0 +1,44 @@
+#pragma once
+
+#include <glm/glm.hpp>
+
+#include <cstdint>
+#include <memory>
+#include <vector>
+
+class J3DModelData;
+
+namespace J3DAnimation {
+    struct J3DAnimationClip;
+}
+
+// Shares posed envelope matrices between model instances within a frame. Instances of the same model playing
+// the same joint animation clip at the same frame produce identical poses, so the first one to be updated
+// stores its pose here and the rest reuse it instead of evaluating the animation themselves.
+//
+// Poses are only valid for the frame they were stored in; J3D::Rendering::Render clears the cache once it has
+// drawn every packet. Renderers that draw instances directly should call Clear() once per frame; the cache also
+// clears itself when it holds about MAX_POSE_COUNT poses. Find and Store may be called from several threads at once, as
+// when packets are gathered in parallel; SetEnabled and Clear must not run while other threads use the cache.
+namespace J3DPoseCache {
+    using Pose = std::shared_ptr<const std::vector<glm::mat4>>;
+
+    constexpr uint32_t MAX_POSE_COUNT = 4096;
+
+    // Returns the pose stored for the model posed by the clip at the given frame, or nullptr if there isn't one.
+    Pose Find(const std::shared_ptr<const J3DAnimation::J3DAnimationClip>& clip, const J3DModelData* modelData, float frame);
+    // Stores the pose for the model posed by the clip at the given frame.
+    void Store(const std::shared_ptr<const J3DAnimation::J3DAnimationClip>& clip, const J3DModelData* modelData, float frame, Pose pose);
+
+    // Pose sharing is enabled by default. Disabling it also clears the cache.
+    void SetEnabled(bool enabled);
+    bool GetEnabled();
+
+    // Returns the number of poses stored since the cache was last cleared.
+    uint32_t GetPoseCount();
+    // Returns the number of lookups that found a stored pose since the cache was last cleared.
+    uint32_t GetHitCount();
+
+    // Forgets every stored pose.
+    void Clear();
+}
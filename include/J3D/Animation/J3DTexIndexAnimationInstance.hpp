@@ -17,16 +17,31 @@ namespace J3DAnimation {
         uint8_t TextureSlotIndex;
     };
 
+    struct J3DTexIndexAnimationClip : public J3DAnimationClip {
+        std::vector<J3DTexIndexAnimationData> Entries;
+    };
+
     class J3DTexIndexAnimationInstance : public J3DAnimationInstance {
-        std::vector<J3DTexIndexAnimationData> mEntries;
+        std::shared_ptr<const J3DTexIndexAnimationClip> mClip;
+
+        void SetClip(std::shared_ptr<const J3DTexIndexAnimationClip> clip);
 
     public:
         J3DTexIndexAnimationInstance();
+        J3DTexIndexAnimationInstance(std::shared_ptr<const J3DTexIndexAnimationClip> clip);
 
         virtual void Deserialize(bStream::CStream& stream) override;
 
-        const std::vector<J3DTexIndexAnimationData>& GetEntries() const { return mEntries; }
+        virtual std::shared_ptr<const J3DAnimationClip> GetClip() const override { return mClip; }
+        virtual std::shared_ptr<J3DAnimationInstance> Clone() const override;
+
+        const std::vector<J3DTexIndexAnimationData>& GetEntries() const { return mClip->Entries; }
+
+        // Resolves the clip's entries against the given material list. The binding belongs to the caller, so one
+        // instance can be applied to several models. Each material takes the first entry naming it.
+        void Bind(const shared_vector<J3DMaterial>& materials, J3DMaterialBinding& binding) const;
 
-        void ApplyAnimation(std::shared_ptr<J3DMaterial> material);
+        // Applies the animation to the material at the given index of the material list the binding was resolved against.
+        void ApplyAnimation(std::shared_ptr<J3DMaterial> material, uint32_t materialIndex, const J3DMaterialBinding& binding);
     };
 }
@@ -22,19 +22,37 @@ namespace J3DAnimation {
         glm::vec3 Origin;
     };
 
+    struct J3DTexMatrixAnimationClip : public J3DAnimationClip {
+        std::vector<J3DTexMatrixAnimationData> Entries;
+    };
+
     class J3DTexMatrixAnimationInstance : public J3DAnimationInstance {
-        std::vector<J3DTexMatrixAnimationData> mEntries;
+        std::shared_ptr<const J3DTexMatrixAnimationClip> mClip;
+
+        void SetClip(std::shared_ptr<const J3DTexMatrixAnimationClip> clip);
+
+        // Key cursors for each entry's nine tracks.
+        std::vector<uint32_t> mTrackCursors;
 
         void ReadFloatComponentTrack(bStream::CStream& stream, J3DHermiteAnimationTrack& track, uint32_t valueTableOffset);
         void ReadRotationComponentTrack(bStream::CStream& stream, J3DHermiteAnimationTrack& track, uint32_t valueTableOffset, float scale);
 
     public:
         J3DTexMatrixAnimationInstance();
+        J3DTexMatrixAnimationInstance(std::shared_ptr<const J3DTexMatrixAnimationClip> clip);
 
         virtual void Deserialize(bStream::CStream& stream) override;
 
-        const std::vector<J3DTexMatrixAnimationData>& GetEntries() const { return mEntries; }
+        virtual std::shared_ptr<const J3DAnimationClip> GetClip() const override { return mClip; }
+        virtual std::shared_ptr<J3DAnimationInstance> Clone() const override;
+
+        const std::vector<J3DTexMatrixAnimationData>& GetEntries() const { return mClip->Entries; }
+
+        // Resolves the clip's entries against the given material list. The binding belongs to the caller, so one
+        // instance can be applied to several models. A material takes every entry naming it, one per tex matrix.
+        void Bind(const shared_vector<J3DMaterial>& materials, J3DMaterialBinding& binding) const;
 
-        void ApplyAnimation(std::shared_ptr<J3DMaterial> material);
+        // Applies the animation to the material at the given index of the material list the binding was resolved against.
+        void ApplyAnimation(std::shared_ptr<J3DMaterial> material, uint32_t materialIndex, const J3DMaterialBinding& binding);
     };
 }
\ No newline at end of file
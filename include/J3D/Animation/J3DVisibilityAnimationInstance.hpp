@@ -16,17 +16,27 @@ namespace J3DAnimation {
         J3DDiscreteAnimationTrack Visibility;
     };
 
+    struct J3DVisibilityAnimationClip : public J3DAnimationClip {
+        std::vector<J3DVisibilityAnimationData> Entries;
+    };
+
     class J3DVisibilityAnimationInstance : public J3DAnimationInstance {
-        std::vector<J3DVisibilityAnimationData> mEntries;
+        std::shared_ptr<const J3DVisibilityAnimationClip> mClip;
+
+        void SetClip(std::shared_ptr<const J3DVisibilityAnimationClip> clip);
 
         void ReadBooleanComponentTrack(bStream::CStream& stream, J3DDiscreteAnimationTrack& track, uint32_t valueTableOffset);
 
     public:
         J3DVisibilityAnimationInstance();
+        J3DVisibilityAnimationInstance(std::shared_ptr<const J3DVisibilityAnimationClip> clip);
 
         virtual void Deserialize(bStream::CStream& stream) override;
 
-        const std::vector<J3DVisibilityAnimationData>& GetEntries() const { return mEntries; }
+        virtual std::shared_ptr<const J3DAnimationClip> GetClip() const override { return mClip; }
+        virtual std::shared_ptr<J3DAnimationInstance> Clone() const override;
+
+        const std::vector<J3DVisibilityAnimationData>& GetEntries() const { return mClip->Entries; }
         
         bool GetVisibilityAtFrame(uint32_t shapeIdx, float deltaTime);
     };
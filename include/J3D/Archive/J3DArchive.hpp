@@ -0,0 +1,86 @@
+#pragma once
+
+#include <cstdint>
+#include <filesystem>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+class J3DModelData;
+class J3DMaterialTable;
+
+namespace J3DAnimation {
+	class J3DAnimationInstance;
+}
+
+// A single file inside of a RARC archive.
+struct J3DArchiveEntry {
+	// Path of the file relative to the archive's root directory, lowercase.
+	std::string Path;
+
+	// Offset and size of the file's data within the archive buffer.
+	uint32_t DataOffset;
+	uint32_t DataSize;
+
+	// Whether the file's data is Yaz0-compressed inside of the archive.
+	bool bCompressed;
+
+	// Decompressed data for compressed files. Filled the first time the file is accessed.
+	std::once_flag DecompressFlag;
+	std::vector<uint8_t> DecompressedData;
+	bool bDecompressed;
+
+	J3DArchiveEntry() : DataOffset(0), DataSize(0), bCompressed(false), bDecompressed(false) { }
+};
+
+// Read-only view of a RARC archive, optionally Yaz0-compressed as a whole (.szs).
+// Files are looked up by path through an index built when the archive is opened. Uncompressed files
+// are returned as pointers into the archive buffer; compressed files are decompressed once, on first
+// access, and are safe to access from several threads at once.
+class J3DArchive {
+	std::vector<uint8_t> mArchiveData;
+
+	std::string mRootName;
+	std::vector<std::unique_ptr<J3DArchiveEntry>> mEntries;
+	std::unordered_map<std::string, J3DArchiveEntry*> mEntryIndex;
+
+	bool ReadIndex();
+	J3DArchiveEntry* FindEntry(const std::string& path) const;
+	bool GetEntryData(J3DArchiveEntry* entry, const uint8_t*& data, size_t& size);
+
+public:
+	J3DArchive() { }
+	~J3DArchive() { }
+
+	// Opens the archive at the given path. Returns false if the file is missing or isn't a RARC archive.
+	bool Open(std::filesystem::path filePath);
+	// Takes ownership of the given archive data. Returns false if it isn't a RARC archive.
+	bool Open(std::vector<uint8_t>&& archiveData);
+
+	const std::string& GetRootName() const { return mRootName; }
+	uint32_t GetFileCount() const { return (uint32_t)mEntries.size(); }
+
+	// Returns the paths of every file in the archive, relative to the root directory.
+	std::vector<std::string> GetFilePaths() const;
+
+	// Returns whether the archive contains a file at the given path. Paths are case-insensitive, and may optionally start with the root directory's name.
+	bool Contains(const std::string& path) const;
+
+	// Retrieves a pointer to the data of the file at the given path, decompressing it first if necessary.
+	// The data is owned by the archive and stays valid for as long as the archive does.
+	bool GetFileData(const std::string& path, const uint8_t*& data, size_t& size);
+
+	// Decompresses the given compressed files in parallel, so that later accesses don't have to.
+	void Prefetch(const std::vector<std::string>& paths);
+	// Decompresses every compressed file in the archive in parallel.
+	void PrefetchAll();
+
+	// Loads the model at the given path straight from the archive's memory.
+	std::shared_ptr<J3DModelData> LoadModel(const std::string& path, uint32_t flags);
+	// Loads the material table (BMT) at the given path straight from the archive's memory.
+	std::shared_ptr<J3DMaterialTable> LoadMaterialTable(const std::string& path, std::shared_ptr<J3DModelData> modelData);
+	// Loads the animation at the given path straight from the archive's memory.
+	std::shared_ptr<J3DAnimation::J3DAnimationInstance> LoadAnimation(const std::string& path);
+};
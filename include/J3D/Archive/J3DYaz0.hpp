@@ -0,0 +1,23 @@
+#pragma once
+
+#include <cstdint>
+#include <cstddef>
+#include <vector>
+
+namespace J3DYaz0 {
+	constexpr uint32_t YAZ0_MAGIC = 0x59617A30; // Yaz0
+	constexpr size_t YAZ0_HEADER_SIZE = 0x10;
+
+	// Returns whether the given buffer starts with a Yaz0 header.
+	bool IsCompressed(const uint8_t* src, size_t srcSize);
+
+	// Returns the decompressed size stored in the Yaz0 header of the given buffer, or 0 if it is not Yaz0 data.
+	uint32_t GetDecompressedSize(const uint8_t* src, size_t srcSize);
+
+	// Decompresses the Yaz0 data in src into dst, which must hold at least GetDecompressedSize() bytes.
+	// Returns false if the compressed data is truncated or references data outside of dst.
+	bool Decompress(const uint8_t* src, size_t srcSize, uint8_t* dst, size_t dstSize);
+
+	// Decompresses the Yaz0 data in src into the given vector, resizing it to fit.
+	bool Decompress(const uint8_t* src, size_t srcSize, std::vector<uint8_t>& dst);
+}
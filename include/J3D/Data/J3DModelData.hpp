@@ -2,6 +2,7 @@
 
 #include "J3DBlock.hpp"
 #include "J3D/Geometry/J3DShape.hpp"
+#include "J3D/Geometry/J3DShapeFactory.hpp"
 #include "J3D/Skeleton/J3DSkeleton.hpp"
 #include "J3D/Material//J3DMaterialTable.hpp"
 #include "J3D/Material/J3DMaterial.hpp"
@@ -15,7 +16,12 @@
 #include <vector>
 #include <memory>
 
+namespace J3DAnimation {
+	struct J3DAnimationClip;
+}
+
 struct J3DEnvelope;
+struct J3DGeometryAllocation;
 class J3DModelLoader;
 class J3DModelInstance;
 class J3DJoint;
@@ -26,9 +32,8 @@ class J3DModelData : public std::enable_shared_from_this<J3DModelData> {
 
 	// Rendering stuff
 	bool mGLInitialized = false;
-	uint32_t mVAO = UINT32_MAX;
-	uint32_t mVBO = UINT32_MAX;
-	uint32_t mIBO = UINT32_MAX;
+	// This model's vertices and indices within the shared geometry arenas.
+	std::shared_ptr<J3DGeometryAllocation> mGeometryAllocation;
 
 	// INF1 data, hierarchy and misc. info
 	uint32_t mFlags;
@@ -40,9 +45,30 @@ class J3DModelData : public std::enable_shared_from_this<J3DModelData> {
 
 	// SHP1 data, geometry
 	GXGeometry mGeometry;
+	// Bounds of each shape, in shape order.
+	std::vector<J3DShapeBounds> mShapeBounds;
+	// Each shape's range of mModelIndices, in shape order.
+	std::vector<J3DShapeIndexRange> mShapeIndexRanges;
+
+	// The shapes triangulated into one vertex and index buffer, held from loading until they are uploaded.
+	std::vector<ModernVertex> mModelVertices;
+	std::vector<uint32_t> mModelIndices;
 
+	// Bounds of the model in its rest pose.
 	glm::vec3 mBBMin;
 	glm::vec3 mBBMax;
+	// Bounds of all of the model's vertices drawn with each draw matrix, for the draw matrices that have any.
+	std::vector<J3DDrawBounds> mDrawBounds;
+
+	// Bounds that hold every pose of a joint animation clip, for the clips that instances of this model have been given.
+	// Found by J3DModelInstance when the clip is first bound, since sampling the whole clip is too slow to repeat.
+	struct J3DClipBounds {
+		// Expires with the clip, so that a later clip at the same address doesn't match.
+		std::weak_ptr<const J3DAnimation::J3DAnimationClip> Clip;
+		glm::vec3 Min;
+		glm::vec3 Max;
+	};
+	std::vector<J3DClipBounds> mClipBounds;
 
 	std::vector<J3DVertexGX> mGXVertices;
 	std::vector<J3DVertexGL> mGLVertices;
@@ -52,29 +78,51 @@ class J3DModelData : public std::enable_shared_from_this<J3DModelData> {
 
 	std::shared_ptr<J3DMaterialTable> mMaterialTable;
 
-	void MakeHierarchy(std::shared_ptr<J3DJoint> root, uint32_t& index);
+	void MakeHierarchy(std::shared_ptr<J3DJoint> root, uint32_t& index, bool deferShaders = false);
+	// Triangulates the shapes into mModelVertices and mModelIndices, and records each shape's range of the indices.
+	void Triangulate();
 	void CalculateRestPose();
+	// Calculates the model's bounds in the rest pose and the bounds of each shape's vertices per draw matrix.
+	void CalculateBounds();
 	
 	void CreateVBO();
 	bool InitializeGL();
+	// Whether this model's geometry is in the arenas. It isn't before the first draw, if uploading it failed,
+	// or after J3DGeometryArena::DestroyArenas().
+	bool HasGeometry() const;
 
 	static std::atomic<uint16_t> sInstanceIdSrc;
 
+	// Identifies this model for the lifetime of the process. Unlike its address, it is never reused by a later model.
+	uint64_t mUniqueId;
+	static std::atomic<uint64_t> sUniqueIdSrc;
+
 public:
 	J3DModelData();
 	virtual ~J3DModelData();
 
 	std::shared_ptr<J3DModelInstance> CreateInstance();
 
+	uint64_t GetUniqueId() const { return mUniqueId; }
+
+	// Returns the model's bounds in its rest pose.
 	void GetBoundingBox(glm::vec3& min, glm::vec3& max) const;
+	const std::vector<J3DDrawBounds>& GetDrawBounds() const { return mDrawBounds; }
 
 	shared_vector<GXShape>& GetShapes() { return mGeometry.GetShapes(); }
+	/* Returns the bounds of the given shape of this model, or nullptr if it isn't one of this model's shapes. */
+	const J3DShapeBounds* GetShapeBounds(const GXShape* shape);
 
 	std::vector<glm::mat4> GetRestPose() const;
 	const std::vector<J3DEnvelope>& GetJointEnvelopes() const { return mSkeleton->GetJointEnvelopes(); }
 	shared_vector<J3DJoint>& GetJoints() { return mSkeleton->GetJoints(); }
 
 	std::vector<glm::mat4> CalculateAnimJointPose(const std::vector<glm::mat4>& transforms) { return mSkeleton->CalculateAnimJointPose(transforms); }
+	void UpdateAnimJointPose(const std::vector<glm::mat4>& transforms, std::vector<glm::mat4>& pose, const std::vector<bool>* skip = nullptr) const { mSkeleton->UpdateAnimJointPose(transforms, pose, skip); }
+	void CalculateJointWorldMatrices(const std::vector<glm::mat4>& localTransforms, std::vector<glm::mat4>& world, const std::vector<bool>* skip = nullptr) const { mSkeleton->CalculateJointWorldMatrices(localTransforms, world, skip); }
+	const std::vector<int32_t>& GetJointParents() const { return mSkeleton->GetJointParents(); }
+	const std::vector<uint32_t>& GetJointOrder() const { return mSkeleton->GetJointOrder(); }
+	std::vector<bool> GetStaticEnvelopes(const std::vector<bool>& staticJoints) const { return mSkeleton->GetStaticEnvelopes(staticJoints); }
 
 	/* Returns the material at the given index, or an empty shared_ptr if it does not exist. */
 	std::shared_ptr<J3DMaterial> GetMaterial(uint32_t idx) { return mMaterialTable->GetMaterial(idx); }
@@ -92,9 +140,19 @@ public:
 
 	uint32_t GetJointCount() const { return (uint32_t)mSkeleton->GetJoints().size(); }
 
+	/* Generates the shaders and decodes the textures of the given materials if they were deferred by a lazy load. */
+	void Prewarm(const shared_vector<J3DMaterial>& materials);
+	/* Generates the shaders and decodes the textures of all of this model's default materials. */
+	void Prewarm() { Prewarm(GetMaterials()); }
+
 	bool SetTexture(uint32_t idx, std::shared_ptr<J3DTexture> texture);
 	bool SetTexture(std::string name, std::shared_ptr<J3DTexture> texture);
 
+	// Binds the shared VAO holding this model's geometry, uploading it first if necessary.
 	void BindVAO();
 	void UnbindVAO();
+
+	// Offsets of this model's geometry within its geometry arena, to be passed along to draw calls.
+	uint32_t GetBaseVertex() const;
+	uint32_t GetFirstIndex() const;
 };
@@ -1,7 +1,10 @@
 #pragma once
 
+#include "J3D/Animation/J3DAnimationInstance.hpp"
 #include "J3D/Rendering/J3DRenderPacket.hpp"
+#include "J3D/Rendering/J3DCulling.hpp"
 #include "J3D/Rendering/J3DLight.hpp"
+#include "J3D/Rendering/J3DOcclusion.hpp"
 #include "J3D/Util/J3DTransform.hpp"
 #include "J3D/Util/J3DUtil.hpp"
 
@@ -10,6 +13,7 @@
 #include <vector>
 
 namespace J3DAnimation {
+    struct J3DAnimationClip;
     class J3DColorAnimationInstance;
     class J3DTexIndexAnimationInstance;
     class J3DTexMatrixAnimationInstance;
@@ -19,18 +23,113 @@ namespace J3DAnimation {
 }
 
 struct J3DTexture;
+struct J3DShapeBounds;
+struct J3DDrawBounds;
+struct J3DFrustum;
+struct J3DRenderPacket;
 
 class J3DMaterial;
 class J3DModelData;
 class J3DMaterialTable;
+class J3DScene;
+
+// One level of an instance's animation level of detail. An instance uses the first level whose MinProjectedSize
+// its projected size reaches, or the last level if it is smaller than all of them.
+struct J3DAnimationLODLevel {
+    // Ratio of the instance's bounding sphere radius to its distance from the camera.
+    float MinProjectedSize = 0.0f;
+    // The pose is recalculated every UpdateInterval frames of the animation and held in between, however the animation
+    // is advanced. Animations themselves still advance every frame.
+    uint32_t UpdateInterval = 1;
+    // Per joint, whether it is animated at this level. Joints that aren't keep the local transform they had when the
+    // level or clip was applied, and still follow their parents. Empty to animate every joint.
+    std::vector<bool> AnimatedJoints;
+};
 
 class J3DModelInstance {
+    friend J3DScene;
+    friend J3DRenderPacket;
+
     std::shared_ptr<J3DModelData> mModelData;
-    std::vector<glm::mat4> mEnvelopeMatrices;
+    // This instance's own posed envelope matrices. It may be shared through J3DPoseCache, so it is copied
+    // before being written to if anything else still holds it.
+    std::shared_ptr<std::vector<glm::mat4>> mEnvelopeMatrices;
+    // A second buffer swapped with mEnvelopeMatrices when the latter is still shared, so that no new buffer
+    // is allocated once both exist.
+    std::shared_ptr<std::vector<glm::mat4>> mSpareEnvelopeMatrices;
+    // The envelope matrices to draw with: either mEnvelopeMatrices or a pose shared by another instance.
+    std::shared_ptr<const std::vector<glm::mat4>> mPose;
     J3DTransformInfo mTransform;
 
-    glm::vec3 mBBMin;
-    glm::vec3 mBBMax;
+    // The clip and frame mPose was calculated for. Updating again at the same frame, as happens for every material
+    // the instance draws, reuses it.
+    std::shared_ptr<const J3DAnimation::J3DAnimationClip> mPoseClip;
+    float mPoseFrame;
+
+    // Local and world transforms of the joints in the current animated pose, reused between frames.
+    std::vector<glm::mat4> mJointLocalMatrices;
+    std::vector<glm::mat4> mJointWorldMatrices;
+    // Joints and envelopes that the current joint animation clip never changes, so they are only calculated
+    // on the clip's first frame. Recalculated whenever the clip changes.
+    std::shared_ptr<const J3DAnimation::J3DAnimationClip> mStaticPoseClip;
+    std::vector<bool> mStaticWorldJoints;
+    std::vector<bool> mStaticEnvelopes;
+    uint32_t mStaticWorldJointCount;
+    uint32_t mStaticEnvelopeCount;
+    // Whether mJointWorldMatrices and mEnvelopeMatrices hold a pose of mStaticPoseClip, so static entries can be reused.
+    bool bJointPoseValid;
+
+    // Animation level of detail, ordered from the largest MinProjectedSize to the smallest.
+    std::vector<J3DAnimationLODLevel> mAnimationLODLevels;
+    uint32_t mAnimationLODLevel;
+    float mProjectedSize;
+    // Joints not animated at the current level. Their local transforms are held, as are the world transforms and
+    // envelopes that only depend on held joints.
+    std::vector<bool> mHeldJoints;
+    // Culled instances don't emit render packets, so they are never posed, but their animations keep advancing.
+    bool bCulled;
+
+    // Where mPose was uploaded to the envelope storage buffer, so that every material and pass drawing the
+    // instance in the same frame reuses it. Only valid while mEnvelopeGeneration is the storage's current generation
+    // and the instance is drawn with the same model-view transform.
+    uint32_t mEnvelopeBase;
+    uint32_t mEnvelopeGeneration;
+    glm::mat4 mEnvelopeModelView;
+    bool bEnvelopesAllocated;
+
+    // With compute skinning, mPose is applied to a copy of the model's vertices once per pose, and materials draw that copy
+    // as static geometry through an identity envelope allocated right after the pose.
+    bool bUseComputeSkinning;
+    uint32_t mPosedVertexBuffer;
+    bool bPosedVerticesValid;
+
+    // Bounds, center of mass and presence of the shape of each material in mMaterialBoundsSource, the material list they
+    // were last looked up for. Shapes set on the list's materials after that are only seen once the list is replaced.
+    std::vector<const J3DShapeBounds*> mMaterialBounds;
+    std::vector<glm::vec3> mMaterialCenters;
+    std::vector<bool> mMaterialHasShape;
+    const shared_vector<J3DMaterial>* mMaterialBoundsSource;
+
+    // Bounds of the current pose in model space and in world space. Each is recalculated when it is next asked for
+    // after the pose, or for the world bounds the transform, changes.
+    mutable glm::vec3 mPoseBBMin;
+    mutable glm::vec3 mPoseBBMax;
+    mutable bool bPoseBoundsValid;
+    mutable glm::vec3 mBBMin;
+    mutable glm::vec3 mBBMax;
+    mutable bool bWorldBoundsValid;
+    // Model-space bounds of every pose of the joint animation clip, found when the animation was set. Instances with
+    // these use them for their world bounds, so that posing them doesn't move them in their scene.
+    glm::vec3 mClipBBMin;
+    glm::vec3 mClipBBMax;
+    bool bHasClipBounds;
+
+    // The scene this instance is in, if any, and its index there.
+    J3DScene* mScene;
+    uint32_t mSceneIndex;
+
+    J3DOcclusionQuery mOcclusionQuery;
+    J3DCullRecord mCullRecord;
 
     // Transform applied to the model-space transform stored in mTransform.
     glm::mat4 mReferenceFrame;
@@ -40,21 +139,55 @@ class J3DModelInstance {
 
     // Recalculates joint transforms based on a load animation - BCK for keyframes at discrete time units, BCA for values at every frame.
     void CalculateJointMatrices(float deltaTime);
+    // Finds the joints and envelopes that can't change under a clip with the given static joints.
+    void UpdateStaticPose(const std::vector<bool>& staticJoints);
+    // Whether the current level of detail lets the pose held at mPoseFrame be replaced by one at the given frame.
+    bool CheckPoseUpdateDue(float frame) const;
+    void SetAnimationLODLevel(uint32_t level);
+    // Uploads mPose to the envelope storage buffer with the given model-view transform applied if it isn't there yet,
+    // and points the following draws at it.
+    void SubmitEnvelopeMatrices(const glm::mat4& modelView);
+    // Skins the posed vertex buffer with mPose if compute skinning is enabled and it doesn't hold the current pose yet.
+    void UpdatePosedVertices();
+    // Whether the material can be drawn from the posed vertex buffer.
+    bool CheckUsePosedVertices(const J3DMaterial* material) const;
+    void RenderMaterial(const std::shared_ptr<J3DMaterial>& material, uint32_t materialShaderOverride);
+    // Render and StaticRender without unbinding the geometry arena afterwards. J3D::Rendering draws packets with these,
+    // so that consecutive packets from the same arena don't rebind it, and unbinds it once at the end.
+    void RenderPacket(float deltaTime, const std::shared_ptr<J3DMaterial>& material, uint32_t materialIndex, glm::mat4& viewMatrix, glm::mat4& projMatrix, uint32_t materialShaderOverride);
+    void StaticRenderPacket(const std::shared_ptr<J3DMaterial>& material, uint32_t materialShaderOverride);
+    // Marks the cached bounds as stale and tells the instance's scene if its world bounds changed.
+    void InvalidateBounds(bool poseChanged);
+    // Finds the bounds of every pose of the current joint animation's clip, or reuses the model's if it already has them.
+    void UpdateClipBounds();
+    // Calculates the bounds of the given boxes under their draw matrices in the current pose and the given transform.
+    // Returns false if there are no boxes or the pose doesn't have their matrices.
+    bool CalculatePosedBounds(const std::vector<J3DDrawBounds>& draws, const glm::mat4& transform, glm::vec3& min, glm::vec3& max) const;
+    // Looks up the shape bounds and centers of each material in the list if they were last looked up for a different one.
+    void BindMaterialBounds(const shared_vector<J3DMaterial>& materials);
+    void GatherPackets(std::vector<J3DRenderPacket>& packetList, glm::vec3 cameraPosition, const J3DFrustum* frustum);
+    // Builds the key that J3D::Rendering::RadixSortPackets orders the material's packet by. See J3DRendering.hpp for the layout.
+    uint64_t CalculateSortKey(const J3DMaterial& material, float distanceSquared) const;
+    // Whether the shape of the material at the given index may be inside the frustum, in the current pose.
+    bool CheckShapeInFrustum(uint32_t materialIndex, const glm::mat4& transform, const J3DFrustum& frustum) const;
     // Recalculates texture transforms based on a loaded BTK animation.
-    void UpdateMaterialTextureMatrices(float deltaTime, std::shared_ptr<J3DMaterial> material, glm::mat4& viewMatrix, glm::mat4& projMatrix);
+    void UpdateMaterialTextureMatrices(float deltaTime, const std::shared_ptr<J3DMaterial>& material, uint32_t materialIndex, glm::mat4& viewMatrix, glm::mat4& projMatrix);
 
     // Updates material textures based on a loaded BTP animation.
-    void UpdateMaterialTextures(float deltaTime, std::shared_ptr<J3DMaterial> material);
+    void UpdateMaterialTextures(float deltaTime, const std::shared_ptr<J3DMaterial>& material, uint32_t materialIndex);
 
     // Updates material colors based on a loaded BPK animation.
     void UpdateMaterialColors(float deltaTime);
     // Updates TEV register colors based on a loaded BRK animation.
-    void UpdateTEVRegisterColors(float deltaTime, std::shared_ptr<J3DMaterial> material);
+    void UpdateTEVRegisterColors(float deltaTime, const std::shared_ptr<J3DMaterial>& material, uint32_t materialIndex);
 
     // Updates shape visibility based on a loaded BVA animation.
     void UpdateShapeVisibility(float deltaTime);
 
-    void Update(float deltaTime, std::shared_ptr<J3DMaterial> material, glm::mat4& viewMatrix, glm::mat4& projMatrix);
+    void Update(float deltaTime, const std::shared_ptr<J3DMaterial>& material, uint32_t materialIndex, glm::mat4& viewMatrix, glm::mat4& projMatrix);
+
+    // Resolves the material animations' entries against the material list this instance currently renders with.
+    void BindMaterialAnimations();
 
     std::shared_ptr<J3DAnimation::J3DColorAnimationInstance> mRegisterColorAnimation;
     std::shared_ptr<J3DAnimation::J3DTexIndexAnimationInstance> mTexIndexAnimation;
@@ -63,6 +196,13 @@ class J3DModelInstance {
     std::shared_ptr<J3DAnimation::J3DJointFullAnimationInstance> mJointFullAnimation;
     std::shared_ptr<J3DAnimation::J3DVisibilityAnimationInstance> mVisibilityAnimation;
 
+    // The material animations' entries resolved against this instance's material list. They live here rather than
+    // in the animation instances so that an animation instance shared between models doesn't rebind every packet.
+    J3DAnimation::J3DMaterialBinding mRegisterColorBinding;
+    J3DAnimation::J3DMaterialBinding mKonstColorBinding;
+    J3DAnimation::J3DMaterialBinding mTexIndexBinding;
+    J3DAnimation::J3DMaterialBinding mTexMatrixBinding;
+
     bool bUseInstanceMaterialTable;
     std::shared_ptr<J3DMaterialTable> mInstanceMaterialTable;
 
@@ -83,29 +223,68 @@ public:
     void SetTransform(const glm::mat4 transform);
     void SetReferenceFrame(const glm::mat4 frame);
 
+    // Returns the instance's bounding box in model space, in its current pose. Instances without a joint animation
+    // use the rest pose. The pose is only calculated when the instance is rendered or culled with a frustum.
     void GetBoundingBox(glm::vec3& min, glm::vec3& max) const;
+    // Returns the instance's bounding box in world space. For instances with a joint animation it holds every pose of
+    // the animation's clip, so it only changes with the transform; for the rest it is the current pose's.
+    void GetWorldBoundingBox(glm::vec3& min, glm::vec3& max) const;
+    // Returns the bounds of the shape drawn by the material at the given index of GetMaterials(), if it has any.
+    const J3DShapeBounds* GetShapeBounds(uint32_t materialIndex);
+    // Returns the transform from the model's space to world space.
+    glm::mat4 GetWorldMatrix() const { return mReferenceFrame * mTransform.ToMat4(); }
+    bool HasJointAnimation() const { return mJointAnimation != nullptr || mJointFullAnimation != nullptr; }
+    // Returns the index range that rendering the given material draws, as passed to glDrawElementsBaseVertex.
+    // Returns false if the material has no shape or the model's geometry hasn't been uploaded yet.
+    bool GetDrawRange(const J3DMaterial* material, uint32_t& count, uint32_t& firstIndex, uint32_t& baseVertex) const;
 	const shared_vector<J3DMaterial>& GetMaterials() const;
+    // Whether the given material can be drawn for this instance and the other one in a single multi-draw, with the state
+    // the first of them binds. Only the envelope matrices may differ between them, so this is false for instances whose
+    // material state or vertices are their own: those with material or visibility animations or compute skinning, and
+    // those drawing from a different texture list or geometry arena. Blended materials are never batched, since the
+    // order of the draws in a batch isn't kept.
+    bool CheckSameBatch(const J3DMaterial* material, const J3DModelInstance& other) const;
+    // The state of this instance's occlusion queries, managed by J3DOcclusion.
+    J3DOcclusionQuery& GetOcclusionQuery() { return mOcclusionQuery; }
+    // Where this instance was last written to the culling buffers, managed by J3DCulling.
+    J3DCullRecord& GetCullRecord() { return mCullRecord; }
+
+    // Generates the shaders and decodes the textures this instance draws with, if they were deferred by a lazy load.
+    void Prewarm();
 
     void GatherRenderPackets(std::vector<J3DRenderPacket>& packetList, glm::vec3 cameraPosition);
+    // Gathers packets only for the materials whose shapes may be inside the frustum. Shapes are tested in the current pose,
+    // so instances with a joint animation are posed here rather than when they are first rendered.
+    void GatherRenderPackets(std::vector<J3DRenderPacket>& packetList, glm::vec3 cameraPosition, const J3DFrustum& frustum);
+    // GatherRenderPackets in two steps. The first updates the instance's level of detail, its shapes' bounds and, with a
+    // frustum, its pose, and returns false if the instance is culled. The second only reads the instance and the state the first one left.
+    // Different instances can be prepared and emitted on different threads: posing shares the pose cache, animation
+    // instances and the scene only through locks.
+    bool PrepareRenderPackets(glm::vec3 cameraPosition, const J3DFrustum* frustum);
+    void EmitRenderPackets(std::vector<J3DRenderPacket>& packetList, glm::vec3 cameraPosition, const J3DFrustum* frustum);
 
     void UpdateAnimations(float deltaTime);
-    void Render(float deltaTime, std::shared_ptr<J3DMaterial> material, glm::mat4& viewMatrix, glm::mat4& projMatrix, uint32_t materialShaderOverride = 0);
+    void Render(float deltaTime, const std::shared_ptr<J3DMaterial>& material, glm::mat4& viewMatrix, glm::mat4& projMatrix, uint32_t materialShaderOverride = 0);
+    // Renders the material at the given index of GetMaterials(), skipping the lookup of the material's index.
+    void Render(float deltaTime, const std::shared_ptr<J3DMaterial>& material, uint32_t materialIndex, glm::mat4& viewMatrix, glm::mat4& projMatrix, uint32_t materialShaderOverride = 0);
 
     // Call this after Render to reuse the model calculations view/proj matrices for static rendering.
-    void StaticRender(std::shared_ptr<J3DMaterial> material, uint32_t materialShaderOverride = 0);
+    void StaticRender(const std::shared_ptr<J3DMaterial>& material, uint32_t materialShaderOverride = 0);
 
     J3DLight GetLight(int index) const;
     void SetLight(const J3DLight& light, int index);
 
     std::shared_ptr<J3DAnimation::J3DColorAnimationInstance> GetRegisterColorAnimation() const { return mRegisterColorAnimation; }
-    void SetRegisterColorAnimation(std::shared_ptr<J3DAnimation::J3DColorAnimationInstance> anim) { mRegisterColorAnimation = anim; }
+    void SetRegisterColorAnimation(std::shared_ptr<J3DAnimation::J3DColorAnimationInstance> anim);
 
     std::shared_ptr<J3DAnimation::J3DTexIndexAnimationInstance> GetTexIndexAnimation() const { return mTexIndexAnimation; }
-    void SetTexIndexAnimation(std::shared_ptr<J3DAnimation::J3DTexIndexAnimationInstance> anim) { mTexIndexAnimation = anim; }
+    void SetTexIndexAnimation(std::shared_ptr<J3DAnimation::J3DTexIndexAnimationInstance> anim);
 
     std::shared_ptr<J3DAnimation::J3DTexMatrixAnimationInstance> GetTexMatrixAnimation() const { return mTexMatrixAnimation; }
-    void SetTexMatrixAnimation(std::shared_ptr<J3DAnimation::J3DTexMatrixAnimationInstance> anim) { mTexMatrixAnimation = anim; }
+    void SetTexMatrixAnimation(std::shared_ptr<J3DAnimation::J3DTexMatrixAnimationInstance> anim);
 
+    // The bounds of every pose of the clip are found when the animation is set, by sampling each of its frames once per
+    // model and clip. Set the animation again after replacing its clip, e.g. with Bake or Deserialize.
     std::shared_ptr<J3DAnimation::J3DJointAnimationInstance> GetJointAnimation() const { return mJointAnimation; }
     void SetJointAnimation(std::shared_ptr<J3DAnimation::J3DJointAnimationInstance> anim);
 
@@ -116,15 +295,42 @@ public:
     void SetVisibilityAnimation(std::shared_ptr<J3DAnimation::J3DVisibilityAnimationInstance> anim) { mVisibilityAnimation = anim; }
 
     bool GetUseInstanceMaterialTable() const { return bUseInstanceMaterialTable; }
-    void SetUseInstanceMaterialTable(bool use) { bUseInstanceMaterialTable = use; }
+    void SetUseInstanceMaterialTable(bool use);
 
-    void SetInstanceMaterialTable(std::shared_ptr<J3DMaterialTable> matTable) { mInstanceMaterialTable = matTable; }
+    void SetInstanceMaterialTable(std::shared_ptr<J3DMaterialTable> matTable);
 
     // Sets a bias value that affects a model's position in the rendering list.
     // The higher the bias value, the earlier the model will be rendered.
     void SetSortBias(uint8_t bias) { mSortBias = bias; }
     uint8_t GetSortBias() const { return mSortBias; }
 
+    // Returns the number of joints and envelopes whose matrices are reused between frames because the current
+    // joint animation never changes them.
+    uint32_t GetStaticJointCount() const { return mStaticWorldJointCount; }
+    uint32_t GetStaticEnvelopeCount() const { return mStaticEnvelopeCount; }
+
+    // Sets the instance's animation levels of detail. With no levels, which is the default, every joint is animated every frame.
+    void SetAnimationLODLevels(const std::vector<J3DAnimationLODLevel>& levels);
+    const std::vector<J3DAnimationLODLevel>& GetAnimationLODLevels() const { return mAnimationLODLevels; }
+    // Picks the level of detail from the instance's projected size as seen from the camera. GatherRenderPackets calls this,
+    // so it only needs to be called directly when packets are gathered some other way.
+    void UpdateAnimationLOD(const glm::vec3& cameraPosition);
+    uint32_t GetAnimationLODLevel() const { return mAnimationLODLevel; }
+    float GetProjectedSize() const { return mProjectedSize; }
+
+    // Culled instances don't emit render packets, so their joints aren't posed, but their animations keep playing.
+    void SetCulled(bool culled) { bCulled = culled; }
+    bool GetCulled() const { return bCulled; }
+
+    // Compute skinning skins the instance's vertices once per pose on the GPU, so that every material and pass draws them
+    // as static geometry. Billboarded shapes still skin per vertex, since their billboarding is relative to their envelope.
+    // Texture coordinates generated from positions use the posed positions rather than the model's original ones.
+    void SetUseComputeSkinning(bool use);
+    bool GetUseComputeSkinning() const { return bUseComputeSkinning; }
+    // Reads the positions of the instance's vertices in its current pose back from the GPU, in model space. Only available
+    // with compute skinning, once the instance has been rendered; returns false otherwise. This stalls until skinning is done.
+    bool GetPosedPositions(std::vector<glm::vec3>& positions) const;
+
     // Returns this model's unique ID.
     uint16_t GetModelId() const { return mModelId; }
 };
@@ -0,0 +1,58 @@
+#pragma once
+
+#include <cstdint>
+#include <memory>
+
+struct ModernVertex;
+
+// A range of vertices and indices suballocated from one of the shared geometry arenas.
+// Offsets may change when the arena is defragmented, so always read them at draw time.
+struct J3DGeometryAllocation {
+	uint32_t ArenaIndex = UINT32_MAX;
+
+	uint32_t BaseVertex = 0;
+	uint32_t VertexCount = 0;
+
+	uint32_t FirstIndex = 0;
+	uint32_t IndexCount = 0;
+
+	// Allocations are invalidated when the arenas are destroyed.
+	bool IsValid() const { return ArenaIndex != UINT32_MAX; }
+};
+
+// Packs the geometry of every loaded model into a few large, shared vertex and index buffers -
+// one arena per combination of enabled vertex attributes - so that a scene draws from a handful of VAOs.
+// Draws use the allocation's base vertex and first index to find their model's data.
+namespace J3DGeometryArena {
+	// Returns a bit mask with one bit set per EGXAttribute that is enabled on the VAO.
+	constexpr uint32_t AttributeBit(uint32_t attribute) { return 1u << attribute; }
+
+	// Copies the given vertices and indices into the arena matching the attribute mask, creating or growing it if necessary.
+	// Indices are relative to the first vertex, and are drawn with the allocation's base vertex.
+	std::shared_ptr<J3DGeometryAllocation> Allocate(uint32_t attributeMask, const ModernVertex* vertices, uint32_t vertexCount,
+		const uint32_t* indices, uint32_t indexCount);
+	// Returns the allocation's ranges to its arena's free lists.
+	void Free(std::shared_ptr<J3DGeometryAllocation>& allocation);
+
+	// Moves every live allocation to the front of its arena, removing the holes left by freed models,
+	// and shrinks the arena's buffers to fit. Updates the offsets of the live allocations in place.
+	void Defragment();
+
+	// Binds the VAO of the arena holding the given allocation. Does nothing if that VAO is already bound.
+	void Bind(const J3DGeometryAllocation& allocation);
+	// Binds a VAO laid out like the arena holding the given allocation, reading indices from the arena but vertices from
+	// vertexBuffer, which holds a copy of just this allocation's vertices. Draw with a base vertex of 0.
+	void BindWithVertexBuffer(const J3DGeometryAllocation& allocation, uint32_t vertexBuffer);
+	// Unbinds the arena VAOs. Call this if other code may bind its own VAOs before the next J3D render.
+	void Unbind();
+
+	// Returns the vertex buffer of the arena holding the given allocation, or 0 if the allocation is invalid.
+	uint32_t GetVertexBuffer(const J3DGeometryAllocation& allocation);
+
+	// Frees all GL resources held by the arenas. Outstanding allocations are invalidated rather than left pointing at
+	// arenas that a later Allocate() may reuse. Models don't keep a copy of geometry they have uploaded, so models
+	// whose allocations were invalidated stop drawing; destroy or reload them along with the arenas.
+	void DestroyArenas();
+
+	uint32_t GetArenaCount();
+}
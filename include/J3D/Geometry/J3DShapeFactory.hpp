@@ -26,6 +26,35 @@ struct J3DShapeInitData {
 	void Deserialize(bStream::CStream* stream);
 };
 
+// Bounds of the vertices drawn with one draw matrix, in the space they are stored in before the matrix is applied.
+struct J3DDrawBounds {
+	uint16_t DrawIndex = 0;
+	glm::vec3 Min = glm::vec3(0.0f);
+	glm::vec3 Max = glm::vec3(0.0f);
+};
+
+struct J3DShapeBounds {
+	// SHP1's bounds for the shape.
+	float Radius = 0.0f;
+	glm::vec3 Min = glm::vec3(0.0f);
+	glm::vec3 Max = glm::vec3(0.0f);
+
+	// Bounds of the shape's vertices for each draw matrix they use, calculated from the vertices when the model is loaded.
+	// In a pose, the shape lies within the union of these boxes under their matrices.
+	std::vector<J3DDrawBounds> Draws;
+	// Bounds of the shape in the model's rest pose.
+	glm::vec3 RestMin = glm::vec3(0.0f);
+	glm::vec3 RestMax = glm::vec3(0.0f);
+	// Billboarded shapes are turned towards the camera when they are drawn, so their vertices' bounds don't contain them.
+	bool Billboard = false;
+};
+
+// The range of a shape's triangles within its model's triangulated indices.
+struct J3DShapeIndexRange {
+	uint32_t FirstIndex = 0;
+	uint32_t IndexCount = 0;
+};
+
 struct J3DShapeMatrixInitData {
 	uint16_t ID;
 	uint16_t Count;
@@ -45,6 +74,11 @@ struct J3DVCDData {
 class J3DShapeFactory {
 	J3DShapeBlock* mBlock;
 
+	// Types of every primitive created by this factory, in creation order.
+	std::vector<EGXPrimitiveType> mPrimitiveTypes;
+	// Bounds of every shape created by this factory, in creation order.
+	std::vector<J3DShapeBounds> mShapeBounds;
+
 	uint16_t ConvertPosMtxIndexToDrawIndex(bStream::CStream* stream, const J3DShapeInitData& initData, const uint16_t& packetIndex, const uint16_t& value);
 	uint16_t GetUseMatrixValue(bStream::CStream* stream, const J3DShapeInitData& initData, const uint16_t& packetIndex);
 	void ReadMatrixInitData(bStream::CStream* stream, J3DShapeMatrixInitData& data, uint32_t index);
@@ -54,4 +88,7 @@ public:
 	~J3DShapeFactory() {}
 
 	std::shared_ptr<GXShape> Create(bStream::CStream* stream, uint32_t index, const GXAttributeData* attributes);
+
+	const std::vector<EGXPrimitiveType>& GetPrimitiveTypes() const { return mPrimitiveTypes; }
+	const std::vector<J3DShapeBounds>& GetShapeBounds() const { return mShapeBounds; }
 };
@@ -0,0 +1,29 @@
+#pragma once
+
+#include <glm/glm.hpp>
+
+#include <cstdint>
+#include <vector>
+
+struct J3DGeometryAllocation;
+
+// Skins a model's vertices once with a compute shader, writing them to a posed vertex buffer laid out like the model's
+// geometry arena. The posed buffer is then drawn as static geometry by every pass that needs the model, instead of each
+// pass skinning every vertex again.
+namespace J3DSkinning {
+	// Creates a posed vertex buffer for the allocation's vertices, initialized with a copy of them.
+	uint32_t CreatePosedBuffer(const J3DGeometryAllocation& allocation);
+	void DestroyPosedBuffer(uint32_t& posedBuffer);
+
+	// Skins the allocation's vertices with the given envelope matrices and writes them to the posed buffer, in model space.
+	// Each posed vertex's envelope index is replaced with posedEnvelopeIndex, so that its draws can point at an identity envelope.
+	void Skin(const J3DGeometryAllocation& allocation, uint32_t posedBuffer, const glm::mat4* envelopes, uint32_t envelopeCount,
+		uint32_t posedEnvelopeIndex);
+
+	// Reads the posed vertex positions back from the GPU. This waits for pending skinning to finish, so it shouldn't be
+	// called while rendering.
+	void ReadPosedPositions(const J3DGeometryAllocation& allocation, uint32_t posedBuffer, std::vector<glm::vec3>& positions);
+
+	// Frees the skinning shader and its scratch buffer.
+	void DestroyShaders();
+}
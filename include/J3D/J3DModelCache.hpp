@@ -0,0 +1,31 @@
+#pragma once
+
+#include <cstdint>
+#include <filesystem>
+#include <memory>
+
+class J3DModelData;
+
+// Shares loaded model data between every load of the same file. Models are keyed by a hash of the file's
+// contents together with the load flags, so the same BMD/BDL loaded from different paths or archives
+// resolves to one J3DModelData; use J3DModelData::CreateInstance() for per-placement state.
+//
+// Loads are thread-safe: concurrent loads of the same model wait for the first one to finish instead of
+// loading it again. Loading still creates GL objects, so it must happen on a thread with a current GL context.
+// If a load throws, every thread waiting for it receives the exception and the next request loads the model again.
+namespace J3DModelCache {
+	// Loads the model at the given path, or returns the already-loaded model data if the same file was loaded with the same flags.
+	std::shared_ptr<J3DModelData> Load(std::filesystem::path filePath, uint32_t flags);
+	// Loads the model in the given buffer, or returns the already-loaded model data if the same data was loaded with the same flags.
+	std::shared_ptr<J3DModelData> Load(const uint8_t* data, size_t size, uint32_t flags);
+
+	// The cache only holds weak references to model data, so models are freed when their last user releases them.
+	// Set this to keep every loaded model alive until Clear() is called instead.
+	void SetRetainModels(bool retain);
+
+	// Returns the number of loaded models currently held by the cache.
+	uint32_t GetModelCount();
+
+	// Forgets every cached model. Models still in use elsewhere stay alive, but will be loaded again on the next request.
+	void Clear();
+}
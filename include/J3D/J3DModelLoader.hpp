@@ -2,26 +2,62 @@
 
 #include "J3D/Data/J3DBlock.hpp"
 
+#include <GXGeometryEnums.hpp>
+
 #include <cstdint>
 #include <memory>
+#include <vector>
+#include <filesystem>
 
 namespace bStream { class CStream; }
 class J3DModelData;
 class J3DJoint;
+struct J3DProgramBinary;
 
 constexpr uint32_t FLAGS_MATRIX_MASK = 0x0000000F;
 
+// Loader-only flags. These sit above the 16 bits that INF1 can set.
+
+// Read the post-processed model from a cache file next to the source, or write one if it is missing or stale.
+constexpr uint32_t FLAGS_USE_CACHE_FILE = 0x00010000;
+// Defer texture decoding and upload and shader generation until each material is first drawn.
+// Use J3DModelData::Prewarm() to materialize them ahead of time.
+constexpr uint32_t FLAGS_LAZY_MATERIALIZATION = 0x00020000;
+
+// Cache files store host-endian arrays aligned to 16 bytes, so they can be copied out of the file buffer directly.
+constexpr uint32_t CACHE_FILE_MAGIC = 0x4A334443; // J3DC
+constexpr uint32_t CACHE_FILE_VERSION = 5;
+constexpr const char* CACHE_FILE_EXTENSION = ".j3dc";
+
 class J3DModelLoader {
 	std::shared_ptr<J3DModelData> mModelData;
 
+	// Contents of the cache file for the model being loaded, if a valid one was found.
+	std::vector<uint8_t> mCacheFileData;
+	// Whether VTX1, SHP1 and TEX1 were restored from a cache file and should be skipped.
+	bool bLoadedFromCache;
+
+	// Types of the primitives read from SHP1, in shape order. Needed to write a cache file.
+	std::vector<EGXPrimitiveType> mPrimitiveTypes;
+	// Linked shader programs from the cache file, by material index.
+	std::vector<std::shared_ptr<const J3DProgramBinary>> mCachedPrograms;
+
 public:
 	J3DModelLoader();
 	virtual ~J3DModelLoader() {}
 
 	virtual std::shared_ptr<J3DModelData> Load(bStream::CStream* stream, uint32_t flags);
 
+	// Loads the model file at the given path. If FLAGS_USE_CACHE_FILE is set, the post-processed
+	// vertex data, shapes, triangulated geometry, shader programs and textures are read from <path>.j3dc
+	// when it was written for the same source file and flags, and the cache file is (re)written otherwise.
+	// Textures that were deferred with FLAGS_LAZY_MATERIALIZATION are cached as their raw TEX1 data and stay deferred.
+	std::shared_ptr<J3DModelData> Load(std::filesystem::path filePath, uint32_t flags);
+
 protected:
 
+	void SkipBlock(bStream::CStream* stream);
+
 	void ReadInformationBlock(bStream::CStream* stream, uint32_t flags);
 	void ReadVertexBlock(bStream::CStream* stream, uint32_t flags);
 	void ReadEnvelopeBlock(bStream::CStream* stream, uint32_t flags);
@@ -31,4 +67,7 @@ protected:
 	void ReadMaterialBlockV2(bStream::CStream* stream, uint32_t flags);
 	void ReadMaterialBlockV3(bStream::CStream* stream, uint32_t flags);
 	void ReadTextureBlock(bStream::CStream* stream, uint32_t flags);
+
+	bool ReadCacheFile();
+	bool WriteCacheFile(std::filesystem::path cachePath, uint64_t cacheKey);
 };
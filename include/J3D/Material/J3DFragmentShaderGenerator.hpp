@@ -27,5 +27,6 @@ class J3DFragmentShaderGenerator {
 	static std::string GenerateAlphaCompare(J3DAlphaCompare& alphaCompare);
 	static std::string GenerateFog(J3DFog& fog);
 public:
-	static bool GenerateFragmentShader(J3DMaterial* material, uint32_t& shaderHandle);
+	// Compiles the material's fragment shader. If source isn't null, the generated GLSL is stored in it.
+	static bool GenerateFragmentShader(J3DMaterial* material, uint32_t& shaderHandle, std::string* source = nullptr);
 };
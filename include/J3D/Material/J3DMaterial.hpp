@@ -75,9 +75,24 @@ struct J3DIndirectBlock {
 	J3DIndirectBlock() : mEnabled(false) { }
 };
 
+// A linked shader program as glGetProgramBinary returns it, and the hash of the GLSL it was built from.
+struct J3DProgramBinary {
+	uint64_t ShaderHash = 0;
+	uint32_t Format = 0;
+	std::vector<uint8_t> Data;
+};
+
 class J3DMaterial {
 	int32_t mShaderProgram;
 	std::weak_ptr<GXShape> mShape;
+	// The shape's range of its model's triangulated indices.
+	uint32_t mIndexOffset;
+	uint32_t mIndexCount;
+
+	// Hash of the vertex and fragment GLSL the current program was built from.
+	uint64_t mShaderHash;
+	// A program restored from a model cache file, tried the next time shaders are generated.
+	std::shared_ptr<const J3DProgramBinary> mCachedProgram;
 
 	glm::mat4 TexMatrices[10]{};
 
@@ -85,9 +100,14 @@ class J3DMaterial {
 
 	uint16_t mMaterialId;
 	bool bSelected;
+	// Whether shader generation was deferred until this material is first drawn.
+	bool bShadersPending;
 
 	void BindJ3DShader(const std::vector<std::shared_ptr<struct J3DTexture>>& textures);
 	void ConfigureGLState();
+	// Sets the uniforms of a newly linked program that don't change while it is used.
+	void InitProgramUniforms();
+	bool LoadProgramBinary(const J3DProgramBinary& binary);
 
 public:
 	J3DMaterial();
@@ -115,14 +135,34 @@ public:
 	J3DTexMatrixInfo AnimationTexMatrixInfo[10]{};
 
 	void CalculateTexMatrices(const glm::mat4& modelMatrix, const glm::mat4& viewMatrix, const glm::mat4& projMatrix);
+	// The ten texture matrices the last CalculateTexMatrices() call produced, as Render uploads them.
+	const glm::mat4* GetTexMatrices() const { return TexMatrices; }
 
-	std::weak_ptr<GXShape> GetShape() const { return mShape; }
+	const std::weak_ptr<GXShape>& GetShape() const { return mShape; }
 	void SetShape(std::weak_ptr<GXShape> shape) { mShape = shape; }
 
+	void GetIndexRange(uint32_t& offset, uint32_t& count) const { offset = mIndexOffset; count = mIndexCount; }
+	void SetIndexRange(uint32_t offset, uint32_t count) { mIndexOffset = offset; mIndexCount = count; }
+
 	int32_t GetShaderProgram() const { return mShaderProgram; }
 	bool GenerateShaders();
 
-	void Render(const std::vector<std::shared_ptr<struct J3DTexture>>& textures, uint32_t shaderOverride = 0);
+	uint64_t GetShaderHash() const { return mShaderHash; }
+	// Reads back the linked program, for caching. Returns false if there is none or the driver can't provide it.
+	bool GetProgramBinary(J3DProgramBinary& binary) const;
+	// Makes the next GenerateShaders() try the given program before generating GLSL. Drivers reject binaries
+	// from other drivers or versions, in which case the shaders are generated as usual.
+	void SetCachedProgram(std::shared_ptr<const J3DProgramBinary> binary) { mCachedProgram = binary; }
+
+	// Defers generating this material's shaders until it is first drawn with them.
+	void DeferShaderGeneration() { bShadersPending = true; }
+	// Generates this material's shaders if they were deferred and decodes any deferred textures it samples,
+	// so that its first draw doesn't hitch.
+	void Prewarm(const std::vector<std::shared_ptr<struct J3DTexture>>& textures);
+
+	// Draws this material's shape. baseVertex and firstIndex locate the owning model's geometry in the bound geometry arena.
+	void Render(const std::vector<std::shared_ptr<struct J3DTexture>>& textures, uint32_t shaderOverride = 0,
+		uint32_t baseVertex = 0, uint32_t firstIndex = 0);
 
 	uint16_t GetMaterialId() const { return mMaterialId; }
 
@@ -21,14 +21,39 @@ namespace J3DUniformBufferObject {
 	void SetProjAndViewMatrices(const glm::mat4& proj, const glm::mat4& view);
 	// Updates the UBO's model matrix. Usually used by a model instance.
 	void SetModelMatrix(const glm::mat4& model);
+	// Returns the UBO's view matrix multiplied by its model matrix.
+	glm::mat4 GetModelViewMatrix();
 	// Updates the UBO's TEV color array - assumes an array of 4 elements. Usually used by a model instance.
 	void SetTevColors(const glm::vec4* colors);
 	// Updates the UBO's konst color array - assumes an array of 4 elements. Usually used by a model instance.
 	void SetKonstColors(const glm::vec4* colors);
 	// Updates the UBO's light array - assumes an array of 8 elements. Usually used by the environment.
 	void SetLights(const J3DLight* lights);
-	// Updates the UBO's envelope matrix array - count must be between 1 and 256. Usually used by a model instance.
+	// Envelope matrices are kept in a shader storage buffer rather than the UBO, so there is no limit on how many a model has.
+	// They are stored with the model and view transforms applied, alongside their normal matrices, so the vertex shader
+	// doesn't have to calculate either per vertex. The buffer has a fixed capacity and is reused as a ring, so drawing
+	// models directly, without J3D::Rendering::Render, doesn't grow it.
+	// Allocates the matrices in the envelope storage and points the following draws at them, using the UBO's
+	// current view and model matrices. Usually used by a model instance.
 	void SetEnvelopeMatrices(const glm::mat4* envelopes, const uint32_t count);
+	// Allocates the matrices in the envelope storage with the given model-view transform applied, and returns the
+	// index of the first one.
+	uint32_t AllocateEnvelopeMatrices(const glm::mat4* envelopes, const uint32_t count, const glm::mat4& modelView);
+	// Makes sure that allocations totalling the given count are placed one after another, starting over at the
+	// beginning of the storage now if they wouldn't fit before its end.
+	void ReserveEnvelopeMatrices(const uint32_t count);
+	// Points the following draws at envelope matrices already allocated.
+	void SetEnvelopeBase(const uint32_t base);
+	// Makes the following draws read their envelope base per draw from the batch of culled draws starting at the given
+	// index, rather than from SetEnvelopeBase, or stops doing so with UINT32_MAX. Used by J3DCulling.
+	void SetBatchStart(const uint32_t start);
+	// Discards every envelope matrix allocated so far. J3D::Rendering::Render calls this at the start of each frame.
+	void ClearEnvelopeMatrices();
+	// Incremented by ClearEnvelopeMatrices, and whenever the storage starts over at its beginning, so that callers can
+	// tell whether the matrices they allocated are still stored.
+	uint32_t GetEnvelopeGeneration();
+	// Returns how many matrices the envelope storage holds.
+	uint32_t GetEnvelopeCapacity();
 	// Updates the UBO's tex matrix array - assumes an array of 10 elements. Usually used by a model instance.
 	void SetTexMatrices(const glm::mat4* matrices);
 	void SetIndTexMatrix(const glm::mat4* matrix, uint32_t index);
@@ -26,5 +26,6 @@ class J3DVertexShaderGenerator {
 
 	static bool IsAttributeUsed(EGXAttribute a, const J3DMaterial* material);
 public:
-	static bool GenerateVertexShader(const J3DMaterial* material, uint32_t& shaderHandle);
+	// Compiles the material's vertex shader. If source isn't null, the generated GLSL is stored in it.
+	static bool GenerateVertexShader(const J3DMaterial* material, uint32_t& shaderHandle, std::string* source = nullptr);
 };
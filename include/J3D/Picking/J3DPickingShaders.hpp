@@ -24,19 +24,29 @@ namespace J3D {
 			"\tvec4 TevColor[4];\n"
 			"\tvec4 KonstColor[4];\n\n"
 			"\tGXLight Lights[8];\n"
-			"\tmat4 Envelopes[512];\n"
 			"\tmat4 TexMatrices[10];\n"
 			"\tmat4 IndTexMatrices[10];\n"
 			"\tuint BillboardType;\n"
 			"\tuint ModelId;\n"
 			"\tuint MaterialId;\n"
+			"\tuint EnvelopeBase;\n"
 			"\tvec4 HighlightColor;\n"
 			"};\n\n"
+			"// An envelope's model-view and normal matrices, stored as the rows of affine matrices: transform with vec4(v, w) * matrix.\n"
+			"struct EnvelopeMatrix {\n"
+			"\tmat3x4 ModelView;\n"
+			"\tmat3x4 Normal;\n"
+			"};\n\n"
+			"// Envelope matrices of every model drawn this frame. The current model's start at EnvelopeBase.\n"
+			"layout(std430, binding = 1) readonly buffer uEnvelopeData {\n"
+			"\tEnvelopeMatrix Envelopes[];\n"
+			"};\n\n"
 			"vec3 CalculateMatrix() {\n"
-			"\tmat4 envelopeMtx = View * Model * Envelopes[int(aPos.w)];\n\n"
+			"\tmat3x4 modelView = Envelopes[EnvelopeBase + uint(aPos.w)].ModelView;\n\n"
 			"\tif (BillboardType == 0 || BillboardType == 3) {\n"
-			"\t\treturn (envelopeMtx * vec4(aPos.xyz, 1.0)).xyz;\n"
+			"\t\treturn vec4(aPos.xyz, 1.0) * modelView;\n"
 			"\t}\n\n"
+			"\tmat4 envelopeMtx = transpose(mat4(modelView[0], modelView[1], modelView[2], vec4(0.0, 0.0, 0.0, 1.0)));\n"
 			"\tmat4 bboardMtx = mat4(1.0);\n\n"
 			"\tfloat mx = envelopeMtx[0][0] * envelopeMtx[0][0] + envelopeMtx[0][1] * envelopeMtx[0][1] + envelopeMtx[0][2] * envelopeMtx[0][2];\n"
 			"\tfloat my = envelopeMtx[1][0] * envelopeMtx[1][0] + envelopeMtx[1][1] * envelopeMtx[1][1] + envelopeMtx[1][2] * envelopeMtx[1][2];\n"
@@ -93,12 +103,12 @@ namespace J3D {
 			"\tvec4 TevColor[4];\n"
 			"\tvec4 KonstColor[4];\n\n"
 			"\tGXLight Lights[8];\n"
-			"\tmat4 Envelopes[512];\n"
 			"\tmat4 TexMatrices[10];\n"
 			"\tmat4 IndTexMatrices[10];\n"
 			"\tuint BillboardType;\n"
 			"\tuint ModelId;\n"
 			"\tuint MaterialId;\n"
+			"\tuint EnvelopeBase;\n"
 			"\tvec4 HighlightColor;\n"
 			"};\n\n"
 			"vec4 VecS10ToFloat(ivec4 a) {\n"
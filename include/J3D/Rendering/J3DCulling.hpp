@@ -0,0 +1,63 @@
+#pragma once
+
+#include <glm/glm.hpp>
+
+#include <cstdint>
+#include <vector>
+
+struct J3DRenderPacket;
+
+// Where an instance's record was written in the culling buffers, valid while Generation is the current cull's.
+// Lets CullPackets find an instance's record again without a lookup.
+struct J3DCullRecord {
+	uint32_t Generation = 0;
+	uint32_t Index = 0;
+};
+
+// Culls render packets on the GPU. A compute pass tests each packet's bounds against the view frustum and against a depth
+// pyramid built from the previous frame's depth buffer (Hi-Z occlusion), and writes an indirect draw command per packet
+// whose instance count is 0 when the packet is culled. Culled packets cost no GPU work and their visibility is never read
+// back to the CPU.
+//
+// Consecutive packets of the same material whose instances can share its state (see J3DModelInstance::CheckSameBatch)
+// form a batch. The pass also packs the commands of each batch's surviving packets together and counts them, so that
+// J3D::Rendering binds the batch's state once and draws it with one glMultiDrawElementsIndirectCount. Each draw finds its
+// packet through gl_DrawID, and with it the envelope matrices of the packet's instance. Packets are still updated on the
+// CPU one by one, culled or not, since their visibility is only known to the GPU.
+namespace J3DCulling {
+	// Builds the depth pyramid from a depth texture of the given size, which should hold the depth of the scene rendered
+	// with the given view-projection matrix. Call this after rendering a frame so that the next frame can be tested against
+	// it. The texture must not have a comparison mode set.
+	void BuildDepthPyramid(uint32_t depthTexture, uint32_t width, uint32_t height, const glm::mat4& viewProjMatrix);
+	// Discards the depth pyramid, so that packets are only frustum culled until the next one is built. Call this when the
+	// camera jumps, since the previous frame's depth no longer says anything about what is hidden.
+	void ClearDepthPyramid();
+
+	// Occlusion culling is enabled by default, and only happens once a depth pyramid has been built.
+	void SetUseOcclusion(bool use);
+	bool GetUseOcclusion();
+
+	// Culls the packets against the frustum of the given view-projection matrix and the depth pyramid, and points each
+	// packet at its draw command. Commands are only valid until the next call, which starts a new generation; packets
+	// culled by an earlier call draw directly.
+	void CullPackets(std::vector<J3DRenderPacket>& packets, const glm::mat4& viewProjMatrix);
+
+	// Selects the command the next draw uses, or UINT32_MAX to draw directly. J3D::Rendering sets this for each packet that
+	// isn't drawn in a batch. Commands from a generation other than the current one are ignored.
+	void SetDrawCommand(uint32_t command, uint32_t generation);
+	// Returns the number of packets, starting at the first of the given ones, that make up a batch of the current cull in
+	// the order it was culled in, or 1 if the first packet doesn't start a batch of more than one.
+	uint32_t GetBatchSize(const J3DRenderPacket* packets, uint32_t count);
+	// Sets the envelope base that the packet's draw in its batch reads. Returns false if the packet's draw range is no
+	// longer the one it was culled with, in which case the batch must not be drawn.
+	bool SetBatchDraw(const J3DRenderPacket& packet, uint32_t count, uint32_t firstIndex, uint32_t baseVertex, uint32_t envelopeBase);
+	// Selects the batch starting at the given command for the next draw, or UINT32_MAX to stop drawing batches, and points
+	// the material shaders at its draws through J3DUniformBufferObject::SetBatchStart.
+	void SetDrawBatch(uint32_t command, uint32_t generation);
+	// Draws the selected batch's surviving packets if a batch is selected. Otherwise draws the given index range through
+	// the selected command if it was written for the same range, and directly if not.
+	void DrawElements(uint32_t count, uint32_t firstIndex, uint32_t baseVertex);
+
+	// Frees the culling shaders, buffers and depth pyramid.
+	void DestroyShaders();
+}
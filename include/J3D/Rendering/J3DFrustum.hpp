@@ -0,0 +1,19 @@
+#pragma once
+
+#include <glm/glm.hpp>
+
+// The six planes bounding a camera's view volume, in world space. Each plane is stored as (normal, distance),
+// with the normal pointing into the volume.
+struct J3DFrustum {
+    glm::vec4 Planes[6];
+
+    J3DFrustum();
+    // Extracts the planes of the volume a view-projection matrix maps to OpenGL's clip space.
+    explicit J3DFrustum(const glm::mat4& viewProjMatrix);
+
+    // Whether any part of the given box may be inside the volume. Boxes near the volume's corners can pass without intersecting it.
+    bool IntersectsBox(const glm::vec3& min, const glm::vec3& max) const;
+    // Whether the given box is entirely inside the volume.
+    bool ContainsBox(const glm::vec3& min, const glm::vec3& max) const;
+    bool IntersectsSphere(const glm::vec3& center, float radius) const;
+};
@@ -0,0 +1,49 @@
+#pragma once
+
+#include <glm/glm.hpp>
+
+#include <cstdint>
+#include <memory>
+
+class J3DModelInstance;
+
+// The occlusion query state of a model instance.
+struct J3DOcclusionQuery {
+	uint32_t Query = 0;
+	// Whether the query was issued and its result hasn't been read yet.
+	bool bPending = false;
+	// Whether the instance is waiting to be queried this frame.
+	bool bQueued = false;
+	// The epoch the pending query was issued in, and the one OccludedFrames was counted in.
+	uint32_t QueryEpoch = 0;
+	uint32_t Epoch = 0;
+	// The number of consecutive query results that found the instance hidden.
+	uint32_t OccludedFrames = 0;
+};
+
+// Skips instances that hardware occlusion queries found hidden behind the rest of the scene. After the packets are rendered,
+// each instance's world bounds are drawn against the depth buffer inside a GL_ANY_SAMPLES_PASSED_CONSERVATIVE query. Results
+// are polled when packets are next gathered and never waited on, so a result that isn't ready just arrives a frame later.
+// Instances found hidden for a number of frames in a row are skipped until a query finds them visible again.
+namespace J3DOcclusion {
+	void SetUseQueries(bool use);
+	bool GetUseQueries();
+	// Sets how many consecutive results must find an instance hidden before it is skipped. Defaults to 2.
+	void SetOccludedFrameThreshold(uint32_t frames);
+
+	// Forgets every result gathered so far, so that all instances are drawn until new queries find them hidden.
+	void NotifyCameraCut();
+
+	// Reads the instance's last query result if it is available, and queues a new query of the instance for this frame.
+	// Returns whether the instance should be skipped.
+	bool CheckOccluded(const std::shared_ptr<J3DModelInstance>& instance);
+	// Draws the bounds of the queued instances against the current depth buffer. J3D::Rendering::Render calls this.
+	void IssueQueries(const glm::mat4& viewMatrix, const glm::mat4& projMatrix);
+	// Drops the queued instances without querying them. J3D::Rendering calls this before gathering packets, so that
+	// instances queued by a gather whose packets were never rendered aren't held on to.
+	void ClearQueue();
+
+	// Deletes an instance's query object.
+	void DestroyQuery(J3DOcclusionQuery& query);
+	void DestroyShaders();
+}
@@ -7,13 +7,36 @@
 #include <vector>
 
 struct J3DRenderPacket {
+    // Packets are drawn in descending order of their keys. See J3D::Rendering for the layout.
     uint64_t SortKey;
 
-    std::shared_ptr<class J3DMaterial> Material;
     class J3DModelInstance* Instance;
+    // Index of the packet's material in the instance's material list. Packets refer to their material by index rather than
+    // by pointer, so that gathering, sorting and copying them doesn't touch reference counts, and so that a packet can
+    // never outlive its material.
+    uint32_t MaterialIndex = UINT32_MAX;
+    // Index of the packet's indirect draw command after J3DCulling::CullPackets, or UINT32_MAX to draw directly,
+    // and the generation of the cull that wrote it.
+    uint32_t DrawCommand = UINT32_MAX;
+    uint32_t CullGeneration = 0;
+
+    // Returns the material at MaterialIndex in the instance's current material list, or nullptr if there is none. If the
+    // instance's material list was replaced since the packet was gathered, this is the new list's material at that index.
+    const std::shared_ptr<class J3DMaterial>* GetMaterial() const;
 
     void Render(float deltaTime, glm::mat4& viewMatrix, glm::mat4& projMatrix, uint32_t materialShaderOverride = 0);
 
     // Call this after Render to reuse the model calculations and view/proj matrices for static rendering.
     void StaticRender(uint32_t materialShaderOverride = 0);
+
+    // Render and StaticRender without unbinding the geometry arena afterwards, so that consecutive packets from the same
+    // arena don't rebind it. Call J3DGeometryArena::Unbind() after the last packet, as J3D::Rendering does.
+    void RenderKeepArena(float deltaTime, glm::mat4& viewMatrix, glm::mat4& projMatrix, uint32_t materialShaderOverride = 0);
+    void StaticRenderKeepArena(uint32_t materialShaderOverride = 0);
+
+    // Updates each of the given packets, which must make up one batch from J3DCulling::GetBatchSize, and draws the ones
+    // that survived culling with a single multi-draw using the first packet's material state. Returns false without
+    // drawing if the packets turn out to need state of their own, e.g. different lights or texture matrices, in which
+    // case they are drawn one by one. Like RenderKeepArena, this leaves the geometry arena bound.
+    static bool RenderBatch(J3DRenderPacket* packets, uint32_t count, float deltaTime, glm::mat4& viewMatrix, glm::mat4& projMatrix);
 };
@@ -14,8 +14,34 @@ namespace J3D {
         using RenderPacketVector = std::vector<J3DRenderPacket>;
         using ModelInstanceVector = const std::vector<std::shared_ptr<J3DModelInstance>>&;
 
+        // Packets are drawn in descending order of their sort keys. J3DModelInstance builds the keys from these fields,
+        // from the most significant bit down:
+        //   bits 56-63  the instance's sort bias, so higher biases are drawn earlier
+        //   bit  55     set for opaque and alpha-tested materials, which are drawn before translucent ones
+        //   opaque:      bits 39-54 shader program, bits 23-38 first texture index, bits 0-22 inverted depth (front to back)
+        //   translucent: bits 32-54 depth (back to front), bits 16-31 shader program, bits 0-15 first texture index
+        // Depth is the top 23 bits below the sign of the squared distance from the camera to the shape's center, as a float.
+        // Programs and texture indices are truncated to 16 bits, and a material without textures uses 0xFFFF.
+
+        // Replaces the function that orders packets after they are gathered. RadixSortPackets is the default.
         void SetSortFunction(std::function<void(RenderPacketVector&)> sortFunction);
+        // Stably sorts packets by descending SortKey.
+        void RadixSortPackets(RenderPacketVector& packets);
+
+        // Sets how many worker threads SortPackets spreads large scenes across, besides the calling thread. Packets are
+        // gathered and sorted in the same order whatever the count. 0 gathers every scene on the calling thread. Defaults to
+        // one less than the number of hardware threads. Workers pose the instances they gather, so an instance may only
+        // appear once in the list passed to SortPackets.
+        void SetWorkerThreadCount(uint32_t count);
+        uint32_t GetWorkerThreadCount();
+
         RenderPacketVector SortPackets(ModelInstanceVector& modelInstances, glm::vec3 cameraPosition);
+        // Gathers and sorts packets only for the shapes that may be visible through the given view-projection matrix.
+        RenderPacketVector SortPackets(ModelInstanceVector& modelInstances, glm::vec3 cameraPosition, const glm::mat4& viewProjMatrix);
+        // These replace the contents of the given vector, reusing its storage. Passing the same vector every frame
+        // keeps packet gathering from allocating once it has grown to fit the scene.
+        void SortPackets(ModelInstanceVector& modelInstances, glm::vec3 cameraPosition, RenderPacketVector& packets);
+        void SortPackets(ModelInstanceVector& modelInstances, glm::vec3 cameraPosition, const glm::mat4& viewProjMatrix, RenderPacketVector& packets);
 
         void Render(float deltaTime, glm::mat4& viewMatrix, glm::mat4& projMatrix,
                     RenderPacketVector& modelInstances, uint32_t materialShaderOverride = 0);
@@ -23,5 +49,9 @@ namespace J3D {
         // Call this after Render to reuse the model calculations view/proj matrices for static rendering.
         // Note: This is used by J3D::Picking
         void StaticRender(RenderPacketVector& modelInstances, uint32_t materialShaderOverride = 0);
+
+        // Call this when the camera jumps to a new view, so that occlusion results gathered from the old one stop
+        // hiding instances. See J3DOcclusion and J3DCulling.
+        void NotifyCameraCut();
     }
 }
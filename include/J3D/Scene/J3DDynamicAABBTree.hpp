@@ -0,0 +1,77 @@
+#pragma once
+
+#include <glm/glm.hpp>
+
+#include <cstdint>
+#include <limits>
+#include <utility>
+#include <vector>
+
+struct J3DFrustum;
+
+// A bounding volume hierarchy over boxes that move, such as the world bounds of model instances. Each leaf holds a box
+// enlarged by a margin, so that small movements don't change the tree. Leaves are inserted next to the node that grows
+// the tree's surface area the least, and subtrees are rotated to keep it balanced, so queries visit O(log n) nodes
+// for small regions.
+class J3DDynamicAABBTree {
+public:
+	static constexpr int32_t NULL_NODE = -1;
+
+	// Boxes are enlarged by this fraction of their size on each side when they are inserted.
+	explicit J3DDynamicAABBTree(float margin = 0.1f);
+
+	// Inserts a box with the given user data and returns its proxy, which identifies it until it is destroyed.
+	int32_t CreateProxy(const glm::vec3& min, const glm::vec3& max, uint32_t userData);
+	void DestroyProxy(int32_t proxy);
+	// Updates the box of a proxy. It is only reinserted if the box has left the enlarged box it was inserted with;
+	// returns whether it was.
+	bool MoveProxy(int32_t proxy, const glm::vec3& min, const glm::vec3& max);
+	void Clear();
+
+	uint32_t GetUserData(int32_t proxy) const { return mNodes[proxy].UserData; }
+	void SetUserData(int32_t proxy, uint32_t userData) { mNodes[proxy].UserData = userData; }
+	// Returns the enlarged box the proxy was inserted with.
+	void GetFatBox(int32_t proxy, glm::vec3& min, glm::vec3& max) const;
+
+	// These append the user data of every proxy whose enlarged box intersects the query, in no particular order.
+	void QueryBox(const glm::vec3& min, const glm::vec3& max, std::vector<uint32_t>& results) const;
+	void QueryFrustum(const J3DFrustum& frustum, std::vector<uint32_t>& results) const;
+	// Appends each hit's user data and the distance along the ray at which it enters the enlarged box.
+	// The direction doesn't need to be normalized; distances are in multiples of it.
+	void QueryRay(const glm::vec3& origin, const glm::vec3& direction, std::vector<std::pair<uint32_t, float>>& results,
+		float maxDistance = std::numeric_limits<float>::max()) const;
+
+	// Returns the height of the tree, which is 0 for a single leaf or an empty tree.
+	int32_t GetHeight() const;
+
+private:
+	struct J3DTreeNode {
+		glm::vec3 Min;
+		glm::vec3 Max;
+		uint32_t UserData;
+		// The next free node while the node is in the free list.
+		int32_t Parent;
+		int32_t Child1;
+		int32_t Child2;
+		// 0 for leaves, -1 for free nodes.
+		int32_t Height;
+
+		bool IsLeaf() const { return Child1 == NULL_NODE; }
+	};
+
+	std::vector<J3DTreeNode> mNodes;
+	int32_t mRoot;
+	int32_t mFreeList;
+	float mMargin;
+
+	int32_t AllocateNode();
+	void FreeNode(int32_t node);
+
+	void InsertLeaf(int32_t leaf);
+	void RemoveLeaf(int32_t leaf);
+	// Recalculates the boxes and heights of the given node and its ancestors, rebalancing them on the way up.
+	void RefitAncestors(int32_t node);
+	// Rotates the subtree at the given node if one child is more than one level taller than the other, and returns
+	// the subtree's new root.
+	int32_t Balance(int32_t node);
+};
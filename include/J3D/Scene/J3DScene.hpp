@@ -0,0 +1,83 @@
+#pragma once
+
+#include "J3D/Scene/J3DDynamicAABBTree.hpp"
+#include "J3D/Rendering/J3DRendering.hpp"
+
+#include <glm/glm.hpp>
+
+#include <cstdint>
+#include <limits>
+#include <memory>
+#include <mutex>
+#include <utility>
+#include <vector>
+
+class J3DModelInstance;
+struct J3DFrustum;
+
+// A set of model instances kept in a bounding volume hierarchy over their world bounds, so that culling and spatial
+// queries only visit the instances near the region they ask about. Instances tell their scene when their world bounds
+// change, and the hierarchy is refit around them before the next query. Animated instances are kept in the tree by
+// bounds that hold every pose of their clip, so playing an animation doesn't refit them, and only the instances a
+// query returns are posed when they are gathered.
+class J3DScene {
+	friend J3DModelInstance;
+
+	J3DDynamicAABBTree mTree;
+
+	std::vector<std::shared_ptr<J3DModelInstance>> mInstances;
+	// The tree proxy of each instance, and whether it is waiting to be refit.
+	std::vector<int32_t> mProxies;
+	std::vector<bool> mMoved;
+	// Indices of the instances whose bounds changed since the tree was last refit.
+	std::vector<uint32_t> mMovedInstances;
+	// Instances are posed on several threads when packets are gathered in parallel, and those posed without bounds
+	// from their clip mark themselves moved as they are.
+	std::mutex mMovedMutex;
+	// The instances SortPackets found in view, kept between frames so that it doesn't allocate.
+	std::vector<std::shared_ptr<J3DModelInstance>> mVisibleInstances;
+	// Results of the tree queries, reused between queries.
+	std::vector<uint32_t> mQueryIndices;
+	std::vector<std::pair<uint32_t, float>> mQueryHits;
+
+	// Called by instances in this scene when their world bounds change. Safe to call from several threads at once.
+	void MarkMoved(uint32_t index);
+	void RefitInstance(uint32_t index);
+
+	void GatherInstances(const std::vector<uint32_t>& indices, std::vector<std::shared_ptr<J3DModelInstance>>& instances) const;
+
+public:
+	J3DScene();
+	~J3DScene();
+
+	J3DScene(const J3DScene&) = delete;
+	J3DScene& operator=(const J3DScene&) = delete;
+
+	// Adds an instance to the scene. Returns false if it is already in a scene.
+	bool AddInstance(std::shared_ptr<J3DModelInstance> instance);
+	// Removes an instance from the scene. The last instance takes its place in GetInstances().
+	bool RemoveInstance(const std::shared_ptr<J3DModelInstance>& instance);
+	void Clear();
+
+	const std::vector<std::shared_ptr<J3DModelInstance>>& GetInstances() const { return mInstances; }
+
+	// Refits the hierarchy around the instances that moved since the last call.
+	// The queries call this themselves.
+	void Update();
+
+	// These append the instances whose bounds may intersect the query. Results are conservative: instances whose
+	// bounds are near the query but outside it may be included.
+	void QueryFrustum(const J3DFrustum& frustum, std::vector<std::shared_ptr<J3DModelInstance>>& instances);
+	void QueryBox(const glm::vec3& min, const glm::vec3& max, std::vector<std::shared_ptr<J3DModelInstance>>& instances);
+	// Appends the instances whose bounds the ray passes through, nearest first. Use J3D::Picking to find the exact hit.
+	void QueryRay(const glm::vec3& origin, const glm::vec3& direction, std::vector<std::shared_ptr<J3DModelInstance>>& instances,
+		float maxDistance = std::numeric_limits<float>::max());
+
+	// Gathers and sorts the render packets of the instances in view, culling their shapes against the view frustum.
+	J3D::Rendering::RenderPacketVector SortPackets(glm::vec3 cameraPosition, const glm::mat4& viewProjMatrix);
+	// Replaces the contents of the given vector, reusing its storage.
+	void SortPackets(glm::vec3 cameraPosition, const glm::mat4& viewProjMatrix, J3D::Rendering::RenderPacketVector& packets);
+
+	// Returns the height of the scene's hierarchy, which grows logarithmically with the number of instances.
+	int32_t GetTreeHeight() const { return mTree.GetHeight(); }
+};
@@ -9,6 +9,7 @@
 #include <string>
 #include <vector>
 #include <memory>
+#include <cstdint>
 
 
 struct J3DEnvelope;
@@ -32,6 +33,18 @@ class J3DSkeleton {
 	// Calculated envelopes for the model's rest pose
 	std::vector<glm::mat4> mRestPose;
 
+	// Envelopes flattened for per-frame pose calculation. The joints and weights of envelope i are at
+	// [mEnvelopeOffsets[i], mEnvelopeOffsets[i + 1]) in mEnvelopeJointIndices and mEnvelopeWeights.
+	std::vector<uint32_t> mEnvelopeOffsets;
+	std::vector<uint16_t> mEnvelopeJointIndices;
+	std::vector<float> mEnvelopeWeights;
+
+	// Parent of each joint, or -1 for the root, and the joint indices ordered so that parents come before their children.
+	std::vector<int32_t> mJointParents;
+	std::vector<uint32_t> mJointOrder;
+
+	void BuildPoseTables();
+
 public:
 	J3DSkeleton();
 
@@ -44,6 +57,19 @@ public:
 
 	void SetRootJoint(std::shared_ptr<J3DJoint> jnt) { mRootJoint = jnt; }
 
+	const std::vector<int32_t>& GetJointParents() const { return mJointParents; }
+	const std::vector<uint32_t>& GetJointOrder() const { return mJointOrder; }
+
 	void CalculateRestPose();
+
+	// Calculates the world transform of each joint from the joints' local transforms. Joints flagged in skip are left
+	// as they are; world must already hold one matrix per joint when skip is given.
+	void CalculateJointWorldMatrices(const std::vector<glm::mat4>& localTransforms, std::vector<glm::mat4>& world, const std::vector<bool>* skip = nullptr) const;
 	std::vector<glm::mat4> CalculateAnimJointPose(const std::vector<glm::mat4>& transforms);
+	// Recalculates the envelope matrices in pose from the given joint transforms. Envelopes flagged in skip are left
+	// as they are; pose must already hold one matrix per envelope when skip is given.
+	void UpdateAnimJointPose(const std::vector<glm::mat4>& transforms, std::vector<glm::mat4>& pose, const std::vector<bool>* skip = nullptr) const;
+
+	// Returns, per envelope matrix, whether it only depends on joints flagged in staticJoints.
+	std::vector<bool> GetStaticEnvelopes(const std::vector<bool>& staticJoints) const;
 };
\ No newline at end of file
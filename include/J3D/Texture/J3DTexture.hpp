@@ -43,6 +43,13 @@ struct J3DTexture {
 	std::vector<uint8_t*> ImageData;
 	uint32_t TexHandle;
 
+	// Raw texture block for textures whose decode and upload was deferred until first use,
+	// and the offset of this texture's header within it. Released once the texture is decoded.
+	std::shared_ptr<std::vector<uint8_t>> SourceData;
+	uint32_t SourceOffset;
+
+	bool IsDecodePending() const { return SourceData != nullptr; }
+
 	J3DTexture();
 	~J3DTexture();
 
@@ -22,4 +22,6 @@ public:
 	~J3DTextureFactory() {}
 
 	std::shared_ptr<J3DTexture> Create(bStream::CStream* stream, uint32_t index);
+	// Creates the texture without decoding it. blockData is a copy of the texture block, which started at blockOffset in the stream.
+	std::shared_ptr<J3DTexture> CreateDeferred(bStream::CStream* stream, uint32_t index, std::shared_ptr<std::vector<uint8_t>> blockData, uint32_t blockOffset);
 };
@@ -16,6 +16,13 @@ public:
   ~J3DTextureLoader() {}
 
   std::shared_ptr<J3DTexture> Load(const std::string& textureName, bStream::CStream* stream);
+  // Reads the texture's header, but leaves decoding and uploading its image data to Materialize().
+  // sourceData must hold the texture's header at sourceOffset, followed by the data it references.
+  std::shared_ptr<J3DTexture> LoadDeferred(const std::string& textureName, bStream::CStream* stream,
+    std::shared_ptr<std::vector<uint8_t>> sourceData, uint32_t sourceOffset);
+
+  // Decodes and uploads the image data of a texture loaded with LoadDeferred(). Does nothing if the texture is already decoded.
+  static void Materialize(std::shared_ptr<J3DTexture> texture);
 
   // Utility
   static void InitTexture(std::shared_ptr<J3DTexture> texture);
@@ -26,6 +33,9 @@ public:
   static float GXAnisoToGLAniso(EGXMaxAnisotropy aniso);
 
 protected:
+  // Creates the GL texture and decodes each mip level from the stream, where dataOffset is the position of the texture's header.
+  void DecodeTexture(std::shared_ptr<J3DTexture> texture, bStream::CStream* stream, uint32_t dataOffset);
+
   // Greyscale formats
   void DecodeI4(bStream::CStream* stream, uint16_t width, uint16_t height, uint8_t* imageData);
   void DecodeI8(bStream::CStream* stream, uint16_t width, uint16_t height, uint8_t* imageData);
@@ -21,7 +21,7 @@ struct J3DTransformInfo {
 	}
 
 	void Deserialize(bStream::CStream* stream);
-	glm::mat4 ToMat4();
+	glm::mat4 ToMat4() const;
 
 	bool operator==(const J3DTransformInfo& other) const;
 	bool operator!=(const J3DTransformInfo& other) const;
@@ -39,3 +39,12 @@ struct J3DTextureSRTInfo {
 	bool operator==(const J3DTextureSRTInfo& other) const;
 	bool operator!=(const J3DTextureSRTInfo& other) const;
 };
+
+namespace J3DUtility {
+	// Returns translate * rotate * scale, for a rotation given as Euler angles in degrees applied in X, Y, Z order.
+	// This matches composing three angle-axis quaternions, but builds the matrix directly from sines and cosines.
+	glm::mat4 ComposeTransform(const glm::vec3& translation, const glm::vec3& eulerDegrees, const glm::vec3& scale);
+
+	// Returns the axis-aligned box enclosing the given box after it is transformed by an affine matrix.
+	void TransformBoundingBox(const glm::mat4& transform, const glm::vec3& min, const glm::vec3& max, glm::vec3& transformedMin, glm::vec3& transformedMax);
+}
@@ -7,6 +7,7 @@
 #include <cstddef>
 #include <algorithm>
 #include <memory>
+#include <cstdint>
 
 namespace bStream { class CStream; }
 
@@ -50,6 +51,11 @@ namespace J3DUtility {
     }
 
     std::string LoadTextFile(std::filesystem::path filePath);
+    // Reads the entire file at the given path into data. Returns false if the file could not be read.
+    bool LoadBinaryFile(std::filesystem::path filePath, std::vector<uint8_t>& data);
+
+    // Returns a 64-bit FNV-1a hash of the given bytes. Not cryptographic; used to identify file contents.
+    uint64_t HashBytes(const uint8_t* data, size_t size, uint64_t seed = 0xCBF29CE484222325);
 
     void PadStreamWithString(bStream::CStream* stream, uint32_t padValue, std::string str = "");
 }
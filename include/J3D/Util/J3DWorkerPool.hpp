@@ -0,0 +1,48 @@
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// A fixed set of threads that run the tasks of parallel loops. The threads are started once and sleep between loops,
+// so a loop costs a wakeup rather than a thread launch. The calling thread runs tasks too, so a pool without threads
+// runs every task itself.
+//
+// Tasks are handed out in no particular order. Loops that need a deterministic result should write each task's output
+// to storage indexed by the task rather than by the thread running it.
+class J3DWorkerPool {
+	std::vector<std::thread> mThreads;
+
+	std::mutex mMutex;
+	std::condition_variable mWorkReady;
+	std::condition_variable mWorkDone;
+
+	// The loop being run. Incrementing mGeneration wakes the threads to run it.
+	const std::function<void(uint32_t)>* mTask;
+	uint32_t mTaskCount;
+	std::atomic<uint32_t> mNextTask;
+	uint32_t mBusyThreads;
+	uint64_t mGeneration;
+	bool bStopping;
+
+	void WorkerMain();
+	void RunTasks();
+
+public:
+	explicit J3DWorkerPool(uint32_t threadCount);
+	~J3DWorkerPool();
+
+	J3DWorkerPool(const J3DWorkerPool&) = delete;
+	J3DWorkerPool& operator=(const J3DWorkerPool&) = delete;
+
+	// Returns the number of threads that run tasks, including the calling thread.
+	uint32_t GetThreadCount() const { return (uint32_t)mThreads.size() + 1; }
+
+	// Runs task(i) for every i below taskCount and returns once all of them have finished. Loops can't be nested,
+	// and only one thread may run loops on a pool at a time.
+	void ParallelFor(uint32_t taskCount, const std::function<void(uint32_t)>& task);
+};
@@ -1,4 +1,7 @@
 #include "J3D/Animation/J3DAnimationInstance.hpp"
+#include "J3D/Material/J3DMaterial.hpp"
+
+#include <unordered_map>
 
 uint16_t J3DAnimation::J3DAnimationInstance::GetLength() const {
     return mLength;
@@ -60,4 +63,48 @@ void J3DAnimation::J3DAnimationInstance::Tick(float deltaTime) {
             break;
         }
     }
-}
\ No newline at end of file
+}
+
+void J3DAnimation::J3DMaterialBinding::ResolveNames(const shared_vector<J3DMaterial>& materials, const std::vector<const std::string*>& entryNames, bool firstMatchOnly) {
+    mMaterials = &materials;
+
+    // Material names aren't guaranteed to be unique, so an entry applies to every material with its name.
+    std::unordered_map<std::string, std::vector<uint32_t>> materialIndices;
+    for (uint32_t i = 0; i < materials.size(); i++) {
+        materialIndices[materials[i]->Name].push_back(i);
+    }
+
+    mOffsets.assign(materials.size() + 1, 0);
+    for (const std::string* name : entryNames) {
+        auto it = materialIndices.find(*name);
+        if (it == materialIndices.end()) {
+            continue;
+        }
+
+        for (uint32_t materialIndex : it->second) {
+            if (!firstMatchOnly || mOffsets[materialIndex + 1] == 0) {
+                mOffsets[materialIndex + 1]++;
+            }
+        }
+    }
+
+    for (size_t i = 1; i < mOffsets.size(); i++) {
+        mOffsets[i] += mOffsets[i - 1];
+    }
+
+    mEntryIndices.resize(mOffsets.back());
+
+    std::vector<uint32_t> fillPositions(mOffsets.begin(), mOffsets.end() - 1);
+    for (uint32_t entryIndex = 0; entryIndex < entryNames.size(); entryIndex++) {
+        auto it = materialIndices.find(*entryNames[entryIndex]);
+        if (it == materialIndices.end()) {
+            continue;
+        }
+
+        for (uint32_t materialIndex : it->second) {
+            if (fillPositions[materialIndex] < mOffsets[materialIndex + 1]) {
+                mEntryIndices[fillPositions[materialIndex]++] = entryIndex;
+            }
+        }
+    }
+}
@@ -11,21 +11,71 @@
 
 #include "J3D/Data/J3DBlock.hpp"
 #include "J3D/Data/J3DData.hpp"
+#include "J3D/Util/J3DUtil.hpp"
 #include "bstream.h"
 
+#include <algorithm>
 #include <iostream>
+#include <mutex>
+#include <unordered_map>
 
-J3DAnimation::J3DAnimationLoader::J3DAnimationLoader() : mAnimInstance() {
+namespace J3DAnimation {
+    namespace {
+        // Instances playing each cached clip, keyed by the hash of the animation file's contents. Loads hand out
+        // clones of a live instance, so the clip is shared without touching anyone's playback state. The cache
+        // doesn't keep instances alive, so a clip is freed along with the last instance playing it.
+        std::mutex mClipCacheMutex;
+        std::unordered_map<uint64_t, std::vector<std::weak_ptr<J3DAnimationInstance>>> mClipCache;
+
+        // Forgets freed instances and the clips nobody plays anymore. Call with mClipCacheMutex held.
+        void PurgeExpiredEntries() {
+            for (auto it = mClipCache.begin(); it != mClipCache.end();) {
+                std::vector<std::weak_ptr<J3DAnimationInstance>>& instances = it->second;
+                instances.erase(std::remove_if(instances.begin(), instances.end(),
+                    [](const std::weak_ptr<J3DAnimationInstance>& instance) { return instance.expired(); }), instances.end());
+
+                if (instances.empty()) {
+                    it = mClipCache.erase(it);
+                    continue;
+                }
+
+                ++it;
+            }
+        }
+
+        // Returns a new instance of the clip cached under the given hash, or nullptr if no instance of it is alive.
+        // Call with mClipCacheMutex held.
+        std::shared_ptr<J3DAnimationInstance> CloneCachedClip(uint64_t clipHash) {
+            auto it = mClipCache.find(clipHash);
+            if (it == mClipCache.end()) {
+                return nullptr;
+            }
+
+            for (const std::weak_ptr<J3DAnimationInstance>& instance : it->second) {
+                if (std::shared_ptr<J3DAnimationInstance> source = instance.lock()) {
+                    std::shared_ptr<J3DAnimationInstance> clone = source->Clone();
+                    it->second.push_back(clone);
+
+                    return clone;
+                }
+            }
+
+            return nullptr;
+        }
+    }
+}
+
+J3DAnimation::J3DAnimationLoader::J3DAnimationLoader() : mAnimInstance(), bBakeJointAnimations(false) {
 
 }
 
 std::shared_ptr<J3DAnimation::J3DAnimationInstance> J3DAnimation::J3DAnimationLoader::LoadAnimation(std::filesystem::path filePath) {
-    if (!std::filesystem::exists(filePath)) {
+    std::vector<uint8_t> fileData;
+    if (!J3DUtility::LoadBinaryFile(filePath, fileData)) {
         return nullptr;
     }
 
-    bStream::CFileStream stream(filePath.string(), bStream::Big, bStream::In);
-    return LoadAnimation(stream);
+    return LoadAnimation(fileData.data(), (uint32_t)fileData.size());
 }
 
 std::shared_ptr<J3DAnimation::J3DAnimationInstance> J3DAnimation::J3DAnimationLoader::LoadAnimation(void* buffer, uint32_t size) {
@@ -33,11 +83,61 @@ std::shared_ptr<J3DAnimation::J3DAnimationInstance> J3DAnimation::J3DAnimationLo
         return nullptr;
     }
 
+    uint64_t clipHash = J3DUtility::HashBytes(reinterpret_cast<uint8_t*>(buffer), size);
+    if (bBakeJointAnimations) {
+        // Keep baked clips apart from unbaked ones.
+        clipHash = ~clipHash;
+    }
+
+    {
+        std::lock_guard<std::mutex> lock(mClipCacheMutex);
+        PurgeExpiredEntries();
+
+        if (std::shared_ptr<J3DAnimationInstance> clone = CloneCachedClip(clipHash)) {
+            mAnimInstance = clone;
+            return mAnimInstance;
+        }
+    }
+
     bStream::CMemoryStream stream(reinterpret_cast<uint8_t*>(buffer), size, bStream::Big, bStream::In);
-    return LoadAnimation(stream);
+
+    std::shared_ptr<J3DAnimationInstance> instance = LoadAnimation(stream);
+    if (instance == nullptr) {
+        return nullptr;
+    }
+
+    {
+        std::lock_guard<std::mutex> lock(mClipCacheMutex);
+
+        // Another thread may have loaded the same clip in the meantime; use its clip so the clip stays shared.
+        if (std::shared_ptr<J3DAnimationInstance> clone = CloneCachedClip(clipHash)) {
+            instance = clone;
+        }
+        else {
+            mClipCache[clipHash].push_back(instance);
+        }
+
+        mAnimInstance = instance;
+    }
+
+    return mAnimInstance;
+}
+
+uint32_t J3DAnimation::J3DAnimationLoader::GetCachedClipCount() {
+    std::lock_guard<std::mutex> lock(mClipCacheMutex);
+    PurgeExpiredEntries();
+
+    return (uint32_t)mClipCache.size();
+}
+
+void J3DAnimation::J3DAnimationLoader::ClearClipCache() {
+    std::lock_guard<std::mutex> lock(mClipCacheMutex);
+    mClipCache.clear();
 }
 
 std::shared_ptr<J3DAnimation::J3DAnimationInstance> J3DAnimation::J3DAnimationLoader::LoadAnimation(bStream::CStream& stream) {
+    mAnimInstance = nullptr;
+
     J3DDataBase header;
     header.Deserialize(&stream);
 
@@ -79,5 +179,9 @@ std::shared_ptr<J3DAnimation::J3DAnimationInstance> J3DAnimation::J3DAnimationLo
         mAnimInstance->Deserialize(stream);
     }
 
+    if (bBakeJointAnimations && blockType == EJ3DBlockType::ANK1) {
+        std::static_pointer_cast<J3DJointAnimationInstance>(mAnimInstance)->Bake();
+    }
+
     return mAnimInstance;
 }
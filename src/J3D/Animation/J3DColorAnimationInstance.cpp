@@ -7,10 +7,26 @@
 #include <memory>
 #include <algorithm>
 
-J3DAnimation::J3DColorAnimationInstance::J3DColorAnimationInstance() {
+J3DAnimation::J3DColorAnimationInstance::J3DColorAnimationInstance() : mClip(std::make_shared<J3DColorAnimationClip>()) {
 
 }
 
+J3DAnimation::J3DColorAnimationInstance::J3DColorAnimationInstance(std::shared_ptr<const J3DColorAnimationClip> clip) {
+    SetClip(clip);
+}
+
+void J3DAnimation::J3DColorAnimationInstance::SetClip(std::shared_ptr<const J3DColorAnimationClip> clip) {
+    mClip = clip;
+    SetClipInfo(*mClip);
+
+    mRegisterTrackCursors.assign(mClip->RegisterEntries.size() * 4, 0);
+    mKonstTrackCursors.assign(mClip->KonstEntries.size() * 4, 0);
+}
+
+std::shared_ptr<J3DAnimation::J3DAnimationInstance> J3DAnimation::J3DColorAnimationInstance::Clone() const {
+    return std::make_shared<J3DColorAnimationInstance>(mClip);
+}
+
 void J3DAnimation::J3DColorAnimationInstance::ReadColorTrack(bStream::CStream& stream, J3DHermiteAnimationTrack& track, uint32_t valueTableOffset) {
     uint16_t keyCount = stream.readUInt16();
     uint16_t firstKeyIndex = stream.readUInt16();
@@ -55,13 +71,14 @@ void J3DAnimation::J3DColorAnimationInstance::ReadColorTrack(bStream::CStream& s
 
 void J3DAnimation::J3DColorAnimationInstance::Deserialize(bStream::CStream& stream) {
     size_t currentStreamPos = stream.tell();
+    std::shared_ptr<J3DColorAnimationClip> clip = std::make_shared<J3DColorAnimationClip>();
 
     // Deserialize counts and offsets from the block
     J3DRegisterColorKeyBlock colorKeyBlock;
     colorKeyBlock.Deserialize(&stream);
 
-    mLength = colorKeyBlock.Length;
-    mLoopMode = static_cast<ELoopMode>(colorKeyBlock.LoopMode);
+    clip->Length = colorKeyBlock.Length;
+    clip->LoopMode = static_cast<ELoopMode>(colorKeyBlock.LoopMode);
 
     // Deserialize the material names for register colors
     stream.seek(colorKeyBlock.RegisterMaterialNameTableOffset);
@@ -87,7 +104,7 @@ void J3DAnimation::J3DColorAnimationInstance::Deserialize(bStream::CStream& stre
         animData.ColorIndex = stream.readUInt8();
         stream.skip(3);
 
-        RegisterEntries.push_back(animData);
+        clip->RegisterEntries.push_back(animData);
     }
 
     // Deserialize the tracks for konst colors
@@ -104,55 +121,47 @@ void J3DAnimation::J3DColorAnimationInstance::Deserialize(bStream::CStream& stre
         animData.ColorIndex = stream.readUInt8();
         stream.skip(3);
 
-        KonstEntries.push_back(animData);
+        clip->KonstEntries.push_back(animData);
     }
 
+    SetClip(clip);
+
     stream.seek(currentStreamPos + colorKeyBlock.BlockSize);
 }
 
-void J3DAnimation::J3DColorAnimationInstance::ApplyAnimation(std::shared_ptr<J3DMaterial> material) {
-    float frameTime = GetFrame();
+void J3DAnimation::J3DColorAnimationInstance::Bind(const shared_vector<J3DMaterial>& materials, J3DMaterialBinding& registerBinding, J3DMaterialBinding& konstBinding) const {
+    registerBinding.Resolve(materials, mClip->RegisterEntries, true);
+    konstBinding.Resolve(materials, mClip->KonstEntries, true);
+}
 
-    // Try to find register anim data for the current material.
-    std::vector<J3DAnimation::J3DColorAnimationData>::const_iterator matFindResult = std::find_if(
-        RegisterEntries.begin(),
-        RegisterEntries.end(),
-        [&material](const J3DAnimation::J3DColorAnimationData& v) { return v.MaterialName == material->Name; }
-    );
+void J3DAnimation::J3DColorAnimationInstance::ApplyAnimation(std::shared_ptr<J3DMaterial> material, uint32_t materialIndex,
+    const J3DMaterialBinding& registerBinding, const J3DMaterialBinding& konstBinding)
+{
+    float frameTime = GetFrame();
 
-    // Found register anim data! Now apply it.
-    if (matFindResult != RegisterEntries.end()) {
+    // Apply the register entries bound to this material.
+    for (const uint32_t* it = registerBinding.EntriesBegin(materialIndex); it != registerBinding.EntriesEnd(materialIndex); it++) {
         material->AreRegisterColorsAnimating = true;
 
-        J3DAnimation::J3DColorAnimationData regData = *matFindResult;
+        const J3DAnimation::J3DColorAnimationData& regData = mClip->RegisterEntries[*it];
+        uint32_t* cursors = &mRegisterTrackCursors[*it * 4];
 
-        material->AnimationRegisterColors[regData.ColorIndex].r = regData.RedTrack.GetValue(frameTime);
-        material->AnimationRegisterColors[regData.ColorIndex].g = regData.GreenTrack.GetValue(frameTime);
-        material->AnimationRegisterColors[regData.ColorIndex].b = regData.BlueTrack.GetValue(frameTime);
-        material->AnimationRegisterColors[regData.ColorIndex].a = regData.AlphaTrack.GetValue(frameTime);
+        material->AnimationRegisterColors[regData.ColorIndex].r = regData.RedTrack.GetValue(frameTime, cursors[0]);
+        material->AnimationRegisterColors[regData.ColorIndex].g = regData.GreenTrack.GetValue(frameTime, cursors[1]);
+        material->AnimationRegisterColors[regData.ColorIndex].b = regData.BlueTrack.GetValue(frameTime, cursors[2]);
+        material->AnimationRegisterColors[regData.ColorIndex].a = regData.AlphaTrack.GetValue(frameTime, cursors[3]);
     }
 
-    // Try to find konst anim data for the current material.
-    std::vector<J3DAnimation::J3DColorAnimationData>::const_iterator matFindResult2 = std::find_if(
-        KonstEntries.begin(),
-        KonstEntries.end(),
-        [&material](const J3DAnimation::J3DColorAnimationData& v) { return v.MaterialName == material->Name; }
-    );
-
-    // Found konst anim data! Now apply it.
-    if (matFindResult2 != KonstEntries.end()) {
+    // Apply the konst entries bound to this material.
+    for (const uint32_t* it = konstBinding.EntriesBegin(materialIndex); it != konstBinding.EntriesEnd(materialIndex); it++) {
         material->AreRegisterColorsAnimating = true;
 
-        // Reset colors to default state before animating
-        //for (int i = 0; i < 4; i++) {
-        //    material->AnimationKonstColors[i] = material->TevBlock->mTevKonstColors[i];
-        //}
-
-        J3DAnimation::J3DColorAnimationData konstData = *matFindResult2;
+        const J3DAnimation::J3DColorAnimationData& konstData = mClip->KonstEntries[*it];
+        uint32_t* cursors = &mKonstTrackCursors[*it * 4];
 
-        material->AnimationKonstColors[konstData.ColorIndex].r = konstData.RedTrack.GetValue(frameTime) / 255.0f;
-        material->AnimationKonstColors[konstData.ColorIndex].g = konstData.GreenTrack.GetValue(frameTime) / 255.0f;
-        material->AnimationKonstColors[konstData.ColorIndex].b = konstData.BlueTrack.GetValue(frameTime) / 255.0f;
-        material->AnimationKonstColors[konstData.ColorIndex].a = konstData.AlphaTrack.GetValue(frameTime) / 255.0f;
+        material->AnimationKonstColors[konstData.ColorIndex].r = konstData.RedTrack.GetValue(frameTime, cursors[0]) / 255.0f;
+        material->AnimationKonstColors[konstData.ColorIndex].g = konstData.GreenTrack.GetValue(frameTime, cursors[1]) / 255.0f;
+        material->AnimationKonstColors[konstData.ColorIndex].b = konstData.BlueTrack.GetValue(frameTime, cursors[2]) / 255.0f;
+        material->AnimationKonstColors[konstData.ColorIndex].a = konstData.AlphaTrack.GetValue(frameTime, cursors[3]) / 255.0f;
     }
 }
\ No newline at end of file
@@ -5,6 +5,16 @@
 
 #include <glm/glm.hpp>
 
+#if defined(__AVX__)
+#define J3D_HERMITE_USE_AVX
+#include <immintrin.h>
+#endif
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define J3D_HERMITE_USE_SSE
+#include <emmintrin.h>
+#endif
+
 const glm::mat4 HERMITE_MTX(
     2.0f, -2.0f, 1.0f, 1.0f,
     -3.0f, 3.0f, -2.0f, -1.0f,
@@ -12,6 +22,62 @@ const glm::mat4 HERMITE_MTX(
     1.0f, 0.0f, 0.0f, 0.0f
 );
 
+namespace {
+    // Returns the index of the first key at or after the given time, starting from 1, using a binary search.
+    // Returns keyCount if the time is past the last key. keyTime(i) gives the time of key i.
+    template<typename KeyTime>
+    uint32_t FindKeyIndex(uint32_t keyCount, float time, const KeyTime& keyTime) {
+        uint32_t first = 1;
+        uint32_t count = keyCount - 1;
+
+        while (count > 0) {
+            uint32_t step = count / 2;
+            if (keyTime(first + step) < time) {
+                first += step + 1;
+                count -= step + 1;
+            }
+            else {
+                count = step;
+            }
+        }
+
+        return first;
+    }
+
+    // Moves a playback cursor to the key FindKeyIndex would return for the given time. Tracks need at least two keys.
+    // When time moves forward or backward a little each call, as it does during playback, the key is found in
+    // constant time; larger jumps fall back to a binary search.
+    template<typename KeyTime>
+    void SeekKeyCursor(uint32_t keyCount, float time, uint32_t& cursor, const KeyTime& keyTime) {
+        // The cursor is valid if the time falls between its key and the one before it. Index keyCount means past the end.
+        auto isCursorValid = [&](uint32_t index) {
+            if (index < 1 || index > keyCount) {
+                return false;
+            }
+
+            bool afterPrevious = index == 1 || keyTime(index - 1) < time;
+            bool beforeCurrent = index == keyCount || keyTime(index) >= time;
+
+            return afterPrevious && beforeCurrent;
+        };
+
+        if (isCursorValid(cursor)) {
+            return;
+        }
+
+        // Playback usually only crosses a single key between calls, so check the neighbours before searching.
+        if (isCursorValid(cursor + 1)) {
+            cursor++;
+        }
+        else if (cursor > 1 && isCursorValid(cursor - 1)) {
+            cursor--;
+        }
+        else {
+            cursor = FindKeyIndex(keyCount, time, keyTime);
+        }
+    }
+}
+
 J3DAnimation::J3DHermiteAnimationTrack::J3DHermiteAnimationTrack() {
 
 }
@@ -21,19 +87,27 @@ J3DAnimation::J3DHermiteAnimationTrack::~J3DHermiteAnimationTrack() {
 }
 
 float J3DAnimation::J3DHermiteAnimationTrack::GetValue(float time) const {
-    if (mKeys.size() == 1) {
-        return mKeys[0].Value;
+    if (mKeys.size() <= 1) {
+        return mKeys.empty() ? 0.0f : mKeys[0].Value;
     }
 
-    size_t index = 1;
-    while (mKeys[index].Time < time) {
-        index++;
-        if (index >= mKeys.size()) {
-            index = mKeys.size() - 1;
-            time = mKeys[index].Time;
+    return GetValueAtKeyIndex(time, FindKeyIndex((uint32_t)mKeys.size(), time, [this](uint32_t i) { return mKeys[i].Time; }));
+}
 
-            break;
-        }
+float J3DAnimation::J3DHermiteAnimationTrack::GetValue(float time, uint32_t& cursor) const {
+    if (mKeys.size() <= 1) {
+        return mKeys.empty() ? 0.0f : mKeys[0].Value;
+    }
+
+    SeekKeyCursor((uint32_t)mKeys.size(), time, cursor, [this](uint32_t i) { return mKeys[i].Time; });
+
+    return GetValueAtKeyIndex(time, cursor);
+}
+
+float J3DAnimation::J3DHermiteAnimationTrack::GetValueAtKeyIndex(float time, uint32_t index) const {
+    if (index >= mKeys.size()) {
+        index = (uint32_t)mKeys.size() - 1;
+        time = mKeys[index].Time;
     }
 
     const J3DAnimationKey* firstKey = &mKeys[index - 1];
@@ -58,3 +132,143 @@ float J3DAnimation::J3DHermiteAnimationTrack::InterpolateValue(float time, const
 void J3DAnimation::J3DHermiteAnimationTrack::AddKey(J3DAnimation::J3DAnimationKey key) {
     mKeys.push_back(key);
 }
+
+void J3DAnimation::J3DPackedHermiteTracks::AddTrack(const J3DHermiteAnimationTrack& track) {
+    if (KeyOffsets.empty()) {
+        KeyOffsets.push_back(0);
+    }
+
+    for (const J3DAnimationKey& key : track.GetKeys()) {
+        Times.push_back(key.Time);
+        Values.push_back(key.Value);
+        InTangents.push_back(key.InTangent);
+        OutTangents.push_back(key.OutTangent);
+    }
+
+    KeyOffsets.push_back((uint32_t)Times.size());
+}
+
+bool J3DAnimation::J3DPackedHermiteTracks::IsChannelConstant(uint32_t channel) const {
+    uint32_t firstKey = KeyOffsets[channel];
+    uint32_t endKey = KeyOffsets[channel + 1];
+
+    for (uint32_t i = firstKey; i < endKey; i++) {
+        if (Values[i] != Values[firstKey]) {
+            return false;
+        }
+
+        // A single key's tangents are never used.
+        if (endKey - firstKey > 1 && (InTangents[i] != 0.0f || OutTangents[i] != 0.0f)) {
+            return false;
+        }
+    }
+
+    return true;
+}
+
+float J3DAnimation::J3DPackedHermiteTracks::GetFirstValue(uint32_t channel) const {
+    return KeyOffsets[channel] < KeyOffsets[channel + 1] ? Values[KeyOffsets[channel]] : 0.0f;
+}
+
+void J3DAnimation::J3DPackedHermiteTracks::GetSegment(uint32_t channel, float time, uint32_t& cursor, float& p0, float& p1, float& m0, float& m1, float& t) const {
+    uint32_t firstKey = KeyOffsets[channel];
+    uint32_t keyCount = KeyOffsets[channel + 1] - firstKey;
+
+    // Constant channels: a degenerate segment that evaluates to the single value.
+    if (keyCount <= 1) {
+        p0 = p1 = keyCount == 0 ? 0.0f : Values[firstKey];
+        m0 = m1 = t = 0.0f;
+        return;
+    }
+
+    const float* times = &Times[firstKey];
+    SeekKeyCursor(keyCount, time, cursor, [times](uint32_t i) { return times[i]; });
+
+    uint32_t index = cursor;
+    float segmentTime = time;
+
+    // Past the last key, hold the last key's value.
+    if (index >= keyCount) {
+        index = keyCount - 1;
+        segmentTime = times[index];
+    }
+
+    uint32_t a = firstKey + index - 1;
+    uint32_t b = firstKey + index;
+    float framesBetweenKeys = Times[b] - Times[a];
+
+    p0 = Values[a];
+    p1 = Values[b];
+    m0 = OutTangents[a] * framesBetweenKeys;
+    m1 = InTangents[b] * framesBetweenKeys;
+    t = (segmentTime - Times[a]) / framesBetweenKeys;
+}
+
+float J3DAnimation::J3DPackedHermiteTracks::GetValue(uint32_t channel, float time, uint32_t& cursor) const {
+    float p0, p1, m0, m1, t, result;
+    GetSegment(channel, time, cursor, p0, p1, m0, m1, t);
+    EvaluateHermiteSegments(&p0, &p1, &m0, &m1, &t, &result, 1);
+
+    return result;
+}
+
+void J3DAnimation::EvaluateHermiteSegments(const float* p0, const float* p1, const float* m0, const float* m1, const float* t, float* results, size_t count) {
+    // With the basis functions h00 = 2t^3 - 3t^2 + 1, h01 = 3t^2 - 2t^3, h10 = t^3 - 2t^2 + t and h11 = t^3 - t^2,
+    // the value is p0 + h01 * (p1 - p0) + h10 * m0 + h11 * m1, since h00 = 1 - h01.
+    size_t i = 0;
+
+#ifdef J3D_HERMITE_USE_AVX
+    const __m256 two8 = _mm256_set1_ps(2.0f);
+    const __m256 three8 = _mm256_set1_ps(3.0f);
+
+    for (; i + 8 <= count; i += 8) {
+        __m256 vt = _mm256_loadu_ps(t + i);
+        __m256 t2 = _mm256_mul_ps(vt, vt);
+        __m256 t3 = _mm256_mul_ps(t2, vt);
+
+        __m256 h01 = _mm256_sub_ps(_mm256_mul_ps(three8, t2), _mm256_mul_ps(two8, t3));
+        __m256 h11 = _mm256_sub_ps(t3, t2);
+        __m256 h10 = _mm256_add_ps(_mm256_sub_ps(h11, t2), vt);
+
+        __m256 vp0 = _mm256_loadu_ps(p0 + i);
+        __m256 result = _mm256_add_ps(vp0, _mm256_mul_ps(h01, _mm256_sub_ps(_mm256_loadu_ps(p1 + i), vp0)));
+        result = _mm256_add_ps(result, _mm256_mul_ps(h10, _mm256_loadu_ps(m0 + i)));
+        result = _mm256_add_ps(result, _mm256_mul_ps(h11, _mm256_loadu_ps(m1 + i)));
+
+        _mm256_storeu_ps(results + i, result);
+    }
+#endif
+
+#ifdef J3D_HERMITE_USE_SSE
+    const __m128 two = _mm_set1_ps(2.0f);
+    const __m128 three = _mm_set1_ps(3.0f);
+
+    for (; i + 4 <= count; i += 4) {
+        __m128 vt = _mm_loadu_ps(t + i);
+        __m128 t2 = _mm_mul_ps(vt, vt);
+        __m128 t3 = _mm_mul_ps(t2, vt);
+
+        __m128 h01 = _mm_sub_ps(_mm_mul_ps(three, t2), _mm_mul_ps(two, t3));
+        __m128 h11 = _mm_sub_ps(t3, t2);
+        __m128 h10 = _mm_add_ps(_mm_sub_ps(h11, t2), vt);
+
+        __m128 vp0 = _mm_loadu_ps(p0 + i);
+        __m128 result = _mm_add_ps(vp0, _mm_mul_ps(h01, _mm_sub_ps(_mm_loadu_ps(p1 + i), vp0)));
+        result = _mm_add_ps(result, _mm_mul_ps(h10, _mm_loadu_ps(m0 + i)));
+        result = _mm_add_ps(result, _mm_mul_ps(h11, _mm_loadu_ps(m1 + i)));
+
+        _mm_storeu_ps(results + i, result);
+    }
+#endif
+
+    for (; i < count; i++) {
+        float t2 = t[i] * t[i];
+        float t3 = t2 * t[i];
+
+        float h01 = 3.0f * t2 - 2.0f * t3;
+        float h11 = t3 - t2;
+        float h10 = h11 - t2 + t[i];
+
+        results[i] = p0[i] + h01 * (p1[i] - p0[i]) + h10 * m0[i] + h11 * m1[i];
+    }
+}
@@ -1,13 +1,75 @@
 #include "J3D/Animation/J3DJointAnimationInstance.hpp"
+#include "J3D/Util/J3DTransform.hpp"
 
 #include <glm/ext.hpp>
 #include <glm/gtx/quaternion.hpp>
 #include <glm/gtc/matrix_transform.hpp>
 #include <glm/gtx/transform.hpp>
 
+#include <algorithm>
+#include <cmath>
 
-J3DAnimation::J3DJointAnimationInstance::J3DJointAnimationInstance() {
 
+J3DAnimation::J3DJointAnimationInstance::J3DJointAnimationInstance() : mClip(std::make_shared<J3DJointAnimationClip>()) {
+
+}
+
+J3DAnimation::J3DJointAnimationInstance::J3DJointAnimationInstance(std::shared_ptr<const J3DJointAnimationClip> clip) {
+    SetClip(clip);
+}
+
+void J3DAnimation::J3DJointAnimationInstance::SetClip(std::shared_ptr<const J3DJointAnimationClip> clip) {
+    mClip = clip;
+    SetClipInfo(*mClip);
+    mTrackCursors.assign((size_t)mClip->JointCount * 9, 0);
+
+    size_t animatedCount = mClip->AnimatedChannels.size();
+    mSegmentP0.resize(animatedCount);
+    mSegmentP1.resize(animatedCount);
+    mSegmentM0.resize(animatedCount);
+    mSegmentM1.resize(animatedCount);
+    mSegmentT.resize(animatedCount);
+    mAnimatedValues.resize(animatedCount);
+
+    // Constant channels are written once here and never touched again.
+    mChannelValues = mClip->InitialChannelValues;
+}
+
+void J3DAnimation::J3DJointAnimationClip::AnalyzeChannels() {
+    uint32_t channelCount = PackedTracks.GetChannelCount();
+
+    AnimatedChannels.clear();
+    InitialChannelValues.resize(channelCount);
+
+    for (uint32_t c = 0; c < channelCount; c++) {
+        InitialChannelValues[c] = PackedTracks.GetFirstValue(c);
+
+        if (!PackedTracks.IsChannelConstant(c)) {
+            AnimatedChannels.push_back(c);
+        }
+    }
+
+    StaticJoints.assign(JointCount, true);
+    StaticTransforms.assign(JointCount, glm::identity<glm::mat4>());
+    StaticJointCount = 0;
+
+    for (uint32_t c : AnimatedChannels) {
+        StaticJoints[c / 9] = false;
+    }
+
+    for (size_t i = 0; i < JointCount; i++) {
+        if (!StaticJoints[i]) {
+            continue;
+        }
+
+        const float* v = &InitialChannelValues[i * 9];
+        StaticTransforms[i] = J3DUtility::ComposeTransform(glm::vec3(v[0], v[1], v[2]), glm::vec3(v[6], v[7], v[8]), glm::vec3(v[3], v[4], v[5]));
+        StaticJointCount++;
+    }
+}
+
+std::shared_ptr<J3DAnimation::J3DAnimationInstance> J3DAnimation::J3DJointAnimationInstance::Clone() const {
+    return std::make_shared<J3DJointAnimationInstance>(mClip);
 }
 
 void J3DAnimation::J3DJointAnimationInstance::ReadFloatComponentTrack(bStream::CStream& stream, J3DHermiteAnimationTrack& track, uint32_t valueTableOffset) {
@@ -100,20 +162,20 @@ void J3DAnimation::J3DJointAnimationInstance::ReadRotationComponentTrack(
 
 void J3DAnimation::J3DJointAnimationInstance::Deserialize(bStream::CStream& stream) {
     size_t currentStreamPos = stream.tell();
+    std::shared_ptr<J3DJointAnimationClip> clip = std::make_shared<J3DJointAnimationClip>();
 
     // Deserialize counts and offsets from the block
     J3DJointKeyBlock jointKeyBlock;
     jointKeyBlock.Deserialize(&stream);
 
-    mLength = jointKeyBlock.Length;
-    mLoopMode = static_cast<ELoopMode>(jointKeyBlock.LoopMode);
+    clip->Length = jointKeyBlock.Length;
+    clip->LoopMode = static_cast<ELoopMode>(jointKeyBlock.LoopMode);
+    clip->JointCount = jointKeyBlock.TrackCount;
 
     size_t fullTrackCount = jointKeyBlock.TrackCount;
 
     float rotationScale = (1 << jointKeyBlock.RotationFraction) * (180.0f / 32768.0f);
 
-    mEntries.reserve(fullTrackCount);
-
     stream.seek(jointKeyBlock.TrackTableOffset);
     for (int i = 0; i < fullTrackCount; i++) {
         J3DJointAnimationData animData;
@@ -131,34 +193,197 @@ void J3DAnimation::J3DJointAnimationInstance::Deserialize(bStream::CStream& stre
         ReadRotationComponentTrack(stream, animData.RotationZ, jointKeyBlock.RotationTableOffset, rotationScale);
         ReadFloatComponentTrack(stream, animData.TranslationZ, jointKeyBlock.TranslationTableOffset);
 
-        mEntries.push_back(animData);
+        // Only the packed keys are kept; the tracks are dropped with animData.
+        clip->PackedTracks.AddTrack(animData.TranslationX);
+        clip->PackedTracks.AddTrack(animData.TranslationY);
+        clip->PackedTracks.AddTrack(animData.TranslationZ);
+        clip->PackedTracks.AddTrack(animData.ScaleX);
+        clip->PackedTracks.AddTrack(animData.ScaleY);
+        clip->PackedTracks.AddTrack(animData.ScaleZ);
+        clip->PackedTracks.AddTrack(animData.RotationX);
+        clip->PackedTracks.AddTrack(animData.RotationY);
+        clip->PackedTracks.AddTrack(animData.RotationZ);
     }
 
+    clip->AnalyzeChannels();
+
+    SetClip(clip);
+
     stream.seek(currentStreamPos + jointKeyBlock.BlockSize);
 }
 
+void J3DAnimation::J3DJointAnimationInstance::Bake() {
+    if (mClip->IsBaked()) {
+        return;
+    }
+
+    // Baked playback only needs the samples and the static joints, so the source tracks aren't copied to the baked clip.
+    std::shared_ptr<J3DJointAnimationClip> clip = std::make_shared<J3DJointAnimationClip>();
+    clip->LoopMode = mClip->LoopMode;
+    clip->Length = mClip->Length;
+    clip->JointCount = mClip->JointCount;
+    clip->AnimatedChannels = mClip->AnimatedChannels;
+    clip->InitialChannelValues = mClip->InitialChannelValues;
+    clip->StaticJoints = mClip->StaticJoints;
+    clip->StaticTransforms = mClip->StaticTransforms;
+    clip->StaticJointCount = mClip->StaticJointCount;
+
+    J3DBakedJointAnimation& baked = clip->Baked;
+
+    // Sample both ends of the clip, so the last frame can blend towards the final pose.
+    baked.JointCount = mClip->JointCount;
+    baked.FrameCount = (uint32_t)clip->Length + 1;
+
+    size_t sampleCount = (size_t)baked.JointCount * baked.FrameCount;
+    baked.TranslationX.resize(sampleCount);
+    baked.TranslationY.resize(sampleCount);
+    baked.TranslationZ.resize(sampleCount);
+    baked.RotationX.resize(sampleCount);
+    baked.RotationY.resize(sampleCount);
+    baked.RotationZ.resize(sampleCount);
+    baked.RotationW.resize(sampleCount);
+    baked.ScaleX.resize(sampleCount);
+    baked.ScaleY.resize(sampleCount);
+    baked.ScaleZ.resize(sampleCount);
+
+    for (uint32_t jointIndex = 0; jointIndex < baked.JointCount; jointIndex++) {
+        const J3DPackedHermiteTracks& tracks = mClip->PackedTracks;
+        uint32_t channel = jointIndex * 9;
+        uint32_t cursors[9] = { };
+
+        glm::quat previousRotation = glm::identity<glm::quat>();
+
+        for (uint32_t frame = 0; frame < baked.FrameCount; frame++) {
+            float frameTime = (float)frame;
+            size_t sample = (size_t)frame * baked.JointCount + jointIndex;
+
+            baked.TranslationX[sample] = tracks.GetValue(channel + 0, frameTime, cursors[0]);
+            baked.TranslationY[sample] = tracks.GetValue(channel + 1, frameTime, cursors[1]);
+            baked.TranslationZ[sample] = tracks.GetValue(channel + 2, frameTime, cursors[2]);
+
+            baked.ScaleX[sample] = tracks.GetValue(channel + 3, frameTime, cursors[3]);
+            baked.ScaleY[sample] = tracks.GetValue(channel + 4, frameTime, cursors[4]);
+            baked.ScaleZ[sample] = tracks.GetValue(channel + 5, frameTime, cursors[5]);
+
+            glm::quat rotation = glm::angleAxis(glm::radians(tracks.GetValue(channel + 8, frameTime, cursors[8])), glm::vec3(0.0f, 0.0f, 1.0f)) *
+                                 glm::angleAxis(glm::radians(tracks.GetValue(channel + 7, frameTime, cursors[7])), glm::vec3(0.0f, 1.0f, 0.0f)) *
+                                 glm::angleAxis(glm::radians(tracks.GetValue(channel + 6, frameTime, cursors[6])), glm::vec3(1.0f, 0.0f, 0.0f));
+
+            // Keep neighbouring frames in the same hemisphere, so playback can nlerp between them without checking.
+            if (glm::dot(previousRotation, rotation) < 0.0f) {
+                rotation = -rotation;
+            }
+            previousRotation = rotation;
+
+            baked.RotationX[sample] = (int16_t)std::round(glm::clamp(rotation.x, -1.0f, 1.0f) * 32767.0f);
+            baked.RotationY[sample] = (int16_t)std::round(glm::clamp(rotation.y, -1.0f, 1.0f) * 32767.0f);
+            baked.RotationZ[sample] = (int16_t)std::round(glm::clamp(rotation.z, -1.0f, 1.0f) * 32767.0f);
+            baked.RotationW[sample] = (int16_t)std::round(glm::clamp(rotation.w, -1.0f, 1.0f) * 32767.0f);
+        }
+    }
+
+    SetClip(clip);
+}
+
+void J3DAnimation::J3DJointAnimationInstance::GetBakedTransformsAtFrame(float frameTime, std::vector<glm::mat4>& transforms, const std::vector<bool>* skip) const {
+    const J3DBakedJointAnimation& baked = mClip->Baked;
+
+    float clampedTime = glm::clamp(frameTime, 0.0f, (float)(baked.FrameCount - 1));
+    uint32_t frameA = (uint32_t)clampedTime;
+    uint32_t frameB = std::min(frameA + 1, baked.FrameCount - 1);
+    float t = clampedTime - (float)frameA;
+
+    size_t a = (size_t)frameA * baked.JointCount;
+    size_t b = (size_t)frameB * baked.JointCount;
+
+    transforms.resize(baked.JointCount);
+
+    for (uint32_t i = 0; i < baked.JointCount; i++, a++, b++) {
+        if (skip != nullptr && (*skip)[i]) {
+            continue;
+        }
+
+        if (mClip->StaticJoints[i]) {
+            transforms[i] = mClip->StaticTransforms[i];
+            continue;
+        }
+
+        glm::vec3 translation(
+            baked.TranslationX[a] + (baked.TranslationX[b] - baked.TranslationX[a]) * t,
+            baked.TranslationY[a] + (baked.TranslationY[b] - baked.TranslationY[a]) * t,
+            baked.TranslationZ[a] + (baked.TranslationZ[b] - baked.TranslationZ[a]) * t
+        );
+        glm::vec3 scale(
+            baked.ScaleX[a] + (baked.ScaleX[b] - baked.ScaleX[a]) * t,
+            baked.ScaleY[a] + (baked.ScaleY[b] - baked.ScaleY[a]) * t,
+            baked.ScaleZ[a] + (baked.ScaleZ[b] - baked.ScaleZ[a]) * t
+        );
+
+        // Blend the quantized quaternions and renormalize; the dequantization scale cancels out.
+        glm::quat rotation = glm::normalize(glm::quat(
+            baked.RotationW[a] + (baked.RotationW[b] - baked.RotationW[a]) * t,
+            baked.RotationX[a] + (baked.RotationX[b] - baked.RotationX[a]) * t,
+            baked.RotationY[a] + (baked.RotationY[b] - baked.RotationY[a]) * t,
+            baked.RotationZ[a] + (baked.RotationZ[b] - baked.RotationZ[a]) * t
+        ));
+
+        // Equivalent to translate * rotate * scale.
+        glm::mat4& transform = transforms[i];
+        transform = glm::mat4_cast(rotation);
+        transform[0] *= scale.x;
+        transform[1] *= scale.y;
+        transform[2] *= scale.z;
+        transform[3] = glm::vec4(translation, 1.0f);
+    }
+}
+
 std::vector<glm::mat4> J3DAnimation::J3DJointAnimationInstance::GetTransformsAtFrame(float deltaTime) {
     std::vector<glm::mat4> transforms;
+    GetTransformsAtFrame(deltaTime, transforms);
+
+    return transforms;
+}
+
+void J3DAnimation::J3DJointAnimationInstance::GetTransformsAtFrame(float deltaTime, std::vector<glm::mat4>& transforms, const std::vector<bool>* skip) {
     float frameTime = GetFrame();
 
-    transforms.reserve(mEntries.size());
+    if (mClip->IsBaked()) {
+        GetBakedTransformsAtFrame(frameTime, transforms, skip);
+        return;
+    }
+
+    std::lock_guard<std::mutex> lock(mEvaluationLock);
 
-    for (const J3DJointAnimationData& j : mEntries) {
-        glm::vec3 translation = glm::vec3(j.TranslationX.GetValue(frameTime), j.TranslationY.GetValue(frameTime), j.TranslationZ.GetValue(frameTime));
-        glm::vec3 scale = glm::vec3(j.ScaleX.GetValue(frameTime), j.ScaleY.GetValue(frameTime), j.ScaleZ.GetValue(frameTime));
-        glm::vec3 eulerRotation = glm::vec3(
-            glm::radians(j.RotationX.GetValue(frameTime)),
-            glm::radians(j.RotationY.GetValue(frameTime)),
-            glm::radians(j.RotationZ.GetValue(frameTime))
-        );
+    const J3DPackedHermiteTracks& packed = mClip->PackedTracks;
+    const std::vector<uint32_t>& animatedChannels = mClip->AnimatedChannels;
+    size_t animatedCount = animatedChannels.size();
 
-        glm::quat rotation = glm::angleAxis(eulerRotation.z, glm::vec3(0.0f, 0.0f, 1.0f)) *
-                             glm::angleAxis(eulerRotation.y, glm::vec3(0.0f, 1.0f, 0.0f)) *
-                             glm::angleAxis(eulerRotation.x, glm::vec3(1.0f, 0.0f, 0.0f));
+    // Find every animated channel's current segment, then evaluate all of them in one batch.
+    for (size_t i = 0; i < animatedCount; i++) {
+        uint32_t c = animatedChannels[i];
+        packed.GetSegment(c, frameTime, mTrackCursors[c], mSegmentP0[i], mSegmentP1[i], mSegmentM0[i], mSegmentM1[i], mSegmentT[i]);
+    }
 
+    EvaluateHermiteSegments(mSegmentP0.data(), mSegmentP1.data(), mSegmentM0.data(), mSegmentM1.data(), mSegmentT.data(), mAnimatedValues.data(), animatedCount);
 
-        transforms.push_back(glm::translate(translation) * glm::toMat4(rotation) * glm::scale(scale));
+    for (size_t i = 0; i < animatedCount; i++) {
+        mChannelValues[animatedChannels[i]] = mAnimatedValues[i];
     }
 
-    return transforms;
+    transforms.resize(mClip->JointCount);
+
+    for (size_t i = 0; i < mClip->JointCount; i++) {
+        if (skip != nullptr && (*skip)[i]) {
+            continue;
+        }
+
+        if (mClip->StaticJoints[i]) {
+            transforms[i] = mClip->StaticTransforms[i];
+            continue;
+        }
+
+        const float* v = &mChannelValues[i * 9];
+
+        transforms[i] = J3DUtility::ComposeTransform(glm::vec3(v[0], v[1], v[2]), glm::vec3(v[6], v[7], v[8]), glm::vec3(v[3], v[4], v[5]));
+    }
 }
\ No newline at end of file
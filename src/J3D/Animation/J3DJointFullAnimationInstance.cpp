@@ -1,38 +1,76 @@
 #include "J3D/Animation/J3DJointFullAnimationInstance.hpp"
-#include "J3D/Animation/J3DAnimationKey.hpp"
+#include "J3D/Util/J3DTransform.hpp"
 
 #include <glm/ext.hpp>
 #include <glm/gtx/quaternion.hpp>
 #include <glm/gtc/matrix_transform.hpp>
 #include <glm/gtx/transform.hpp>
 
+#include <algorithm>
 
-J3DAnimation::J3DJointFullAnimationInstance::J3DJointFullAnimationInstance() {
 
+J3DAnimation::J3DJointFullAnimationInstance::J3DJointFullAnimationInstance() : mClip(std::make_shared<J3DJointFullAnimationClip>()) {
+
+}
+
+J3DAnimation::J3DJointFullAnimationInstance::J3DJointFullAnimationInstance(std::shared_ptr<const J3DJointFullAnimationClip> clip) {
+    SetClip(clip);
+}
+
+void J3DAnimation::J3DJointFullAnimationInstance::SetClip(std::shared_ptr<const J3DJointFullAnimationClip> clip) {
+    mClip = clip;
+    SetClipInfo(*mClip);
+}
+
+void J3DAnimation::J3DJointFullAnimationClip::AnalyzeChannels() {
+    StaticJoints.assign(Entries.size(), false);
+    StaticTransforms.assign(Entries.size(), glm::identity<glm::mat4>());
+    StaticJointCount = 0;
+    ConstantChannelCount = 0;
+
+    for (size_t i = 0; i < Entries.size(); i++) {
+        J3DJointFullAnimationData& j = Entries[i];
+
+        uint32_t constantTracks = 0;
+        auto fold = [&constantTracks](auto& track) {
+            track.Fold();
+            if (track.GetFrameCount() <= 1) {
+                constantTracks++;
+            }
+        };
+
+        fold(j.ScaleX); fold(j.ScaleY); fold(j.ScaleZ);
+        fold(j.RotationX); fold(j.RotationY); fold(j.RotationZ);
+        fold(j.TranslationX); fold(j.TranslationY); fold(j.TranslationZ);
+
+        ConstantChannelCount += constantTracks;
+
+        if (constantTracks == 9) {
+            StaticJoints[i] = true;
+            StaticTransforms[i] = J3DUtility::ComposeTransform(
+                glm::vec3(j.TranslationX.GetValue(0, 0.0f), j.TranslationY.GetValue(0, 0.0f), j.TranslationZ.GetValue(0, 0.0f)),
+                glm::vec3(j.RotationX.GetValue(0, 0.0f), j.RotationY.GetValue(0, 0.0f), j.RotationZ.GetValue(0, 0.0f)),
+                glm::vec3(j.ScaleX.GetValue(0, 0.0f), j.ScaleY.GetValue(0, 0.0f), j.ScaleZ.GetValue(0, 0.0f))
+            );
+            StaticJointCount++;
+        }
+    }
+}
+
+std::shared_ptr<J3DAnimation::J3DAnimationInstance> J3DAnimation::J3DJointFullAnimationInstance::Clone() const {
+    return std::make_shared<J3DJointFullAnimationInstance>(mClip);
 }
 
-void J3DAnimation::J3DJointFullAnimationInstance::ReadFloatComponentTrack(bStream::CStream& stream, J3DDiscreteAnimationTrack& track, uint32_t valueTableOffset) {
+void J3DAnimation::J3DJointFullAnimationInstance::ReadFloatComponentTrack(bStream::CStream& stream, J3DFullFrameAnimationTrack<float>& track, uint32_t valueTableOffset) {
     uint16_t keyCount = stream.readUInt16();
     uint16_t firstKeyIndex = stream.readUInt16();
 
     size_t currentStreamPos = stream.tell();
     stream.seek(valueTableOffset + firstKeyIndex * sizeof(float));
 
-    if (keyCount == 1) {
-        J3DAnimationKey newKey;
-        newKey.Value = stream.readFloat();
-
-        track.AddKey(newKey);
-    }
-    else {
-        for (uint16_t i = 0; i < keyCount; i++) {
-            J3DAnimationKey newKey;
-
-            //newKey.Time = stream.readFloat();
-            newKey.Value = stream.readFloat();
-
-            track.AddKey(newKey);
-        }
+    track.Reserve(keyCount);
+    for (uint16_t i = 0; i < keyCount; i++) {
+        track.AddValue(stream.readFloat());
     }
 
     stream.seek(currentStreamPos);
@@ -40,7 +78,7 @@ void J3DAnimation::J3DJointFullAnimationInstance::ReadFloatComponentTrack(bStrea
 
 void J3DAnimation::J3DJointFullAnimationInstance::ReadRotationComponentTrack(
     bStream::CStream& stream,
-    J3DDiscreteAnimationTrack& track,
+    J3DFullFrameAnimationTrack<int16_t>& track,
     uint32_t valueTableOffset, float scale
 ) {
     uint16_t keyCount = stream.readUInt16();
@@ -49,21 +87,10 @@ void J3DAnimation::J3DJointFullAnimationInstance::ReadRotationComponentTrack(
     size_t currentStreamPos = stream.tell();
     stream.seek(valueTableOffset + firstKeyIndex * sizeof(uint16_t));
 
-    if (keyCount == 1) {
-        J3DAnimationKey newKey;
-        newKey.Value = static_cast<float>(stream.readInt16()) * scale;
-
-        track.AddKey(newKey);
-    }
-    else {
-        for (uint16_t i = 0; i < keyCount; i++) {
-            J3DAnimationKey newKey;
-
-            //newKey.Time = static_cast<float>(stream.readInt16());
-            newKey.Value = static_cast<float>(stream.readInt16()) * scale;
-
-            track.AddKey(newKey);
-        }
+    track.SetValueScale(scale);
+    track.Reserve(keyCount);
+    for (uint16_t i = 0; i < keyCount; i++) {
+        track.AddValue(stream.readInt16());
     }
 
     stream.seek(currentStreamPos);
@@ -71,19 +98,20 @@ void J3DAnimation::J3DJointFullAnimationInstance::ReadRotationComponentTrack(
 
 void J3DAnimation::J3DJointFullAnimationInstance::Deserialize(bStream::CStream& stream) {
     size_t currentStreamPos = stream.tell();
+    std::shared_ptr<J3DJointFullAnimationClip> clip = std::make_shared<J3DJointFullAnimationClip>();
 
     // Deserialize counts and offsets from the block
     J3DJointFullBlock jointFullBlock;
     jointFullBlock.Deserialize(&stream);
 
-    mLength = jointFullBlock.Length;
-    mLoopMode = static_cast<ELoopMode>(jointFullBlock.LoopMode);
+    clip->Length = jointFullBlock.Length;
+    clip->LoopMode = static_cast<ELoopMode>(jointFullBlock.LoopMode);
 
     size_t fullTrackCount = jointFullBlock.TrackCount;
 
     float rotationScale = (180.0f / 32768.0f);
 
-    mEntries.reserve(fullTrackCount);
+    clip->Entries.reserve(fullTrackCount);
 
     stream.seek(jointFullBlock.TrackTableOffset);
     for (int i = 0; i < fullTrackCount; i++) {
@@ -102,34 +130,48 @@ void J3DAnimation::J3DJointFullAnimationInstance::Deserialize(bStream::CStream&
         ReadRotationComponentTrack(stream, animData.RotationZ, jointFullBlock.RotationTableOffset, rotationScale);
         ReadFloatComponentTrack(stream, animData.TranslationZ, jointFullBlock.TranslationTableOffset);
 
-        mEntries.push_back(animData);
+        clip->Entries.push_back(animData);
     }
 
+    clip->AnalyzeChannels();
+
+    SetClip(clip);
+
     stream.seek(currentStreamPos + jointFullBlock.BlockSize);
 }
 
 std::vector<glm::mat4> J3DAnimation::J3DJointFullAnimationInstance::GetTransformsAtFrame(float deltaTime) {
     std::vector<glm::mat4> transforms;
+    GetTransformsAtFrame(deltaTime, transforms);
+
+    return transforms;
+}
+
+void J3DAnimation::J3DJointFullAnimationInstance::GetTransformsAtFrame(float deltaTime, std::vector<glm::mat4>& transforms, const std::vector<bool>* skip) {
     float frameTime = GetFrame();
 
-    transforms.reserve(mEntries.size());
+    // Every track shares the clip's frame rate, so the frame and blend are found once for all of them.
+    frameTime = std::max(frameTime, 0.0f);
+    uint32_t frame = static_cast<uint32_t>(frameTime);
+    float blend = frameTime - (float)frame;
+
+    transforms.resize(mClip->Entries.size());
 
-    for (const J3DJointFullAnimationData& j : mEntries) {
-        glm::vec3 translation = glm::vec3(j.TranslationX.GetValue(frameTime), j.TranslationY.GetValue(frameTime), j.TranslationZ.GetValue(frameTime));
-        glm::vec3 scale = glm::vec3(j.ScaleX.GetValue(frameTime), j.ScaleY.GetValue(frameTime), j.ScaleZ.GetValue(frameTime));
-        glm::vec3 eulerRotation = glm::vec3(
-            glm::radians(j.RotationX.GetValue(frameTime)),
-            glm::radians(j.RotationY.GetValue(frameTime)),
-            glm::radians(j.RotationZ.GetValue(frameTime))
-        );
+    for (size_t i = 0; i < mClip->Entries.size(); i++) {
+        if (skip != nullptr && (*skip)[i]) {
+            continue;
+        }
 
-        glm::quat rotation = glm::angleAxis(eulerRotation.z, glm::vec3(0.0f, 0.0f, 1.0f)) *
-            glm::angleAxis(eulerRotation.y, glm::vec3(0.0f, 1.0f, 0.0f)) *
-            glm::angleAxis(eulerRotation.x, glm::vec3(1.0f, 0.0f, 0.0f));
+        if (mClip->StaticJoints[i]) {
+            transforms[i] = mClip->StaticTransforms[i];
+            continue;
+        }
 
+        const J3DJointFullAnimationData& j = mClip->Entries[i];
+        glm::vec3 translation = glm::vec3(j.TranslationX.GetValue(frame, blend), j.TranslationY.GetValue(frame, blend), j.TranslationZ.GetValue(frame, blend));
+        glm::vec3 scale = glm::vec3(j.ScaleX.GetValue(frame, blend), j.ScaleY.GetValue(frame, blend), j.ScaleZ.GetValue(frame, blend));
+        glm::vec3 rotation = glm::vec3(j.RotationX.GetValue(frame, blend), j.RotationY.GetValue(frame, blend), j.RotationZ.GetValue(frame, blend));
 
-        transforms.push_back(glm::translate(translation) * glm::toMat4(rotation) * glm::scale(scale));
+        transforms[i] = J3DUtility::ComposeTransform(translation, rotation, scale);
     }
-
-    return transforms;
 }
\ No newline at end of file
@@ -0,0 +1,193 @@
+#include "J3D/Animation/J3DPoseCache.hpp"
+#include "J3D/Animation/J3DAnimationInstance.hpp"
+#include "J3D/Data/J3DModelData.hpp"
+
+#include <cstring>
+#include <functional>
+#include <mutex>
+#include <utility>
+#include <vector>
+
+namespace J3DPoseCache {
+    namespace {
+        struct J3DPoseKey {
+            const J3DAnimation::J3DAnimationClip* Clip;
+            // The model's unique ID rather than its address, which a later model may reuse.
+            uint64_t ModelId;
+            // The bits of the sampled frame, so that only exactly matching frames share a pose.
+            uint32_t Frame;
+
+            bool operator==(const J3DPoseKey& other) const {
+                return Clip == other.Clip && ModelId == other.ModelId && Frame == other.Frame;
+            }
+        };
+
+        struct J3DPoseKeyHash {
+            size_t operator()(const J3DPoseKey& key) const {
+                size_t hash = std::hash<const void*>()(key.Clip);
+                hash ^= std::hash<uint64_t>()(key.ModelId) + 0x9E3779B9 + (hash << 6) + (hash >> 2);
+                hash ^= std::hash<uint32_t>()(key.Frame) + 0x9E3779B9 + (hash << 6) + (hash >> 2);
+
+                return hash;
+            }
+        };
+
+        struct J3DPoseCacheEntry {
+            J3DPoseKey Key;
+            // Keeps the clip alive while its address is used as part of the key.
+            std::shared_ptr<const J3DAnimation::J3DAnimationClip> Clip;
+            Pose CachedPose;
+        };
+
+        // Open-addressed table with linear probing. Its size is a power of two, and clearing it keeps the storage,
+        // so storing poses every frame doesn't allocate once the table has grown large enough.
+        struct J3DPoseCacheShard {
+            std::mutex Mutex;
+            std::vector<J3DPoseCacheEntry> Slots;
+            uint32_t PoseCount = 0;
+            uint32_t HitCount = 0;
+        };
+
+        // Instances are posed on several threads at once, so keys are spread over shards that each have their own lock,
+        // and instances posing different models or clips rarely wait on each other.
+        constexpr uint32_t SHARD_COUNT = 16;
+        constexpr uint32_t MAX_SHARD_POSE_COUNT = MAX_POSE_COUNT / SHARD_COUNT;
+
+        J3DPoseCacheShard mShards[SHARD_COUNT];
+        bool bEnabled = true;
+
+        J3DPoseKey MakeKey(const std::shared_ptr<const J3DAnimation::J3DAnimationClip>& clip, const J3DModelData* modelData, float frame) {
+            J3DPoseKey key { clip.get(), modelData->GetUniqueId(), 0 };
+            std::memcpy(&key.Frame, &frame, sizeof(float));
+
+            return key;
+        }
+
+        // The shard is picked by bits of the hash above the ones that pick a slot in small tables.
+        J3DPoseCacheShard& GetShard(const J3DPoseKey& key) {
+            return mShards[(J3DPoseKeyHash()(key) >> 16) % SHARD_COUNT];
+        }
+
+        // Returns the slot holding the key, or the empty slot where it would be inserted.
+        J3DPoseCacheEntry& FindSlot(J3DPoseCacheShard& shard, const J3DPoseKey& key) {
+            size_t mask = shard.Slots.size() - 1;
+
+            for (size_t i = J3DPoseKeyHash()(key) & mask; ; i = (i + 1) & mask) {
+                if (shard.Slots[i].CachedPose == nullptr || shard.Slots[i].Key == key) {
+                    return shard.Slots[i];
+                }
+            }
+        }
+
+        void Grow(J3DPoseCacheShard& shard) {
+            std::vector<J3DPoseCacheEntry> oldSlots = std::move(shard.Slots);
+            shard.Slots = std::vector<J3DPoseCacheEntry>(oldSlots.empty() ? 16 : oldSlots.size() * 2);
+
+            for (J3DPoseCacheEntry& entry : oldSlots) {
+                if (entry.CachedPose != nullptr) {
+                    FindSlot(shard, entry.Key) = std::move(entry);
+                }
+            }
+        }
+
+        void ClearShard(J3DPoseCacheShard& shard) {
+            if (shard.PoseCount != 0) {
+                for (J3DPoseCacheEntry& entry : shard.Slots) {
+                    entry = J3DPoseCacheEntry();
+                }
+            }
+
+            shard.PoseCount = 0;
+            shard.HitCount = 0;
+        }
+    }
+}
+
+J3DPoseCache::Pose J3DPoseCache::Find(const std::shared_ptr<const J3DAnimation::J3DAnimationClip>& clip, const J3DModelData* modelData, float frame) {
+    if (!bEnabled || clip == nullptr || modelData == nullptr) {
+        return nullptr;
+    }
+
+    J3DPoseKey key = MakeKey(clip, modelData, frame);
+    J3DPoseCacheShard& shard = GetShard(key);
+    std::lock_guard<std::mutex> lock(shard.Mutex);
+
+    if (shard.PoseCount == 0) {
+        return nullptr;
+    }
+
+    J3DPoseCacheEntry& entry = FindSlot(shard, key);
+    if (entry.CachedPose == nullptr) {
+        return nullptr;
+    }
+
+    shard.HitCount++;
+    return entry.CachedPose;
+}
+
+void J3DPoseCache::Store(const std::shared_ptr<const J3DAnimation::J3DAnimationClip>& clip, const J3DModelData* modelData, float frame, Pose pose) {
+    if (!bEnabled || clip == nullptr || modelData == nullptr || pose == nullptr) {
+        return;
+    }
+
+    J3DPoseKey key = MakeKey(clip, modelData, frame);
+    J3DPoseCacheShard& shard = GetShard(key);
+    std::lock_guard<std::mutex> lock(shard.Mutex);
+
+    // Bound the cache for renderers that never clear it. Poses from earlier frames are stale anyway.
+    if (shard.PoseCount >= MAX_SHARD_POSE_COUNT) {
+        ClearShard(shard);
+    }
+
+    // Keep the table at most half full, so probes stay short.
+    if ((shard.PoseCount + 1) * 2 > shard.Slots.size()) {
+        Grow(shard);
+    }
+
+    J3DPoseCacheEntry& entry = FindSlot(shard, key);
+
+    if (entry.CachedPose == nullptr) {
+        shard.PoseCount++;
+    }
+
+    entry = { key, clip, pose };
+}
+
+void J3DPoseCache::SetEnabled(bool enabled) {
+    bEnabled = enabled;
+
+    if (!bEnabled) {
+        Clear();
+    }
+}
+
+bool J3DPoseCache::GetEnabled() {
+    return bEnabled;
+}
+
+uint32_t J3DPoseCache::GetPoseCount() {
+    uint32_t poseCount = 0;
+    for (J3DPoseCacheShard& shard : mShards) {
+        std::lock_guard<std::mutex> lock(shard.Mutex);
+        poseCount += shard.PoseCount;
+    }
+
+    return poseCount;
+}
+
+uint32_t J3DPoseCache::GetHitCount() {
+    uint32_t hitCount = 0;
+    for (J3DPoseCacheShard& shard : mShards) {
+        std::lock_guard<std::mutex> lock(shard.Mutex);
+        hitCount += shard.HitCount;
+    }
+
+    return hitCount;
+}
+
+void J3DPoseCache::Clear() {
+    for (J3DPoseCacheShard& shard : mShards) {
+        std::lock_guard<std::mutex> lock(shard.Mutex);
+        ClearShard(shard);
+    }
+}
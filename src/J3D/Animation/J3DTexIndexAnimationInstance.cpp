@@ -8,26 +8,40 @@
 #include <memory>
 #include <algorithm>
 
-J3DAnimation::J3DTexIndexAnimationInstance::J3DTexIndexAnimationInstance() {
+J3DAnimation::J3DTexIndexAnimationInstance::J3DTexIndexAnimationInstance() : mClip(std::make_shared<J3DTexIndexAnimationClip>()) {
 
 }
 
+J3DAnimation::J3DTexIndexAnimationInstance::J3DTexIndexAnimationInstance(std::shared_ptr<const J3DTexIndexAnimationClip> clip) {
+    SetClip(clip);
+}
+
+void J3DAnimation::J3DTexIndexAnimationInstance::SetClip(std::shared_ptr<const J3DTexIndexAnimationClip> clip) {
+    mClip = clip;
+    SetClipInfo(*mClip);
+}
+
+std::shared_ptr<J3DAnimation::J3DAnimationInstance> J3DAnimation::J3DTexIndexAnimationInstance::Clone() const {
+    return std::make_shared<J3DTexIndexAnimationInstance>(mClip);
+}
+
 void J3DAnimation::J3DTexIndexAnimationInstance::Deserialize(bStream::CStream& stream) {
     size_t currentStreamPos = stream.tell();
+    std::shared_ptr<J3DTexIndexAnimationClip> clip = std::make_shared<J3DTexIndexAnimationClip>();
 
     // Deserialize counts and offsets from the block
     J3DTexIndexKeyBlock indexKeyBlock;
     indexKeyBlock.Deserialize(&stream);
 
-    mLength = indexKeyBlock.Length;
-    mLoopMode = static_cast<ELoopMode>(indexKeyBlock.LoopMode);
+    clip->Length = indexKeyBlock.Length;
+    clip->LoopMode = static_cast<ELoopMode>(indexKeyBlock.LoopMode);
 
     // Deserialize the material names for register colors
     stream.seek(indexKeyBlock.MaterialNameTableOffset);
     J3DNameTable materialNames;
     materialNames.Deserialize(&stream);
 
-    mEntries.reserve(indexKeyBlock.TrackCount);
+    clip->Entries.reserve(indexKeyBlock.TrackCount);
     
     stream.seek(indexKeyBlock.TrackTableOffset);
     for (int i = 0; i < indexKeyBlock.TrackCount; i++) {
@@ -50,27 +64,26 @@ void J3DAnimation::J3DTexIndexAnimationInstance::Deserialize(bStream::CStream& s
             animData.Track.AddKey(newKey);
         }
 
-        mEntries.push_back(animData);
+        clip->Entries.push_back(animData);
         stream.seek(currentStreamPos);
     }
 
+    SetClip(clip);
+
     stream.seek(currentStreamPos + indexKeyBlock.BlockSize);
 }
 
-void J3DAnimation::J3DTexIndexAnimationInstance::ApplyAnimation(std::shared_ptr<J3DMaterial> material) {
-    std::vector<J3DAnimation::J3DTexIndexAnimationData>::const_iterator matFindResult = std::find_if(
-        mEntries.begin(),
-        mEntries.end(),
-        [&material](const J3DAnimation::J3DTexIndexAnimationData& v) { return v.MaterialName == material->Name; }
-    );
+void J3DAnimation::J3DTexIndexAnimationInstance::Bind(const shared_vector<J3DMaterial>& materials, J3DMaterialBinding& binding) const {
+    binding.Resolve(materials, mClip->Entries, true);
+}
 
-    if (matFindResult == mEntries.end()) {
-        return;
-    }
+void J3DAnimation::J3DTexIndexAnimationInstance::ApplyAnimation(std::shared_ptr<J3DMaterial> material, uint32_t materialIndex, const J3DMaterialBinding& binding) {
+    float frameTime = GetFrame();
 
-    material->AreTexIndicesAnimating = true;
+    for (const uint32_t* it = binding.EntriesBegin(materialIndex); it != binding.EntriesEnd(materialIndex); it++) {
+        material->AreTexIndicesAnimating = true;
 
-    J3DAnimation::J3DTexIndexAnimationData data = *matFindResult;
-    //material->AnimationTexIndices[i] = material->TevBlock->mTextureIndices[i];
-    material->AnimationTexIndices[data.TextureSlotIndex] = (uint16_t)data.Track.GetValue(GetFrame());
+        const J3DAnimation::J3DTexIndexAnimationData& data = mClip->Entries[*it];
+        material->AnimationTexIndices[data.TextureSlotIndex] = (uint16_t)data.Track.GetValue(frameTime);
+    }
 }
@@ -8,10 +8,24 @@
 #include <memory>
 #include <algorithm>
 
-J3DAnimation::J3DTexMatrixAnimationInstance::J3DTexMatrixAnimationInstance() {
+J3DAnimation::J3DTexMatrixAnimationInstance::J3DTexMatrixAnimationInstance() : mClip(std::make_shared<J3DTexMatrixAnimationClip>()) {
 
 }
 
+J3DAnimation::J3DTexMatrixAnimationInstance::J3DTexMatrixAnimationInstance(std::shared_ptr<const J3DTexMatrixAnimationClip> clip) {
+    SetClip(clip);
+}
+
+void J3DAnimation::J3DTexMatrixAnimationInstance::SetClip(std::shared_ptr<const J3DTexMatrixAnimationClip> clip) {
+    mClip = clip;
+    SetClipInfo(*mClip);
+    mTrackCursors.assign(mClip->Entries.size() * 9, 0);
+}
+
+std::shared_ptr<J3DAnimation::J3DAnimationInstance> J3DAnimation::J3DTexMatrixAnimationInstance::Clone() const {
+    return std::make_shared<J3DTexMatrixAnimationInstance>(mClip);
+}
+
 void J3DAnimation::J3DTexMatrixAnimationInstance::ReadFloatComponentTrack(bStream::CStream& stream, J3DHermiteAnimationTrack& track, uint32_t valueTableOffset) {
     uint16_t keyCount = stream.readUInt16();
     uint16_t firstKeyIndex = stream.readUInt16();
@@ -102,13 +116,14 @@ void J3DAnimation::J3DTexMatrixAnimationInstance::ReadRotationComponentTrack(
 
 void J3DAnimation::J3DTexMatrixAnimationInstance::Deserialize(bStream::CStream& stream) {
     size_t currentStreamPos = stream.tell();
+    std::shared_ptr<J3DTexMatrixAnimationClip> clip = std::make_shared<J3DTexMatrixAnimationClip>();
 
     // Deserialize counts and offsets from the block
     J3DTexMatrixKeyBlock matrixKeyBlock;
     matrixKeyBlock.Deserialize(&stream);
 
-    mLength = matrixKeyBlock.Length;
-    mLoopMode = static_cast<ELoopMode>(matrixKeyBlock.LoopMode);
+    clip->Length = matrixKeyBlock.Length;
+    clip->LoopMode = static_cast<ELoopMode>(matrixKeyBlock.LoopMode);
 
     size_t fullTrackCount = matrixKeyBlock.TrackCount / 3;
 
@@ -137,7 +152,7 @@ void J3DAnimation::J3DTexMatrixAnimationInstance::Deserialize(bStream::CStream&
 
     float rotationScale = (1 << matrixKeyBlock.RotationFraction) * (180.0f / 32768.0f);
 
-    mEntries.reserve(fullTrackCount);
+    clip->Entries.reserve(fullTrackCount);
 
     stream.seek(matrixKeyBlock.TrackTableOffset);
     for (int i = 0; i < fullTrackCount; i++) {
@@ -158,14 +173,20 @@ void J3DAnimation::J3DTexMatrixAnimationInstance::Deserialize(bStream::CStream&
         ReadRotationComponentTrack(stream, animData.RotationQ, matrixKeyBlock.RotationTableOffset, rotationScale);
         ReadFloatComponentTrack(stream, animData.TranslationQ, matrixKeyBlock.TranslationTableOffset);
 
-        mEntries.push_back(animData);
+        clip->Entries.push_back(animData);
     }
 
+    SetClip(clip);
+
     stream.seek(currentStreamPos + matrixKeyBlock.BlockSize);
 }
 
-void J3DAnimation::J3DTexMatrixAnimationInstance::ApplyAnimation(std::shared_ptr<J3DMaterial> material) {
-    auto texMatrices = material->TexGenBlock.mTexMatrix;
+void J3DAnimation::J3DTexMatrixAnimationInstance::Bind(const shared_vector<J3DMaterial>& materials, J3DMaterialBinding& binding) const {
+    binding.Resolve(materials, mClip->Entries, false);
+}
+
+void J3DAnimation::J3DTexMatrixAnimationInstance::ApplyAnimation(std::shared_ptr<J3DMaterial> material, uint32_t materialIndex, const J3DMaterialBinding& binding) {
+    const auto& texMatrices = material->TexGenBlock.mTexMatrix;
 
     for (int i = 0; i < texMatrices.size(); i++) {
         material->AnimationTexMatrixInfo[i] = *texMatrices[i];
@@ -173,24 +194,23 @@ void J3DAnimation::J3DTexMatrixAnimationInstance::ApplyAnimation(std::shared_ptr
 
     float frameTime = GetFrame();
 
-    for (auto t : mEntries) {
-        if (t.MaterialName != material->Name) {
-            continue;
-        }
+    for (const uint32_t* it = binding.EntriesBegin(materialIndex); it != binding.EntriesEnd(materialIndex); it++) {
+        const J3DTexMatrixAnimationData& t = mClip->Entries[*it];
+        uint32_t* cursors = &mTrackCursors[*it * 9];
 
-        std::shared_ptr<J3DTexMatrixInfo> texMat = material->TexGenBlock.mTexMatrix[t.TexGenIndex];
+        const std::shared_ptr<J3DTexMatrixInfo>& texMat = texMatrices[t.TexGenIndex];
 
         texMat->Origin = t.Origin;
 
         texMat->Transform.Translation = glm::vec3(
-            t.TranslationS.GetValue(frameTime),
-            t.TranslationT.GetValue(frameTime),
-            t.TranslationQ.GetValue(frameTime)
+            t.TranslationS.GetValue(frameTime, cursors[0]),
+            t.TranslationT.GetValue(frameTime, cursors[1]),
+            t.TranslationQ.GetValue(frameTime, cursors[2])
         );
         texMat->Transform.Scale = glm::vec3(
-            t.ScaleS.GetValue(frameTime),
-            t.ScaleT.GetValue(frameTime),
-            t.ScaleQ.GetValue(frameTime)
+            t.ScaleS.GetValue(frameTime, cursors[3]),
+            t.ScaleT.GetValue(frameTime, cursors[4]),
+            t.ScaleQ.GetValue(frameTime, cursors[5])
         );
         //texMat.Transform.Rotation = glm::vec3(
         //);
@@ -1,10 +1,23 @@
 #include "J3D/Animation/J3DVisibilityAnimationInstance.hpp"
 #include "J3D/Animation/J3DAnimationKey.hpp"
 
-J3DAnimation::J3DVisibilityAnimationInstance::J3DVisibilityAnimationInstance() {
+J3DAnimation::J3DVisibilityAnimationInstance::J3DVisibilityAnimationInstance() : mClip(std::make_shared<J3DVisibilityAnimationClip>()) {
 
 }
 
+J3DAnimation::J3DVisibilityAnimationInstance::J3DVisibilityAnimationInstance(std::shared_ptr<const J3DVisibilityAnimationClip> clip) {
+    SetClip(clip);
+}
+
+void J3DAnimation::J3DVisibilityAnimationInstance::SetClip(std::shared_ptr<const J3DVisibilityAnimationClip> clip) {
+    mClip = clip;
+    SetClipInfo(*mClip);
+}
+
+std::shared_ptr<J3DAnimation::J3DAnimationInstance> J3DAnimation::J3DVisibilityAnimationInstance::Clone() const {
+    return std::make_shared<J3DVisibilityAnimationInstance>(mClip);
+}
+
 void J3DAnimation::J3DVisibilityAnimationInstance::ReadBooleanComponentTrack(
     bStream::CStream& stream, J3DDiscreteAnimationTrack& track, uint32_t valueTableOffset)
 {
@@ -27,17 +40,18 @@ void J3DAnimation::J3DVisibilityAnimationInstance::ReadBooleanComponentTrack(
 
 void J3DAnimation::J3DVisibilityAnimationInstance::Deserialize(bStream::CStream& stream) {
     size_t currentStreamPos = stream.tell();
+    std::shared_ptr<J3DVisibilityAnimationClip> clip = std::make_shared<J3DVisibilityAnimationClip>();
 
     // Deserialize counts and offsets from the block
     J3DVisibilityBlock visBlock;
     visBlock.Deserialize(&stream);
 
-    mLength = visBlock.Length;
-    mLoopMode = static_cast<ELoopMode>(visBlock.LoopMode);
+    clip->Length = visBlock.Length;
+    clip->LoopMode = static_cast<ELoopMode>(visBlock.LoopMode);
 
     size_t fullTrackCount = visBlock.TrackCount;
 
-    mEntries.reserve(fullTrackCount);
+    clip->Entries.reserve(fullTrackCount);
 
     stream.seek(visBlock.TrackTableOffset);
     for (int i = 0; i < fullTrackCount; i++) {
@@ -46,17 +60,19 @@ void J3DAnimation::J3DVisibilityAnimationInstance::Deserialize(bStream::CStream&
 
         ReadBooleanComponentTrack(stream, animData.Visibility, visBlock.BooleanTableOffset);
 
-        mEntries.push_back(animData);
+        clip->Entries.push_back(animData);
     }
 
+    SetClip(clip);
+
     stream.seek(currentStreamPos + visBlock.BlockSize);
 }
 
 bool J3DAnimation::J3DVisibilityAnimationInstance::GetVisibilityAtFrame(uint32_t shapeIdx, float deltaTime) {
-    if (shapeIdx >= mEntries.size()) {
+    if (shapeIdx >= mClip->Entries.size()) {
         return true;
     }
 
     float frameTime = GetFrame();
-    return static_cast<bool>(mEntries[shapeIdx].Visibility.GetValue(frameTime));
+    return static_cast<bool>(mClip->Entries[shapeIdx].Visibility.GetValue(frameTime));
 }
@@ -0,0 +1,344 @@
+#include "J3D/Archive/J3DArchive.hpp"
+#include "J3D/Archive/J3DYaz0.hpp"
+
+#include "J3D/J3DModelLoader.hpp"
+#include "J3D/Data/J3DModelData.hpp"
+#include "J3D/Material/J3DMaterialTableLoader.hpp"
+#include "J3D/Animation/J3DAnimationLoader.hpp"
+#include "J3D/Animation/J3DAnimationInstance.hpp"
+#include "J3D/Util/J3DUtil.hpp"
+
+#include <bstream.h>
+
+#include <algorithm>
+#include <cctype>
+#include <cstring>
+#include <future>
+#include <iostream>
+#include <thread>
+
+namespace {
+    constexpr uint32_t RARC_MAGIC = 0x52415243; // RARC
+    constexpr uint32_t RARC_HEADER_SIZE = 0x20;
+    constexpr uint32_t RARC_INFO_SIZE = 0x20;
+    constexpr uint32_t RARC_DIRECTORY_SIZE = 0x10;
+    constexpr uint32_t RARC_FILE_ENTRY_SIZE = 0x14;
+
+    constexpr uint8_t RARC_FLAG_FILE = 0x01;
+    constexpr uint8_t RARC_FLAG_DIRECTORY = 0x02;
+    constexpr uint8_t RARC_FLAG_COMPRESSED = 0x04;
+    constexpr uint8_t RARC_FLAG_YAZ0 = 0x80;
+
+    // Lowercases the path and strips leading slashes so that lookups are case- and separator-insensitive.
+    std::string NormalizePath(const std::string& path) {
+        std::string normalized;
+        normalized.reserve(path.size());
+
+        for (char c : path) {
+            if (c == '\\') {
+                c = '/';
+            }
+
+            if (c == '/' && normalized.empty()) {
+                continue;
+            }
+
+            normalized.push_back(static_cast<char>(std::tolower(static_cast<unsigned char>(c))));
+        }
+
+        return normalized;
+    }
+
+    std::string ReadString(const std::vector<uint8_t>& data, size_t offset) {
+        if (offset >= data.size()) {
+            return "";
+        }
+
+        const char* str = reinterpret_cast<const char*>(data.data() + offset);
+        return std::string(str, strnlen(str, data.size() - offset));
+    }
+}
+
+bool J3DArchive::Open(std::filesystem::path filePath) {
+    std::vector<uint8_t> fileData;
+    if (!J3DUtility::LoadBinaryFile(filePath, fileData)) {
+        return false;
+    }
+
+    return Open(std::move(fileData));
+}
+
+bool J3DArchive::Open(std::vector<uint8_t>&& archiveData) {
+    mEntries.clear();
+    mEntryIndex.clear();
+    mRootName.clear();
+
+    if (J3DYaz0::IsCompressed(archiveData.data(), archiveData.size())) {
+        if (!J3DYaz0::Decompress(archiveData.data(), archiveData.size(), mArchiveData)) {
+            std::cout << "Failed to decompress Yaz0 archive." << std::endl;
+            return false;
+        }
+    }
+    else {
+        mArchiveData = std::move(archiveData);
+    }
+
+    if (!ReadIndex()) {
+        std::cout << "Failed to read RARC archive index." << std::endl;
+
+        mEntries.clear();
+        mEntryIndex.clear();
+        mArchiveData.clear();
+
+        return false;
+    }
+
+    return true;
+}
+
+bool J3DArchive::ReadIndex() {
+    if (mArchiveData.size() < RARC_HEADER_SIZE + RARC_INFO_SIZE) {
+        return false;
+    }
+
+    bStream::CMemoryStream stream(mArchiveData.data(), mArchiveData.size(), bStream::Big, bStream::In);
+
+    if (stream.readUInt32() != RARC_MAGIC) {
+        return false;
+    }
+
+    stream.seek(0x0C);
+    uint32_t dataOffset = stream.readUInt32() + RARC_HEADER_SIZE;
+
+    stream.seek(RARC_HEADER_SIZE);
+    uint32_t dirCount = stream.readUInt32();
+    uint32_t dirOffset = stream.readUInt32() + RARC_HEADER_SIZE;
+    uint32_t fileEntryCount = stream.readUInt32();
+    uint32_t fileEntryOffset = stream.readUInt32() + RARC_HEADER_SIZE;
+    stream.skip(4);
+    uint32_t stringTableOffset = stream.readUInt32() + RARC_HEADER_SIZE;
+
+    if (dirCount == 0 ||
+        dirOffset + (size_t)dirCount * RARC_DIRECTORY_SIZE > mArchiveData.size() ||
+        fileEntryOffset + (size_t)fileEntryCount * RARC_FILE_ENTRY_SIZE > mArchiveData.size()) {
+        return false;
+    }
+
+    // Walk the directory tree from the root, building each file's full path as we go.
+    // The root's name is left out of the paths so that files can be found without knowing it.
+    std::vector<std::pair<uint32_t, std::string>> dirStack = { { 0, "" } };
+    std::vector<bool> visitedDirs(dirCount, false);
+
+    while (!dirStack.empty()) {
+        auto [dirIndex, dirPath] = dirStack.back();
+        dirStack.pop_back();
+
+        if (dirIndex >= dirCount || visitedDirs[dirIndex]) {
+            continue;
+        }
+        visitedDirs[dirIndex] = true;
+
+        stream.seek(dirOffset + dirIndex * RARC_DIRECTORY_SIZE + 4);
+        uint32_t dirNameOffset = stream.readUInt32();
+        stream.skip(2);
+        uint16_t dirFileCount = stream.readUInt16();
+        uint32_t dirFirstFile = stream.readUInt32();
+
+        if (dirIndex == 0) {
+            mRootName = ReadString(mArchiveData, stringTableOffset + dirNameOffset);
+        }
+
+        for (uint32_t i = 0; i < dirFileCount; i++) {
+            if (dirFirstFile + i >= fileEntryCount) {
+                return false;
+            }
+
+            stream.seek(fileEntryOffset + (dirFirstFile + i) * RARC_FILE_ENTRY_SIZE + 4);
+            uint32_t typeAndNameOffset = stream.readUInt32();
+            uint32_t entryDataOffset = stream.readUInt32();
+            uint32_t entryDataSize = stream.readUInt32();
+
+            uint8_t entryFlags = typeAndNameOffset >> 24;
+            std::string entryName = ReadString(mArchiveData, stringTableOffset + (typeAndNameOffset & 0x00FFFFFF));
+
+            if (entryFlags & RARC_FLAG_DIRECTORY) {
+                if (entryName != "." && entryName != "..") {
+                    dirStack.push_back({ entryDataOffset, dirPath + entryName + "/" });
+                }
+
+                continue;
+            }
+
+            if ((entryFlags & RARC_FLAG_FILE) == 0) {
+                continue;
+            }
+
+            if ((size_t)dataOffset + entryDataOffset + entryDataSize > mArchiveData.size()) {
+                return false;
+            }
+
+            std::unique_ptr<J3DArchiveEntry> entry = std::make_unique<J3DArchiveEntry>();
+            entry->Path = NormalizePath(dirPath + entryName);
+            entry->DataOffset = dataOffset + entryDataOffset;
+            entry->DataSize = entryDataSize;
+
+            // Yay0-compressed files aren't supported, but they're never used for J3D data.
+            entry->bCompressed = (entryFlags & RARC_FLAG_COMPRESSED) && (entryFlags & RARC_FLAG_YAZ0) &&
+                J3DYaz0::IsCompressed(mArchiveData.data() + entry->DataOffset, entry->DataSize);
+
+            mEntryIndex[entry->Path] = entry.get();
+            mEntries.push_back(std::move(entry));
+        }
+    }
+
+    return true;
+}
+
+J3DArchiveEntry* J3DArchive::FindEntry(const std::string& path) const {
+    std::string normalized = NormalizePath(path);
+
+    auto it = mEntryIndex.find(normalized);
+    if (it != mEntryIndex.end()) {
+        return it->second;
+    }
+
+    // Allow the path to start with the root directory's name.
+    std::string rootPrefix = NormalizePath(mRootName) + "/";
+    if (normalized.compare(0, rootPrefix.size(), rootPrefix) == 0) {
+        it = mEntryIndex.find(normalized.substr(rootPrefix.size()));
+        if (it != mEntryIndex.end()) {
+            return it->second;
+        }
+    }
+
+    return nullptr;
+}
+
+bool J3DArchive::GetEntryData(J3DArchiveEntry* entry, const uint8_t*& data, size_t& size) {
+    if (entry == nullptr) {
+        return false;
+    }
+
+    const uint8_t* entryData = mArchiveData.data() + entry->DataOffset;
+
+    if (!entry->bCompressed) {
+        data = entryData;
+        size = entry->DataSize;
+
+        return true;
+    }
+
+    std::call_once(entry->DecompressFlag, [entry, entryData]() {
+        entry->bDecompressed = J3DYaz0::Decompress(entryData, entry->DataSize, entry->DecompressedData);
+    });
+
+    if (!entry->bDecompressed) {
+        std::cout << "Failed to decompress archive file \"" << entry->Path << "\"." << std::endl;
+        return false;
+    }
+
+    data = entry->DecompressedData.data();
+    size = entry->DecompressedData.size();
+
+    return true;
+}
+
+std::vector<std::string> J3DArchive::GetFilePaths() const {
+    std::vector<std::string> paths;
+    paths.reserve(mEntries.size());
+
+    for (const std::unique_ptr<J3DArchiveEntry>& entry : mEntries) {
+        paths.push_back(entry->Path);
+    }
+
+    return paths;
+}
+
+bool J3DArchive::Contains(const std::string& path) const {
+    return FindEntry(path) != nullptr;
+}
+
+bool J3DArchive::GetFileData(const std::string& path, const uint8_t*& data, size_t& size) {
+    return GetEntryData(FindEntry(path), data, size);
+}
+
+void J3DArchive::Prefetch(const std::vector<std::string>& paths) {
+    std::vector<J3DArchiveEntry*> compressedEntries;
+
+    for (const std::string& path : paths) {
+        J3DArchiveEntry* entry = FindEntry(path);
+        if (entry != nullptr && entry->bCompressed) {
+            compressedEntries.push_back(entry);
+        }
+    }
+
+    if (compressedEntries.empty()) {
+        return;
+    }
+
+    // Split the entries between the available threads. Entries that are already decompressed,
+    // or are being decompressed by another thread, are handled by their once flag.
+    size_t threadCount = std::min<size_t>(std::max(1u, std::thread::hardware_concurrency()), compressedEntries.size());
+    std::vector<std::future<void>> tasks;
+    tasks.reserve(threadCount);
+
+    for (size_t t = 0; t < threadCount; t++) {
+        tasks.push_back(std::async(std::launch::async, [this, &compressedEntries, t, threadCount]() {
+            const uint8_t* data = nullptr;
+            size_t size = 0;
+
+            for (size_t i = t; i < compressedEntries.size(); i += threadCount) {
+                GetEntryData(compressedEntries[i], data, size);
+            }
+        }));
+    }
+
+    for (std::future<void>& task : tasks) {
+        task.wait();
+    }
+}
+
+void J3DArchive::PrefetchAll() {
+    Prefetch(GetFilePaths());
+}
+
+std::shared_ptr<J3DModelData> J3DArchive::LoadModel(const std::string& path, uint32_t flags) {
+    const uint8_t* data = nullptr;
+    size_t size = 0;
+
+    if (!GetFileData(path, data, size)) {
+        return nullptr;
+    }
+
+    // The stream only reads from the buffer, so it can point straight at the archive's data.
+    bStream::CMemoryStream stream(const_cast<uint8_t*>(data), size, bStream::Big, bStream::In);
+
+    J3DModelLoader loader;
+    return loader.Load(&stream, flags);
+}
+
+std::shared_ptr<J3DMaterialTable> J3DArchive::LoadMaterialTable(const std::string& path, std::shared_ptr<J3DModelData> modelData) {
+    const uint8_t* data = nullptr;
+    size_t size = 0;
+
+    if (modelData == nullptr || !GetFileData(path, data, size)) {
+        return nullptr;
+    }
+
+    bStream::CMemoryStream stream(const_cast<uint8_t*>(data), size, bStream::Big, bStream::In);
+
+    J3DMaterialTableLoader loader;
+    return loader.Load(&stream, modelData);
+}
+
+std::shared_ptr<J3DAnimation::J3DAnimationInstance> J3DArchive::LoadAnimation(const std::string& path) {
+    const uint8_t* data = nullptr;
+    size_t size = 0;
+
+    if (!GetFileData(path, data, size)) {
+        return nullptr;
+    }
+
+    J3DAnimation::J3DAnimationLoader loader;
+    return loader.LoadAnimation(const_cast<uint8_t*>(data), (uint32_t)size);
+}
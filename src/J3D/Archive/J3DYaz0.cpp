@@ -0,0 +1,120 @@
+#include "J3D/Archive/J3DYaz0.hpp"
+
+#include <algorithm>
+#include <cstring>
+
+namespace {
+    uint32_t ReadUInt32BE(const uint8_t* src) {
+        return (uint32_t(src[0]) << 24) | (uint32_t(src[1]) << 16) | (uint32_t(src[2]) << 8) | uint32_t(src[3]);
+    }
+}
+
+bool J3DYaz0::IsCompressed(const uint8_t* src, size_t srcSize) {
+    return src != nullptr && srcSize >= YAZ0_HEADER_SIZE && ReadUInt32BE(src) == YAZ0_MAGIC;
+}
+
+uint32_t J3DYaz0::GetDecompressedSize(const uint8_t* src, size_t srcSize) {
+    if (!IsCompressed(src, srcSize)) {
+        return 0;
+    }
+
+    return ReadUInt32BE(src + 4);
+}
+
+bool J3DYaz0::Decompress(const uint8_t* src, size_t srcSize, uint8_t* dst, size_t dstSize) {
+    if (!IsCompressed(src, srcSize) || dst == nullptr) {
+        return false;
+    }
+
+    const uint8_t* srcCur = src + YAZ0_HEADER_SIZE;
+    const uint8_t* srcEnd = src + srcSize;
+
+    uint8_t* dstCur = dst;
+    uint8_t* dstEnd = dst + std::min<size_t>(dstSize, GetDecompressedSize(src, srcSize));
+
+    while (dstCur < dstEnd) {
+        if (srcCur >= srcEnd) {
+            return false;
+        }
+
+        uint8_t groupHeader = *srcCur++;
+
+        // All eight chunks in this group are literals, and there's room for all of them - copy them in one go.
+        if (groupHeader == 0xFF && srcEnd - srcCur >= 8 && dstEnd - dstCur >= 8) {
+            std::memcpy(dstCur, srcCur, 8);
+            srcCur += 8;
+            dstCur += 8;
+
+            continue;
+        }
+
+        for (uint32_t bit = 0; bit < 8 && dstCur < dstEnd; bit++) {
+            // Literal byte
+            if (groupHeader & (0x80 >> bit)) {
+                if (srcCur >= srcEnd) {
+                    return false;
+                }
+
+                *dstCur++ = *srcCur++;
+                continue;
+            }
+
+            // Back-reference
+            if (srcEnd - srcCur < 2) {
+                return false;
+            }
+
+            uint8_t b0 = *srcCur++;
+            uint8_t b1 = *srcCur++;
+
+            size_t distance = (((b0 & 0x0F) << 8) | b1) + 1;
+            size_t length = b0 >> 4;
+
+            if (length == 0) {
+                if (srcCur >= srcEnd) {
+                    return false;
+                }
+
+                length = *srcCur++ + 0x12;
+            }
+            else {
+                length += 2;
+            }
+
+            if (distance > size_t(dstCur - dst) || length > size_t(dstEnd - dstCur)) {
+                return false;
+            }
+
+            const uint8_t* copySrc = dstCur - distance;
+
+            // The source run doesn't overlap what we're writing, so it can be copied as a block.
+            if (distance >= length) {
+                std::memcpy(dstCur, copySrc, length);
+                dstCur += length;
+            }
+            // Overlapping runs repeat the last `distance` bytes, so they have to be copied forward byte by byte.
+            else {
+                for (size_t i = 0; i < length; i++) {
+                    *dstCur++ = copySrc[i];
+                }
+            }
+        }
+    }
+
+    return true;
+}
+
+bool J3DYaz0::Decompress(const uint8_t* src, size_t srcSize, std::vector<uint8_t>& dst) {
+    uint32_t decompressedSize = GetDecompressedSize(src, srcSize);
+    if (decompressedSize == 0) {
+        return false;
+    }
+
+    dst.resize(decompressedSize);
+    if (!Decompress(src, srcSize, dst.data(), dst.size())) {
+        dst.clear();
+        return false;
+    }
+
+    return true;
+}
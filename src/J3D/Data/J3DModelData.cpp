@@ -6,25 +6,26 @@
 #include "J3D/Skeleton/J3DNode.hpp"
 
 #include "J3D/Material/J3DUniformBufferObject.hpp"
+#include "J3D/Geometry/J3DGeometryArena.hpp"
 
 #include <glad/glad.h>
+#include <algorithm>
 #include <atomic>
+#include <limits>
 
 std::atomic<uint16_t> J3DModelData::sInstanceIdSrc = 1;
+std::atomic<uint64_t> J3DModelData::sUniqueIdSrc = 1;
 
-J3DModelData::J3DModelData() {
+J3DModelData::J3DModelData() : mUniqueId(sUniqueIdSrc++) {
     mSkeleton = std::make_shared<J3DSkeleton>();
     mMaterialTable = std::make_shared<J3DMaterialTable>();
 }
 
 J3DModelData::~J3DModelData() {
-    uint32_t buffers[] = { mVBO, mIBO };
-    glDeleteBuffers(2, buffers);
-
-    glDeleteVertexArrays(1, &mVAO);
+    J3DGeometryArena::Free(mGeometryAllocation);
 }
 
-void J3DModelData::MakeHierarchy(std::shared_ptr<J3DJoint> root, uint32_t& index) {
+void J3DModelData::MakeHierarchy(std::shared_ptr<J3DJoint> root, uint32_t& index, bool deferShaders) {
     std::shared_ptr<J3DJoint> last = root;
     const auto& shapes = mGeometry.GetShapes();
 
@@ -32,12 +33,13 @@ void J3DModelData::MakeHierarchy(std::shared_ptr<J3DJoint> root, uint32_t& index
         std::shared_ptr<J3DJoint> currentJoint = nullptr;
         std::shared_ptr<J3DMaterial> currentMaterial;
         std::shared_ptr<GXShape> currentShape = nullptr;
+        uint32_t currentShapeIndex = 0;
 
         switch (mHierarchyNodes[index].Type) {
             // The nodes after this one are lower on the hierarchy (eg go down to joint children)
         case EJ3DHierarchyType::Begin:
             index++;
-            MakeHierarchy(last, index);
+            MakeHierarchy(last, index, deferShaders);
 
             break;
             // The nodes after this one are higher on the hierarchy (eg go back up to joint parents)
@@ -62,7 +64,8 @@ void J3DModelData::MakeHierarchy(std::shared_ptr<J3DJoint> root, uint32_t& index
             break;
             // This node represents a shape, so grab that shape.
         case EJ3DHierarchyType::Shape:
-            currentShape = shapes[mHierarchyNodes[index].Index];
+            currentShapeIndex = mHierarchyNodes[index].Index;
+            currentShape = shapes[currentShapeIndex];
             index++;
 
             break;
@@ -84,12 +87,24 @@ void J3DModelData::MakeHierarchy(std::shared_ptr<J3DJoint> root, uint32_t& index
             root->AddMaterial(currentMaterial);
         // If we have a shape this iteration, assign it to the last material we added to the current root joint.
         // Also generate shaders, since now that it has a shape the material has all the data it needs.
+        // Lazy loads leave that until the material is first drawn.
         else if (currentShape != nullptr) {
             std::shared_ptr<J3DMaterial> shapeMaterial = root->GetLastMaterial().lock();
 
             shapeMaterial->SetShape(currentShape);
-            shapeMaterial->GenerateShaders();
-            J3DUniformBufferObject::LinkMaterialToUBO(shapeMaterial);
+
+            if (currentShapeIndex < mShapeIndexRanges.size()) {
+                const J3DShapeIndexRange& range = mShapeIndexRanges[currentShapeIndex];
+                shapeMaterial->SetIndexRange(range.FirstIndex, range.IndexCount);
+            }
+
+            if (deferShaders) {
+                shapeMaterial->DeferShaderGeneration();
+            }
+            else {
+                shapeMaterial->GenerateShaders();
+                J3DUniformBufferObject::LinkMaterialToUBO(shapeMaterial);
+            }
         }
     }
 }
@@ -98,146 +113,143 @@ void J3DModelData::CalculateRestPose() {
     mSkeleton->CalculateRestPose();
 }
 
-bool J3DModelData::InitializeGL() {
-    mGeometry.CreateVertexArray();
+void J3DModelData::CalculateBounds() {
+    shared_vector<GXShape>& shapes = mGeometry.GetShapes();
+    mShapeBounds.resize(shapes.size());
+    mDrawBounds.clear();
 
-    const auto& verts = mGeometry.GetModelVertices();
-    const auto& indices = mGeometry.GetModelIndices();
-
-    mBBMin = { 0, 0, 0 };
-    mBBMax = { 0, 0, 0 };
-    for (const auto& vertex : verts) {
-        if (mBBMin.x > vertex.Position.x)
-            mBBMin.x = vertex.Position.x;
-        if (mBBMin.y > vertex.Position.y)
-            mBBMin.y = vertex.Position.y;
-        if (mBBMin.z > vertex.Position.z)
-            mBBMin.z = vertex.Position.z;
-
-        if (mBBMax.x < vertex.Position.x)
-            mBBMax.x = vertex.Position.x;
-        if (mBBMax.y < vertex.Position.y)
-            mBBMax.y = vertex.Position.y;
-        if (mBBMax.z < vertex.Position.z)
-            mBBMax.z = vertex.Position.z;
-    }
+    std::vector<glm::mat4> restPose = GetRestPose();
 
-    // Create VBO
-    glCreateBuffers(1, &mVBO);
-    glNamedBufferStorage(mVBO, verts.size() * sizeof(ModernVertex), verts.data(), GL_MAP_WRITE_BIT | GL_DYNAMIC_STORAGE_BIT);
+    mBBMin = glm::vec3(std::numeric_limits<float>::max());
+    mBBMax = glm::vec3(std::numeric_limits<float>::lowest());
 
-    // Create IBO
-    glCreateBuffers(1, &mIBO);
-    glNamedBufferStorage(mIBO, indices.size() * sizeof(uint32_t), indices.data(), GL_MAP_WRITE_BIT | GL_DYNAMIC_STORAGE_BIT);
+    // Index of each draw matrix's entry in the current shape's bounds and in the model's, or -1 if it has none yet.
+    std::vector<int32_t> shapeSlots;
+    std::vector<int32_t> modelSlots;
 
-    // Create VAO
-    glCreateVertexArrays(1, &mVAO);
-    if (mVAO == UINT32_MAX)
-        return false;
+    for (uint32_t i = 0; i < shapes.size(); i++) {
+        std::vector<J3DDrawBounds>& draws = mShapeBounds[i].Draws;
+        draws.clear();
+        std::fill(shapeSlots.begin(), shapeSlots.end(), -1);
 
-    // Set VBO as the data source for the VAO
-    glVertexArrayVertexBuffer(mVAO, 0, mVBO, 0, sizeof(ModernVertex));
-    // Set IBO as the index source for the VAO
-    glVertexArrayElementBuffer(mVAO, mIBO);
+        glm::vec3 restMin(std::numeric_limits<float>::max());
+        glm::vec3 restMax(std::numeric_limits<float>::lowest());
 
-    // Configure position data on VAO
-    if (mVertexData.HasPositions()) {
-        uint32_t posEnumVal = J3DUtility::EnumToIntegral(EGXAttribute::Position);
-        glEnableVertexArrayAttrib(mVAO, posEnumVal);
+        for (auto primitive : shapes[i]->GetPrimitives()) {
+            for (const ModernVertex& vertex : primitive->GetVertices()) {
+                uint16_t drawIndex = static_cast<uint16_t>(vertex.Position.w);
+                glm::vec3 position = glm::vec3(vertex.Position);
 
-        glVertexArrayAttribBinding(mVAO, posEnumVal, 0);
-        glVertexArrayAttribFormat(mVAO, posEnumVal, glm::vec4::length(), GL_FLOAT, GL_FALSE, offsetof(ModernVertex, Position));
-    }
+                if (drawIndex >= shapeSlots.size()) {
+                    shapeSlots.resize(drawIndex + 1, -1);
+                }
 
-    // Configure normal data on VAO
-    if (mVertexData.HasNormals()) {
-        uint32_t nrmEnumVal = J3DUtility::EnumToIntegral(EGXAttribute::Normal);
-        glEnableVertexArrayAttrib(mVAO, nrmEnumVal);
+                if (shapeSlots[drawIndex] < 0) {
+                    shapeSlots[drawIndex] = (int32_t)draws.size();
+                    draws.push_back({ drawIndex, position, position });
+                }
 
-        glVertexArrayAttribBinding(mVAO, nrmEnumVal, 0);
-        glVertexArrayAttribFormat(mVAO, nrmEnumVal, glm::vec3::length(), GL_FLOAT, GL_FALSE, offsetof(ModernVertex, Normal));
-    }
+                J3DDrawBounds& bounds = draws[shapeSlots[drawIndex]];
+                bounds.Min = glm::min(bounds.Min, position);
+                bounds.Max = glm::max(bounds.Max, position);
 
-    // Configure vertex color data on VAO
-    if (mVertexData.HasColors(0)) {
-        uint32_t colEnumVal = J3DUtility::EnumToIntegral(EGXAttribute::Color0);
-        glEnableVertexArrayAttrib(mVAO, colEnumVal);
+                // Vertices are stored relative to their draw matrix, so the rest bounds apply the rest pose to them.
+                glm::vec3 restPosition = drawIndex < restPose.size() ? glm::vec3(restPose[drawIndex] * glm::vec4(position, 1.0f)) : position;
+                restMin = glm::min(restMin, restPosition);
+                restMax = glm::max(restMax, restPosition);
+            }
+        }
 
-        glVertexArrayAttribBinding(mVAO, colEnumVal, 0);
-        glVertexArrayAttribFormat(mVAO, colEnumVal, glm::vec4::length(), GL_FLOAT, GL_FALSE, offsetof(ModernVertex, Colors[0]));
-    }
+        draws.shrink_to_fit();
 
-    if (mVertexData.HasColors(1)) {
-        uint32_t colEnumVal = J3DUtility::EnumToIntegral(EGXAttribute::Color1);
-        glEnableVertexArrayAttrib(mVAO, colEnumVal);
+        uint32_t billboardType = *shapes[i]->GetUserData<uint32_t>();
+        mShapeBounds[i].Billboard = billboardType == 1 || billboardType == 2;
 
-        glVertexArrayAttribBinding(mVAO, colEnumVal, 0);
-        glVertexArrayAttribFormat(mVAO, colEnumVal, glm::vec4::length(), GL_FLOAT, GL_FALSE, offsetof(ModernVertex, Colors[1]));
-    }
+        if (!draws.empty()) {
+            mShapeBounds[i].RestMin = restMin;
+            mShapeBounds[i].RestMax = restMax;
 
-    // Configure tex coord data on VAO
-    if (mVertexData.HasTexCoords(0)) {
-        uint32_t texEnumVal = J3DUtility::EnumToIntegral(EGXAttribute::TexCoord0);
-        glEnableVertexArrayAttrib(mVAO, texEnumVal);
+            mBBMin = glm::min(mBBMin, restMin);
+            mBBMax = glm::max(mBBMax, restMax);
+        }
 
-        glVertexArrayAttribBinding(mVAO, texEnumVal, 0);
-        glVertexArrayAttribFormat(mVAO, texEnumVal, glm::vec3::length(), GL_FLOAT, GL_FALSE, offsetof(ModernVertex, TexCoords[0]));
-    }
-    if (mVertexData.HasTexCoords(1)) {
-        uint32_t texEnumVal = J3DUtility::EnumToIntegral(EGXAttribute::TexCoord1);
-        glEnableVertexArrayAttrib(mVAO, texEnumVal);
+        for (const J3DDrawBounds& shapeDraw : draws) {
+            if (shapeDraw.DrawIndex >= modelSlots.size()) {
+                modelSlots.resize(shapeDraw.DrawIndex + 1, -1);
+            }
 
-        glVertexArrayAttribBinding(mVAO, texEnumVal, 0);
-        glVertexArrayAttribFormat(mVAO, texEnumVal, glm::vec3::length(), GL_FLOAT, GL_FALSE, offsetof(ModernVertex, TexCoords[1]));
-    }
-    if (mVertexData.HasTexCoords(2)) {
-        uint32_t texEnumVal = J3DUtility::EnumToIntegral(EGXAttribute::TexCoord2);
-        glEnableVertexArrayAttrib(mVAO, texEnumVal);
+            if (modelSlots[shapeDraw.DrawIndex] < 0) {
+                modelSlots[shapeDraw.DrawIndex] = (int32_t)mDrawBounds.size();
+                mDrawBounds.push_back(shapeDraw);
+                continue;
+            }
 
-        glVertexArrayAttribBinding(mVAO, texEnumVal, 0);
-        glVertexArrayAttribFormat(mVAO, texEnumVal, glm::vec3::length(), GL_FLOAT, GL_FALSE, offsetof(ModernVertex, TexCoords[2]));
+            J3DDrawBounds& modelDraw = mDrawBounds[modelSlots[shapeDraw.DrawIndex]];
+            modelDraw.Min = glm::min(modelDraw.Min, shapeDraw.Min);
+            modelDraw.Max = glm::max(modelDraw.Max, shapeDraw.Max);
+        }
     }
-    if (mVertexData.HasTexCoords(3)) {
-        uint32_t texEnumVal = J3DUtility::EnumToIntegral(EGXAttribute::TexCoord3);
-        glEnableVertexArrayAttrib(mVAO, texEnumVal);
 
-        glVertexArrayAttribBinding(mVAO, texEnumVal, 0);
-        glVertexArrayAttribFormat(mVAO, texEnumVal, glm::vec3::length(), GL_FLOAT, GL_FALSE, offsetof(ModernVertex, TexCoords[3]));
+    if (mDrawBounds.empty()) {
+        mBBMin = glm::vec3(0.0f);
+        mBBMax = glm::vec3(0.0f);
     }
-    if (mVertexData.HasTexCoords(4)) {
-        uint32_t texEnumVal = J3DUtility::EnumToIntegral(EGXAttribute::TexCoord4);
-        glEnableVertexArrayAttrib(mVAO, texEnumVal);
+}
 
-        glVertexArrayAttribBinding(mVAO, texEnumVal, 0);
-        glVertexArrayAttribFormat(mVAO, texEnumVal, glm::vec3::length(), GL_FLOAT, GL_FALSE, offsetof(ModernVertex, TexCoords[4]));
-    }
-    if (mVertexData.HasTexCoords(5)) {
-        uint32_t texEnumVal = J3DUtility::EnumToIntegral(EGXAttribute::TexCoord5);
-        glEnableVertexArrayAttrib(mVAO, texEnumVal);
+void J3DModelData::Triangulate() {
+    mGeometry.CreateVertexArray();
+
+    mModelVertices = mGeometry.GetModelVertices();
+    mModelIndices = mGeometry.GetModelIndices();
 
-        glVertexArrayAttribBinding(mVAO, texEnumVal, 0);
-        glVertexArrayAttribFormat(mVAO, texEnumVal, glm::vec3::length(), GL_FLOAT, GL_FALSE, offsetof(ModernVertex, TexCoords[5]));
+    shared_vector<GXShape>& shapes = mGeometry.GetShapes();
+    mShapeIndexRanges.resize(shapes.size());
+
+    for (uint32_t i = 0; i < shapes.size(); i++) {
+        shapes[i]->GetVertexOffsetAndCount(mShapeIndexRanges[i].FirstIndex, mShapeIndexRanges[i].IndexCount);
     }
-    if (mVertexData.HasTexCoords(6)) {
-        uint32_t texEnumVal = J3DUtility::EnumToIntegral(EGXAttribute::TexCoord6);
-        glEnableVertexArrayAttrib(mVAO, texEnumVal);
 
-        glVertexArrayAttribBinding(mVAO, texEnumVal, 0);
-        glVertexArrayAttribFormat(mVAO, texEnumVal, glm::vec3::length(), GL_FLOAT, GL_FALSE, offsetof(ModernVertex, TexCoords[6]));
+    mGeometry.CleanupVertexArray();
+}
+
+bool J3DModelData::InitializeGL() {
+    // Models are grouped into arenas by the vertex attributes they use, since disabled attributes must read their constant value.
+    uint32_t attributeMask = 0;
+
+    if (mVertexData.HasPositions())
+        attributeMask |= J3DGeometryArena::AttributeBit(J3DUtility::EnumToIntegral(EGXAttribute::Position));
+    if (mVertexData.HasNormals())
+        attributeMask |= J3DGeometryArena::AttributeBit(J3DUtility::EnumToIntegral(EGXAttribute::Normal));
+    if (mVertexData.HasColors(0))
+        attributeMask |= J3DGeometryArena::AttributeBit(J3DUtility::EnumToIntegral(EGXAttribute::Color0));
+    if (mVertexData.HasColors(1))
+        attributeMask |= J3DGeometryArena::AttributeBit(J3DUtility::EnumToIntegral(EGXAttribute::Color1));
+
+    for (uint32_t i = 0; i < 8; i++) {
+        if (mVertexData.HasTexCoords(i))
+            attributeMask |= J3DGeometryArena::AttributeBit(J3DUtility::EnumToIntegral(EGXAttribute::TexCoord0) + i);
     }
-    if (mVertexData.HasTexCoords(7)) {
-        uint32_t texEnumVal = J3DUtility::EnumToIntegral(EGXAttribute::TexCoord7);
-        glEnableVertexArrayAttrib(mVAO, texEnumVal);
 
-        glVertexArrayAttribBinding(mVAO, texEnumVal, 0);
-        glVertexArrayAttribFormat(mVAO, texEnumVal, glm::vec3::length(), GL_FLOAT, GL_FALSE, offsetof(ModernVertex, TexCoords[7]));
+    mGeometryAllocation = J3DGeometryArena::Allocate(attributeMask, mModelVertices.data(), (uint32_t)mModelVertices.size(),
+        mModelIndices.data(), (uint32_t)mModelIndices.size());
+
+    if (mGeometryAllocation == nullptr) {
+        return false;
     }
 
-    mGeometry.CleanupVertexArray();
+    // The arena holds its own copy now.
+    mModelVertices.clear();
+    mModelVertices.shrink_to_fit();
+    mModelIndices.clear();
+    mModelIndices.shrink_to_fit();
 
     return true;
 }
 
+bool J3DModelData::HasGeometry() const {
+    return mGeometryAllocation != nullptr && mGeometryAllocation->IsValid();
+}
+
 std::shared_ptr<J3DModelInstance> J3DModelData::CreateInstance() {
     return std::make_shared<J3DModelInstance>(shared_from_this(), sInstanceIdSrc++);
 }
@@ -247,10 +259,28 @@ void J3DModelData::GetBoundingBox(glm::vec3& min, glm::vec3& max) const {
   max = mBBMax;
 }
 
+const J3DShapeBounds* J3DModelData::GetShapeBounds(const GXShape* shape) {
+    shared_vector<GXShape>& shapes = mGeometry.GetShapes();
+
+    for (uint32_t i = 0; i < shapes.size() && i < mShapeBounds.size(); i++) {
+        if (shapes[i].get() == shape) {
+            return &mShapeBounds[i];
+        }
+    }
+
+    return nullptr;
+}
+
 std::vector<glm::mat4> J3DModelData::GetRestPose() const {
     return mSkeleton->GetRestPose();
 }
 
+void J3DModelData::Prewarm(const shared_vector<J3DMaterial>& materials) {
+    for (const std::shared_ptr<J3DMaterial>& material : materials) {
+        material->Prewarm(GetTextures());
+    }
+}
+
 bool J3DModelData::SetTexture(uint32_t idx, std::shared_ptr<J3DTexture> texture) {
     return mMaterialTable->SetTexture(idx, texture);
 }
@@ -264,13 +294,19 @@ void J3DModelData::BindVAO()
     if (!mGLInitialized)
         mGLInitialized = InitializeGL();
 
-    glBindVertexArray(mVAO);
-    
-    uint32_t col0Enum = J3DUtility::EnumToIntegral(EGXAttribute::Color0);
-    glVertexAttrib4f(col0Enum, 1.0f, 1.0f, 1.0f, 1.0f);
+    if (HasGeometry())
+        J3DGeometryArena::Bind(*mGeometryAllocation);
 }
 
 void J3DModelData::UnbindVAO()
 {
-    glBindVertexArray(0);
+    J3DGeometryArena::Unbind();
+}
+
+uint32_t J3DModelData::GetBaseVertex() const {
+    return HasGeometry() ? mGeometryAllocation->BaseVertex : 0;
+}
+
+uint32_t J3DModelData::GetFirstIndex() const {
+    return HasGeometry() ? mGeometryAllocation->FirstIndex : 0;
 }
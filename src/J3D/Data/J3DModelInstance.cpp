@@ -9,29 +9,122 @@
 #include "J3D/Animation/J3DJointAnimationInstance.hpp"
 #include "J3D/Animation/J3DJointFullAnimationInstance.hpp"
 #include "J3D/Animation/J3DVisibilityAnimationInstance.hpp"
+#include "J3D/Animation/J3DPoseCache.hpp"
+
+#include "J3D/Geometry/J3DGeometryArena.hpp"
+#include "J3D/Geometry/J3DSkinning.hpp"
 
 #include "J3D/Skeleton/J3DJoint.hpp"
 
+#include "J3D/Rendering/J3DFrustum.hpp"
+
+#include "J3D/Scene/J3DScene.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <limits>
 #include <stdexcept>
 #include <iostream>
 #include <glm/gtx/matrix_decompose.hpp>
 #include <glm/gtc/matrix_transform.hpp>
 #include <glm/gtx/transform.hpp>
 
+namespace {
+	// Finds model-space bounds that hold the model in every pose of the clip. Every whole frame is posed by an animation
+	// instance of its own, so the one being played is left alone. Poses between whole frames are interpolated, so the
+	// bounds are grown by the furthest any draw matrix's box moves from one frame to the next.
+	template<typename TAnimation, typename TClip>
+	bool CalculateClipBounds(const J3DModelData& modelData, const std::shared_ptr<const TClip>& clip, glm::vec3& min, glm::vec3& max) {
+		const std::vector<J3DDrawBounds>& draws = modelData.GetDrawBounds();
+		if (draws.empty()) {
+			return false;
+		}
+
+		TAnimation sampler(clip);
+		std::vector<glm::mat4> localMatrices;
+		std::vector<glm::mat4> worldMatrices;
+		std::vector<glm::mat4> pose = modelData.GetRestPose();
+
+		std::vector<glm::vec3> lastMins(draws.size());
+		std::vector<glm::vec3> lastMaxs(draws.size());
+		glm::vec3 step(0.0f);
+
+		min = glm::vec3(std::numeric_limits<float>::max());
+		max = glm::vec3(std::numeric_limits<float>::lowest());
+
+		for (uint32_t frame = 0; frame <= clip->Length; frame++) {
+			sampler.SetFrame((uint16_t)frame, true);
+			sampler.GetTransformsAtFrame(0.0f, localMatrices);
+
+			modelData.CalculateJointWorldMatrices(localMatrices, worldMatrices);
+			modelData.UpdateAnimJointPose(worldMatrices, pose);
+
+			for (size_t i = 0; i < draws.size(); i++) {
+				if (draws[i].DrawIndex >= pose.size()) {
+					return false;
+				}
+
+				glm::vec3 drawMin, drawMax;
+				J3DUtility::TransformBoundingBox(pose[draws[i].DrawIndex], draws[i].Min, draws[i].Max, drawMin, drawMax);
+
+				if (frame != 0) {
+					step = glm::max(step, glm::max(glm::abs(drawMin - lastMins[i]), glm::abs(drawMax - lastMaxs[i])));
+				}
+
+				lastMins[i] = drawMin;
+				lastMaxs[i] = drawMax;
+
+				min = glm::min(min, drawMin);
+				max = glm::max(max, drawMax);
+			}
+		}
+
+		min -= step;
+		max += step;
+
+		return true;
+	}
+}
+
 J3DModelInstance::J3DModelInstance(std::shared_ptr<J3DModelData> modelData, uint16_t id) {
 	if (modelData == nullptr)
 		throw std::invalid_argument("Tried to create a J3DModelInstance from invalid J3DModelData pointer!");
 
 	mModelData = modelData;
-	mEnvelopeMatrices = mModelData->GetRestPose();
+	mEnvelopeMatrices = std::make_shared<std::vector<glm::mat4>>(mModelData->GetRestPose());
+	mPose = mEnvelopeMatrices;
 	mReferenceFrame = glm::identity<glm::mat4>();
 	mSortBias = 0;
 	mModelId = id;
 	bUseInstanceMaterialTable = false;
+	mStaticWorldJointCount = 0;
+	mStaticEnvelopeCount = 0;
+	bJointPoseValid = false;
+	mPoseFrame = 0.0f;
+	mAnimationLODLevel = 0;
+	mProjectedSize = 0.0f;
+	bCulled = false;
+	mEnvelopeBase = 0;
+	mEnvelopeGeneration = 0;
+	mEnvelopeModelView = glm::identity<glm::mat4>();
+	bEnvelopesAllocated = false;
+	bUseComputeSkinning = false;
+	mPosedVertexBuffer = 0;
+	bPosedVerticesValid = false;
+	mMaterialBoundsSource = nullptr;
+	mScene = nullptr;
+	mSceneIndex = 0;
+	bPoseBoundsValid = false;
+	bWorldBoundsValid = false;
+	mClipBBMin = glm::vec3(0.0f);
+	mClipBBMax = glm::vec3(0.0f);
+	bHasClipBounds = false;
 }
 
 J3DModelInstance::~J3DModelInstance() {
-
+	J3DSkinning::DestroyPosedBuffer(mPosedVertexBuffer);
+	J3DOcclusion::DestroyQuery(mOcclusionQuery);
 }
 
 void J3DModelInstance::CalculateJointMatrices(float deltaTime) {
@@ -39,74 +132,146 @@ void J3DModelInstance::CalculateJointMatrices(float deltaTime) {
 		return;
 	}
 
-	std::vector<glm::mat4> animTransforms;
+	std::shared_ptr<const J3DAnimation::J3DAnimationClip> clip;
+	float frame;
 
 	if (mJointAnimation != nullptr) {
-		animTransforms = mJointAnimation->GetTransformsAtFrame(deltaTime);
+		clip = mJointAnimation->GetClip();
+		frame = mJointAnimation->GetFrame();
 	}
-	else if (mJointFullAnimation != nullptr) {
-		animTransforms = mJointFullAnimation->GetTransformsAtFrame(deltaTime);
+	else {
+		clip = mJointFullAnimation->GetClip();
+		frame = mJointFullAnimation->GetFrame();
+	}
+
+	// The pose only changes when the animation has moved on since it was last calculated,
+	// and lower levels of detail hold it for a few frames even then.
+	if (clip == mPoseClip && (frame == mPoseFrame || !CheckPoseUpdateDue(frame))) {
+		return;
+	}
+
+	mPoseClip = clip;
+	mPoseFrame = frame;
+	bEnvelopesAllocated = false;
+	bPosedVerticesValid = false;
+
+	// Instances of this model playing the same clip in sync share a single pose. Instances holding some of their
+	// joints have a pose of their own.
+	bool holdsJoints = !mHeldJoints.empty();
+	if (!holdsJoints) {
+		J3DPoseCache::Pose sharedPose = J3DPoseCache::Find(clip, mModelData.get(), frame);
+		if (sharedPose != nullptr) {
+			mPose = sharedPose;
+			InvalidateBounds(true);
+			return;
+		}
+	}
+
+	const std::vector<bool>& staticJoints = mJointAnimation != nullptr ? mJointAnimation->GetStaticJoints() : mJointFullAnimation->GetStaticJoints();
+	if (clip != mStaticPoseClip) {
+		mStaticPoseClip = clip;
+		UpdateStaticPose(staticJoints);
+	}
+
+	// Held joints keep the local transforms calculated the first time the clip was posed.
+	const std::vector<bool>* heldJoints = bJointPoseValid && holdsJoints ? &mHeldJoints : nullptr;
+
+	if (mJointAnimation != nullptr) {
+		mJointAnimation->GetTransformsAtFrame(deltaTime, mJointLocalMatrices, heldJoints);
 	}
 	else {
-		animTransforms = { glm::identity<glm::mat4>() };
+		mJointFullAnimation->GetTransformsAtFrame(deltaTime, mJointLocalMatrices, heldJoints);
 	}
 
-    std::vector<glm::mat4> t;
-    t.reserve(mModelData->GetJoints().size());
+	mModelData->CalculateJointWorldMatrices(mJointLocalMatrices, mJointWorldMatrices, bJointPoseValid ? &mStaticWorldJoints : nullptr);
 
-	for (std::shared_ptr<J3DJoint> jnt : mModelData->GetJoints()) {
-		std::shared_ptr<J3DJoint> p = jnt;
+	// Don't overwrite a pose that another instance or the pose cache is still using; write to the spare buffer instead.
+	mPose = nullptr;
+	if (mEnvelopeMatrices.use_count() > 1) {
+		if (mSpareEnvelopeMatrices == nullptr || mSpareEnvelopeMatrices.use_count() > 1) {
+			mSpareEnvelopeMatrices = std::make_shared<std::vector<glm::mat4>>();
+		}
 
-		glm::mat4 completeTransform = glm::identity<glm::mat4>();
+		// Static envelopes are kept from the previous pose, so it has to be carried over.
+		*mSpareEnvelopeMatrices = *mEnvelopeMatrices;
+		std::swap(mEnvelopeMatrices, mSpareEnvelopeMatrices);
+	}
 
-		while (p != nullptr) {
-			glm::mat4 parentTransform = animTransforms[p->GetJointID()];
+	mModelData->UpdateAnimJointPose(mJointWorldMatrices, *mEnvelopeMatrices, bJointPoseValid ? &mStaticEnvelopes : nullptr);
+	bJointPoseValid = true;
 
-			if (p->GetAttachFlag() == 1) {
-				glm::vec3 scale, translation, skew;
-				glm::vec4 persp;
-				glm::quat rotation;
+	mPose = mEnvelopeMatrices;
+	if (!holdsJoints) {
+		J3DPoseCache::Store(clip, mModelData.get(), frame, mPose);
+	}
 
-				glm::decompose(parentTransform, scale, rotation, translation, skew, persp);
-				parentTransform = glm::inverse(glm::scale(scale)) * parentTransform;
-			}
+	InvalidateBounds(true);
+}
+
+bool J3DModelInstance::CheckPoseUpdateDue(float frame) const {
+	if (mAnimationLODLevels.empty() || mAnimationLODLevels[mAnimationLODLevel].UpdateInterval <= 1) {
+		return true;
+	}
+
+	uint32_t interval = mAnimationLODLevels[mAnimationLODLevel].UpdateInterval;
 
-			completeTransform = animTransforms[p->GetJointID()] * completeTransform;
-			p = std::dynamic_pointer_cast<J3DJoint>(p->GetParent().lock());
+	// The pose is due once the animation crosses into another span of interval frames, so it is held for the same
+	// stretch of the animation whether it is ticked or driven with SetFrame, and jumps are picked up at once.
+	// Spans are offset by the instance's ID so that instances at the same level don't all update on the same frame.
+	float offset = (float)(mModelId % interval);
+	return std::floor((frame + offset) / interval) != std::floor((mPoseFrame + offset) / interval);
+}
+
+void J3DModelInstance::UpdateStaticPose(const std::vector<bool>& staticJoints) {
+	const std::vector<int32_t>& parents = mModelData->GetJointParents();
+
+	// A joint's world transform is only static if its own transform and all of its parents' are.
+	// Parents come first in the joint order, so their flags are already set. Held joints count as static.
+	mStaticWorldJoints.assign(parents.size(), false);
+	mStaticWorldJointCount = 0;
+
+	for (uint32_t jointIndex : mModelData->GetJointOrder()) {
+		bool isStatic = (jointIndex < staticJoints.size() && staticJoints[jointIndex]) || (!mHeldJoints.empty() && mHeldJoints[jointIndex]);
+		if (parents[jointIndex] >= 0) {
+			isStatic = isStatic && mStaticWorldJoints[parents[jointIndex]];
 		}
 
-		t.push_back(completeTransform);
+		mStaticWorldJoints[jointIndex] = isStatic;
+		mStaticWorldJointCount += isStatic ? 1 : 0;
 	}
 
-	mEnvelopeMatrices = mModelData->CalculateAnimJointPose(t);
+	mStaticEnvelopes = mModelData->GetStaticEnvelopes(mStaticWorldJoints);
+	mStaticEnvelopeCount = (uint32_t)std::count(mStaticEnvelopes.begin(), mStaticEnvelopes.end(), true);
+
+	bJointPoseValid = false;
 }
 
-void J3DModelInstance::UpdateMaterialTextureMatrices(float deltaTime, std::shared_ptr<J3DMaterial> material, glm::mat4& viewMatrix, glm::mat4& projMatrix) {
+void J3DModelInstance::UpdateMaterialTextureMatrices(float deltaTime, const std::shared_ptr<J3DMaterial>& material, uint32_t materialIndex, glm::mat4& viewMatrix, glm::mat4& projMatrix) {
 	if (mTexMatrixAnimation != nullptr) {
-		mTexMatrixAnimation->ApplyAnimation(material);
+		mTexMatrixAnimation->ApplyAnimation(material, materialIndex, mTexMatrixBinding);
 	}
 
 	material->CalculateTexMatrices(mTransform.ToMat4(), viewMatrix, projMatrix);
 }
 
-void J3DModelInstance::UpdateMaterialTextures(float deltaTime, std::shared_ptr<J3DMaterial> material) {
+void J3DModelInstance::UpdateMaterialTextures(float deltaTime, const std::shared_ptr<J3DMaterial>& material, uint32_t materialIndex) {
 	if (mTexIndexAnimation == nullptr) {
 		return;
 	}
 
-	mTexIndexAnimation->ApplyAnimation(material);
+	mTexIndexAnimation->ApplyAnimation(material, materialIndex, mTexIndexBinding);
 }
 
 void J3DModelInstance::UpdateMaterialColors(float deltaTime) {
 	// TODO: implement BPK
 }
 
-void J3DModelInstance::UpdateTEVRegisterColors(float deltaTime, std::shared_ptr<J3DMaterial> material) {
+void J3DModelInstance::UpdateTEVRegisterColors(float deltaTime, const std::shared_ptr<J3DMaterial>& material, uint32_t materialIndex) {
 	if (mRegisterColorAnimation == nullptr) {
 		return;
 	}
 
-	mRegisterColorAnimation->ApplyAnimation(material);
+	mRegisterColorAnimation->ApplyAnimation(material, materialIndex, mRegisterColorBinding, mKonstColorBinding);
 }
 
 void J3DModelInstance::UpdateShapeVisibility(float deltaTime) {
@@ -120,22 +285,123 @@ void J3DModelInstance::UpdateShapeVisibility(float deltaTime) {
 	}
 }
 
-void J3DModelInstance::Update(float deltaTime, std::shared_ptr<J3DMaterial> material, glm::mat4& viewMatrix, glm::mat4& projMatrix) {
-	UpdateTEVRegisterColors(deltaTime, material);
-	UpdateMaterialTextures(deltaTime, material);
-	UpdateMaterialTextureMatrices(deltaTime, material, viewMatrix, projMatrix);
+void J3DModelInstance::Update(float deltaTime, const std::shared_ptr<J3DMaterial>& material, uint32_t materialIndex, glm::mat4& viewMatrix, glm::mat4& projMatrix) {
+	// Rebind the material animations if the material list they were resolved against was replaced.
+	const shared_vector<J3DMaterial>& materials = GetMaterials();
+	if ((mRegisterColorAnimation != nullptr && !mRegisterColorBinding.IsBoundTo(materials)) ||
+		(mTexIndexAnimation != nullptr && !mTexIndexBinding.IsBoundTo(materials)) ||
+		(mTexMatrixAnimation != nullptr && !mTexMatrixBinding.IsBoundTo(materials))) {
+		BindMaterialAnimations();
+	}
+
+	UpdateTEVRegisterColors(deltaTime, material, materialIndex);
+	UpdateMaterialTextures(deltaTime, material, materialIndex);
+	UpdateMaterialTextureMatrices(deltaTime, material, materialIndex, viewMatrix, projMatrix);
 	UpdateShapeVisibility(deltaTime);
 	CalculateJointMatrices(deltaTime);
 
-	J3DUniformBufferObject::SetEnvelopeMatrices(mEnvelopeMatrices.data(), (uint32_t)mEnvelopeMatrices.size());
-	J3DUniformBufferObject::SetLights(mLights);
-
 	glm::mat4 transformMat4 = mReferenceFrame * mTransform.ToMat4();
 	J3DUniformBufferObject::SetModelMatrix(transformMat4);
+
+	SubmitEnvelopeMatrices(J3DUniformBufferObject::GetModelViewMatrix());
+	UpdatePosedVertices();
+	J3DUniformBufferObject::SetLights(mLights);
+}
+
+void J3DModelInstance::SubmitEnvelopeMatrices(const glm::mat4& modelView) {
+	if (!bEnvelopesAllocated || mEnvelopeGeneration != J3DUniformBufferObject::GetEnvelopeGeneration() || modelView != mEnvelopeModelView) {
+		J3DUniformBufferObject::ReserveEnvelopeMatrices((uint32_t)mPose->size() + (bUseComputeSkinning ? 1 : 0));
+		mEnvelopeBase = J3DUniformBufferObject::AllocateEnvelopeMatrices(mPose->data(), (uint32_t)mPose->size(), modelView);
+
+		// Both allocations were reserved together, so this lands at index mPose->size(), where the posed vertices point.
+		if (bUseComputeSkinning) {
+			const glm::mat4 identity = glm::identity<glm::mat4>();
+			J3DUniformBufferObject::AllocateEnvelopeMatrices(&identity, 1, modelView);
+		}
+		mEnvelopeGeneration = J3DUniformBufferObject::GetEnvelopeGeneration();
+		mEnvelopeModelView = modelView;
+		bEnvelopesAllocated = true;
+	}
+
+	J3DUniformBufferObject::SetEnvelopeBase(mEnvelopeBase);
+}
+
+void J3DModelInstance::UpdatePosedVertices() {
+	if (!bUseComputeSkinning || bPosedVerticesValid) {
+		return;
+	}
+
+	// Makes sure the model's geometry has been uploaded.
+	mModelData->BindVAO();
+	if (!mModelData->HasGeometry()) {
+		return;
+	}
+
+	if (mPosedVertexBuffer == 0) {
+		mPosedVertexBuffer = J3DSkinning::CreatePosedBuffer(*mModelData->mGeometryAllocation);
+	}
+
+	J3DSkinning::Skin(*mModelData->mGeometryAllocation, mPosedVertexBuffer, mPose->data(), (uint32_t)mPose->size(), (uint32_t)mPose->size());
+	bPosedVerticesValid = true;
+}
+
+bool J3DModelInstance::CheckUsePosedVertices(const J3DMaterial* material) const {
+	if (!bUseComputeSkinning || !bPosedVerticesValid || mPosedVertexBuffer == 0) {
+		return false;
+	}
+
+	std::shared_ptr<GXShape> shape = material->GetShape().lock();
+	if (shape == nullptr) {
+		return false;
+	}
+
+	// Billboards are rotated about their envelope's origin, which the posed vertices no longer carry.
+	uint32_t billboardType = *shape->GetUserData<uint32_t>();
+	return billboardType == 0 || billboardType == 3;
+}
+
+void J3DModelInstance::SetUseComputeSkinning(bool use) {
+	if (use == bUseComputeSkinning) {
+		return;
+	}
+
+	bUseComputeSkinning = use;
+	bPosedVerticesValid = false;
+	bEnvelopesAllocated = false;
+
+	if (!use) {
+		J3DSkinning::DestroyPosedBuffer(mPosedVertexBuffer);
+	}
+}
+
+bool J3DModelInstance::GetPosedPositions(std::vector<glm::vec3>& positions) const {
+	if (!bUseComputeSkinning || !bPosedVerticesValid || !mModelData->HasGeometry()) {
+		return false;
+	}
+
+	J3DSkinning::ReadPosedPositions(*mModelData->mGeometryAllocation, mPosedVertexBuffer, positions);
+	return true;
+}
+
+void J3DModelInstance::BindMaterialAnimations() {
+	const shared_vector<J3DMaterial>& materials = GetMaterials();
+
+	if (mRegisterColorAnimation != nullptr) {
+		mRegisterColorAnimation->Bind(materials, mRegisterColorBinding, mKonstColorBinding);
+	}
+
+	if (mTexIndexAnimation != nullptr) {
+		mTexIndexAnimation->Bind(materials, mTexIndexBinding);
+	}
+
+	if (mTexMatrixAnimation != nullptr) {
+		mTexMatrixAnimation->Bind(materials, mTexMatrixBinding);
+	}
 }
 
 void J3DModelInstance::SetTranslation(const glm::vec3 trans) {
 	mTransform.Translation = trans;
+	InvalidateBounds(false);
 }
 
 void J3DModelInstance::SetRotation(const glm::vec3 rot) {
@@ -147,10 +413,12 @@ void J3DModelInstance::SetRotation(const glm::vec3 rot) {
 	mTransform.Rotation = glm::angleAxis(eulerRotation.z, glm::vec3(0.0f, 0.0f, 1.0f)) *
 		glm::angleAxis(eulerRotation.y, glm::vec3(0.0f, 1.0f, 0.0f)) *
 		glm::angleAxis(eulerRotation.x, glm::vec3(1.0f, 0.0f, 0.0f));
+	InvalidateBounds(false);
 }
 
 void J3DModelInstance::SetScale(const glm::vec3 scale) {
 	mTransform.Scale = scale;
+	InvalidateBounds(false);
 }
 
 void J3DModelInstance::SetTransform(const glm::mat4 transform) {
@@ -163,16 +431,117 @@ void J3DModelInstance::SetTransform(const glm::mat4 transform) {
 	mTransform.Translation = translation;
 	mTransform.Scale = scale;
 	mTransform.Rotation = rotation;
+	InvalidateBounds(false);
 }
 
 void J3DModelInstance::GetBoundingBox(glm::vec3& min, glm::vec3& max) const {
-	mModelData->GetBoundingBox(min, max);
+	if (!bPoseBoundsValid) {
+		if (!CalculatePosedBounds(mModelData->GetDrawBounds(), glm::identity<glm::mat4>(), mPoseBBMin, mPoseBBMax)) {
+			mModelData->GetBoundingBox(mPoseBBMin, mPoseBBMax);
+		}
+
+		bPoseBoundsValid = true;
+	}
+
+	min = mPoseBBMin;
+	max = mPoseBBMax;
+}
+
+void J3DModelInstance::GetWorldBoundingBox(glm::vec3& min, glm::vec3& max) const {
+	if (!bWorldBoundsValid) {
+		glm::mat4 transform = mReferenceFrame * mTransform.ToMat4();
+
+		// Bounds found from the clip don't depend on the pose. For the current pose, transforming each draw matrix's box
+		// separately gives a tighter box than transforming the pose's bounds.
+		if (bHasClipBounds) {
+			J3DUtility::TransformBoundingBox(transform, mClipBBMin, mClipBBMax, mBBMin, mBBMax);
+		}
+		else if (!CalculatePosedBounds(mModelData->GetDrawBounds(), transform, mBBMin, mBBMax)) {
+			glm::vec3 modelMin, modelMax;
+			mModelData->GetBoundingBox(modelMin, modelMax);
+
+			J3DUtility::TransformBoundingBox(transform, modelMin, modelMax, mBBMin, mBBMax);
+		}
+
+		bWorldBoundsValid = true;
+	}
+
+	min = mBBMin;
+	max = mBBMax;
+}
+
+void J3DModelInstance::InvalidateBounds(bool poseChanged) {
+	bPoseBoundsValid = bPoseBoundsValid && !poseChanged;
+
+	// World bounds found from the clip already hold every pose it can take.
+	if (poseChanged && bHasClipBounds) {
+		return;
+	}
+
+	bWorldBoundsValid = false;
+
+	if (mScene != nullptr) {
+		mScene->MarkMoved(mSceneIndex);
+	}
+}
+
+void J3DModelInstance::UpdateClipBounds() {
+	std::shared_ptr<const J3DAnimation::J3DAnimationClip> clip;
+	if (mJointAnimation != nullptr) {
+		clip = mJointAnimation->GetClip();
+	}
+	else if (mJointFullAnimation != nullptr) {
+		clip = mJointFullAnimation->GetClip();
+	}
+
+	bHasClipBounds = false;
+
+	if (clip != nullptr) {
+		std::vector<J3DModelData::J3DClipBounds>& clipBounds = mModelData->mClipBounds;
+
+		auto found = std::find_if(clipBounds.begin(), clipBounds.end(),
+			[&clip](const J3DModelData::J3DClipBounds& bounds) { return bounds.Clip.lock() == clip; });
+
+		if (found != clipBounds.end()) {
+			mClipBBMin = found->Min;
+			mClipBBMax = found->Max;
+			bHasClipBounds = true;
+		}
+		else {
+			if (mJointAnimation != nullptr) {
+				bHasClipBounds = CalculateClipBounds<J3DAnimation::J3DJointAnimationInstance>(*mModelData,
+					std::static_pointer_cast<const J3DAnimation::J3DJointAnimationClip>(clip), mClipBBMin, mClipBBMax);
+			}
+			else {
+				bHasClipBounds = CalculateClipBounds<J3DAnimation::J3DJointFullAnimationInstance>(*mModelData,
+					std::static_pointer_cast<const J3DAnimation::J3DJointFullAnimationClip>(clip), mClipBBMin, mClipBBMax);
+			}
+
+			if (bHasClipBounds) {
+				// Forget the bounds of clips that no longer exist.
+				clipBounds.erase(std::remove_if(clipBounds.begin(), clipBounds.end(),
+					[](const J3DModelData::J3DClipBounds& bounds) { return bounds.Clip.expired(); }), clipBounds.end());
+
+				clipBounds.push_back({ clip, mClipBBMin, mClipBBMax });
+			}
+		}
+	}
+
+	InvalidateBounds(false);
 }
 
 const shared_vector<J3DMaterial>& J3DModelInstance::GetMaterials() const {
 	return CheckUseInstanceMaterials() ? mInstanceMaterialTable->GetMaterials() : mModelData->GetMaterials();
 }
 
+void J3DModelInstance::Prewarm() {
+	auto& textures = CheckUseInstanceTextures() ? mInstanceMaterialTable->GetTextures() : mModelData->GetTextures();
+
+	for (const std::shared_ptr<J3DMaterial>& material : GetMaterials()) {
+		material->Prewarm(textures);
+	}
+}
+
 J3DLight J3DModelInstance::GetLight(int index) const {
 	J3DLight light;
 
@@ -193,38 +562,246 @@ void J3DModelInstance::SetLight(const J3DLight& light, int index) {
 
 void J3DModelInstance::SetReferenceFrame(const glm::mat4 frame) {
 	mReferenceFrame = frame;
+	InvalidateBounds(false);
+}
+
+void J3DModelInstance::SetAnimationLODLevels(const std::vector<J3DAnimationLODLevel>& levels) {
+	mAnimationLODLevels = levels;
+	std::stable_sort(mAnimationLODLevels.begin(), mAnimationLODLevels.end(),
+		[](const J3DAnimationLODLevel& a, const J3DAnimationLODLevel& b) { return a.MinProjectedSize > b.MinProjectedSize; });
+
+	SetAnimationLODLevel(0);
+}
+
+void J3DModelInstance::SetAnimationLODLevel(uint32_t level) {
+	mAnimationLODLevel = level;
+
+	std::vector<bool> heldJoints;
+	if (level < mAnimationLODLevels.size() && !mAnimationLODLevels[level].AnimatedJoints.empty()) {
+		const std::vector<bool>& animatedJoints = mAnimationLODLevels[level].AnimatedJoints;
+
+		heldJoints.assign(mModelData->GetJointCount(), false);
+		for (uint32_t i = 0; i < heldJoints.size() && i < animatedJoints.size(); i++) {
+			heldJoints[i] = !animatedJoints[i];
+		}
+
+		if (std::find(heldJoints.begin(), heldJoints.end(), true) == heldJoints.end()) {
+			heldJoints.clear();
+		}
+	}
+
+	if (heldJoints == mHeldJoints) {
+		return;
+	}
+
+	// Rebuild the static joints and repose from scratch, so that held joints pick up their local transforms.
+	mHeldJoints.swap(heldJoints);
+	mStaticPoseClip = nullptr;
+	mPoseClip = nullptr;
+}
+
+void J3DModelInstance::UpdateAnimationLOD(const glm::vec3& cameraPosition) {
+	glm::vec3 min, max;
+	mModelData->GetBoundingBox(min, max);
+
+	glm::mat4 transformMat4 = mReferenceFrame * mTransform.ToMat4();
+	glm::vec3 center = glm::vec3(transformMat4 * glm::vec4((min + max) * 0.5f, 1.0f));
+
+	float scale = std::max(glm::length(glm::vec3(transformMat4[0])), std::max(glm::length(glm::vec3(transformMat4[1])), glm::length(glm::vec3(transformMat4[2]))));
+	float radius = glm::length(max - min) * 0.5f * scale;
+	float distance = glm::distance(cameraPosition, center);
+
+	mProjectedSize = distance > radius ? radius / distance : 1.0f;
+
+	if (mAnimationLODLevels.empty()) {
+		return;
+	}
+
+	uint32_t level = 0;
+	while (level + 1 < mAnimationLODLevels.size() && mProjectedSize < mAnimationLODLevels[level].MinProjectedSize) {
+		level++;
+	}
+
+	if (level != mAnimationLODLevel) {
+		SetAnimationLODLevel(level);
+	}
 }
 
 void J3DModelInstance::GatherRenderPackets(std::vector<J3DRenderPacket>& packetList, glm::vec3 cameraPosition) {
+	GatherPackets(packetList, cameraPosition, nullptr);
+}
+
+void J3DModelInstance::GatherRenderPackets(std::vector<J3DRenderPacket>& packetList, glm::vec3 cameraPosition, const J3DFrustum& frustum) {
+	GatherPackets(packetList, cameraPosition, &frustum);
+}
+
+void J3DModelInstance::GatherPackets(std::vector<J3DRenderPacket>& packetList, glm::vec3 cameraPosition, const J3DFrustum* frustum) {
+	if (PrepareRenderPackets(cameraPosition, frustum)) {
+		EmitRenderPackets(packetList, cameraPosition, frustum);
+	}
+}
+
+bool J3DModelInstance::PrepareRenderPackets(glm::vec3 cameraPosition, const J3DFrustum* frustum) {
+	if (bCulled) {
+		return false;
+	}
+
+	UpdateAnimationLOD(cameraPosition);
+	BindMaterialBounds(GetMaterials());
+
+	if (frustum != nullptr) {
+		// Rendering reuses this pose, since it is calculated for the same frame.
+		CalculateJointMatrices(0.0f);
+	}
+
+	return true;
+}
+
+void J3DModelInstance::EmitRenderPackets(std::vector<J3DRenderPacket>& packetList, glm::vec3 cameraPosition, const J3DFrustum* frustum) {
 	glm::mat4 transformMat4 = mReferenceFrame * mTransform.ToMat4();
 
-	const shared_vector<J3DMaterial>& materials = CheckUseInstanceMaterials() ? mInstanceMaterialTable->GetMaterials() : mModelData->GetMaterials();
+	const shared_vector<J3DMaterial>& materials = GetMaterials();
+
+	for (uint32_t i = 0; i < materials.size(); i++) {
+		const std::shared_ptr<J3DMaterial>& mat = materials[i];
+
+		// PrepareRenderPackets looked up the shapes' centers, so their weak pointers aren't locked for every packet.
+		if (!mMaterialHasShape[i] || mat->GetShape().expired()) {
+			continue;
+		}
+
+		if (frustum != nullptr && !CheckShapeInFrustum(i, transformMat4, *frustum)) {
+			continue;
+		}
+
+		glm::vec3 toCenter = glm::vec3(transformMat4 * glm::vec4(mMaterialCenters[i], 1.0f)) - cameraPosition;
+
+		packetList.push_back({ CalculateSortKey(*mat, glm::dot(toCenter, toCenter)), this, i });
+	}
+}
+
+uint64_t J3DModelInstance::CalculateSortKey(const J3DMaterial& material, float distanceSquared) const {
+	// Positive floats order the same way as their bits, so the squared distance orders packets without a square root.
+	uint32_t distanceBits;
+	std::memcpy(&distanceBits, &distanceSquared, sizeof(float));
+
+	uint64_t depth = (distanceBits >> 8) & 0x7FFFFF;
+	uint64_t program = (uint32_t)material.GetShaderProgram() & 0xFFFF;
+	uint64_t texture = 0xFFFF;
+	if (material.TevBlock != nullptr && !material.TevBlock->mTextureIndices.empty()) {
+		texture = material.TevBlock->mTextureIndices[0];
+	}
+
+	// Packets are drawn from the highest key down, so higher biases render earlier, as do opaque packets.
+	uint64_t sortKey = (uint64_t)mSortBias << 56;
+
+	// Opaque packets are grouped by shader and texture, then drawn front to back. Translucent packets must be drawn
+	// back to front, so their depth comes first.
+	if (material.PEMode == EPixelEngineMode::Opaque || material.PEMode == EPixelEngineMode::AlphaTest) {
+		sortKey |= 1ull << 55;
+		sortKey |= (program << 39) | (texture << 23) | (0x7FFFFF - depth);
+	}
+	else {
+		sortKey |= (depth << 32) | (program << 16) | texture;
+	}
+
+	return sortKey;
+}
+
+void J3DModelInstance::BindMaterialBounds(const shared_vector<J3DMaterial>& materials) {
+	if (mMaterialBoundsSource == &materials && mMaterialBounds.size() == materials.size()) {
+		return;
+	}
+
+	mMaterialBoundsSource = &materials;
+	mMaterialBounds.assign(materials.size(), nullptr);
+	mMaterialCenters.assign(materials.size(), glm::vec3(0.0f));
+	mMaterialHasShape.assign(materials.size(), false);
+
+	for (uint32_t i = 0; i < materials.size(); i++) {
+		std::shared_ptr<GXShape> shape = materials[i]->GetShape().lock();
+		if (shape != nullptr) {
+			mMaterialBounds[i] = mModelData->GetShapeBounds(shape.get());
+			mMaterialCenters[i] = shape->GetCenterOfMass();
+			mMaterialHasShape[i] = true;
+		}
+	}
+}
+
+const J3DShapeBounds* J3DModelInstance::GetShapeBounds(uint32_t materialIndex) {
+	BindMaterialBounds(GetMaterials());
+	return materialIndex < mMaterialBounds.size() ? mMaterialBounds[materialIndex] : nullptr;
+}
 
-    packetList.reserve(packetList.size() + materials.size() + 1);
+bool J3DModelInstance::GetDrawRange(const J3DMaterial* material, uint32_t& count, uint32_t& firstIndex, uint32_t& baseVertex) const {
+	std::shared_ptr<GXShape> shape = material->GetShape().lock();
+	if (shape == nullptr || !mModelData->HasGeometry()) {
+		return false;
+	}
 
-    for (std::shared_ptr<J3DMaterial> mat : materials)
-    {
-        if (mat->GetShape().expired()) {
-            continue;
-        }
+	uint32_t offset;
+	material->GetIndexRange(offset, count);
 
-		std::shared_ptr<GXShape> lockedShape = mat->GetShape().lock();
+	firstIndex = mModelData->GetFirstIndex() + offset;
+	baseVertex = CheckUsePosedVertices(material) ? 0 : mModelData->GetBaseVertex();
 
-		const glm::vec3& center = lockedShape->GetCenterOfMass();
-		glm::vec4 transformedCenter = transformMat4 * glm::vec4(center.x, center.y, center.z, 1.0f);
+	return true;
+}
 
-		float distToCamera = glm::distance(cameraPosition, glm::vec3(transformedCenter.x, transformedCenter.y, transformedCenter.z));
-		uint32_t sortKey = static_cast<uint32_t>(distToCamera) & 0x7FFFFF;
+bool J3DModelInstance::CheckSameBatch(const J3DMaterial* material, const J3DModelInstance& other) const {
+	if (material->PEBlock.mBlendMode.Type != EGXBlendMode::None) {
+		return false;
+	}
 
-		if (mat->PEMode == EPixelEngineMode::Opaque || mat->PEMode == EPixelEngineMode::AlphaTest)
-		{
-			sortKey |= 0x00800000;
+	for (const J3DModelInstance* instance : { this, &other }) {
+		if (instance->mRegisterColorAnimation != nullptr || instance->mTexIndexAnimation != nullptr || instance->mTexMatrixAnimation != nullptr ||
+			instance->mVisibilityAnimation != nullptr || instance->bUseComputeSkinning || !instance->mModelData->HasGeometry()) {
+			return false;
 		}
+	}
 
-		sortKey |= mSortBias << 24;
+	const shared_vector<J3DTexture>& textures = CheckUseInstanceTextures() ? mInstanceMaterialTable->GetTextures() : mModelData->GetTextures();
+	const shared_vector<J3DTexture>& otherTextures = other.CheckUseInstanceTextures() ? other.mInstanceMaterialTable->GetTextures() : other.mModelData->GetTextures();
 
-		packetList.push_back({ sortKey, mat, this });
+	return &textures == &otherTextures && mModelData->mGeometryAllocation->ArenaIndex == other.mModelData->mGeometryAllocation->ArenaIndex;
+}
+
+bool J3DModelInstance::CheckShapeInFrustum(uint32_t materialIndex, const glm::mat4& transform, const J3DFrustum& frustum) const {
+	const J3DShapeBounds* bounds = materialIndex < mMaterialBounds.size() ? mMaterialBounds[materialIndex] : nullptr;
+
+	glm::vec3 worldMin, worldMax;
+	if (bounds == nullptr || bounds->Billboard || !CalculatePosedBounds(bounds->Draws, transform, worldMin, worldMax)) {
+		return true;
 	}
+
+	return frustum.IntersectsBox(worldMin, worldMax);
+}
+
+bool J3DModelInstance::CalculatePosedBounds(const std::vector<J3DDrawBounds>& draws, const glm::mat4& transform, glm::vec3& min, glm::vec3& max) const {
+	if (draws.empty()) {
+		return false;
+	}
+
+	// Each box is in the space of its vertices before their draw matrix is applied. Skinned vertices are blends of
+	// their joints' transforms, so they also stay within the union of the transformed boxes.
+	const std::vector<glm::mat4>& pose = *mPose;
+
+	min = glm::vec3(std::numeric_limits<float>::max());
+	max = glm::vec3(std::numeric_limits<float>::lowest());
+
+	for (const J3DDrawBounds& draw : draws) {
+		if (draw.DrawIndex >= pose.size()) {
+			return false;
+		}
+
+		glm::vec3 drawMin, drawMax;
+		J3DUtility::TransformBoundingBox(transform * pose[draw.DrawIndex], draw.Min, draw.Max, drawMin, drawMax);
+
+		min = glm::min(min, drawMin);
+		max = glm::max(max, drawMax);
+	}
+
+	return true;
 }
 
 void J3DModelInstance::UpdateAnimations(float deltaTime) {
@@ -253,34 +830,61 @@ void J3DModelInstance::UpdateAnimations(float deltaTime) {
 	}
 }
 
-void J3DModelInstance::Render(float deltaTime, std::shared_ptr<J3DMaterial> material, glm::mat4& viewMatrix, glm::mat4& projMatrix, uint32_t materialShaderOverride) {
-	Update(deltaTime, material, viewMatrix, projMatrix);
-
-	J3DUniformBufferObject::SetModelId(mModelId);
-	mModelData->BindVAO();
+void J3DModelInstance::Render(float deltaTime, const std::shared_ptr<J3DMaterial>& material, glm::mat4& viewMatrix, glm::mat4& projMatrix, uint32_t materialShaderOverride) {
+	ptrdiff_t materialIndex = J3DUtility::VectorIndexOf(GetMaterials(), material);
+	Render(deltaTime, material, materialIndex < 0 ? UINT32_MAX : (uint32_t)materialIndex, viewMatrix, projMatrix, materialShaderOverride);
+}
 
-	auto& textures = CheckUseInstanceTextures() ? mInstanceMaterialTable->GetTextures() : mModelData->GetTextures();
-	material->Render(textures, materialShaderOverride);
+void J3DModelInstance::Render(float deltaTime, const std::shared_ptr<J3DMaterial>& material, uint32_t materialIndex, glm::mat4& viewMatrix, glm::mat4& projMatrix, uint32_t materialShaderOverride) {
+	RenderPacket(deltaTime, material, materialIndex, viewMatrix, projMatrix, materialShaderOverride);
 
-	mModelData->UnbindVAO();
+	// Callers may bind their own VAOs before the next draw, which the arena can't know about.
+	J3DGeometryArena::Unbind();
 }
 
-void J3DModelInstance::StaticRender(std::shared_ptr<J3DMaterial> material, uint32_t materialShaderOverride)
+void J3DModelInstance::StaticRender(const std::shared_ptr<J3DMaterial>& material, uint32_t materialShaderOverride)
 {
-	J3DUniformBufferObject::SetEnvelopeMatrices(mEnvelopeMatrices.data(),
-		(uint32_t)mEnvelopeMatrices.size());
-	J3DUniformBufferObject::SetLights(mLights);
+	StaticRenderPacket(material, materialShaderOverride);
 
+	J3DGeometryArena::Unbind();
+}
+
+void J3DModelInstance::RenderPacket(float deltaTime, const std::shared_ptr<J3DMaterial>& material, uint32_t materialIndex, glm::mat4& viewMatrix, glm::mat4& projMatrix, uint32_t materialShaderOverride) {
+	Update(deltaTime, material, materialIndex, viewMatrix, projMatrix);
+	RenderMaterial(material, materialShaderOverride);
+}
+
+void J3DModelInstance::StaticRenderPacket(const std::shared_ptr<J3DMaterial>& material, uint32_t materialShaderOverride)
+{
 	glm::mat4 transformMat4 = mReferenceFrame * mTransform.ToMat4();
 	J3DUniformBufferObject::SetModelMatrix(transformMat4);
 
+	SubmitEnvelopeMatrices(J3DUniformBufferObject::GetModelViewMatrix());
+	J3DUniformBufferObject::SetLights(mLights);
+
+	RenderMaterial(material, materialShaderOverride);
+}
+
+void J3DModelInstance::RenderMaterial(const std::shared_ptr<J3DMaterial>& material, uint32_t materialShaderOverride) {
 	J3DUniformBufferObject::SetModelId(mModelId);
-	mModelData->BindVAO();
 
-	auto& textures = CheckUseInstanceTextures() ? mInstanceMaterialTable->GetTextures() : mModelData->GetTextures();
-	material->Render(textures, materialShaderOverride);
+	// Posed vertices are a copy of just this model's vertices, so they start at vertex 0. Binding the VAO uploads the
+	// model's geometry on its first draw, so the base vertex is only read afterwards.
+	uint32_t baseVertex = 0;
+	if (CheckUsePosedVertices(material.get())) {
+		J3DGeometryArena::BindWithVertexBuffer(*mModelData->mGeometryAllocation, mPosedVertexBuffer);
+	}
+	else {
+		mModelData->BindVAO();
+		baseVertex = mModelData->GetBaseVertex();
+	}
+
+	if (!mModelData->HasGeometry()) {
+		return;
+	}
 
-	mModelData->UnbindVAO();
+	auto& textures = CheckUseInstanceTextures() ? mInstanceMaterialTable->GetTextures() : mModelData->GetTextures();
+	material->Render(textures, materialShaderOverride, baseVertex, mModelData->GetFirstIndex());
 }
 
 bool J3DModelInstance::CheckUseInstanceMaterials() const {
@@ -297,6 +901,7 @@ void J3DModelInstance::SetJointAnimation(std::shared_ptr<J3DAnimation::J3DJointA
     }
 
 	mJointAnimation = anim;
+	UpdateClipBounds();
 }
 
 void J3DModelInstance::SetJointFullAnimation(std::shared_ptr<J3DAnimation::J3DJointFullAnimationInstance> anim) {
@@ -305,4 +910,41 @@ void J3DModelInstance::SetJointFullAnimation(std::shared_ptr<J3DAnimation::J3DJo
     }
 
 	mJointFullAnimation = anim;
+	UpdateClipBounds();
+}
+
+void J3DModelInstance::SetRegisterColorAnimation(std::shared_ptr<J3DAnimation::J3DColorAnimationInstance> anim) {
+	mRegisterColorAnimation = anim;
+
+	if (anim != nullptr) {
+		anim->Bind(GetMaterials(), mRegisterColorBinding, mKonstColorBinding);
+	}
+}
+
+void J3DModelInstance::SetTexIndexAnimation(std::shared_ptr<J3DAnimation::J3DTexIndexAnimationInstance> anim) {
+	mTexIndexAnimation = anim;
+
+	if (anim != nullptr) {
+		anim->Bind(GetMaterials(), mTexIndexBinding);
+	}
+}
+
+void J3DModelInstance::SetTexMatrixAnimation(std::shared_ptr<J3DAnimation::J3DTexMatrixAnimationInstance> anim) {
+	mTexMatrixAnimation = anim;
+
+	if (anim != nullptr) {
+		anim->Bind(GetMaterials(), mTexMatrixBinding);
+	}
+}
+
+void J3DModelInstance::SetUseInstanceMaterialTable(bool use) {
+	bUseInstanceMaterialTable = use;
+	mMaterialBoundsSource = nullptr;
+	BindMaterialAnimations();
+}
+
+void J3DModelInstance::SetInstanceMaterialTable(std::shared_ptr<J3DMaterialTable> matTable) {
+	mInstanceMaterialTable = matTable;
+	mMaterialBoundsSource = nullptr;
+	BindMaterialAnimations();
 }
@@ -0,0 +1,390 @@
+#include "J3D/Geometry/J3DGeometryArena.hpp"
+#include "J3D/Util/J3DUtil.hpp"
+
+#include <GXGeometryEnums.hpp>
+#include <GXGeometryData.hpp>
+
+#include <glad/glad.h>
+#include <glm/glm.hpp>
+
+#include <algorithm>
+#include <cstddef>
+#include <map>
+#include <vector>
+
+namespace J3DGeometryArena {
+	namespace {
+		// Arenas start out with room for this many vertices and indices, and at least double when they grow.
+		constexpr uint32_t MIN_ARENA_VERTEX_CAPACITY = 1 << 16;
+		constexpr uint32_t MIN_ARENA_INDEX_CAPACITY = 1 << 17;
+
+		struct J3DVertexAttributeFormat {
+			EGXAttribute Attribute;
+			int32_t ComponentCount;
+			size_t Offset;
+		};
+
+		const J3DVertexAttributeFormat ATTRIBUTE_FORMATS[] = {
+			{ EGXAttribute::Position,  glm::vec4::length(), offsetof(ModernVertex, Position) },
+			{ EGXAttribute::Normal,    glm::vec3::length(), offsetof(ModernVertex, Normal) },
+			{ EGXAttribute::Color0,    glm::vec4::length(), offsetof(ModernVertex, Colors[0]) },
+			{ EGXAttribute::Color1,    glm::vec4::length(), offsetof(ModernVertex, Colors[1]) },
+			{ EGXAttribute::TexCoord0, glm::vec3::length(), offsetof(ModernVertex, TexCoords[0]) },
+			{ EGXAttribute::TexCoord1, glm::vec3::length(), offsetof(ModernVertex, TexCoords[1]) },
+			{ EGXAttribute::TexCoord2, glm::vec3::length(), offsetof(ModernVertex, TexCoords[2]) },
+			{ EGXAttribute::TexCoord3, glm::vec3::length(), offsetof(ModernVertex, TexCoords[3]) },
+			{ EGXAttribute::TexCoord4, glm::vec3::length(), offsetof(ModernVertex, TexCoords[4]) },
+			{ EGXAttribute::TexCoord5, glm::vec3::length(), offsetof(ModernVertex, TexCoords[5]) },
+			{ EGXAttribute::TexCoord6, glm::vec3::length(), offsetof(ModernVertex, TexCoords[6]) },
+			{ EGXAttribute::TexCoord7, glm::vec3::length(), offsetof(ModernVertex, TexCoords[7]) },
+		};
+
+		// Free ranges of an arena buffer, keyed by offset. Adjacent ranges are always merged.
+		using FreeRangeMap = std::map<uint32_t, uint32_t>;
+
+		struct J3DGeometryArenaData {
+			uint32_t AttributeMask = 0;
+
+			uint32_t VAO = 0;
+			// Same layout as VAO, for drawing copies of an allocation's vertices held outside the arena.
+			uint32_t ExternalVAO = 0;
+			uint32_t VBO = 0;
+			uint32_t IBO = 0;
+
+			uint32_t VertexCapacity = 0;
+			uint32_t IndexCapacity = 0;
+
+			FreeRangeMap FreeVertexRanges;
+			FreeRangeMap FreeIndexRanges;
+
+			std::vector<std::shared_ptr<J3DGeometryAllocation>> Allocations;
+		};
+
+		std::vector<J3DGeometryArenaData> mArenas;
+		uint32_t mBoundVAO = 0;
+		// Vertex buffer attached to the bound arena's ExternalVAO, if that is what's bound.
+		uint32_t mBoundVertexBuffer = 0;
+
+		// Finds the first free range that fits the given size and takes it. Returns false if no range is large enough.
+		bool AllocateRange(FreeRangeMap& freeRanges, uint32_t size, uint32_t& offset) {
+			for (auto it = freeRanges.begin(); it != freeRanges.end(); ++it) {
+				if (it->second < size) {
+					continue;
+				}
+
+				offset = it->first;
+
+				uint32_t remaining = it->second - size;
+				freeRanges.erase(it);
+
+				if (remaining != 0) {
+					freeRanges[offset + size] = remaining;
+				}
+
+				return true;
+			}
+
+			return false;
+		}
+
+		void FreeRange(FreeRangeMap& freeRanges, uint32_t offset, uint32_t size) {
+			if (size == 0) {
+				return;
+			}
+
+			auto next = freeRanges.lower_bound(offset);
+
+			// Merge with the range before this one
+			if (next != freeRanges.begin()) {
+				auto prev = std::prev(next);
+
+				if (prev->first + prev->second == offset) {
+					offset = prev->first;
+					size += prev->second;
+
+					freeRanges.erase(prev);
+				}
+			}
+
+			// Merge with the range after this one
+			if (next != freeRanges.end() && offset + size == next->first) {
+				size += next->second;
+				freeRanges.erase(next);
+			}
+
+			freeRanges[offset] = size;
+		}
+
+		// Replaces the given buffer with a larger one, keeping the contents of the old one.
+		void GrowBuffer(uint32_t& buffer, uint32_t oldCapacity, uint32_t newCapacity, size_t elementSize) {
+			uint32_t newBuffer = 0;
+			glCreateBuffers(1, &newBuffer);
+			glNamedBufferStorage(newBuffer, newCapacity * elementSize, nullptr, GL_DYNAMIC_STORAGE_BIT);
+
+			if (buffer != 0) {
+				glCopyNamedBufferSubData(buffer, newBuffer, 0, 0, oldCapacity * elementSize);
+				glDeleteBuffers(1, &buffer);
+			}
+
+			buffer = newBuffer;
+		}
+
+		void AttachBuffers(J3DGeometryArenaData& arena) {
+			glVertexArrayVertexBuffer(arena.VAO, 0, arena.VBO, 0, sizeof(ModernVertex));
+			glVertexArrayElementBuffer(arena.VAO, arena.IBO);
+		}
+
+		uint32_t CreateVAO(uint32_t attributeMask) {
+			uint32_t vao = 0;
+			glCreateVertexArrays(1, &vao);
+
+			for (const J3DVertexAttributeFormat& format : ATTRIBUTE_FORMATS) {
+				uint32_t attribEnumVal = J3DUtility::EnumToIntegral(format.Attribute);
+				if ((attributeMask & AttributeBit(attribEnumVal)) == 0) {
+					continue;
+				}
+
+				glEnableVertexArrayAttrib(vao, attribEnumVal);
+
+				glVertexArrayAttribBinding(vao, attribEnumVal, 0);
+				glVertexArrayAttribFormat(vao, attribEnumVal, format.ComponentCount, GL_FLOAT, GL_FALSE, (uint32_t)format.Offset);
+			}
+
+			return vao;
+		}
+
+		void BindVAO(uint32_t vao) {
+			glBindVertexArray(vao);
+			mBoundVAO = vao;
+
+			// Models without vertex colors read this constant instead.
+			uint32_t col0Enum = J3DUtility::EnumToIntegral(EGXAttribute::Color0);
+			glVertexAttrib4f(col0Enum, 1.0f, 1.0f, 1.0f, 1.0f);
+		}
+
+		uint32_t GetOrCreateArena(uint32_t attributeMask) {
+			for (uint32_t i = 0; i < mArenas.size(); i++) {
+				if (mArenas[i].AttributeMask == attributeMask) {
+					return i;
+				}
+			}
+
+			J3DGeometryArenaData arena;
+			arena.AttributeMask = attributeMask;
+			arena.VAO = CreateVAO(attributeMask);
+
+			mArenas.push_back(std::move(arena));
+			return (uint32_t)mArenas.size() - 1;
+		}
+
+		// Takes a range of the given size from the arena's vertex or index buffer, growing the buffer if there's no room.
+		uint32_t AllocateOrGrow(J3DGeometryArenaData& arena, bool bIndices, uint32_t size) {
+			FreeRangeMap& freeRanges = bIndices ? arena.FreeIndexRanges : arena.FreeVertexRanges;
+			uint32_t& capacity = bIndices ? arena.IndexCapacity : arena.VertexCapacity;
+
+			uint32_t offset = 0;
+			if (AllocateRange(freeRanges, size, offset)) {
+				return offset;
+			}
+
+			uint32_t minCapacity = bIndices ? MIN_ARENA_INDEX_CAPACITY : MIN_ARENA_VERTEX_CAPACITY;
+			uint32_t newCapacity = std::max({ minCapacity, capacity * 2, capacity + size });
+
+			if (bIndices) {
+				GrowBuffer(arena.IBO, capacity, newCapacity, sizeof(uint32_t));
+			}
+			else {
+				GrowBuffer(arena.VBO, capacity, newCapacity, sizeof(ModernVertex));
+			}
+
+			FreeRange(freeRanges, capacity, newCapacity - capacity);
+			capacity = newCapacity;
+
+			AttachBuffers(arena);
+			// The external VAO still points at the old index buffer.
+			mBoundVertexBuffer = 0;
+
+			AllocateRange(freeRanges, size, offset);
+			return offset;
+		}
+	}
+}
+
+std::shared_ptr<J3DGeometryAllocation> J3DGeometryArena::Allocate(uint32_t attributeMask, const ModernVertex* vertices, uint32_t vertexCount,
+	const uint32_t* indices, uint32_t indexCount) {
+	if (vertices == nullptr || indices == nullptr || vertexCount == 0 || indexCount == 0) {
+		return nullptr;
+	}
+
+	std::shared_ptr<J3DGeometryAllocation> allocation = std::make_shared<J3DGeometryAllocation>();
+	allocation->ArenaIndex = GetOrCreateArena(attributeMask);
+
+	J3DGeometryArenaData& arena = mArenas[allocation->ArenaIndex];
+
+	allocation->VertexCount = vertexCount;
+	allocation->BaseVertex = AllocateOrGrow(arena, false, vertexCount);
+
+	allocation->IndexCount = indexCount;
+	allocation->FirstIndex = AllocateOrGrow(arena, true, indexCount);
+
+	glNamedBufferSubData(arena.VBO, allocation->BaseVertex * sizeof(ModernVertex), vertexCount * sizeof(ModernVertex), vertices);
+	glNamedBufferSubData(arena.IBO, allocation->FirstIndex * sizeof(uint32_t), indexCount * sizeof(uint32_t), indices);
+
+	arena.Allocations.push_back(allocation);
+
+	return allocation;
+}
+
+void J3DGeometryArena::Free(std::shared_ptr<J3DGeometryAllocation>& allocation) {
+	if (allocation == nullptr || allocation->ArenaIndex >= mArenas.size()) {
+		allocation = nullptr;
+		return;
+	}
+
+	J3DGeometryArenaData& arena = mArenas[allocation->ArenaIndex];
+
+	auto it = std::find(arena.Allocations.begin(), arena.Allocations.end(), allocation);
+	if (it != arena.Allocations.end()) {
+		FreeRange(arena.FreeVertexRanges, allocation->BaseVertex, allocation->VertexCount);
+		FreeRange(arena.FreeIndexRanges, allocation->FirstIndex, allocation->IndexCount);
+
+		arena.Allocations.erase(it);
+	}
+
+	allocation->ArenaIndex = UINT32_MAX;
+	allocation = nullptr;
+}
+
+void J3DGeometryArena::Defragment() {
+	for (J3DGeometryArenaData& arena : mArenas) {
+		if (arena.FreeVertexRanges.empty() && arena.FreeIndexRanges.empty()) {
+			continue;
+		}
+
+		if (arena.Allocations.empty()) {
+			uint32_t buffers[] = { arena.VBO, arena.IBO };
+			glDeleteBuffers(2, buffers);
+
+			arena.VBO = 0;
+			arena.IBO = 0;
+			arena.VertexCapacity = 0;
+			arena.IndexCapacity = 0;
+			arena.FreeVertexRanges.clear();
+			arena.FreeIndexRanges.clear();
+
+			AttachBuffers(arena);
+			continue;
+		}
+
+		uint32_t vertexCount = 0;
+		uint32_t indexCount = 0;
+		for (const auto& allocation : arena.Allocations) {
+			vertexCount += allocation->VertexCount;
+			indexCount += allocation->IndexCount;
+		}
+
+		uint32_t newVBO = 0, newIBO = 0;
+		glCreateBuffers(1, &newVBO);
+		glNamedBufferStorage(newVBO, vertexCount * sizeof(ModernVertex), nullptr, GL_DYNAMIC_STORAGE_BIT);
+		glCreateBuffers(1, &newIBO);
+		glNamedBufferStorage(newIBO, indexCount * sizeof(uint32_t), nullptr, GL_DYNAMIC_STORAGE_BIT);
+
+		// Indices are relative to the base vertex, so the ranges can be moved without rewriting them.
+		uint32_t vertexOffset = 0;
+		uint32_t indexOffset = 0;
+		for (const auto& allocation : arena.Allocations) {
+			glCopyNamedBufferSubData(arena.VBO, newVBO, allocation->BaseVertex * sizeof(ModernVertex),
+				vertexOffset * sizeof(ModernVertex), allocation->VertexCount * sizeof(ModernVertex));
+			glCopyNamedBufferSubData(arena.IBO, newIBO, allocation->FirstIndex * sizeof(uint32_t),
+				indexOffset * sizeof(uint32_t), allocation->IndexCount * sizeof(uint32_t));
+
+			allocation->BaseVertex = vertexOffset;
+			allocation->FirstIndex = indexOffset;
+
+			vertexOffset += allocation->VertexCount;
+			indexOffset += allocation->IndexCount;
+		}
+
+		uint32_t oldBuffers[] = { arena.VBO, arena.IBO };
+		glDeleteBuffers(2, oldBuffers);
+
+		arena.VBO = newVBO;
+		arena.IBO = newIBO;
+		arena.VertexCapacity = vertexCount;
+		arena.IndexCapacity = indexCount;
+		arena.FreeVertexRanges.clear();
+		arena.FreeIndexRanges.clear();
+
+		AttachBuffers(arena);
+	}
+
+	mBoundVertexBuffer = 0;
+}
+
+void J3DGeometryArena::Bind(const J3DGeometryAllocation& allocation) {
+	if (allocation.ArenaIndex >= mArenas.size()) {
+		return;
+	}
+
+	uint32_t vao = mArenas[allocation.ArenaIndex].VAO;
+	if (vao == mBoundVAO) {
+		return;
+	}
+
+	BindVAO(vao);
+}
+
+void J3DGeometryArena::BindWithVertexBuffer(const J3DGeometryAllocation& allocation, uint32_t vertexBuffer) {
+	if (allocation.ArenaIndex >= mArenas.size()) {
+		return;
+	}
+
+	J3DGeometryArenaData& arena = mArenas[allocation.ArenaIndex];
+	if (arena.ExternalVAO == 0) {
+		arena.ExternalVAO = CreateVAO(arena.AttributeMask);
+	}
+
+	if (arena.ExternalVAO == mBoundVAO && vertexBuffer == mBoundVertexBuffer) {
+		return;
+	}
+
+	glVertexArrayVertexBuffer(arena.ExternalVAO, 0, vertexBuffer, 0, sizeof(ModernVertex));
+	glVertexArrayElementBuffer(arena.ExternalVAO, arena.IBO);
+	mBoundVertexBuffer = vertexBuffer;
+
+	if (arena.ExternalVAO != mBoundVAO) {
+		BindVAO(arena.ExternalVAO);
+	}
+}
+
+void J3DGeometryArena::Unbind() {
+	glBindVertexArray(0);
+	mBoundVAO = 0;
+}
+
+uint32_t J3DGeometryArena::GetVertexBuffer(const J3DGeometryAllocation& allocation) {
+	return allocation.ArenaIndex < mArenas.size() ? mArenas[allocation.ArenaIndex].VBO : 0;
+}
+
+void J3DGeometryArena::DestroyArenas() {
+	Unbind();
+
+	for (J3DGeometryArenaData& arena : mArenas) {
+		uint32_t buffers[] = { arena.VBO, arena.IBO };
+		glDeleteBuffers(2, buffers);
+		glDeleteVertexArrays(1, &arena.VAO);
+		if (arena.ExternalVAO != 0) {
+			glDeleteVertexArrays(1, &arena.ExternalVAO);
+		}
+
+		for (auto& allocation : arena.Allocations) {
+			allocation->ArenaIndex = UINT32_MAX;
+		}
+	}
+
+	mArenas.clear();
+}
+
+uint32_t J3DGeometryArena::GetArenaCount() {
+	return (uint32_t)mArenas.size();
+}
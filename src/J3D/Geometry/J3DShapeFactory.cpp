@@ -33,6 +33,12 @@ std::shared_ptr<GXShape> J3DShapeFactory::Create(bStream::CStream* stream, uint3
 
 	gxShape->SetUserData(new uint32_t(initData.MatrixType));
 
+	J3DShapeBounds bounds;
+	bounds.Radius = initData.BoundingSphereRadius;
+	bounds.Min = initData.BoundingBoxMin;
+	bounds.Max = initData.BoundingBoxMax;
+	mShapeBounds.push_back(bounds);
+
 	// Load the vertex descriptions that will allow us to properly read the geometry data
 	auto& shapeAttributeTable = gxShape->GetAttributeTable();
 	std::vector<J3DVCDData> vertexAttributes;
@@ -223,6 +229,7 @@ std::shared_ptr<GXShape> J3DShapeFactory::Create(bStream::CStream* stream, uint3
 
 			//newPrimitive->TriangluatePrimitive();
 			shapePrimitives.push_back(newPrimitive);
+			mPrimitiveTypes.push_back(primType);
 		}
 	}
 
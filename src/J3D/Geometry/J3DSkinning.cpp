@@ -0,0 +1,228 @@
+#include "J3D/Geometry/J3DSkinning.hpp"
+#include "J3D/Geometry/J3DGeometryArena.hpp"
+
+#include <GXGeometryData.hpp>
+
+#include <glad/glad.h>
+
+#include <algorithm>
+#include <cstddef>
+#include <iostream>
+
+namespace J3DSkinning {
+	namespace {
+		constexpr uint32_t WORKGROUP_SIZE = 64;
+		// Initial capacity of the skinning matrix buffer, in envelopes. It grows as needed.
+		constexpr uint32_t SKINNING_MATS_INITIAL = 1024;
+
+		// Storage buffer bindings. Binding 1 holds the envelope matrices read by the material shaders.
+		constexpr uint32_t SKINNING_MATS_BINDING = 2;
+		constexpr uint32_t SOURCE_VERTICES_BINDING = 3;
+		constexpr uint32_t POSED_VERTICES_BINDING = 4;
+
+		// Vertices are read as an array of floats, since the vertex layout doesn't follow std430's alignment rules.
+		const char* SkinningShader =
+			"#version 460\n\n"
+			"layout (local_size_x = 64) in;\n\n"
+			"// An envelope's matrix and normal matrix, stored as the rows of affine matrices: transform with vec4(v, w) * matrix.\n"
+			"struct SkinningMatrix {\n"
+			"\tmat3x4 Position;\n"
+			"\tmat3x4 Normal;\n"
+			"};\n\n"
+			"layout (std430, binding = 2) readonly buffer uSkinningMatrices {\n"
+			"\tSkinningMatrix Matrices[];\n"
+			"};\n\n"
+			"layout (std430, binding = 3) readonly buffer uSourceVertices {\n"
+			"\tfloat SourceVertices[];\n"
+			"};\n\n"
+			"layout (std430, binding = 4) buffer uPosedVertices {\n"
+			"\tfloat PosedVertices[];\n"
+			"};\n\n"
+			"// Offsets and strides are in floats.\n"
+			"layout (location = 0) uniform uint VertexCount;\n"
+			"layout (location = 1) uniform uint SourceBase;\n"
+			"layout (location = 2) uniform uint VertexStride;\n"
+			"layout (location = 3) uniform uint PositionOffset;\n"
+			"layout (location = 4) uniform uint NormalOffset;\n"
+			"layout (location = 5) uniform float PosedEnvelopeIndex;\n\n"
+			"void main() {\n"
+			"\tuint index = gl_GlobalInvocationID.x;\n"
+			"\tif (index >= VertexCount) {\n"
+			"\t\treturn;\n"
+			"\t}\n\n"
+			"\tuint source = SourceBase + index * VertexStride;\n"
+			"\tuint posed = index * VertexStride;\n\n"
+			"\tuint position = source + PositionOffset;\n"
+			"\tuint normal = source + NormalOffset;\n"
+			"\tSkinningMatrix matrix = Matrices[uint(SourceVertices[position + 3])];\n\n"
+			"\tvec3 posedPosition = vec4(SourceVertices[position], SourceVertices[position + 1], SourceVertices[position + 2], 1.0) * matrix.Position;\n"
+			"\tvec3 posedNormal = vec4(SourceVertices[normal], SourceVertices[normal + 1], SourceVertices[normal + 2], 0.0) * matrix.Normal;\n\n"
+			"\tPosedVertices[posed + PositionOffset] = posedPosition.x;\n"
+			"\tPosedVertices[posed + PositionOffset + 1] = posedPosition.y;\n"
+			"\tPosedVertices[posed + PositionOffset + 2] = posedPosition.z;\n"
+			"\tPosedVertices[posed + PositionOffset + 3] = PosedEnvelopeIndex;\n\n"
+			"\tPosedVertices[posed + NormalOffset] = posedNormal.x;\n"
+			"\tPosedVertices[posed + NormalOffset + 1] = posedNormal.y;\n"
+			"\tPosedVertices[posed + NormalOffset + 2] = posedNormal.z;\n"
+			"}\n";
+
+		struct J3DSkinningMatrix {
+			glm::vec4 Position[3];
+			glm::vec4 Normal[3];
+		};
+
+		uint32_t mSkinningProgram = 0;
+
+		std::vector<J3DSkinningMatrix> mSkinningMatrices;
+		uint32_t mSkinningMatrixBuffer = 0;
+		uint32_t mSkinningMatrixCapacity = 0;
+
+		bool CreateSkinningProgram() {
+			int32_t shader = glCreateShader(GL_COMPUTE_SHADER);
+			glShaderSource(shader, 1, &SkinningShader, NULL);
+			glCompileShader(shader);
+
+			int32_t success = 0;
+			glGetShaderiv(shader, GL_COMPILE_STATUS, &success);
+			if (!success) {
+				std::cout << "Skinning shader compilation failed!" << std::endl;
+
+				GLsizei size = 0;
+				char t[512];
+				glGetShaderInfoLog(shader, 512, &size, t);
+
+				std::cout << t << std::endl;
+
+				glDeleteShader(shader);
+				return false;
+			}
+
+			mSkinningProgram = glCreateProgram();
+			glAttachShader(mSkinningProgram, shader);
+			glLinkProgram(mSkinningProgram);
+
+			glDetachShader(mSkinningProgram, shader);
+			glDeleteShader(shader);
+
+			return true;
+		}
+
+		void UploadSkinningMatrices(const glm::mat4* envelopes, uint32_t envelopeCount) {
+			mSkinningMatrices.resize(envelopeCount);
+
+			for (uint32_t i = 0; i < envelopeCount; i++) {
+				const glm::mat4& envelope = envelopes[i];
+				glm::mat3 normal = glm::transpose(glm::inverse(glm::mat3(envelope)));
+
+				for (int row = 0; row < 3; row++) {
+					mSkinningMatrices[i].Position[row] = glm::vec4(envelope[0][row], envelope[1][row], envelope[2][row], envelope[3][row]);
+					mSkinningMatrices[i].Normal[row] = glm::vec4(normal[0][row], normal[1][row], normal[2][row], 0.0f);
+				}
+			}
+
+			if (envelopeCount > mSkinningMatrixCapacity) {
+				if (mSkinningMatrixBuffer != 0) {
+					glDeleteBuffers(1, &mSkinningMatrixBuffer);
+				}
+
+				mSkinningMatrixCapacity = std::max(envelopeCount, std::max(SKINNING_MATS_INITIAL, mSkinningMatrixCapacity * 2));
+
+				glCreateBuffers(1, &mSkinningMatrixBuffer);
+				glNamedBufferStorage(mSkinningMatrixBuffer, sizeof(J3DSkinningMatrix) * mSkinningMatrixCapacity, nullptr, GL_DYNAMIC_STORAGE_BIT);
+			}
+
+			glNamedBufferSubData(mSkinningMatrixBuffer, 0, sizeof(J3DSkinningMatrix) * envelopeCount, mSkinningMatrices.data());
+		}
+	}
+}
+
+uint32_t J3DSkinning::CreatePosedBuffer(const J3DGeometryAllocation& allocation) {
+	uint32_t sourceBuffer = J3DGeometryArena::GetVertexBuffer(allocation);
+	if (sourceBuffer == 0 || allocation.VertexCount == 0) {
+		return 0;
+	}
+
+	uint32_t posedBuffer = 0;
+	glCreateBuffers(1, &posedBuffer);
+	glNamedBufferStorage(posedBuffer, allocation.VertexCount * sizeof(ModernVertex), nullptr, GL_DYNAMIC_STORAGE_BIT);
+
+	// Skinning only rewrites positions and normals, so the other attributes are copied over once.
+	glCopyNamedBufferSubData(sourceBuffer, posedBuffer, allocation.BaseVertex * sizeof(ModernVertex), 0, allocation.VertexCount * sizeof(ModernVertex));
+
+	return posedBuffer;
+}
+
+void J3DSkinning::DestroyPosedBuffer(uint32_t& posedBuffer) {
+	if (posedBuffer == 0) {
+		return;
+	}
+
+	// The buffer may still be attached to a bound arena VAO, and its name may be reused.
+	J3DGeometryArena::Unbind();
+
+	glDeleteBuffers(1, &posedBuffer);
+	posedBuffer = 0;
+}
+
+void J3DSkinning::Skin(const J3DGeometryAllocation& allocation, uint32_t posedBuffer, const glm::mat4* envelopes, uint32_t envelopeCount,
+	uint32_t posedEnvelopeIndex) {
+	uint32_t sourceBuffer = J3DGeometryArena::GetVertexBuffer(allocation);
+	if (sourceBuffer == 0 || posedBuffer == 0 || envelopeCount == 0) {
+		return;
+	}
+
+	if (mSkinningProgram == 0 && !CreateSkinningProgram()) {
+		return;
+	}
+
+	UploadSkinningMatrices(envelopes, envelopeCount);
+
+	constexpr uint32_t vertexStride = sizeof(ModernVertex) / sizeof(float);
+
+	glProgramUniform1ui(mSkinningProgram, 0, allocation.VertexCount);
+	glProgramUniform1ui(mSkinningProgram, 1, allocation.BaseVertex * vertexStride);
+	glProgramUniform1ui(mSkinningProgram, 2, vertexStride);
+	glProgramUniform1ui(mSkinningProgram, 3, (uint32_t)(offsetof(ModernVertex, Position) / sizeof(float)));
+	glProgramUniform1ui(mSkinningProgram, 4, (uint32_t)(offsetof(ModernVertex, Normal) / sizeof(float)));
+	glProgramUniform1f(mSkinningProgram, 5, (float)posedEnvelopeIndex);
+
+	glBindBufferBase(GL_SHADER_STORAGE_BUFFER, SKINNING_MATS_BINDING, mSkinningMatrixBuffer);
+	glBindBufferBase(GL_SHADER_STORAGE_BUFFER, SOURCE_VERTICES_BINDING, sourceBuffer);
+	glBindBufferBase(GL_SHADER_STORAGE_BUFFER, POSED_VERTICES_BINDING, posedBuffer);
+
+	glUseProgram(mSkinningProgram);
+	glDispatchCompute((allocation.VertexCount + WORKGROUP_SIZE - 1) / WORKGROUP_SIZE, 1, 1);
+
+	// Draws read the posed buffer as vertex attributes, and ReadPosedPositions reads it back.
+	glMemoryBarrier(GL_VERTEX_ATTRIB_ARRAY_BARRIER_BIT | GL_BUFFER_UPDATE_BARRIER_BIT);
+}
+
+void J3DSkinning::ReadPosedPositions(const J3DGeometryAllocation& allocation, uint32_t posedBuffer, std::vector<glm::vec3>& positions) {
+	positions.clear();
+	if (posedBuffer == 0) {
+		return;
+	}
+
+	std::vector<ModernVertex> vertices(allocation.VertexCount);
+	glGetNamedBufferSubData(posedBuffer, 0, allocation.VertexCount * sizeof(ModernVertex), vertices.data());
+
+	positions.reserve(vertices.size());
+	for (const ModernVertex& vertex : vertices) {
+		positions.push_back(glm::vec3(vertex.Position));
+	}
+}
+
+void J3DSkinning::DestroyShaders() {
+	if (mSkinningProgram != 0) {
+		glDeleteProgram(mSkinningProgram);
+		mSkinningProgram = 0;
+	}
+
+	if (mSkinningMatrixBuffer != 0) {
+		glDeleteBuffers(1, &mSkinningMatrixBuffer);
+		mSkinningMatrixBuffer = 0;
+		mSkinningMatrixCapacity = 0;
+	}
+
+	mSkinningMatrices.clear();
+}
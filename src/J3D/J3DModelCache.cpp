@@ -0,0 +1,168 @@
+#include "J3D/J3DModelCache.hpp"
+#include "J3D/J3DModelLoader.hpp"
+#include "J3D/Data/J3DModelData.hpp"
+#include "J3D/Util/J3DUtil.hpp"
+
+#include <bstream.h>
+
+#include <exception>
+#include <future>
+#include <map>
+#include <mutex>
+#include <utility>
+#include <vector>
+
+namespace J3DModelCache {
+	namespace {
+		using ModelFuture = std::shared_future<std::shared_ptr<J3DModelData>>;
+
+		// Content hash and load flags
+		using ModelKey = std::pair<uint64_t, uint32_t>;
+
+		struct J3DModelCacheEntry {
+			std::weak_ptr<J3DModelData> Model;
+			std::shared_ptr<J3DModelData> RetainedModel;
+
+			// Set while the model is being loaded, so other threads can wait for it.
+			ModelFuture PendingLoad;
+		};
+
+		std::mutex mCacheMutex;
+		std::map<ModelKey, J3DModelCacheEntry> mEntries;
+		bool bRetainModels = false;
+
+		// Removes the entries of models that were freed. Call with mCacheMutex held.
+		void PurgeExpiredEntries() {
+			for (auto it = mEntries.begin(); it != mEntries.end();) {
+				if (!it->second.PendingLoad.valid() && it->second.Model.expired()) {
+					it = mEntries.erase(it);
+					continue;
+				}
+
+				++it;
+			}
+		}
+
+		template<typename LoadFunc>
+		std::shared_ptr<J3DModelData> LoadOrJoin(const ModelKey& key, LoadFunc loadFunc) {
+			std::promise<std::shared_ptr<J3DModelData>> loadPromise;
+
+			{
+				std::unique_lock<std::mutex> lock(mCacheMutex);
+				PurgeExpiredEntries();
+
+				J3DModelCacheEntry& entry = mEntries[key];
+
+				if (std::shared_ptr<J3DModelData> model = entry.Model.lock()) {
+					return model;
+				}
+
+				// Another thread is already loading this model - wait for it outside of the lock.
+				if (entry.PendingLoad.valid()) {
+					ModelFuture pendingLoad = entry.PendingLoad;
+					lock.unlock();
+
+					return pendingLoad.get();
+				}
+
+				entry.PendingLoad = loadPromise.get_future().share();
+			}
+
+			std::shared_ptr<J3DModelData> model;
+			try {
+				model = loadFunc();
+			}
+			catch (...) {
+				// Pass the failure on to the threads waiting for this load, and let the next request try again.
+				loadPromise.set_exception(std::current_exception());
+
+				std::lock_guard<std::mutex> lock(mCacheMutex);
+				mEntries.erase(key);
+
+				throw;
+			}
+
+			loadPromise.set_value(model);
+
+			std::lock_guard<std::mutex> lock(mCacheMutex);
+			J3DModelCacheEntry& entry = mEntries[key];
+
+			entry.Model = model;
+			entry.RetainedModel = bRetainModels ? model : nullptr;
+			entry.PendingLoad = ModelFuture();
+
+			// Don't keep failed loads around, so that they can be retried.
+			if (model == nullptr) {
+				mEntries.erase(key);
+			}
+
+			return model;
+		}
+	}
+}
+
+std::shared_ptr<J3DModelData> J3DModelCache::Load(std::filesystem::path filePath, uint32_t flags) {
+	std::vector<uint8_t> fileData;
+	if (!J3DUtility::LoadBinaryFile(filePath, fileData)) {
+		return nullptr;
+	}
+
+	ModelKey key = { J3DUtility::HashBytes(fileData.data(), fileData.size()), flags };
+
+	return LoadOrJoin(key, [&]() -> std::shared_ptr<J3DModelData> {
+		J3DModelLoader loader;
+
+		// The cache file lives next to the source, so the loader needs the path to find it.
+		if (flags & FLAGS_USE_CACHE_FILE) {
+			return loader.Load(filePath, flags);
+		}
+
+		bStream::CMemoryStream stream(fileData.data(), fileData.size(), bStream::Big, bStream::In);
+		return loader.Load(&stream, flags);
+	});
+}
+
+std::shared_ptr<J3DModelData> J3DModelCache::Load(const uint8_t* data, size_t size, uint32_t flags) {
+	if (data == nullptr || size == 0) {
+		return nullptr;
+	}
+
+	ModelKey key = { J3DUtility::HashBytes(data, size), flags };
+
+	return LoadOrJoin(key, [&]() -> std::shared_ptr<J3DModelData> {
+		bStream::CMemoryStream stream(const_cast<uint8_t*>(data), size, bStream::Big, bStream::In);
+
+		J3DModelLoader loader;
+		return loader.Load(&stream, flags);
+	});
+}
+
+void J3DModelCache::SetRetainModels(bool retain) {
+	std::lock_guard<std::mutex> lock(mCacheMutex);
+	bRetainModels = retain;
+
+	for (auto& [key, entry] : mEntries) {
+		entry.RetainedModel = retain ? entry.Model.lock() : nullptr;
+	}
+}
+
+uint32_t J3DModelCache::GetModelCount() {
+	std::lock_guard<std::mutex> lock(mCacheMutex);
+	PurgeExpiredEntries();
+
+	uint32_t count = 0;
+	for (const auto& [key, entry] : mEntries) {
+		if (!entry.PendingLoad.valid()) {
+			count++;
+		}
+	}
+
+	return count;
+}
+
+void J3DModelCache::Clear() {
+	std::lock_guard<std::mutex> lock(mCacheMutex);
+
+	// Loads in progress will re-add their entries when they finish.
+	mEntries.clear();
+}
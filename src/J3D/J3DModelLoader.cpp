@@ -11,22 +11,225 @@
 #include "J3D/Material/J3DMaterialFactoryV3.hpp"
 #include "J3D/Material/J3DMaterialTable.hpp"
 #include "J3D/Texture/J3DTextureFactory.hpp"
+#include "J3D/Texture/J3DTextureLoader.hpp"
 
 #include "J3D/Util/J3DNameTable.hpp"
+#include "J3D/Util/J3DUtil.hpp"
 
 #include "GX/GXStruct.hpp"
 
 #include <GXGeometryEnums.hpp>
+#include <GXGeometryData.hpp>
 #include <GXVertexData.hpp>
 
 #include <bstream.h>
 
-J3DModelLoader::J3DModelLoader() : mModelData(nullptr) {
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <unordered_map>
+
+namespace {
+    constexpr size_t CACHE_FILE_ALIGNMENT = 16;
+    // Size of the J3D file header, which holds the file's size and block count.
+    constexpr size_t J3D_FILE_HEADER_SIZE = 0x20;
+
+    struct J3DCacheFileHeader {
+        uint32_t Magic;
+        uint32_t Version;
+        // Hash of the source file's size, modification time and header, and of the load flags, which change what is loaded.
+        uint64_t CacheKey;
+        uint32_t VertexSize;
+        uint32_t ShapeCount;
+        uint32_t TextureCount;
+        uint32_t MaterialCount;
+        uint32_t ProgramCount;
+    };
+
+    struct J3DCacheFileShapeBounds {
+        float Radius;
+        glm::vec3 Min;
+        glm::vec3 Max;
+    };
+
+    struct J3DCacheFileTextureInfo {
+        uint32_t TextureFormat;
+        uint32_t AlphaEnabled;
+        uint32_t Width;
+        uint32_t Height;
+        uint32_t WrapS;
+        uint32_t WrapT;
+        uint32_t MipmapsEnabled;
+        uint32_t DoEdgeLOD;
+        uint32_t BiasClamp;
+        uint32_t MaxAnisotropy;
+        uint32_t MinFilter;
+        uint32_t MagFilter;
+        int32_t MinLOD;
+        int32_t MaxLOD;
+        int32_t MipmapCount;
+        int32_t LODBias;
+    };
+
+    // Appends values to a byte buffer, padding arrays so they start on an aligned offset.
+    class J3DCacheFileWriter {
+        std::vector<uint8_t> mData;
+
+    public:
+        void WriteBytes(const void* data, size_t size) {
+            const uint8_t* bytes = reinterpret_cast<const uint8_t*>(data);
+            mData.insert(mData.end(), bytes, bytes + size);
+        }
+
+        template<typename T>
+        void Write(const T& value) {
+            WriteBytes(&value, sizeof(T));
+        }
+
+        template<typename T>
+        void WriteArray(const T* values, uint32_t count) {
+            Write(count);
+            mData.resize((mData.size() + (CACHE_FILE_ALIGNMENT - 1)) & ~(CACHE_FILE_ALIGNMENT - 1), 0);
+            WriteBytes(values, count * sizeof(T));
+        }
+
+        const std::vector<uint8_t>& GetData() const { return mData; }
+    };
+
+    // Reads values back out of a cache file buffer. Arrays are returned as pointers into the buffer.
+    class J3DCacheFileReader {
+        const uint8_t* mData;
+        size_t mSize;
+        size_t mOffset;
+        bool bValid;
+
+        const uint8_t* Advance(size_t size) {
+            if (!bValid || mOffset + size > mSize) {
+                bValid = false;
+                return nullptr;
+            }
+
+            const uint8_t* ptr = mData + mOffset;
+            mOffset += size;
+
+            return ptr;
+        }
+
+    public:
+        J3DCacheFileReader(const std::vector<uint8_t>& data) : mData(data.data()), mSize(data.size()), mOffset(0), bValid(true) { }
+
+        bool IsValid() const { return bValid; }
+
+        template<typename T>
+        T Read() {
+            T value{};
+
+            const uint8_t* ptr = Advance(sizeof(T));
+            if (ptr != nullptr) {
+                std::memcpy(&value, ptr, sizeof(T));
+            }
+
+            return value;
+        }
+
+        template<typename T>
+        const T* ReadArray(uint32_t& count) {
+            count = Read<uint32_t>();
+            mOffset = (mOffset + (CACHE_FILE_ALIGNMENT - 1)) & ~(CACHE_FILE_ALIGNMENT - 1);
+
+            return reinterpret_cast<const T*>(Advance(count * sizeof(T)));
+        }
+
+        template<typename T>
+        void ReadVector(std::vector<T>& vec) {
+            uint32_t count = 0;
+            const T* values = ReadArray<T>(count);
+
+            if (values != nullptr) {
+                vec.assign(values, values + count);
+            }
+        }
+    };
+
+    bool IsCacheFileValid(const std::vector<uint8_t>& cacheData, uint64_t cacheKey) {
+        if (cacheData.size() < sizeof(J3DCacheFileHeader)) {
+            return false;
+        }
+
+        J3DCacheFileHeader header;
+        std::memcpy(&header, cacheData.data(), sizeof(J3DCacheFileHeader));
+
+        return header.Magic == CACHE_FILE_MAGIC && header.Version == CACHE_FILE_VERSION &&
+               header.CacheKey == cacheKey && header.VertexSize == sizeof(ModernVertex);
+    }
+}
+
+J3DModelLoader::J3DModelLoader() : mModelData(nullptr), bLoadedFromCache(false) {
+
+}
+
+std::shared_ptr<J3DModelData> J3DModelLoader::Load(std::filesystem::path filePath, uint32_t flags) {
+    std::vector<uint8_t> fileData;
+    if (!J3DUtility::LoadBinaryFile(filePath, fileData)) {
+        return nullptr;
+    }
+
+    bStream::CMemoryStream stream(fileData.data(), fileData.size(), bStream::Big, bStream::In);
+
+    if ((flags & FLAGS_USE_CACHE_FILE) == 0) {
+        return Load(&stream, flags);
+    }
+
+    // The cache is checked on every load, so rather than hashing all of the source, stamp it with its size, modification
+    // time and J3D header. Without a modification time there is no telling whether the source changed, so skip the cache.
+    std::error_code error;
+    int64_t writeTime = std::filesystem::last_write_time(filePath, error).time_since_epoch().count();
+    if (error) {
+        return Load(&stream, flags);
+    }
+
+    uint64_t fileSize = fileData.size();
+
+    uint64_t cacheKey = J3DUtility::HashBytes(reinterpret_cast<const uint8_t*>(&fileSize), sizeof(fileSize));
+    cacheKey = J3DUtility::HashBytes(reinterpret_cast<const uint8_t*>(&writeTime), sizeof(writeTime), cacheKey);
+    cacheKey = J3DUtility::HashBytes(fileData.data(), std::min(fileData.size(), J3D_FILE_HEADER_SIZE), cacheKey);
+    cacheKey = J3DUtility::HashBytes(reinterpret_cast<const uint8_t*>(&flags), sizeof(flags), cacheKey);
 
+    std::filesystem::path cachePath = filePath;
+    cachePath += CACHE_FILE_EXTENSION;
+
+    if (!J3DUtility::LoadBinaryFile(cachePath, mCacheFileData) || !IsCacheFileValid(mCacheFileData, cacheKey)) {
+        mCacheFileData.clear();
+    }
+
+    std::shared_ptr<J3DModelData> modelData = Load(&stream, flags);
+
+    if (modelData != nullptr && !bLoadedFromCache) {
+        WriteCacheFile(cachePath, cacheKey);
+    }
+
+    mCacheFileData.clear();
+    mCacheFileData.shrink_to_fit();
+    mCachedPrograms.clear();
+    bLoadedFromCache = false;
+
+    return modelData;
 }
 
 std::shared_ptr<J3DModelData> J3DModelLoader::Load(bStream::CStream* stream, uint32_t flags) {
     mModelData = std::make_shared<J3DModelData>();
+    mPrimitiveTypes.clear();
+    mCachedPrograms.clear();
+
+    bLoadedFromCache = !mCacheFileData.empty() && ReadCacheFile();
+    if (!mCacheFileData.empty() && !bLoadedFromCache) {
+        // Throw away the vertex tables a partial read left behind and parse the source instead.
+        mModelData = std::make_shared<J3DModelData>();
+        mPrimitiveTypes.clear();
+        mCachedPrograms.clear();
+    }
     
     J3DDataBase header;
     header.Deserialize(stream);
@@ -61,19 +264,36 @@ std::shared_ptr<J3DModelData> J3DModelLoader::Load(bStream::CStream* stream, uin
                 ReadTextureBlock(stream, flags);
                 break;
             default:
-                uint32_t unsupportedBlockSize = stream->peekUInt32(stream->tell() + 4);
-                stream->seek(stream->tell() + unsupportedBlockSize);
+                SkipBlock(stream);
                 break;
         }
     }
 
+    if (!bLoadedFromCache) {
+        mModelData->Triangulate();
+    }
+
+    // Cached programs are only valid for the materials they were read back from.
+    shared_vector<J3DMaterial>& materials = mModelData->GetMaterials();
+    if (mCachedPrograms.size() == materials.size()) {
+        for (uint32_t i = 0; i < materials.size(); i++) {
+            materials[i]->SetCachedProgram(mCachedPrograms[i]);
+        }
+    }
+
     uint32_t index = 0;
-    mModelData->MakeHierarchy(nullptr, index);
+    mModelData->MakeHierarchy(nullptr, index, (flags & FLAGS_LAZY_MATERIALIZATION) != 0);
     mModelData->CalculateRestPose();
+    mModelData->CalculateBounds();
 
     return mModelData;
 }
 
+void J3DModelLoader::SkipBlock(bStream::CStream* stream) {
+    uint32_t blockSize = stream->peekUInt32(stream->tell() + 4);
+    stream->seek(stream->tell() + blockSize);
+}
+
 void J3DModelLoader::ReadInformationBlock(bStream::CStream* stream, uint32_t flags) {
     size_t currentStreamPos = stream->tell();
 
@@ -117,6 +337,11 @@ void J3DModelLoader::ReadInformationBlock(bStream::CStream* stream, uint32_t fla
 }
 
 void J3DModelLoader::ReadVertexBlock(bStream::CStream* stream, uint32_t flags) {
+    if (bLoadedFromCache) {
+        SkipBlock(stream);
+        return;
+    }
+
     size_t currentStreamPos = stream->tell();
 
     J3DVertexBlock vtxBlock;
@@ -308,6 +533,11 @@ void J3DModelLoader::ReadJointBlock(bStream::CStream* stream, uint32_t flags) {
 }
 
 void J3DModelLoader::ReadShapeBlock(bStream::CStream* stream, uint32_t flags) {
+    if (bLoadedFromCache) {
+        SkipBlock(stream);
+        return;
+    }
+
     size_t currentStreamPos = stream->tell();
 
     J3DShapeBlock shapeBlock;
@@ -321,6 +551,9 @@ void J3DModelLoader::ReadShapeBlock(bStream::CStream* stream, uint32_t flags) {
         shapes.push_back(shapeFactory.Create(stream, i, &mModelData->mVertexData));
     }
 
+    mPrimitiveTypes = shapeFactory.GetPrimitiveTypes();
+    mModelData->mShapeBounds = shapeFactory.GetShapeBounds();
+
     stream->seek(currentStreamPos + shapeBlock.BlockSize);
 }
 
@@ -357,6 +590,11 @@ void J3DModelLoader::ReadMaterialBlockV3(bStream::CStream* stream, uint32_t flag
 }
 
 void J3DModelLoader::ReadTextureBlock(bStream::CStream* stream, uint32_t flags) {
+    if (bLoadedFromCache) {
+        SkipBlock(stream);
+        return;
+    }
+
     size_t currentStreamPos = stream->tell();
 
     J3DTextureBlock texBlock;
@@ -365,9 +603,414 @@ void J3DModelLoader::ReadTextureBlock(bStream::CStream* stream, uint32_t flags)
     mModelData->mMaterialTable->mTextures.reserve(texBlock.Count);
 
     J3DTextureFactory textureFactory(&texBlock, stream);
-    for (int i = 0; i < texBlock.Count; i++) {
-        mModelData->mMaterialTable->mTextures.push_back(textureFactory.Create(stream, i));
+
+    if (flags & FLAGS_LAZY_MATERIALIZATION) {
+        // Keep a copy of the block around for the textures to decode from when they're first used.
+        std::shared_ptr<std::vector<uint8_t>> blockData = std::make_shared<std::vector<uint8_t>>(texBlock.BlockSize);
+
+        stream->seek(currentStreamPos);
+        stream->readBytesTo(blockData->data(), texBlock.BlockSize);
+
+        for (int i = 0; i < texBlock.Count; i++) {
+            mModelData->mMaterialTable->mTextures.push_back(textureFactory.CreateDeferred(stream, i, blockData, (uint32_t)currentStreamPos));
+        }
+    }
+    else {
+        for (int i = 0; i < texBlock.Count; i++) {
+            mModelData->mMaterialTable->mTextures.push_back(textureFactory.Create(stream, i));
+        }
     }
 
     stream->seek(currentStreamPos + texBlock.BlockSize);
 }
+
+bool J3DModelLoader::ReadCacheFile() {
+    J3DCacheFileReader reader(mCacheFileData);
+
+    J3DCacheFileHeader header = reader.Read<J3DCacheFileHeader>();
+
+    // VTX1 attribute tables. If the rest of the file turns out to be bad, Load() discards the model these were read into.
+    GXAttributeData& vtxData = mModelData->mVertexData;
+    reader.ReadVector(vtxData.GetPositions());
+    reader.ReadVector(vtxData.GetNormals());
+    for (uint32_t i = 0; i < 2; i++) {
+        reader.ReadVector(vtxData.GetColors(i));
+    }
+    for (uint32_t i = 0; i < 8; i++) {
+        reader.ReadVector(vtxData.GetTexCoords(i));
+    }
+
+    // Everything else is staged here and only handed to the model once the whole file has been read,
+    // so that a bad file doesn't leave textures or shape data behind.
+    shared_vector<GXShape> shapes;
+    std::vector<std::unique_ptr<uint32_t>> shapeMatrixTypes;
+    std::vector<J3DShapeBounds> shapeBounds;
+    std::vector<EGXPrimitiveType> primitiveTypes;
+
+    // SHP1 shapes, already converted to modern vertices
+    for (uint32_t i = 0; i < header.ShapeCount && reader.IsValid(); i++) {
+        std::shared_ptr<GXShape> shape = std::make_shared<GXShape>();
+        shapeMatrixTypes.push_back(std::make_unique<uint32_t>(reader.Read<uint32_t>()));
+
+        J3DCacheFileShapeBounds cachedBounds = reader.Read<J3DCacheFileShapeBounds>();
+
+        J3DShapeBounds bounds;
+        bounds.Radius = cachedBounds.Radius;
+        bounds.Min = cachedBounds.Min;
+        bounds.Max = cachedBounds.Max;
+        shapeBounds.push_back(bounds);
+
+        uint32_t attributeCount = 0;
+        const uint32_t* attributes = reader.ReadArray<uint32_t>(attributeCount);
+        if (attributes == nullptr) {
+            return false;
+        }
+
+        auto& attributeTable = shape->GetAttributeTable();
+        for (uint32_t j = 0; j < attributeCount; j++) {
+            attributeTable.push_back(static_cast<EGXAttribute>(attributes[j]));
+        }
+
+        auto& primitives = shape->GetPrimitives();
+        uint32_t primitiveCount = reader.Read<uint32_t>();
+
+        for (uint32_t j = 0; j < primitiveCount && reader.IsValid(); j++) {
+            EGXPrimitiveType primType = static_cast<EGXPrimitiveType>(reader.Read<uint32_t>());
+
+            uint32_t vertexCount = 0;
+            const ModernVertex* vertices = reader.ReadArray<ModernVertex>(vertexCount);
+            if (vertices == nullptr) {
+                return false;
+            }
+
+            GXPrimitive* primitive = new GXPrimitive(primType);
+            primitive->GetVertices().assign(vertices, vertices + vertexCount);
+
+            primitives.push_back(primitive);
+            primitiveTypes.push_back(primType);
+        }
+
+        shape->CalculateCenterOfMass();
+        shapes.push_back(shape);
+    }
+
+    // The shapes triangulated into the buffers that are uploaded to the geometry arena
+    std::vector<ModernVertex> modelVertices;
+    std::vector<uint32_t> modelIndices;
+    std::vector<J3DShapeIndexRange> shapeIndexRanges;
+    reader.ReadVector(modelVertices);
+    reader.ReadVector(modelIndices);
+    reader.ReadVector(shapeIndexRanges);
+
+    if (shapeIndexRanges.size() != shapes.size()) {
+        return false;
+    }
+
+    // Linked shader programs, shared by the materials whose GLSL hashed the same
+    std::vector<std::shared_ptr<const J3DProgramBinary>> programs;
+    for (uint32_t i = 0; i < header.ProgramCount && reader.IsValid(); i++) {
+        std::shared_ptr<J3DProgramBinary> program = std::make_shared<J3DProgramBinary>();
+        program->ShaderHash = reader.Read<uint64_t>();
+        program->Format = reader.Read<uint32_t>();
+        reader.ReadVector(program->Data);
+
+        programs.push_back(program);
+    }
+
+    uint32_t materialCount = 0;
+    const uint32_t* materialPrograms = reader.ReadArray<uint32_t>(materialCount);
+    if (materialPrograms == nullptr || materialCount != header.MaterialCount) {
+        return false;
+    }
+
+    std::vector<std::shared_ptr<const J3DProgramBinary>> cachedPrograms(materialCount);
+    for (uint32_t i = 0; i < materialCount; i++) {
+        if (materialPrograms[i] < programs.size()) {
+            cachedPrograms[i] = programs[materialPrograms[i]];
+        }
+    }
+
+    // Raw TEX1 blocks that lazily loaded textures decode from when they are first used
+    std::vector<std::shared_ptr<std::vector<uint8_t>>> sourceBlocks(reader.Read<uint32_t>());
+    for (std::shared_ptr<std::vector<uint8_t>>& block : sourceBlocks) {
+        block = std::make_shared<std::vector<uint8_t>>();
+        reader.ReadVector(*block);
+    }
+
+    // TEX1 textures, either already decoded to RGBA8 or deferred
+    shared_vector<J3DTexture> textures;
+    textures.reserve(header.TextureCount);
+    std::vector<const uint8_t*> mipImages;
+
+    for (uint32_t i = 0; i < header.TextureCount && reader.IsValid(); i++) {
+        uint32_t nameLength = 0;
+        const char* name = reader.ReadArray<char>(nameLength);
+        if (name == nullptr) {
+            return false;
+        }
+
+        uint32_t sourceBlock = reader.Read<uint32_t>();
+        if (sourceBlock != UINT32_MAX) {
+            uint32_t sourceOffset = reader.Read<uint32_t>();
+            if (sourceBlock >= sourceBlocks.size() || sourceOffset >= sourceBlocks[sourceBlock]->size()) {
+                return false;
+            }
+
+            std::shared_ptr<std::vector<uint8_t>>& block = sourceBlocks[sourceBlock];
+            bStream::CMemoryStream blockStream(block->data(), block->size(), bStream::Big, bStream::In);
+            blockStream.seek(sourceOffset);
+
+            J3DTextureLoader btiLoader{};
+            textures.push_back(btiLoader.LoadDeferred(std::string(name, nameLength), &blockStream, block, sourceOffset));
+            continue;
+        }
+
+        J3DCacheFileTextureInfo info = reader.Read<J3DCacheFileTextureInfo>();
+        if (!reader.IsValid() || info.MipmapCount < 1) {
+            return false;
+        }
+
+        // Check each mip image against the size it is uploaded with before creating the texture, so that a bad file
+        // falls back to loading the source instead of having the upload read past the end of an image.
+        mipImages.clear();
+        for (int mip = 0; mip < info.MipmapCount; mip++) {
+            uint32_t mipSize = 0;
+            const uint8_t* mipData = reader.ReadArray<uint8_t>(mipSize);
+
+            uint16_t mipWidth = (uint16_t)(info.Width / std::pow(2.0f, mip));
+            uint16_t mipHeight = (uint16_t)(info.Height / std::pow(2.0f, mip));
+
+            if (mipData == nullptr || mipSize != (uint32_t)mipWidth * mipHeight * 4) {
+                return false;
+            }
+
+            mipImages.push_back(mipData);
+        }
+
+        std::shared_ptr<J3DTexture> texture = std::make_shared<J3DTexture>();
+
+        texture->Name = std::string(name, nameLength);
+        texture->TextureFormat = static_cast<EGXTextureFormat>(info.TextureFormat);
+        texture->AlphaEnabled = info.AlphaEnabled != 0;
+        texture->Width = static_cast<uint16_t>(info.Width);
+        texture->Height = static_cast<uint16_t>(info.Height);
+        texture->WrapS = static_cast<EGXWrapMode>(info.WrapS);
+        texture->WrapT = static_cast<EGXWrapMode>(info.WrapT);
+        texture->PalettesEnabled = false;
+        texture->MipmapsEnabled = info.MipmapsEnabled != 0;
+        texture->DoEdgeLOD = info.DoEdgeLOD != 0;
+        texture->BiasClamp = info.BiasClamp != 0;
+        texture->MaxAnisotropy = static_cast<EGXMaxAnisotropy>(info.MaxAnisotropy);
+        texture->MinFilter = static_cast<EGXFilterMode>(info.MinFilter);
+        texture->MagFilter = static_cast<EGXFilterMode>(info.MagFilter);
+        texture->MinLOD = info.MinLOD;
+        texture->MaxLOD = info.MaxLOD;
+        texture->MipmapCount = info.MipmapCount;
+        texture->LODBias = info.LODBias;
+
+        // Textures release their GL handle and images when they are destroyed, so staged ones clean up after a failed read.
+        J3DTextureLoader::InitTexture(texture);
+
+        for (int mip = 0; mip < texture->MipmapCount; mip++) {
+            uint16_t mipWidth = (uint16_t)(texture->Width / std::pow(2.0f, mip));
+            uint16_t mipHeight = (uint16_t)(texture->Height / std::pow(2.0f, mip));
+
+            uint32_t mipSize = (uint32_t)mipWidth * mipHeight * 4;
+            uint8_t* imgData = new uint8_t[mipSize];
+            std::memcpy(imgData, mipImages[mip], mipSize);
+
+            texture->ImageData.push_back(imgData);
+            J3DTextureLoader::SetTextureMipImage(texture->TexHandle, mip, mipWidth, mipHeight, imgData);
+        }
+
+        textures.push_back(texture);
+    }
+
+    if (!reader.IsValid()) {
+        return false;
+    }
+
+    for (uint32_t i = 0; i < shapes.size(); i++) {
+        shapes[i]->SetUserData(shapeMatrixTypes[i].release());
+    }
+
+    mModelData->mGeometry.GetShapes() = std::move(shapes);
+    mModelData->mShapeBounds = std::move(shapeBounds);
+    mModelData->mShapeIndexRanges = std::move(shapeIndexRanges);
+    mModelData->mModelVertices = std::move(modelVertices);
+    mModelData->mModelIndices = std::move(modelIndices);
+    mModelData->mMaterialTable->mTextures = std::move(textures);
+    mPrimitiveTypes = std::move(primitiveTypes);
+    mCachedPrograms = std::move(cachedPrograms);
+
+    return true;
+}
+
+bool J3DModelLoader::WriteCacheFile(std::filesystem::path cachePath, uint64_t cacheKey) {
+    auto& shapes = mModelData->mGeometry.GetShapes();
+    auto& textures = mModelData->mMaterialTable->mTextures;
+    auto& materials = mModelData->GetMaterials();
+
+    // Read back the linked programs, storing each distinct one once. Materials whose shaders haven't been
+    // generated yet, such as those of lazy loads, are left to generate them.
+    std::vector<J3DProgramBinary> programs;
+    std::vector<uint32_t> materialPrograms(materials.size(), UINT32_MAX);
+    std::unordered_map<uint64_t, uint32_t> programIndices;
+
+    for (uint32_t i = 0; i < materials.size(); i++) {
+        auto it = programIndices.find(materials[i]->GetShaderHash());
+        if (it != programIndices.end()) {
+            materialPrograms[i] = it->second;
+            continue;
+        }
+
+        J3DProgramBinary program;
+        if (!materials[i]->GetProgramBinary(program)) {
+            continue;
+        }
+
+        materialPrograms[i] = (uint32_t)programs.size();
+        programIndices.emplace(program.ShaderHash, materialPrograms[i]);
+        programs.push_back(std::move(program));
+    }
+
+    J3DCacheFileWriter writer;
+
+    J3DCacheFileHeader header = {
+        CACHE_FILE_MAGIC,
+        CACHE_FILE_VERSION,
+        cacheKey,
+        (uint32_t)sizeof(ModernVertex),
+        (uint32_t)shapes.size(),
+        (uint32_t)textures.size(),
+        (uint32_t)materials.size(),
+        (uint32_t)programs.size()
+    };
+    writer.Write(header);
+
+    // VTX1 attribute tables
+    GXAttributeData& vtxData = mModelData->mVertexData;
+    writer.WriteArray(vtxData.GetPositions().data(), (uint32_t)vtxData.GetPositions().size());
+    writer.WriteArray(vtxData.GetNormals().data(), (uint32_t)vtxData.GetNormals().size());
+    for (uint32_t i = 0; i < 2; i++) {
+        writer.WriteArray(vtxData.GetColors(i).data(), (uint32_t)vtxData.GetColors(i).size());
+    }
+    for (uint32_t i = 0; i < 8; i++) {
+        writer.WriteArray(vtxData.GetTexCoords(i).data(), (uint32_t)vtxData.GetTexCoords(i).size());
+    }
+
+    // SHP1 shapes
+    size_t primitiveIndex = 0;
+    for (uint32_t shapeIndex = 0; shapeIndex < shapes.size(); shapeIndex++) {
+        std::shared_ptr<GXShape>& shape = shapes[shapeIndex];
+        writer.Write<uint32_t>(*shape->GetUserData<uint32_t>());
+
+        J3DCacheFileShapeBounds cachedBounds = { 0.0f, glm::vec3(0.0f), glm::vec3(0.0f) };
+        if (shapeIndex < mModelData->mShapeBounds.size()) {
+            const J3DShapeBounds& bounds = mModelData->mShapeBounds[shapeIndex];
+            cachedBounds = { bounds.Radius, bounds.Min, bounds.Max };
+        }
+        writer.Write(cachedBounds);
+
+        std::vector<uint32_t> attributes;
+        for (EGXAttribute attribute : shape->GetAttributeTable()) {
+            attributes.push_back(static_cast<uint32_t>(attribute));
+        }
+        writer.WriteArray(attributes.data(), (uint32_t)attributes.size());
+
+        auto& primitives = shape->GetPrimitives();
+        writer.Write<uint32_t>((uint32_t)primitives.size());
+
+        for (auto primitive : primitives) {
+            // Every primitive should have had its type recorded while reading SHP1.
+            if (primitiveIndex >= mPrimitiveTypes.size()) {
+                return false;
+            }
+
+            auto& vertices = primitive->GetVertices();
+
+            writer.Write<uint32_t>(static_cast<uint32_t>(mPrimitiveTypes[primitiveIndex++]));
+            writer.WriteArray(vertices.data(), (uint32_t)vertices.size());
+        }
+    }
+
+    // Triangulated geometry. This is written before the model is first drawn, so it hasn't been uploaded and released yet.
+    writer.WriteArray(mModelData->mModelVertices.data(), (uint32_t)mModelData->mModelVertices.size());
+    writer.WriteArray(mModelData->mModelIndices.data(), (uint32_t)mModelData->mModelIndices.size());
+    writer.WriteArray(mModelData->mShapeIndexRanges.data(), (uint32_t)mModelData->mShapeIndexRanges.size());
+
+    // Shader programs
+    for (const J3DProgramBinary& program : programs) {
+        writer.Write<uint64_t>(program.ShaderHash);
+        writer.Write<uint32_t>(program.Format);
+        writer.WriteArray(program.Data.data(), (uint32_t)program.Data.size());
+    }
+    writer.WriteArray(materialPrograms.data(), (uint32_t)materialPrograms.size());
+
+    // Textures that are still waiting to be decoded are written as the raw blocks they decode from, so that writing
+    // the cache file doesn't decode them. Lazily loaded textures all share their model's TEX1 block.
+    std::vector<const std::vector<uint8_t>*> sourceBlocks;
+    std::unordered_map<const std::vector<uint8_t>*, uint32_t> sourceBlockIndices;
+
+    for (std::shared_ptr<J3DTexture>& texture : textures) {
+        if (texture->IsDecodePending() && sourceBlockIndices.emplace(texture->SourceData.get(), (uint32_t)sourceBlocks.size()).second) {
+            sourceBlocks.push_back(texture->SourceData.get());
+        }
+    }
+
+    writer.Write<uint32_t>((uint32_t)sourceBlocks.size());
+    for (const std::vector<uint8_t>* block : sourceBlocks) {
+        writer.WriteArray(block->data(), (uint32_t)block->size());
+    }
+
+    // TEX1 textures
+    for (std::shared_ptr<J3DTexture>& texture : textures) {
+        writer.WriteArray(texture->Name.data(), (uint32_t)texture->Name.size());
+
+        if (texture->IsDecodePending()) {
+            writer.Write<uint32_t>(sourceBlockIndices[texture->SourceData.get()]);
+            writer.Write<uint32_t>(texture->SourceOffset);
+            continue;
+        }
+
+        writer.Write<uint32_t>(UINT32_MAX);
+
+        J3DCacheFileTextureInfo info = {
+            static_cast<uint32_t>(texture->TextureFormat),
+            texture->AlphaEnabled,
+            texture->Width,
+            texture->Height,
+            static_cast<uint32_t>(texture->WrapS),
+            static_cast<uint32_t>(texture->WrapT),
+            texture->MipmapsEnabled,
+            texture->DoEdgeLOD,
+            texture->BiasClamp,
+            static_cast<uint32_t>(texture->MaxAnisotropy),
+            static_cast<uint32_t>(texture->MinFilter),
+            static_cast<uint32_t>(texture->MagFilter),
+            texture->MinLOD,
+            texture->MaxLOD,
+            (int32_t)texture->ImageData.size(),
+            texture->LODBias
+        };
+        writer.Write(info);
+
+        for (size_t mip = 0; mip < texture->ImageData.size(); mip++) {
+            uint16_t mipWidth = (uint16_t)(texture->Width / std::pow(2.0f, mip));
+            uint16_t mipHeight = (uint16_t)(texture->Height / std::pow(2.0f, mip));
+
+            writer.WriteArray(texture->ImageData[mip], (uint32_t)(mipWidth * mipHeight * 4));
+        }
+    }
+
+    std::ofstream cacheFile(cachePath, std::ios::binary | std::ios::trunc);
+    if (!cacheFile.is_open()) {
+        std::cout << "Unable to write model cache file " << cachePath << std::endl;
+        return false;
+    }
+
+    const std::vector<uint8_t>& data = writer.GetData();
+    cacheFile.write(reinterpret_cast<const char*>(data.data()), data.size());
+
+    return cacheFile.good();
+}
@@ -16,7 +16,7 @@
 
 #define etoi magic_enum::enum_integer
 
-bool J3DFragmentShaderGenerator::GenerateFragmentShader(J3DMaterial* material, uint32_t& shaderHandle) {
+bool J3DFragmentShaderGenerator::GenerateFragmentShader(J3DMaterial* material, uint32_t& shaderHandle, std::string* source) {
 	// TODO: actual fragment shader generation
 
 	std::stringstream fragmentShader;
@@ -40,6 +40,10 @@ bool J3DFragmentShaderGenerator::GenerateFragmentShader(J3DMaterial* material, u
 
 	//std::string shaderChars = J3DUtility::LoadTextFile("./res/shaders/Debug_NormalColors.frag");
 	std::string shaderStr = fragmentShader.str();
+	if (source != nullptr) {
+		*source = shaderStr;
+	}
+
 	const char* s = shaderStr.c_str();
 
 	glShaderSource(shaderHandle, 1, &s, NULL);
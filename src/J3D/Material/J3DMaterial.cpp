@@ -2,7 +2,10 @@
 #include "J3D/Material/J3DFragmentShaderGenerator.hpp"
 #include "J3D/Material/J3DUniformBufferObject.hpp"
 #include "J3D/Material/J3DVertexShaderGenerator.hpp"
+#include "J3D/Rendering/J3DCulling.hpp"
 #include "J3D/Texture/J3DTexture.hpp"
+#include "J3D/Texture/J3DTextureLoader.hpp"
+#include "J3D/Util/J3DUtil.hpp"
 
 #include <GXGeometryData.hpp>
 #include <atomic>
@@ -14,7 +17,8 @@ std::atomic<uint16_t> J3DMaterial::sMaterialIdSrc = 1;
 
 J3DMaterial::J3DMaterial()
   : mShaderProgram(-1), AreRegisterColorsAnimating(false), AreTexIndicesAnimating(false),
-  mShape(std::weak_ptr<GXShape>()), bSelected(false), mMaterialId(sMaterialIdSrc++) {
+  mShape(std::weak_ptr<GXShape>()), mIndexOffset(0), mIndexCount(0), mShaderHash(0),
+  bSelected(false), bShadersPending(false), mMaterialId(sMaterialIdSrc++) {
   TevBlock = std::make_shared<J3DTevBlock>();
 }
 
@@ -27,26 +31,42 @@ J3DMaterial::~J3DMaterial() {
 bool J3DMaterial::GenerateShaders() {
   uint32_t vertShader, fragShader;
 
+  bShadersPending = false;
+
   if (mShaderProgram != -1) {
     glDeleteProgram(mShaderProgram);
+    mShaderProgram = -1;
+  }
+
+  // A cached program is only tried once, whether or not the driver accepts it.
+  std::shared_ptr<const J3DProgramBinary> cachedProgram = std::move(mCachedProgram);
+  if (cachedProgram != nullptr && LoadProgramBinary(*cachedProgram)) {
+    return true;
   }
 
-  if (!J3DVertexShaderGenerator::GenerateVertexShader(this, vertShader)) {
+  std::string vertSource, fragSource;
+
+  if (!J3DVertexShaderGenerator::GenerateVertexShader(this, vertShader, &vertSource)) {
     std::cout << "Error in vertex shader generator!" << std::endl;
     return false;
   }
 
-  if (!J3DFragmentShaderGenerator::GenerateFragmentShader(this, fragShader)) {
+  if (!J3DFragmentShaderGenerator::GenerateFragmentShader(this, fragShader, &fragSource)) {
     std::cout << "Error in fragment shader generator!" << std::endl;
 
     glDeleteShader(vertShader);
     return false;
   }
 
+  mShaderHash = J3DUtility::HashBytes(reinterpret_cast<const uint8_t*>(vertSource.data()), vertSource.size());
+  mShaderHash = J3DUtility::HashBytes(reinterpret_cast<const uint8_t*>(fragSource.data()), fragSource.size(), mShaderHash);
+
   mShaderProgram = glCreateProgram();
   glAttachShader(mShaderProgram, vertShader);
   glAttachShader(mShaderProgram, fragShader);
 
+  // Lets model cache files store the linked program.
+  glProgramParameteri(mShaderProgram, GL_PROGRAM_BINARY_RETRIEVABLE_HINT, GL_TRUE);
   glLinkProgram(mShaderProgram);
 
   int32_t isLinked = 0;
@@ -76,6 +96,18 @@ bool J3DMaterial::GenerateShaders() {
     return false;
   }
 
+  InitProgramUniforms();
+
+  // Program linked successfully, detach and delete the shaders because they're not needed now
+  glDetachShader(mShaderProgram, vertShader);
+  glDetachShader(mShaderProgram, fragShader);
+  glDeleteShader(vertShader);
+  glDeleteShader(fragShader);
+
+  return true;
+}
+
+void J3DMaterial::InitProgramUniforms() {
   for (int i = 0; i < 8; i++) {
     std::string name = "Texture[" + std::to_string(i) + "]";
     uint32_t uniformID = glGetUniformLocation(mShaderProgram, name.c_str());
@@ -83,8 +115,6 @@ bool J3DMaterial::GenerateShaders() {
     glProgramUniform1i(mShaderProgram, uniformID, i);
   }
 
-  glm::vec4 test(0, 0, 0, 1.0);
-
   uint32_t uniformID = glGetUniformLocation(mShaderProgram, "uMaterialReg[0]");
   glProgramUniform4fv(mShaderProgram, uniformID, 1, &LightBlock.mMaterialColor[0][0]);
   uniformID = glGetUniformLocation(mShaderProgram, "uMaterialReg[1]");
@@ -93,16 +123,54 @@ bool J3DMaterial::GenerateShaders() {
   glProgramUniform4fv(mShaderProgram, uniformID, 1, &LightBlock.mAmbientColor[0][0]);
   uniformID = glGetUniformLocation(mShaderProgram, "uAmbientReg[1]");
   glProgramUniform4fv(mShaderProgram, uniformID, 1, &LightBlock.mAmbientColor[1][0]);
+}
 
-  // Program linked successfully, detach and delete the shaders because they're not needed now
-  glDetachShader(mShaderProgram, vertShader);
-  glDetachShader(mShaderProgram, fragShader);
-  glDeleteShader(vertShader);
-  glDeleteShader(fragShader);
+bool J3DMaterial::LoadProgramBinary(const J3DProgramBinary& binary) {
+  if (binary.Data.empty()) {
+    return false;
+  }
+
+  mShaderProgram = glCreateProgram();
+  glProgramParameteri(mShaderProgram, GL_PROGRAM_BINARY_RETRIEVABLE_HINT, GL_TRUE);
+  glProgramBinary(mShaderProgram, binary.Format, binary.Data.data(), (GLsizei)binary.Data.size());
+
+  int32_t isLinked = 0;
+  glGetProgramiv(mShaderProgram, GL_LINK_STATUS, &isLinked);
+  if (!isLinked) {
+    glDeleteProgram(mShaderProgram);
+    mShaderProgram = -1;
+
+    return false;
+  }
+
+  mShaderHash = binary.ShaderHash;
+  InitProgramUniforms();
 
   return true;
 }
 
+bool J3DMaterial::GetProgramBinary(J3DProgramBinary& binary) const {
+  if (mShaderProgram == -1) {
+    return false;
+  }
+
+  int32_t length = 0;
+  glGetProgramiv(mShaderProgram, GL_PROGRAM_BINARY_LENGTH, &length);
+  if (length <= 0) {
+    return false;
+  }
+
+  GLenum format = 0;
+  binary.Data.resize(length);
+  glGetProgramBinary(mShaderProgram, length, &length, &format, binary.Data.data());
+
+  binary.Data.resize(length);
+  binary.Format = format;
+  binary.ShaderHash = mShaderHash;
+
+  return length > 0;
+}
+
 int GXBlendModeControlToGLFactor(EGXBlendModeControl Control)
 {
 	switch (Control)
@@ -184,7 +252,25 @@ static int GXCullModeToGLMode(EGXCullMode mode) {
   }
 }
 
+void J3DMaterial::Prewarm(const std::vector<std::shared_ptr<J3DTexture>>& textures) {
+  if (bShadersPending) {
+    GenerateShaders();
+    J3DUniformBufferObject::LinkShaderProgramToUBO(mShaderProgram);
+  }
+
+  for (uint16_t texIndex : TevBlock->mTextureIndices) {
+    if (texIndex < textures.size()) {
+      J3DTextureLoader::Materialize(textures[texIndex]);
+    }
+  }
+}
+
 void J3DMaterial::BindJ3DShader(const std::vector<std::shared_ptr<J3DTexture>>& textures) {
+  if (bShadersPending) {
+    GenerateShaders();
+    J3DUniformBufferObject::LinkShaderProgramToUBO(mShaderProgram);
+  }
+
   glUseProgram(mShaderProgram);
   for (int i = 0; i < TevBlock->mTextureIndices.size(); i++) {
     uint16_t texIndex = TevBlock->mTextureIndices[i];
@@ -192,6 +278,8 @@ void J3DMaterial::BindJ3DShader(const std::vector<std::shared_ptr<J3DTexture>>&
       texIndex = AnimationTexIndices[i];
     }
 
+    // Textures loaded lazily are decoded the first time they're bound.
+    J3DTextureLoader::Materialize(textures[texIndex]);
     glBindTextureUnit(i, textures[texIndex]->TexHandle);
   }
 
@@ -268,7 +356,7 @@ void J3DMaterial::ConfigureGLState() {
 }
 
 void J3DMaterial::Render(const std::vector<std::shared_ptr<J3DTexture>>& textures,
-  uint32_t shaderOverride) {
+  uint32_t shaderOverride, uint32_t baseVertex, uint32_t firstIndex) {
   if (mShape.expired()) {
     return;
   }
@@ -291,10 +379,7 @@ void J3DMaterial::Render(const std::vector<std::shared_ptr<J3DTexture>>& texture
   J3DUniformBufferObject::SetBillboardType(*lockedShape->GetUserData<uint32_t>());
   J3DUniformBufferObject::SubmitUBO();
 
-  uint32_t offset, count;
-  lockedShape->GetVertexOffsetAndCount(offset, count);
-
-  glDrawElements(GL_TRIANGLES, count, GL_UNSIGNED_INT, (const void*)(offset * sizeof(uint32_t)));
+  J3DCulling::DrawElements(mIndexCount, firstIndex + mIndexOffset, baseVertex);
 }
 
 void J3DMaterial::CalculateTexMatrices(const glm::mat4& modelMatrix, const glm::mat4& viewMatrix,
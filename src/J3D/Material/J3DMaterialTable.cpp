@@ -87,6 +87,11 @@ bool J3DMaterialTable::SetTexture(uint32_t idx, std::shared_ptr<J3DTexture> text
 
   mTextures[idx] = texture;
 
+  if (texture->IsDecodePending()) {
+    J3DTextureLoader::Materialize(texture);
+    return true;
+  }
+
   J3DTextureLoader::InitTexture(texture);
   for (uint32_t i = 0; i < texture->MipmapCount; i++) {
     uint16_t mipWidth = (uint16_t)(texture->Width / std::pow(2.0f, i));
@@ -75,6 +75,11 @@ std::shared_ptr<J3DMaterialTable> J3DMaterialTableLoader::Load(bStream::CStream*
 
 		if (instanceMaterial != nullptr) {
 			instanceMaterial->SetShape(defaultMaterial->GetShape());
+
+			uint32_t indexOffset, indexCount;
+			defaultMaterial->GetIndexRange(indexOffset, indexCount);
+			instanceMaterial->SetIndexRange(indexOffset, indexCount);
+
 			instanceMaterial->GenerateShaders();
 
 			J3DUniformBufferObject::LinkMaterialToUBO(instanceMaterial);
@@ -23,13 +23,35 @@ std::string J3DShaderGeneratorCommon::GenerateStructs() {
 		"\tvec4 TevColor[4];\n"
 		"\tvec4 KonstColor[4];\n\n"
 		"\tGXLight Lights[8];\n"
-		"\tmat4 Envelopes[512];\n"
 		"\tmat4 TexMatrices[10];\n"
 		"\tmat4 IndTexMatrices[10];\n"
 		"\tuint BillboardType;\n"
 		"\tuint ModelId;\n"
 		"\tuint MaterialId;\n"
+		"\tuint EnvelopeBase;\n"
 		"\tvec4 HighlightColor;\n"
+		"\tuint BatchStart;\n"
+		"};\n\n";
+
+	stream << "// An envelope's model-view and normal matrices, stored as the rows of affine matrices: transform with vec4(v, w) * matrix.\n";
+	stream << "struct EnvelopeMatrix {\n"
+		"\tmat3x4 ModelView;\n"
+		"\tmat3x4 Normal;\n"
+		"};\n\n";
+
+	stream << "// Envelope matrices of every model drawn this frame. The current model's start at EnvelopeBase.\n";
+	stream << "layout (std430, binding=1) readonly buffer uEnvelopeData {\n"
+		"\tEnvelopeMatrix Envelopes[];\n"
+		"};\n\n";
+
+	stream << "// While a batch of culled draws is drawn with one multi-draw, BatchDraws[BatchStart + gl_DrawID] is the index of\n";
+	stream << "// each surviving draw, and DrawEnvelopeBases holds the envelope base of each draw by index.\n";
+	stream << "layout (std430, binding=10) readonly buffer uBatchDraws {\n"
+		"\tuint BatchDraws[];\n"
+		"};\n\n";
+
+	stream << "layout (std430, binding=11) readonly buffer uDrawEnvelopeBases {\n"
+		"\tuint DrawEnvelopeBases[];\n"
 		"};\n\n";
 
 	return stream.str();
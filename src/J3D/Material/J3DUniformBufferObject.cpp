@@ -6,12 +6,15 @@
 
 #include <cstdint>
 #include <algorithm>
+#include <vector>
 
 namespace J3DUniformBufferObject {
 	namespace {
 		constexpr uint32_t LIGHTS_MAX = 8;
 		constexpr uint32_t COLORS_MAX = 4;
-		constexpr uint32_t ENVELOPE_MATS_MAX = 512;
+		// Capacity of the envelope storage buffer, in matrices. It only grows for a single allocation larger than this.
+		constexpr uint32_t ENVELOPE_MATS_CAPACITY = 16384;
+		constexpr uint32_t ENVELOPE_SSBO_BINDING = 1;
 		constexpr uint32_t TEX_MATS_MAX = 10;
 		constexpr uint32_t IND_TEX_MATS_MAX = 10;
 		constexpr char* UBO_NAME = "uSharedData";
@@ -25,7 +28,6 @@ namespace J3DUniformBufferObject {
 			glm::vec4 KonstColor[COLORS_MAX];
 
 			J3DLight Lights[LIGHTS_MAX];
-			glm::mat4 Envelopes[ENVELOPE_MATS_MAX];
 			glm::mat4 TexMatrices[TEX_MATS_MAX];
 			glm::mat4 IndTexMatrices[IND_TEX_MATS_MAX];
 
@@ -34,15 +36,47 @@ namespace J3DUniformBufferObject {
 			uint32_t ModelId;
 			uint32_t MaterialId;
 
-			uint32_t Padding0;
+			// Index of the current model's first matrix in the envelope storage buffer.
+			uint32_t EnvelopeBase;
 
 			glm::vec4 HighlightColor;
 
+			// Start of the current batch's draws in the culling buffers, or UINT32_MAX when not drawing a batch.
+			uint32_t BatchStart;
+
 			J3DUniformBufferObject() { ClearUBO(); }
 		};
 
 		static J3DUniformBufferObject mUBO;
 		uint32_t mUBOID = 0;
+
+		// An envelope matrix as the vertex shader reads it, with the model and view transforms already applied and the
+		// inverse transpose taken for normals. Both are stored as the three rows of an affine matrix (a std430 mat3x4),
+		// so the shader transforms a vector with a single vector-matrix product.
+		struct J3DEnvelopeMatrix {
+			glm::vec4 ModelView[3];
+			glm::vec4 Normal[3];
+		};
+
+		// The envelope storage is a ring buffer. Allocations are made at mEnvelopeHead, and when one doesn't fit before the
+		// end it starts over at the beginning, overwriting the oldest matrices and bumping mEnvelopeGeneration so that their
+		// owners allocate them again. Buffer updates are ordered with the draws already submitted, so those still read the
+		// matrices they were submitted with. This keeps the storage bounded however often models are drawn between clears.
+		std::vector<J3DEnvelopeMatrix> mEnvelopeScratch;
+		uint32_t mEnvelopeHead = 0;
+		uint32_t mEnvelopeCapacity = ENVELOPE_MATS_CAPACITY;
+		uint32_t mEnvelopeSSBOID = 0;
+		uint32_t mEnvelopeGeneration = 0;
+
+		void CreateEnvelopeSSBO() {
+			if (mEnvelopeSSBOID != 0) {
+				glDeleteBuffers(1, &mEnvelopeSSBOID);
+			}
+
+			glCreateBuffers(1, &mEnvelopeSSBOID);
+			glNamedBufferStorage(mEnvelopeSSBOID, sizeof(J3DEnvelopeMatrix) * mEnvelopeCapacity, nullptr, GL_DYNAMIC_STORAGE_BIT);
+			glBindBufferBase(GL_SHADER_STORAGE_BUFFER, ENVELOPE_SSBO_BINDING, mEnvelopeSSBOID);
+		}
 	}
 }
 
@@ -51,6 +85,10 @@ void J3DUniformBufferObject::CreateUBO() {
 
 	glNamedBufferStorage(mUBOID, sizeof(J3DUniformBufferObject), nullptr, GL_DYNAMIC_STORAGE_BIT);
 	glBindBufferRange(GL_UNIFORM_BUFFER, 0, mUBOID, 0, sizeof(J3DUniformBufferObject));
+
+	// Matrices allocated before the buffer existed were never uploaded.
+	CreateEnvelopeSSBO();
+	ClearEnvelopeMatrices();
 }
 
 void J3DUniformBufferObject::DestroyUBO() {
@@ -59,6 +97,9 @@ void J3DUniformBufferObject::DestroyUBO() {
 
 	glDeleteBuffers(1, &mUBOID);
 	mUBOID = 0;
+
+	glDeleteBuffers(1, &mEnvelopeSSBOID);
+	mEnvelopeSSBOID = 0;
 }
 
 void J3DUniformBufferObject::SubmitUBO() {
@@ -78,16 +119,18 @@ void J3DUniformBufferObject::ClearUBO() {
 
 	std::fill_n(mUBO.Lights, LIGHTS_MAX, DEFAULT_LIGHT);
 
-	std::fill_n(mUBO.Envelopes, ENVELOPE_MATS_MAX, glm::identity<glm::mat4>());
 	std::fill_n(mUBO.TexMatrices, TEX_MATS_MAX, glm::identity<glm::mat4>());
 	std::fill_n(mUBO.IndTexMatrices, IND_TEX_MATS_MAX, glm::identity<glm::mat4>());
 
 	mUBO.BillboardType = 0;
+	mUBO.EnvelopeBase = 0;
 
 	mUBO.ModelId = 0;
 	mUBO.MaterialId = 0;
 
 	mUBO.HighlightColor = { 0, 0, 0, 0 };
+
+	mUBO.BatchStart = UINT32_MAX;
 }
 
 bool J3DUniformBufferObject::LinkShaderProgramToUBO(const int32_t shaderProgram) {
@@ -121,6 +164,10 @@ void J3DUniformBufferObject::SetModelMatrix(const glm::mat4& model) {
 	mUBO.ModelMatrix = model;
 }
 
+glm::mat4 J3DUniformBufferObject::GetModelViewMatrix() {
+	return mUBO.ViewMatrix * mUBO.ModelMatrix;
+}
+
 void J3DUniformBufferObject::SetTevColors(const glm::vec4* colors) {
 	std::memcpy(mUBO.TevColor, colors, sizeof(glm::vec4) * COLORS_MAX);
 }
@@ -134,10 +181,75 @@ void J3DUniformBufferObject::SetLights(const J3DLight* lights) {
 }
 
 void J3DUniformBufferObject::SetEnvelopeMatrices(const glm::mat4* envelopes, const uint32_t count) {
-	if (count == 0 || count > ENVELOPE_MATS_MAX)
+	SetEnvelopeBase(AllocateEnvelopeMatrices(envelopes, count, GetModelViewMatrix()));
+}
+
+uint32_t J3DUniformBufferObject::AllocateEnvelopeMatrices(const glm::mat4* envelopes, const uint32_t count, const glm::mat4& modelView) {
+	ReserveEnvelopeMatrices(count);
+
+	uint32_t base = mEnvelopeHead;
+	if (count == 0)
+		return base;
+
+	mEnvelopeHead += count;
+	mEnvelopeScratch.resize(count);
+
+	glm::mat3 modelViewRotation = glm::mat3(modelView);
+	for (uint32_t i = 0; i < count; i++) {
+		J3DEnvelopeMatrix& matrix = mEnvelopeScratch[i];
+
+		glm::mat4 envelopeModelView = modelView * envelopes[i];
+		// Envelopes are affine, so the inverse transpose of the upper 3x3 is all the normals need.
+		glm::mat3 normal = modelViewRotation * glm::transpose(glm::inverse(glm::mat3(envelopes[i])));
+
+		for (int row = 0; row < 3; row++) {
+			matrix.ModelView[row] = glm::vec4(envelopeModelView[0][row], envelopeModelView[1][row], envelopeModelView[2][row], envelopeModelView[3][row]);
+			matrix.Normal[row] = glm::vec4(normal[0][row], normal[1][row], normal[2][row], 0.0f);
+		}
+	}
+
+	if (mEnvelopeSSBOID != 0)
+		glNamedBufferSubData(mEnvelopeSSBOID, sizeof(J3DEnvelopeMatrix) * base, sizeof(J3DEnvelopeMatrix) * count, mEnvelopeScratch.data());
+
+	return base;
+}
+
+void J3DUniformBufferObject::ReserveEnvelopeMatrices(const uint32_t count) {
+	if (mEnvelopeHead + count <= mEnvelopeCapacity)
 		return;
 
-	std::memcpy(mUBO.Envelopes, envelopes, sizeof(glm::mat4) * count);
+	// Only a model with more envelopes than the whole buffer holds can grow it. Draws already submitted keep reading
+	// the old buffer, so it can be replaced.
+	if (count > mEnvelopeCapacity) {
+		while (mEnvelopeCapacity < count)
+			mEnvelopeCapacity *= 2;
+
+		if (mEnvelopeSSBOID != 0)
+			CreateEnvelopeSSBO();
+	}
+
+	ClearEnvelopeMatrices();
+}
+
+void J3DUniformBufferObject::SetEnvelopeBase(const uint32_t base) {
+	mUBO.EnvelopeBase = base;
+}
+
+void J3DUniformBufferObject::SetBatchStart(const uint32_t start) {
+	mUBO.BatchStart = start;
+}
+
+void J3DUniformBufferObject::ClearEnvelopeMatrices() {
+	mEnvelopeHead = 0;
+	mEnvelopeGeneration++;
+}
+
+uint32_t J3DUniformBufferObject::GetEnvelopeGeneration() {
+	return mEnvelopeGeneration;
+}
+
+uint32_t J3DUniformBufferObject::GetEnvelopeCapacity() {
+	return mEnvelopeCapacity;
 }
 
 void J3DUniformBufferObject::SetTexMatrices(const glm::mat4* texMatrices) {
@@ -17,7 +17,7 @@
 
 #define etoi magic_enum::enum_integer
 
-bool J3DVertexShaderGenerator::GenerateVertexShader(const J3DMaterial* material, uint32_t& shaderHandle) {
+bool J3DVertexShaderGenerator::GenerateVertexShader(const J3DMaterial* material, uint32_t& shaderHandle, std::string* source) {
   if (material == nullptr || material->GetShape().expired()) {
     return false;
   }
@@ -56,6 +56,9 @@ bool J3DVertexShaderGenerator::GenerateVertexShader(const J3DMaterial* material,
   shaderHandle = glCreateShader(GL_VERTEX_SHADER);
 
   std::string shaderStr = vertexShader.str();
+  if (source != nullptr) {
+    *source = shaderStr;
+  }
 
 #ifdef _DEBUG
   if (!std::filesystem::exists("./shaderdump"))
@@ -459,13 +462,22 @@ std::string J3DVertexShaderGenerator::GenerateColorChannel(std::shared_ptr<J3DCo
 
 std::string J3DVertexShaderGenerator::GenerateMatrixCalcFunction() {
   std::stringstream stream;
+  stream << "uint GetEnvelopeBase() {\n";
+  stream << "\tif (BatchStart == 0xFFFFFFFFu) {\n";
+  stream << "\t\treturn EnvelopeBase;\n";
+  stream << "\t}\n\n";
+  stream << "\treturn DrawEnvelopeBases[BatchDraws[BatchStart + uint(gl_DrawID)]];\n";
+  stream << "}\n\n";
+
   stream << "vec3 CalculateMatrix() {\n";
-  stream << "\tmat4 envelopeMtx = View * Model * Envelopes[int(aPos.w)];\n\n";
+  stream << "\tmat3x4 modelView = Envelopes[GetEnvelopeBase() + uint(aPos.w)].ModelView;\n\n";
 
   stream << "\tif (BillboardType == 0 || BillboardType == 3) {\n";
-  stream << "\t\treturn (envelopeMtx * vec4(aPos.xyz, 1.0)).xyz;\n";
+  stream << "\t\treturn vec4(aPos.xyz, 1.0) * modelView;\n";
   stream << "\t}\n\n";
 
+  stream << "\tmat4 envelopeMtx = transpose(mat4(modelView[0], modelView[1], modelView[2], vec4(0.0, 0.0, 0.0, 1.0)));\n";
+
   stream << "\tmat4 bboardMtx = mat4(1.0);\n\n";
   stream << "\tfloat mx = envelopeMtx[0][0] * envelopeMtx[0][0] + envelopeMtx[0][1] * envelopeMtx[0][1] + envelopeMtx[0][2] * envelopeMtx[0][2];\n";
   stream << "\tfloat my = envelopeMtx[1][0] * envelopeMtx[1][0] + envelopeMtx[1][1] * envelopeMtx[1][1] + envelopeMtx[1][2] * envelopeMtx[1][2];\n";
@@ -517,7 +529,7 @@ std::string J3DVertexShaderGenerator::GenerateMainFunction(const J3DMaterial* ma
 
   stream << "\tvec3 ViewPos = CalculateMatrix();\n";
   if (IsAttributeUsed(EGXAttribute::Normal, material)) {
-    stream << "\tvec3 ViewNormal = (View * Model * vec4(mat3(transpose(inverse(Envelopes[int(aPos.w)]))) * aNrm, 0.0)).xyz;\n";
+    stream << "\tvec3 ViewNormal = vec4(aNrm, 0.0) * Envelopes[GetEnvelopeBase() + uint(aPos.w)].Normal;\n";
   }
 
   stream << "\n";
@@ -0,0 +1,718 @@
+#include "J3D/Rendering/J3DCulling.hpp"
+#include "J3D/Rendering/J3DRenderPacket.hpp"
+#include "J3D/Rendering/J3DFrustum.hpp"
+#include "J3D/Data/J3DModelInstance.hpp"
+#include "J3D/Geometry/J3DShapeFactory.hpp"
+#include "J3D/Material/J3DUniformBufferObject.hpp"
+
+#include <glad/glad.h>
+
+#include <algorithm>
+#include <cmath>
+#include <iostream>
+
+namespace J3DCulling {
+	namespace {
+		constexpr uint32_t CULL_WORKGROUP_SIZE = 64;
+		constexpr uint32_t PYRAMID_WORKGROUP_SIZE = 8;
+		// Initial capacity of the culling buffers, in packets. They grow as needed.
+		constexpr uint32_t CULL_DRAWS_INITIAL = 1024;
+
+		// Storage buffer bindings, following the envelope matrices at 1 and the skinning buffers at 2 to 4. The material
+		// shaders read the batch draws and envelope bases at 10 and 11.
+		constexpr uint32_t CULL_INSTANCES_BINDING = 5;
+		constexpr uint32_t CULL_DRAWS_BINDING = 6;
+		constexpr uint32_t DRAW_COMMANDS_BINDING = 7;
+		constexpr uint32_t BATCH_COUNTS_BINDING = 8;
+		constexpr uint32_t BATCH_COMMANDS_BINDING = 9;
+		constexpr uint32_t BATCH_DRAWS_BINDING = 10;
+		constexpr uint32_t DRAW_ENVELOPE_BASES_BINDING = 11;
+
+		// How a draw's bounds are found: its shape's rest bounds under the instance's transform, the instance's posed world
+		// bounds, or none at all.
+		constexpr float CULL_MODE_SHAPE = 0.0f;
+		constexpr float CULL_MODE_INSTANCE = 1.0f;
+		constexpr float CULL_MODE_NEVER = 2.0f;
+
+		const char* PyramidShader =
+			"#version 460\n\n"
+			"layout (local_size_x = 8, local_size_y = 8) in;\n\n"
+			"layout (binding = 0) uniform sampler2D uSource;\n"
+			"layout (r32f, binding = 0) writeonly uniform image2D uDestination;\n\n"
+			"layout (location = 0) uniform int SourceLevel;\n"
+			"layout (location = 1) uniform ivec2 SourceSize;\n"
+			"layout (location = 2) uniform ivec2 DestinationSize;\n\n"
+			"// Each texel keeps the farthest depth of the source texels it covers. Odd source sizes make some texels cover three.\n"
+			"void main() {\n"
+			"\tivec2 coord = ivec2(gl_GlobalInvocationID.xy);\n"
+			"\tif (any(greaterThanEqual(coord, DestinationSize))) {\n"
+			"\t\treturn;\n"
+			"\t}\n\n"
+			"\tivec2 start = (coord * SourceSize) / DestinationSize;\n"
+			"\tivec2 end = min(((coord + 1) * SourceSize + DestinationSize - 1) / DestinationSize, SourceSize);\n\n"
+			"\tfloat depth = 0.0;\n"
+			"\tfor (int y = start.y; y < end.y; y++) {\n"
+			"\t\tfor (int x = start.x; x < end.x; x++) {\n"
+			"\t\t\tdepth = max(depth, texelFetch(uSource, ivec2(x, y), SourceLevel).r);\n"
+			"\t\t}\n"
+			"\t}\n\n"
+			"\timageStore(uDestination, coord, vec4(depth));\n"
+			"}\n";
+
+		const char* CullShader =
+			"#version 460\n\n"
+			"layout (local_size_x = 64) in;\n\n"
+			"struct CullInstance {\n"
+			"\tmat4 Model;\n"
+			"\tvec4 WorldMin;\n"
+			"\tvec4 WorldMax;\n"
+			"};\n\n"
+			"// ShapeMin.w is the draw's cull mode. BatchStart is the index of the first draw of the draw's batch.\n"
+			"struct CullDraw {\n"
+			"\tvec4 ShapeMin;\n"
+			"\tvec4 ShapeMax;\n"
+			"\tuint Instance;\n"
+			"\tuint Count;\n"
+			"\tuint FirstIndex;\n"
+			"\tuint BaseVertex;\n"
+			"\tuint Batch;\n"
+			"\tuint BatchStart;\n"
+			"};\n\n"
+			"layout (std430, binding = 5) readonly buffer uCullInstances {\n"
+			"\tCullInstance Instances[];\n"
+			"};\n\n"
+			"layout (std430, binding = 6) readonly buffer uCullDraws {\n"
+			"\tCullDraw Draws[];\n"
+			"};\n\n"
+			"// DrawElementsIndirectCommand, five uints per draw.\n"
+			"layout (std430, binding = 7) writeonly buffer uDrawCommands {\n"
+			"\tuint Commands[];\n"
+			"};\n\n"
+			"// The number of visible draws of each batch, counted up from 0 as they are compacted.\n"
+			"layout (std430, binding = 8) buffer uBatchCounts {\n"
+			"\tuint BatchCounts[];\n"
+			"};\n\n"
+			"// The commands of each batch's visible draws, packed at the start of the batch's range, and the index of each.\n"
+			"layout (std430, binding = 9) writeonly buffer uBatchCommands {\n"
+			"\tuint BatchCommands[];\n"
+			"};\n\n"
+			"layout (std430, binding = 10) writeonly buffer uBatchDraws {\n"
+			"\tuint BatchDraws[];\n"
+			"};\n\n"
+			"layout (binding = 0) uniform sampler2D uDepthPyramid;\n\n"
+			"layout (location = 0) uniform uint DrawCount;\n"
+			"layout (location = 1) uniform vec4 FrustumPlanes[6];\n"
+			"layout (location = 7) uniform mat4 PyramidViewProj;\n"
+			"// 0 when there is no depth pyramid to test against.\n"
+			"layout (location = 8) uniform int PyramidLevels;\n"
+			"layout (location = 9) uniform vec2 PyramidSize;\n\n"
+			"bool IsInFrustum(vec3 boxMin, vec3 boxMax) {\n"
+			"\tfor (int i = 0; i < 6; i++) {\n"
+			"\t\tvec4 plane = FrustumPlanes[i];\n"
+			"\t\tvec3 corner = mix(boxMin, boxMax, greaterThanEqual(plane.xyz, vec3(0.0)));\n"
+			"\t\tif (dot(plane.xyz, corner) + plane.w < 0.0) {\n"
+			"\t\t\treturn false;\n"
+			"\t\t}\n"
+			"\t}\n\n"
+			"\treturn true;\n"
+			"}\n\n"
+			"bool IsOccluded(vec3 boxMin, vec3 boxMax) {\n"
+			"\tif (PyramidLevels == 0) {\n"
+			"\t\treturn false;\n"
+			"\t}\n\n"
+			"\tvec2 uvMin = vec2(1.0);\n"
+			"\tvec2 uvMax = vec2(0.0);\n"
+			"\tfloat nearest = 1.0;\n\n"
+			"\tfor (int i = 0; i < 8; i++) {\n"
+			"\t\tvec3 corner = vec3((i & 1) != 0 ? boxMax.x : boxMin.x, (i & 2) != 0 ? boxMax.y : boxMin.y, (i & 4) != 0 ? boxMax.z : boxMin.z);\n"
+			"\t\tvec4 clip = PyramidViewProj * vec4(corner, 1.0);\n\n"
+			"\t\t// Boxes reaching behind the camera can't be projected.\n"
+			"\t\tif (clip.w <= 0.0) {\n"
+			"\t\t\treturn false;\n"
+			"\t\t}\n\n"
+			"\t\tvec3 ndc = clip.xyz / clip.w;\n"
+			"\t\tuvMin = min(uvMin, ndc.xy * 0.5 + 0.5);\n"
+			"\t\tuvMax = max(uvMax, ndc.xy * 0.5 + 0.5);\n"
+			"\t\tnearest = min(nearest, ndc.z * 0.5 + 0.5);\n"
+			"\t}\n\n"
+			"\tuvMin = clamp(uvMin, vec2(0.0), vec2(1.0));\n"
+			"\tuvMax = clamp(uvMax, vec2(0.0), vec2(1.0));\n\n"
+			"\t// Pick the level at which the box covers at most two texels on each axis.\n"
+			"\tvec2 size = (uvMax - uvMin) * PyramidSize;\n"
+			"\tint level = clamp(int(ceil(log2(max(max(size.x, size.y), 1.0)))), 0, PyramidLevels - 1);\n\n"
+			"\tivec2 levelSize = textureSize(uDepthPyramid, level);\n"
+			"\tivec2 texelMin = clamp(ivec2(uvMin * vec2(levelSize)), ivec2(0), levelSize - 1);\n"
+			"\tivec2 texelMax = clamp(ivec2(uvMax * vec2(levelSize)), ivec2(0), levelSize - 1);\n\n"
+			"\tfloat farthest = max(\n"
+			"\t\tmax(texelFetch(uDepthPyramid, texelMin, level).r, texelFetch(uDepthPyramid, ivec2(texelMax.x, texelMin.y), level).r),\n"
+			"\t\tmax(texelFetch(uDepthPyramid, ivec2(texelMin.x, texelMax.y), level).r, texelFetch(uDepthPyramid, texelMax, level).r));\n\n"
+			"\treturn nearest > farthest;\n"
+			"}\n\n"
+			"void main() {\n"
+			"\tuint index = gl_GlobalInvocationID.x;\n"
+			"\tif (index >= DrawCount) {\n"
+			"\t\treturn;\n"
+			"\t}\n\n"
+			"\tCullDraw draw = Draws[index];\n"
+			"\tbool visible = true;\n\n"
+			"\tif (draw.ShapeMin.w < 2.0) {\n"
+			"\t\tCullInstance instance = Instances[draw.Instance];\n"
+			"\t\tvec3 boxMin = instance.WorldMin.xyz;\n"
+			"\t\tvec3 boxMax = instance.WorldMax.xyz;\n\n"
+			"\t\tif (draw.ShapeMin.w == 0.0) {\n"
+			"\t\t\tvec3 center = (instance.Model * vec4((draw.ShapeMin.xyz + draw.ShapeMax.xyz) * 0.5, 1.0)).xyz;\n"
+			"\t\t\tvec3 extent = mat3(abs(instance.Model[0].xyz), abs(instance.Model[1].xyz), abs(instance.Model[2].xyz)) *\n"
+			"\t\t\t\t((draw.ShapeMax.xyz - draw.ShapeMin.xyz) * 0.5);\n\n"
+			"\t\t\tboxMin = center - extent;\n"
+			"\t\t\tboxMax = center + extent;\n"
+			"\t\t}\n\n"
+			"\t\tvisible = IsInFrustum(boxMin, boxMax) && !IsOccluded(boxMin, boxMax);\n"
+			"\t}\n\n"
+			"\tuint command = index * 5;\n"
+			"\tCommands[command] = draw.Count;\n"
+			"\tCommands[command + 1] = visible ? 1 : 0;\n"
+			"\tCommands[command + 2] = draw.FirstIndex;\n"
+			"\tCommands[command + 3] = draw.BaseVertex;\n"
+			"\tCommands[command + 4] = 0;\n\n"
+			"\tif (!visible) {\n"
+			"\t\treturn;\n"
+			"\t}\n\n"
+			"\t// Visible draws take the next free slot of their batch, so the batch's multi-draw only issues those.\n"
+			"\tuint slot = draw.BatchStart + atomicAdd(BatchCounts[draw.Batch], 1u);\n"
+			"\tuint batchCommand = slot * 5;\n"
+			"\tBatchCommands[batchCommand] = draw.Count;\n"
+			"\tBatchCommands[batchCommand + 1] = 1;\n"
+			"\tBatchCommands[batchCommand + 2] = draw.FirstIndex;\n"
+			"\tBatchCommands[batchCommand + 3] = draw.BaseVertex;\n"
+			"\tBatchCommands[batchCommand + 4] = 0;\n"
+			"\tBatchDraws[slot] = index;\n"
+			"}\n";
+
+		struct J3DCullInstance {
+			glm::mat4 Model;
+			glm::vec4 WorldMin;
+			glm::vec4 WorldMax;
+		};
+
+		struct J3DCullDraw {
+			glm::vec4 ShapeMin;
+			glm::vec4 ShapeMax;
+			uint32_t Instance;
+			uint32_t Count;
+			uint32_t FirstIndex;
+			uint32_t BaseVertex;
+			uint32_t Batch;
+			uint32_t BatchStart;
+			// Pads the draw to the 64 bytes a std430 array of the shader's struct steps by.
+			uint32_t Padding[2];
+		};
+
+		// A run of consecutive packets of the same material that can share one multi-draw. See J3DModelInstance::CheckSameBatch.
+		struct J3DCullBatch {
+			uint32_t Start;
+			uint32_t Size;
+		};
+
+		struct J3DDrawElementsCommand {
+			uint32_t Count;
+			uint32_t InstanceCount;
+			uint32_t FirstIndex;
+			uint32_t BaseVertex;
+			uint32_t BaseInstance;
+		};
+
+		uint32_t mCullProgram = 0;
+		uint32_t mPyramidProgram = 0;
+
+		std::vector<J3DCullInstance> mCullInstances;
+		std::vector<J3DCullDraw> mCullDraws;
+		std::vector<J3DCullBatch> mCullBatches;
+		// The envelope base of each draw drawn in a batch, by draw index, set as the batch's packets are updated.
+		std::vector<uint32_t> mDrawEnvelopeBases;
+		// Incremented by every CullPackets call. Packets and instance records from another generation are stale.
+		uint32_t mGeneration = 0;
+
+		uint32_t mInstanceBuffer = 0;
+		uint32_t mInstanceCapacity = 0;
+		uint32_t mDrawBuffer = 0;
+		uint32_t mCommandBuffer = 0;
+		uint32_t mBatchCountBuffer = 0;
+		uint32_t mBatchCommandBuffer = 0;
+		uint32_t mBatchDrawBuffer = 0;
+		uint32_t mEnvelopeBaseBuffer = 0;
+		uint32_t mDrawCapacity = 0;
+
+		// The command or batch selected for the next draw, and the buffer bound for indirect draws.
+		uint32_t mDrawCommand = UINT32_MAX;
+		uint32_t mDrawBatch = UINT32_MAX;
+		uint32_t mBoundCommandBuffer = 0;
+
+		bool bUseOcclusion = true;
+
+		uint32_t mPyramidTexture = 0;
+		uint32_t mPyramidWidth = 0;
+		uint32_t mPyramidHeight = 0;
+		uint32_t mPyramidLevels = 0;
+		bool bPyramidValid = false;
+		glm::mat4 mPyramidViewProj;
+
+		// The depth texture may not have mipmaps, so it is read through a sampler that doesn't use them.
+		uint32_t mDepthSampler = 0;
+		uint32_t mPyramidSampler = 0;
+
+		uint32_t CreateProgram(const char* source, const char* name) {
+			int32_t shader = glCreateShader(GL_COMPUTE_SHADER);
+			glShaderSource(shader, 1, &source, NULL);
+			glCompileShader(shader);
+
+			int32_t success = 0;
+			glGetShaderiv(shader, GL_COMPILE_STATUS, &success);
+			if (!success) {
+				std::cout << name << " shader compilation failed!" << std::endl;
+
+				GLsizei size = 0;
+				char t[512];
+				glGetShaderInfoLog(shader, 512, &size, t);
+
+				std::cout << t << std::endl;
+
+				glDeleteShader(shader);
+				return 0;
+			}
+
+			uint32_t program = glCreateProgram();
+			glAttachShader(program, shader);
+			glLinkProgram(program);
+
+			glDetachShader(program, shader);
+			glDeleteShader(shader);
+
+			return program;
+		}
+
+		void CreateSamplers() {
+			glCreateSamplers(1, &mDepthSampler);
+			glSamplerParameteri(mDepthSampler, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+			glSamplerParameteri(mDepthSampler, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+			glSamplerParameteri(mDepthSampler, GL_TEXTURE_COMPARE_MODE, GL_NONE);
+
+			glCreateSamplers(1, &mPyramidSampler);
+			glSamplerParameteri(mPyramidSampler, GL_TEXTURE_MIN_FILTER, GL_NEAREST_MIPMAP_NEAREST);
+			glSamplerParameteri(mPyramidSampler, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+		}
+
+		void CreatePyramidTexture(uint32_t width, uint32_t height) {
+			if (mPyramidTexture != 0) {
+				glDeleteTextures(1, &mPyramidTexture);
+			}
+
+			mPyramidWidth = width;
+			mPyramidHeight = height;
+			mPyramidLevels = (uint32_t)std::floor(std::log2((float)std::max(width, height))) + 1;
+
+			glCreateTextures(GL_TEXTURE_2D, 1, &mPyramidTexture);
+			glTextureStorage2D(mPyramidTexture, mPyramidLevels, GL_R32F, width, height);
+		}
+
+		void DestroyDrawBuffers() {
+			if (mDrawBuffer == 0) {
+				return;
+			}
+
+			uint32_t buffers[] = { mDrawBuffer, mCommandBuffer, mBatchCountBuffer, mBatchCommandBuffer, mBatchDrawBuffer, mEnvelopeBaseBuffer };
+			glDeleteBuffers(6, buffers);
+
+			mDrawBuffer = 0;
+			mCommandBuffer = 0;
+			mBatchCountBuffer = 0;
+			mBatchCommandBuffer = 0;
+			mBatchDrawBuffer = 0;
+			mEnvelopeBaseBuffer = 0;
+			mBoundCommandBuffer = 0;
+		}
+
+		void ReserveDrawBuffers(uint32_t drawCount) {
+			if (drawCount <= mDrawCapacity) {
+				return;
+			}
+
+			DestroyDrawBuffers();
+
+			mDrawCapacity = std::max(drawCount, std::max(CULL_DRAWS_INITIAL, mDrawCapacity * 2));
+
+			glCreateBuffers(1, &mDrawBuffer);
+			glNamedBufferStorage(mDrawBuffer, sizeof(J3DCullDraw) * mDrawCapacity, nullptr, GL_DYNAMIC_STORAGE_BIT);
+
+			glCreateBuffers(1, &mCommandBuffer);
+			glNamedBufferStorage(mCommandBuffer, sizeof(J3DDrawElementsCommand) * mDrawCapacity, nullptr, 0);
+
+			// There are never more batches than draws.
+			glCreateBuffers(1, &mBatchCountBuffer);
+			glNamedBufferStorage(mBatchCountBuffer, sizeof(uint32_t) * mDrawCapacity, nullptr, 0);
+
+			glCreateBuffers(1, &mBatchCommandBuffer);
+			glNamedBufferStorage(mBatchCommandBuffer, sizeof(J3DDrawElementsCommand) * mDrawCapacity, nullptr, 0);
+
+			glCreateBuffers(1, &mBatchDrawBuffer);
+			glNamedBufferStorage(mBatchDrawBuffer, sizeof(uint32_t) * mDrawCapacity, nullptr, 0);
+
+			glCreateBuffers(1, &mEnvelopeBaseBuffer);
+			glNamedBufferStorage(mEnvelopeBaseBuffer, sizeof(uint32_t) * mDrawCapacity, nullptr, GL_DYNAMIC_STORAGE_BIT);
+		}
+
+		void ReserveInstanceBuffer(uint32_t instanceCount) {
+			if (instanceCount <= mInstanceCapacity) {
+				return;
+			}
+
+			if (mInstanceBuffer != 0) {
+				glDeleteBuffers(1, &mInstanceBuffer);
+			}
+
+			mInstanceCapacity = std::max(instanceCount, std::max(CULL_DRAWS_INITIAL, mInstanceCapacity * 2));
+
+			glCreateBuffers(1, &mInstanceBuffer);
+			glNamedBufferStorage(mInstanceBuffer, sizeof(J3DCullInstance) * mInstanceCapacity, nullptr, GL_DYNAMIC_STORAGE_BIT);
+		}
+
+		uint32_t AddInstance(J3DModelInstance* instance) {
+			J3DCullRecord& record = instance->GetCullRecord();
+			if (record.Generation == mGeneration) {
+				return record.Index;
+			}
+
+			J3DCullInstance cullInstance;
+			cullInstance.Model = instance->GetWorldMatrix();
+
+			glm::vec3 worldMin, worldMax;
+			instance->GetWorldBoundingBox(worldMin, worldMax);
+			cullInstance.WorldMin = glm::vec4(worldMin, 0.0f);
+			cullInstance.WorldMax = glm::vec4(worldMax, 0.0f);
+
+			record.Generation = mGeneration;
+			record.Index = (uint32_t)mCullInstances.size();
+			mCullInstances.push_back(cullInstance);
+
+			return record.Index;
+		}
+
+		void BindCommandBuffer(uint32_t buffer) {
+			if (mBoundCommandBuffer != buffer) {
+				glBindBuffer(GL_DRAW_INDIRECT_BUFFER, buffer);
+				mBoundCommandBuffer = buffer;
+			}
+		}
+
+		// Draws the visible draws of the batch with one multi-draw. Their count is only known to the GPU.
+		void DrawBatch(uint32_t batchIndex) {
+			const J3DCullBatch& batch = mCullBatches[batchIndex];
+
+			glNamedBufferSubData(mEnvelopeBaseBuffer, sizeof(uint32_t) * batch.Start, sizeof(uint32_t) * batch.Size, &mDrawEnvelopeBases[batch.Start]);
+
+			glBindBufferBase(GL_SHADER_STORAGE_BUFFER, BATCH_DRAWS_BINDING, mBatchDrawBuffer);
+			glBindBufferBase(GL_SHADER_STORAGE_BUFFER, DRAW_ENVELOPE_BASES_BINDING, mEnvelopeBaseBuffer);
+
+			BindCommandBuffer(mBatchCommandBuffer);
+			glBindBuffer(GL_PARAMETER_BUFFER, mBatchCountBuffer);
+
+			glMultiDrawElementsIndirectCount(GL_TRIANGLES, GL_UNSIGNED_INT, (const void*)(batch.Start * sizeof(J3DDrawElementsCommand)),
+				(GLintptr)(batchIndex * sizeof(uint32_t)), (GLsizei)batch.Size, 0);
+		}
+	}
+}
+
+void J3DCulling::BuildDepthPyramid(uint32_t depthTexture, uint32_t width, uint32_t height, const glm::mat4& viewProjMatrix) {
+	if (depthTexture == 0 || width == 0 || height == 0) {
+		return;
+	}
+
+	if (mPyramidProgram == 0) {
+		mPyramidProgram = CreateProgram(PyramidShader, "Depth pyramid");
+		if (mPyramidProgram == 0) {
+			return;
+		}
+
+		CreateSamplers();
+	}
+
+	if (width != mPyramidWidth || height != mPyramidHeight || mPyramidTexture == 0) {
+		CreatePyramidTexture(width, height);
+	}
+
+	glUseProgram(mPyramidProgram);
+
+	uint32_t sourceWidth = width;
+	uint32_t sourceHeight = height;
+
+	// Level 0 is a copy of the depth texture, and every level after it is reduced from the one before.
+	for (uint32_t level = 0; level < mPyramidLevels; level++) {
+		uint32_t levelWidth = std::max(width >> level, 1u);
+		uint32_t levelHeight = std::max(height >> level, 1u);
+
+		if (level == 0) {
+			glBindTextureUnit(0, depthTexture);
+			glBindSampler(0, mDepthSampler);
+			glProgramUniform1i(mPyramidProgram, 0, 0);
+		}
+		else {
+			glBindTextureUnit(0, mPyramidTexture);
+			glBindSampler(0, mPyramidSampler);
+			glProgramUniform1i(mPyramidProgram, 0, (int32_t)level - 1);
+		}
+
+		glProgramUniform2i(mPyramidProgram, 1, (int32_t)sourceWidth, (int32_t)sourceHeight);
+		glProgramUniform2i(mPyramidProgram, 2, (int32_t)levelWidth, (int32_t)levelHeight);
+		glBindImageTexture(0, mPyramidTexture, level, GL_FALSE, 0, GL_WRITE_ONLY, GL_R32F);
+
+		glDispatchCompute((levelWidth + PYRAMID_WORKGROUP_SIZE - 1) / PYRAMID_WORKGROUP_SIZE, (levelHeight + PYRAMID_WORKGROUP_SIZE - 1) / PYRAMID_WORKGROUP_SIZE, 1);
+		glMemoryBarrier(GL_TEXTURE_FETCH_BARRIER_BIT);
+
+		sourceWidth = levelWidth;
+		sourceHeight = levelHeight;
+	}
+
+	glBindSampler(0, 0);
+
+	mPyramidViewProj = viewProjMatrix;
+	bPyramidValid = true;
+}
+
+void J3DCulling::ClearDepthPyramid() {
+	bPyramidValid = false;
+}
+
+void J3DCulling::SetUseOcclusion(bool use) {
+	bUseOcclusion = use;
+}
+
+bool J3DCulling::GetUseOcclusion() {
+	return bUseOcclusion;
+}
+
+void J3DCulling::CullPackets(std::vector<J3DRenderPacket>& packets, const glm::mat4& viewProjMatrix) {
+	if (packets.empty()) {
+		return;
+	}
+
+	if (mCullProgram == 0) {
+		mCullProgram = CreateProgram(CullShader, "Culling");
+		if (mCullProgram == 0) {
+			return;
+		}
+	}
+
+	mCullInstances.clear();
+	mCullDraws.clear();
+	mCullBatches.clear();
+
+	// Generation 0 is never used, so that records and packets that were never culled don't match.
+	if (++mGeneration == 0) {
+		mGeneration = 1;
+	}
+
+	mCullDraws.reserve(packets.size());
+
+	// The packet before this one and its material, if it was given a draw.
+	const J3DRenderPacket* previous = nullptr;
+	const J3DMaterial* previousMaterial = nullptr;
+
+	for (J3DRenderPacket& packet : packets) {
+		J3DCullDraw draw;
+		const std::shared_ptr<J3DMaterial>* material = packet.GetMaterial();
+
+		if (material == nullptr || !packet.Instance->GetDrawRange(material->get(), draw.Count, draw.FirstIndex, draw.BaseVertex)) {
+			packet.DrawCommand = UINT32_MAX;
+			previous = nullptr;
+			continue;
+		}
+
+		// Packets of the same material join the batch of the one before them if they can share its draw state.
+		if (previous == nullptr || previousMaterial != material->get() || !packet.Instance->CheckSameBatch(material->get(), *previous->Instance)) {
+			mCullBatches.push_back({ (uint32_t)mCullDraws.size(), 0 });
+		}
+
+		draw.Batch = (uint32_t)mCullBatches.size() - 1;
+		draw.BatchStart = mCullBatches.back().Start;
+		draw.Padding[0] = 0;
+		draw.Padding[1] = 0;
+		mCullBatches.back().Size++;
+
+		draw.Instance = AddInstance(packet.Instance);
+
+		const J3DShapeBounds* bounds = packet.Instance->GetShapeBounds(packet.MaterialIndex);
+		if (bounds == nullptr || bounds->Billboard) {
+			draw.ShapeMin = glm::vec4(0.0f, 0.0f, 0.0f, CULL_MODE_NEVER);
+			draw.ShapeMax = glm::vec4(0.0f);
+		}
+		else {
+			// Animated shapes move within the instance's posed bounds rather than their rest bounds.
+			float mode = packet.Instance->HasJointAnimation() ? CULL_MODE_INSTANCE : CULL_MODE_SHAPE;
+
+			draw.ShapeMin = glm::vec4(bounds->RestMin, mode);
+			draw.ShapeMax = glm::vec4(bounds->RestMax, 0.0f);
+		}
+
+		packet.DrawCommand = (uint32_t)mCullDraws.size();
+		packet.CullGeneration = mGeneration;
+		mCullDraws.push_back(draw);
+
+		previous = &packet;
+		previousMaterial = material->get();
+	}
+
+	if (mCullDraws.empty()) {
+		return;
+	}
+
+	ReserveDrawBuffers((uint32_t)mCullDraws.size());
+	ReserveInstanceBuffer((uint32_t)mCullInstances.size());
+
+	glNamedBufferSubData(mDrawBuffer, 0, sizeof(J3DCullDraw) * mCullDraws.size(), mCullDraws.data());
+	glNamedBufferSubData(mInstanceBuffer, 0, sizeof(J3DCullInstance) * mCullInstances.size(), mCullInstances.data());
+	glClearNamedBufferSubData(mBatchCountBuffer, GL_R32UI, 0, sizeof(uint32_t) * mCullBatches.size(), GL_RED_INTEGER, GL_UNSIGNED_INT, nullptr);
+
+	mDrawEnvelopeBases.assign(mCullDraws.size(), 0);
+
+	J3DFrustum frustum(viewProjMatrix);
+	bool useOcclusion = bUseOcclusion && bPyramidValid;
+
+	glProgramUniform1ui(mCullProgram, 0, (uint32_t)mCullDraws.size());
+	glProgramUniform4fv(mCullProgram, 1, 6, &frustum.Planes[0][0]);
+	glProgramUniformMatrix4fv(mCullProgram, 7, 1, GL_FALSE, &mPyramidViewProj[0][0]);
+	glProgramUniform1i(mCullProgram, 8, useOcclusion ? (int32_t)mPyramidLevels : 0);
+	glProgramUniform2f(mCullProgram, 9, (float)mPyramidWidth, (float)mPyramidHeight);
+
+	glBindBufferBase(GL_SHADER_STORAGE_BUFFER, CULL_INSTANCES_BINDING, mInstanceBuffer);
+	glBindBufferBase(GL_SHADER_STORAGE_BUFFER, CULL_DRAWS_BINDING, mDrawBuffer);
+	glBindBufferBase(GL_SHADER_STORAGE_BUFFER, DRAW_COMMANDS_BINDING, mCommandBuffer);
+	glBindBufferBase(GL_SHADER_STORAGE_BUFFER, BATCH_COUNTS_BINDING, mBatchCountBuffer);
+	glBindBufferBase(GL_SHADER_STORAGE_BUFFER, BATCH_COMMANDS_BINDING, mBatchCommandBuffer);
+	glBindBufferBase(GL_SHADER_STORAGE_BUFFER, BATCH_DRAWS_BINDING, mBatchDrawBuffer);
+
+	if (useOcclusion) {
+		glBindTextureUnit(0, mPyramidTexture);
+		glBindSampler(0, mPyramidSampler);
+	}
+
+	glUseProgram(mCullProgram);
+	glDispatchCompute(((uint32_t)mCullDraws.size() + CULL_WORKGROUP_SIZE - 1) / CULL_WORKGROUP_SIZE, 1, 1);
+
+	glBindSampler(0, 0);
+
+	// The commands and counts are read by indirect draws, and the batch draws by the material shaders.
+	glMemoryBarrier(GL_COMMAND_BARRIER_BIT | GL_SHADER_STORAGE_BARRIER_BIT);
+}
+
+uint32_t J3DCulling::GetBatchSize(const J3DRenderPacket* packets, uint32_t count) {
+	if (count == 0 || packets[0].CullGeneration != mGeneration || packets[0].DrawCommand >= mCullDraws.size()) {
+		return 1;
+	}
+
+	const J3DCullBatch& batch = mCullBatches[mCullDraws[packets[0].DrawCommand].Batch];
+	if (batch.Start != packets[0].DrawCommand || batch.Size < 2 || batch.Size > count) {
+		return 1;
+	}
+
+	// The packets may have been reordered or removed since they were culled.
+	for (uint32_t i = 1; i < batch.Size; i++) {
+		if (packets[i].CullGeneration != mGeneration || packets[i].DrawCommand != batch.Start + i) {
+			return 1;
+		}
+	}
+
+	return batch.Size;
+}
+
+bool J3DCulling::SetBatchDraw(const J3DRenderPacket& packet, uint32_t count, uint32_t firstIndex, uint32_t baseVertex, uint32_t envelopeBase) {
+	if (packet.CullGeneration != mGeneration || packet.DrawCommand >= mCullDraws.size()) {
+		return false;
+	}
+
+	const J3DCullDraw& draw = mCullDraws[packet.DrawCommand];
+	if (draw.Count != count || draw.FirstIndex != firstIndex || draw.BaseVertex != baseVertex) {
+		return false;
+	}
+
+	mDrawEnvelopeBases[packet.DrawCommand] = envelopeBase;
+	return true;
+}
+
+void J3DCulling::SetDrawCommand(uint32_t command, uint32_t generation) {
+	mDrawCommand = generation == mGeneration ? command : UINT32_MAX;
+
+	if (mDrawBatch != UINT32_MAX) {
+		mDrawBatch = UINT32_MAX;
+		J3DUniformBufferObject::SetBatchStart(UINT32_MAX);
+	}
+}
+
+void J3DCulling::SetDrawBatch(uint32_t command, uint32_t generation) {
+	mDrawCommand = UINT32_MAX;
+	mDrawBatch = generation == mGeneration && command < mCullDraws.size() ? mCullDraws[command].Batch : UINT32_MAX;
+
+	J3DUniformBufferObject::SetBatchStart(mDrawBatch != UINT32_MAX ? mCullBatches[mDrawBatch].Start : UINT32_MAX);
+}
+
+void J3DCulling::DrawElements(uint32_t count, uint32_t firstIndex, uint32_t baseVertex) {
+	// SetBatchDraw has already checked every draw of the batch against the packet it was culled for.
+	if (mDrawBatch != UINT32_MAX) {
+		DrawBatch(mDrawBatch);
+		return;
+	}
+
+	// The command only stands in for this draw if nothing about the draw changed since it was culled.
+	if (mDrawCommand < mCullDraws.size()) {
+		const J3DCullDraw& draw = mCullDraws[mDrawCommand];
+
+		if (draw.Count == count && draw.FirstIndex == firstIndex && draw.BaseVertex == baseVertex) {
+			BindCommandBuffer(mCommandBuffer);
+
+			glDrawElementsIndirect(GL_TRIANGLES, GL_UNSIGNED_INT, (const void*)(mDrawCommand * sizeof(J3DDrawElementsCommand)));
+			return;
+		}
+	}
+
+	glDrawElementsBaseVertex(GL_TRIANGLES, count, GL_UNSIGNED_INT, (const void*)(firstIndex * sizeof(uint32_t)), baseVertex);
+}
+
+void J3DCulling::DestroyShaders() {
+	if (mCullProgram != 0) {
+		glDeleteProgram(mCullProgram);
+		mCullProgram = 0;
+	}
+
+	if (mPyramidProgram != 0) {
+		glDeleteProgram(mPyramidProgram);
+		mPyramidProgram = 0;
+
+		glDeleteSamplers(1, &mDepthSampler);
+		glDeleteSamplers(1, &mPyramidSampler);
+		mDepthSampler = 0;
+		mPyramidSampler = 0;
+	}
+
+	DestroyDrawBuffers();
+	mDrawCapacity = 0;
+
+	if (mInstanceBuffer != 0) {
+		glDeleteBuffers(1, &mInstanceBuffer);
+		mInstanceBuffer = 0;
+		mInstanceCapacity = 0;
+	}
+
+	if (mPyramidTexture != 0) {
+		glDeleteTextures(1, &mPyramidTexture);
+		mPyramidTexture = 0;
+		mPyramidWidth = 0;
+		mPyramidHeight = 0;
+		mPyramidLevels = 0;
+	}
+
+	mCullInstances.clear();
+	mCullDraws.clear();
+	mCullBatches.clear();
+	mDrawEnvelopeBases.clear();
+	mDrawCommand = UINT32_MAX;
+	mDrawBatch = UINT32_MAX;
+	bPyramidValid = false;
+}
@@ -0,0 +1,66 @@
+#include "J3D/Rendering/J3DFrustum.hpp"
+
+J3DFrustum::J3DFrustum() {
+    // A default frustum contains everything.
+    for (glm::vec4& plane : Planes) {
+        plane = glm::vec4(0.0f, 0.0f, 0.0f, 1.0f);
+    }
+}
+
+J3DFrustum::J3DFrustum(const glm::mat4& viewProjMatrix) {
+    // Gribb and Hartmann: each clip plane is the sum or difference of the matrix's last row and one of the others.
+    glm::vec4 rows[4];
+    for (int i = 0; i < 4; i++) {
+        rows[i] = glm::vec4(viewProjMatrix[0][i], viewProjMatrix[1][i], viewProjMatrix[2][i], viewProjMatrix[3][i]);
+    }
+
+    Planes[0] = rows[3] + rows[0]; // Left
+    Planes[1] = rows[3] - rows[0]; // Right
+    Planes[2] = rows[3] + rows[1]; // Bottom
+    Planes[3] = rows[3] - rows[1]; // Top
+    Planes[4] = rows[3] + rows[2]; // Near
+    Planes[5] = rows[3] - rows[2]; // Far
+
+    for (glm::vec4& plane : Planes) {
+        float length = glm::length(glm::vec3(plane));
+        if (length > 0.0f) {
+            plane /= length;
+        }
+    }
+}
+
+bool J3DFrustum::IntersectsBox(const glm::vec3& min, const glm::vec3& max) const {
+    for (const glm::vec4& plane : Planes) {
+        // The corner furthest along the plane's normal is the last one to leave the volume.
+        glm::vec3 corner(plane.x >= 0.0f ? max.x : min.x, plane.y >= 0.0f ? max.y : min.y, plane.z >= 0.0f ? max.z : min.z);
+
+        if (glm::dot(glm::vec3(plane), corner) + plane.w < 0.0f) {
+            return false;
+        }
+    }
+
+    return true;
+}
+
+bool J3DFrustum::ContainsBox(const glm::vec3& min, const glm::vec3& max) const {
+    for (const glm::vec4& plane : Planes) {
+        // The corner nearest along the plane's normal is the first one to leave the volume.
+        glm::vec3 corner(plane.x >= 0.0f ? min.x : max.x, plane.y >= 0.0f ? min.y : max.y, plane.z >= 0.0f ? min.z : max.z);
+
+        if (glm::dot(glm::vec3(plane), corner) + plane.w < 0.0f) {
+            return false;
+        }
+    }
+
+    return true;
+}
+
+bool J3DFrustum::IntersectsSphere(const glm::vec3& center, float radius) const {
+    for (const glm::vec4& plane : Planes) {
+        if (glm::dot(glm::vec3(plane), center) + plane.w < -radius) {
+            return false;
+        }
+    }
+
+    return true;
+}
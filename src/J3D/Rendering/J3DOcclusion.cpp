@@ -0,0 +1,266 @@
+#include "J3D/Rendering/J3DOcclusion.hpp"
+#include "J3D/Rendering/J3DFrustum.hpp"
+#include "J3D/Data/J3DModelInstance.hpp"
+
+#include <glad/glad.h>
+
+#include <iostream>
+#include <vector>
+
+namespace J3DOcclusion {
+	namespace {
+		const char* ProxyVertexShader =
+			"#version 460\n\n"
+			"layout (location = 0) uniform mat4 ViewProj;\n"
+			"layout (location = 1) uniform vec3 BoxMin;\n"
+			"layout (location = 2) uniform vec3 BoxMax;\n\n"
+			"// The corners of the box's twelve triangles. Bit 0 of a corner selects its x, bit 1 its y and bit 2 its z.\n"
+			"const int Corners[36] = int[36](\n"
+			"\t0, 1, 3, 0, 3, 2,\n"
+			"\t4, 6, 7, 4, 7, 5,\n"
+			"\t0, 4, 5, 0, 5, 1,\n"
+			"\t2, 3, 7, 2, 7, 6,\n"
+			"\t0, 2, 6, 0, 6, 4,\n"
+			"\t1, 5, 7, 1, 7, 3\n"
+			");\n\n"
+			"void main() {\n"
+			"\tint corner = Corners[gl_VertexID];\n"
+			"\tvec3 position = mix(BoxMin, BoxMax, vec3(corner & 1, (corner >> 1) & 1, (corner >> 2) & 1));\n"
+			"\tgl_Position = ViewProj * vec4(position, 1.0);\n"
+			"}\n";
+
+		const char* ProxyFragmentShader =
+			"#version 460\n\n"
+			"void main() {\n"
+			"}\n";
+
+		bool bUseQueries = false;
+		uint32_t mOccludedFrameThreshold = 2;
+		// Incremented on camera cuts, so that results counted or queried before them are ignored.
+		uint32_t mEpoch = 1;
+
+		// Instances to query after this frame's packets are rendered.
+		std::vector<std::shared_ptr<J3DModelInstance>> mQueued;
+
+		uint32_t mProxyProgram = 0;
+		// Proxies are generated from gl_VertexID, but drawing still needs a vertex array bound.
+		uint32_t mProxyVAO = 0;
+
+		uint32_t CompileShader(uint32_t type, const char* source) {
+			uint32_t shader = glCreateShader(type);
+			glShaderSource(shader, 1, &source, NULL);
+			glCompileShader(shader);
+
+			int32_t success = 0;
+			glGetShaderiv(shader, GL_COMPILE_STATUS, &success);
+			if (!success) {
+				std::cout << "Occlusion proxy shader compilation failed!" << std::endl;
+
+				GLsizei size = 0;
+				char t[512];
+				glGetShaderInfoLog(shader, 512, &size, t);
+
+				std::cout << t << std::endl;
+
+				glDeleteShader(shader);
+				return 0;
+			}
+
+			return shader;
+		}
+
+		bool CreateProxyProgram() {
+			uint32_t vertexShader = CompileShader(GL_VERTEX_SHADER, ProxyVertexShader);
+			uint32_t fragmentShader = CompileShader(GL_FRAGMENT_SHADER, ProxyFragmentShader);
+
+			if (vertexShader == 0 || fragmentShader == 0) {
+				glDeleteShader(vertexShader);
+				glDeleteShader(fragmentShader);
+				return false;
+			}
+
+			mProxyProgram = glCreateProgram();
+			glAttachShader(mProxyProgram, vertexShader);
+			glAttachShader(mProxyProgram, fragmentShader);
+			glLinkProgram(mProxyProgram);
+
+			glDetachShader(mProxyProgram, vertexShader);
+			glDetachShader(mProxyProgram, fragmentShader);
+			glDeleteShader(vertexShader);
+			glDeleteShader(fragmentShader);
+
+			glCreateVertexArrays(1, &mProxyVAO);
+
+			return true;
+		}
+
+		// Whether any part of the box is behind the plane.
+		bool CheckBoxCrossesPlane(const glm::vec4& plane, const glm::vec3& min, const glm::vec3& max) {
+			glm::vec3 corner(plane.x >= 0.0f ? min.x : max.x, plane.y >= 0.0f ? min.y : max.y, plane.z >= 0.0f ? min.z : max.z);
+			return glm::dot(glm::vec3(plane), corner) + plane.w < 0.0f;
+		}
+	}
+}
+
+void J3DOcclusion::SetUseQueries(bool use) {
+	if (use == bUseQueries) {
+		return;
+	}
+
+	// Results from before queries were last disabled may be stale.
+	bUseQueries = use;
+	mEpoch++;
+	ClearQueue();
+}
+
+bool J3DOcclusion::GetUseQueries() {
+	return bUseQueries;
+}
+
+void J3DOcclusion::SetOccludedFrameThreshold(uint32_t frames) {
+	mOccludedFrameThreshold = frames;
+}
+
+void J3DOcclusion::NotifyCameraCut() {
+	mEpoch++;
+}
+
+void J3DOcclusion::ClearQueue() {
+	for (std::shared_ptr<J3DModelInstance>& instance : mQueued) {
+		instance->GetOcclusionQuery().bQueued = false;
+	}
+
+	mQueued.clear();
+}
+
+bool J3DOcclusion::CheckOccluded(const std::shared_ptr<J3DModelInstance>& instance) {
+	J3DOcclusionQuery& query = instance->GetOcclusionQuery();
+
+	if (query.Epoch != mEpoch) {
+		query.Epoch = mEpoch;
+		query.OccludedFrames = 0;
+	}
+
+	if (query.bPending) {
+		GLuint available = GL_FALSE;
+		glGetQueryObjectuiv(query.Query, GL_QUERY_RESULT_AVAILABLE, &available);
+
+		if (available == GL_TRUE) {
+			GLuint samplesPassed = GL_FALSE;
+			glGetQueryObjectuiv(query.Query, GL_QUERY_RESULT, &samplesPassed);
+
+			query.bPending = false;
+
+			if (query.QueryEpoch == mEpoch) {
+				if (samplesPassed != GL_FALSE) {
+					query.OccludedFrames = 0;
+				}
+				else if (query.OccludedFrames < UINT32_MAX) {
+					query.OccludedFrames++;
+				}
+			}
+		}
+	}
+
+	// Queries still in flight are left to finish rather than being restarted.
+	if (!query.bPending && !query.bQueued) {
+		query.bQueued = true;
+		mQueued.push_back(instance);
+	}
+
+	return mOccludedFrameThreshold > 0 && query.OccludedFrames >= mOccludedFrameThreshold;
+}
+
+void J3DOcclusion::IssueQueries(const glm::mat4& viewMatrix, const glm::mat4& projMatrix) {
+	if (mQueued.empty()) {
+		return;
+	}
+
+	if (mProxyProgram == 0 && !CreateProxyProgram()) {
+		ClearQueue();
+		return;
+	}
+
+	glm::mat4 viewProj = projMatrix * viewMatrix;
+	J3DFrustum frustum(viewProj);
+
+	GLboolean depthMask, colorMask[4];
+	GLint depthFunc;
+	glGetBooleanv(GL_DEPTH_WRITEMASK, &depthMask);
+	glGetBooleanv(GL_COLOR_WRITEMASK, colorMask);
+	glGetIntegerv(GL_DEPTH_FUNC, &depthFunc);
+	GLboolean depthTest = glIsEnabled(GL_DEPTH_TEST);
+	GLboolean cullFace = glIsEnabled(GL_CULL_FACE);
+
+	glColorMask(GL_FALSE, GL_FALSE, GL_FALSE, GL_FALSE);
+	glDepthMask(GL_FALSE);
+	glEnable(GL_DEPTH_TEST);
+	glDepthFunc(GL_LEQUAL);
+	glDisable(GL_CULL_FACE);
+
+	glUseProgram(mProxyProgram);
+	glBindVertexArray(mProxyVAO);
+	glProgramUniformMatrix4fv(mProxyProgram, 0, 1, GL_FALSE, &viewProj[0][0]);
+
+	for (std::shared_ptr<J3DModelInstance>& instance : mQueued) {
+		J3DOcclusionQuery& query = instance->GetOcclusionQuery();
+		query.bQueued = false;
+
+		glm::vec3 min, max;
+		instance->GetWorldBoundingBox(min, max);
+
+		// Instances reaching behind the near plane can't be tested, since the camera may be inside their bounds. Instances
+		// out of view count as visible too, so that they aren't skipped for a frame when they come into view.
+		if (!frustum.IntersectsBox(min, max) || CheckBoxCrossesPlane(frustum.Planes[4], min, max)) {
+			query.OccludedFrames = 0;
+			continue;
+		}
+
+		if (query.Query == 0) {
+			glCreateQueries(GL_ANY_SAMPLES_PASSED_CONSERVATIVE, 1, &query.Query);
+		}
+
+		glProgramUniform3fv(mProxyProgram, 1, 1, &min[0]);
+		glProgramUniform3fv(mProxyProgram, 2, 1, &max[0]);
+
+		glBeginQuery(GL_ANY_SAMPLES_PASSED_CONSERVATIVE, query.Query);
+		glDrawArrays(GL_TRIANGLES, 0, 36);
+		glEndQuery(GL_ANY_SAMPLES_PASSED_CONSERVATIVE);
+
+		query.bPending = true;
+		query.QueryEpoch = mEpoch;
+	}
+
+	glBindVertexArray(0);
+
+	glColorMask(colorMask[0], colorMask[1], colorMask[2], colorMask[3]);
+	glDepthMask(depthMask);
+	glDepthFunc(depthFunc);
+	if (depthTest == GL_FALSE) {
+		glDisable(GL_DEPTH_TEST);
+	}
+	if (cullFace == GL_TRUE) {
+		glEnable(GL_CULL_FACE);
+	}
+
+	mQueued.clear();
+}
+
+void J3DOcclusion::DestroyQuery(J3DOcclusionQuery& query) {
+	if (query.Query != 0) {
+		glDeleteQueries(1, &query.Query);
+	}
+
+	query = J3DOcclusionQuery();
+}
+
+void J3DOcclusion::DestroyShaders() {
+	if (mProxyProgram != 0) {
+		glDeleteProgram(mProxyProgram);
+		glDeleteVertexArrays(1, &mProxyVAO);
+		mProxyProgram = 0;
+		mProxyVAO = 0;
+	}
+
+	ClearQueue();
+}
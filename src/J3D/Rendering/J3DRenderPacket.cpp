@@ -1,27 +1,120 @@
 #include "J3D/Rendering/J3DRenderPacket.hpp"
 #include "J3D/Material/J3DMaterial.hpp"
+#include "J3D/Material/J3DUniformBufferObject.hpp"
 #include "J3D/Data/J3DModelInstance.hpp"
+#include "J3D/Rendering/J3DCulling.hpp"
+#include "J3D/Geometry/J3DGeometryArena.hpp"
 
+#include <cstring>
 #include <iostream>
 
+const std::shared_ptr<J3DMaterial>* J3DRenderPacket::GetMaterial() const
+{
+    if (Instance == nullptr)
+    {
+        return nullptr;
+    }
+
+    const shared_vector<J3DMaterial>& materials = Instance->GetMaterials();
+    if (MaterialIndex >= materials.size() || materials[MaterialIndex] == nullptr)
+    {
+        return nullptr;
+    }
+
+    return &materials[MaterialIndex];
+}
+
 void J3DRenderPacket::Render(float deltaTime, glm::mat4& viewMatrix, glm::mat4& projMatrix, uint32_t materialShaderOverride)
 {
-    if (Material == nullptr || Instance == nullptr)
+    RenderKeepArena(deltaTime, viewMatrix, projMatrix, materialShaderOverride);
+
+    // Callers may bind their own VAOs before the next draw, which the arena can't know about.
+    J3DGeometryArena::Unbind();
+}
+
+void J3DRenderPacket::StaticRender(uint32_t materialShaderOverride)
+{
+  StaticRenderKeepArena(materialShaderOverride);
+
+  J3DGeometryArena::Unbind();
+}
+
+void J3DRenderPacket::RenderKeepArena(float deltaTime, glm::mat4& viewMatrix, glm::mat4& projMatrix, uint32_t materialShaderOverride)
+{
+    const std::shared_ptr<J3DMaterial>* material = GetMaterial();
+    if (material == nullptr)
     {
         std::cout << "Material or data pointers were invalid!" << std::endl;
         return;
     }
 
-    Instance->Render(deltaTime, Material, viewMatrix, projMatrix, materialShaderOverride);
+    Instance->RenderPacket(deltaTime, *material, MaterialIndex, viewMatrix, projMatrix, materialShaderOverride);
 }
 
-void J3DRenderPacket::StaticRender(uint32_t materialShaderOverride)
+void J3DRenderPacket::StaticRenderKeepArena(uint32_t materialShaderOverride)
 {
-  if (Material == nullptr || Instance == nullptr)
+  const std::shared_ptr<J3DMaterial>* material = GetMaterial();
+  if (material == nullptr)
   {
     std::cout << "Material or data pointers were invalid!" << std::endl;
     return;
   }
 
-  Instance->StaticRender(Material, materialShaderOverride);
+  Instance->StaticRenderPacket(*material, materialShaderOverride);
+}
+
+bool J3DRenderPacket::RenderBatch(J3DRenderPacket* packets, uint32_t count, float deltaTime, glm::mat4& viewMatrix, glm::mat4& projMatrix)
+{
+    const std::shared_ptr<J3DMaterial>* material = packets[0].GetMaterial();
+    if (material == nullptr)
+    {
+        return false;
+    }
+
+    glm::mat4 texMatrices[10];
+    uint32_t envelopeGeneration = 0;
+
+    for (uint32_t i = 0; i < count; i++)
+    {
+        J3DRenderPacket& packet = packets[i];
+
+        const std::shared_ptr<J3DMaterial>* packetMaterial = packet.GetMaterial();
+        if (packetMaterial == nullptr || packetMaterial->get() != material->get())
+        {
+            return false;
+        }
+
+        // Each instance's envelopes are uploaded as usual, and the batch's draws find them by their draw index.
+        packet.Instance->Update(deltaTime, *material, packet.MaterialIndex, viewMatrix, projMatrix);
+
+        uint32_t drawCount, firstIndex, baseVertex;
+        if (!packet.Instance->GetDrawRange(material->get(), drawCount, firstIndex, baseVertex) ||
+            !J3DCulling::SetBatchDraw(packet, drawCount, firstIndex, baseVertex, packet.Instance->mEnvelopeBase))
+        {
+            return false;
+        }
+
+        if (i == 0)
+        {
+            std::memcpy(texMatrices, (*material)->GetTexMatrices(), sizeof(texMatrices));
+            envelopeGeneration = J3DUniformBufferObject::GetEnvelopeGeneration();
+            continue;
+        }
+
+        // The batch is drawn with the first packet's texture matrices and lights, and with every packet's envelopes still
+        // in the storage, which starting it over would have overwritten.
+        if (J3DUniformBufferObject::GetEnvelopeGeneration() != envelopeGeneration ||
+            std::memcmp(texMatrices, (*material)->GetTexMatrices(), sizeof(texMatrices)) != 0 ||
+            std::memcmp(packet.Instance->mLights, packets[0].Instance->mLights, sizeof(packet.Instance->mLights)) != 0)
+        {
+            return false;
+        }
+    }
+
+    // The last packet's update left its lights and texture matrices set, which match the first packet's.
+    J3DCulling::SetDrawBatch(packets[0].DrawCommand, packets[0].CullGeneration);
+    packets[0].Instance->RenderMaterial(*material, 0);
+    J3DCulling::SetDrawBatch(UINT32_MAX, 0);
+
+    return true;
 }
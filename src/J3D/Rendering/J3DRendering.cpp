@@ -1,48 +1,442 @@
 #include "J3D/Rendering/J3DRendering.hpp"
 #include "J3D/Rendering/J3DRenderPacket.hpp"
+#include "J3D/Rendering/J3DFrustum.hpp"
+#include "J3D/Rendering/J3DCulling.hpp"
+#include "J3D/Rendering/J3DOcclusion.hpp"
 #include "J3D/Data/J3DModelInstance.hpp"
+#include "J3D/Geometry/J3DGeometryArena.hpp"
+#include "J3D/Animation/J3DPoseCache.hpp"
+#include "J3D/Material/J3DUniformBufferObject.hpp"
+#include "J3D/Util/J3DWorkerPool.hpp"
+
+#include <algorithm>
+#include <thread>
+#include <utility>
 
 namespace J3D {
     namespace Rendering {
         namespace {
-            std::function<void(RenderPacketVector&)> SortFunction = [](RenderPacketVector) {};
+            std::function<void(RenderPacketVector&)> SortFunction = RadixSortPackets;
+            // Whether SortFunction is RadixSortPackets, which parallel gathering replaces with a bucketed sort of its own.
+            bool UseRadixSort = true;
+
+            // A packet's key and position, which the radix sort moves around instead of the packets themselves. Packets are
+            // drawn in descending order of their keys, so the entries hold the inverted keys and are sorted ascending.
+            struct SortEntry {
+                uint64_t Key;
+                uint32_t Index;
+            };
+
+            // Scratch space for sorting, kept between frames so that sorting doesn't allocate.
+            std::vector<SortEntry> SortEntries;
+            std::vector<SortEntry> SortScratch;
+            RenderPacketVector PacketScratch;
+
+            // Scenes with fewer instances than this are gathered on the calling thread, since waking the workers would
+            // cost more than it saves.
+            constexpr uint32_t PARALLEL_GATHER_MIN_INSTANCES = 256;
+            // Each thread takes a few chunks of the instance list, so that one chunk of expensive instances doesn't hold up the rest.
+            constexpr uint32_t CHUNKS_PER_THREAD = 4;
+            // Keys sampled from each chunk to place the boundaries between sort buckets.
+            constexpr uint32_t SAMPLES_PER_CHUNK = 16;
+
+            std::unique_ptr<J3DWorkerPool> WorkerPool;
+            uint32_t WorkerThreadCount = std::max(std::thread::hardware_concurrency(), 1u) - 1;
+
+            // The instances left to gather after occlusion, and the packets each chunk of them emitted.
+            std::vector<J3DModelInstance*> GatherInstances;
+            std::vector<RenderPacketVector> ChunkPackets;
+            // The sort bucket of each packet of each chunk, and where each chunk's packets of each bucket go.
+            std::vector<std::vector<uint16_t>> ChunkBuckets;
+            std::vector<std::vector<uint32_t>> ChunkBucketOffsets;
+            // Inverted keys below Splitters[0] go in bucket 0, those from Splitters[i - 1] below Splitters[i] in bucket i.
+            std::vector<uint64_t> Splitters;
+            std::vector<uint32_t> BucketStarts;
+
+            struct GatherContext {
+                glm::vec3 CameraPosition;
+                const J3DFrustum* Frustum;
+                uint32_t ChunkCount;
+                RenderPacketVector* Packets;
+            };
+
+            J3DWorkerPool* GetWorkerPool() {
+                if (WorkerThreadCount == 0) {
+                    return nullptr;
+                }
+
+                if (WorkerPool == nullptr) {
+                    WorkerPool = std::make_unique<J3DWorkerPool>(WorkerThreadCount);
+                }
+
+                return WorkerPool.get();
+            }
+
+            // Stably sorts the entries by key, using the scratch entries as well. Returns whichever of the two holds the result.
+            SortEntry* RadixSortEntries(SortEntry* entries, SortEntry* scratch, uint32_t count) {
+                if (count < 2) {
+                    return entries;
+                }
+
+                // Count the digits of every byte of the keys in a single pass.
+                uint32_t histograms[8][256] = {};
+                for (uint32_t i = 0; i < count; i++) {
+                    for (uint32_t byte = 0; byte < 8; byte++) {
+                        histograms[byte][(entries[i].Key >> (byte * 8)) & 0xFF]++;
+                    }
+                }
+
+                SortEntry* source = entries;
+                SortEntry* destination = scratch;
+
+                // Each pass is a stable counting sort on one byte, starting from the least significant.
+                for (uint32_t byte = 0; byte < 8; byte++) {
+                    uint32_t* histogram = histograms[byte];
+                    uint32_t shift = byte * 8;
+
+                    // A byte that every key shares doesn't change the order, which is common for the bias and mode bits.
+                    if (histogram[(source[0].Key >> shift) & 0xFF] == count) {
+                        continue;
+                    }
+
+                    uint32_t offset = 0;
+                    for (uint32_t digit = 0; digit < 256; digit++) {
+                        uint32_t digitCount = histogram[digit];
+                        histogram[digit] = offset;
+                        offset += digitCount;
+                    }
+
+                    for (uint32_t i = 0; i < count; i++) {
+                        destination[histogram[(source[i].Key >> shift) & 0xFF]++] = source[i];
+                    }
+
+                    std::swap(source, destination);
+                }
+
+                return source;
+            }
+
+            // Picks the bucket boundaries from keys sampled at fixed positions in each chunk. Boundaries taken from the keys
+            // themselves keep the buckets balanced however the keys' bits are spread, where a fixed high byte would put most
+            // scenes in one or two buckets, since the bias and translucency bits rarely vary.
+            uint32_t ChooseSplitters(uint32_t chunkCount, uint32_t maxBucketCount) {
+                Splitters.clear();
+
+                for (uint32_t chunk = 0; chunk < chunkCount; chunk++) {
+                    const RenderPacketVector& chunkPackets = ChunkPackets[chunk];
+                    if (chunkPackets.empty()) {
+                        continue;
+                    }
+
+                    for (uint32_t sample = 0; sample < SAMPLES_PER_CHUNK; sample++) {
+                        Splitters.push_back(~chunkPackets[(size_t)chunkPackets.size() * sample / SAMPLES_PER_CHUNK].SortKey);
+                    }
+                }
+
+                std::sort(Splitters.begin(), Splitters.end());
+
+                uint32_t bucketCount = std::min(maxBucketCount, (uint32_t)Splitters.size());
+                if (bucketCount < 2) {
+                    Splitters.clear();
+                    return 1;
+                }
+
+                // Keep evenly spaced samples. Each one is read from at or after the slot it is written to.
+                for (uint32_t bucket = 1; bucket < bucketCount; bucket++) {
+                    Splitters[bucket - 1] = Splitters[(size_t)Splitters.size() * bucket / bucketCount];
+                }
+
+                Splitters.resize(bucketCount - 1);
+                return bucketCount;
+            }
+
+            // Sorts the packets the chunks emitted into the given vector, with the same result as concatenating the chunks in
+            // order and calling RadixSortPackets. Packets are partitioned into key ranges chunk by chunk, so each range holds
+            // its packets in gathering order, and then the ranges are radix sorted in parallel.
+            void SortChunks(J3DWorkerPool* pool, const GatherContext& context) {
+                uint32_t bucketCount = ChooseSplitters(context.ChunkCount, std::min(pool->GetThreadCount() * CHUNKS_PER_THREAD, 65536u));
+
+                pool->ParallelFor(context.ChunkCount, [&context, bucketCount](uint32_t chunk) {
+                    const RenderPacketVector& chunkPackets = ChunkPackets[chunk];
+                    std::vector<uint16_t>& buckets = ChunkBuckets[chunk];
+                    std::vector<uint32_t>& counts = ChunkBucketOffsets[chunk];
+
+                    buckets.resize(chunkPackets.size());
+                    counts.assign(bucketCount, 0);
+
+                    for (size_t i = 0; i < chunkPackets.size(); i++) {
+                        uint16_t bucket = (uint16_t)(std::upper_bound(Splitters.begin(), Splitters.end(), ~chunkPackets[i].SortKey) - Splitters.begin());
+
+                        buckets[i] = bucket;
+                        counts[bucket]++;
+                    }
+                });
+
+                // Lay the buckets out in key order, and each bucket's chunks out in gathering order.
+                BucketStarts.resize(bucketCount + 1);
+
+                uint32_t offset = 0;
+                for (uint32_t bucket = 0; bucket < bucketCount; bucket++) {
+                    BucketStarts[bucket] = offset;
+
+                    for (uint32_t chunk = 0; chunk < context.ChunkCount; chunk++) {
+                        uint32_t count = ChunkBucketOffsets[chunk][bucket];
+                        ChunkBucketOffsets[chunk][bucket] = offset;
+                        offset += count;
+                    }
+                }
+
+                BucketStarts[bucketCount] = offset;
+
+                // Resizing rather than clearing and refilling leaves the packets from the last frame in place instead of
+                // constructing new ones, since every slot is overwritten below.
+                RenderPacketVector& packets = *context.Packets;
+                packets.resize(offset);
+                PacketScratch.resize(offset);
+                SortEntries.resize(offset);
+                SortScratch.resize(offset);
+
+                pool->ParallelFor(context.ChunkCount, [&context](uint32_t chunk) {
+                    const RenderPacketVector& chunkPackets = ChunkPackets[chunk];
+                    const std::vector<uint16_t>& buckets = ChunkBuckets[chunk];
+                    std::vector<uint32_t>& offsets = ChunkBucketOffsets[chunk];
+
+                    for (size_t i = 0; i < chunkPackets.size(); i++) {
+                        (*context.Packets)[offsets[buckets[i]]++] = chunkPackets[i];
+                    }
+                });
+
+                pool->ParallelFor(bucketCount, [&context](uint32_t bucket) {
+                    const RenderPacketVector& packets = *context.Packets;
+                    uint32_t start = BucketStarts[bucket];
+                    uint32_t count = BucketStarts[bucket + 1] - start;
+
+                    SortEntry* entries = SortEntries.data() + start;
+                    for (uint32_t i = 0; i < count; i++) {
+                        entries[i] = { ~packets[start + i].SortKey, i };
+                    }
+
+                    SortEntry* sorted = RadixSortEntries(entries, SortScratch.data() + start, count);
+                    for (uint32_t i = 0; i < count; i++) {
+                        PacketScratch[start + i] = packets[start + sorted[i].Index];
+                    }
+                });
+
+                packets.swap(PacketScratch);
+            }
+
+            void GatherPacketsParallel(J3DWorkerPool* pool, ModelInstanceVector& modelInstances, glm::vec3 cameraPosition,
+                                       const J3DFrustum* frustum, RenderPacketVector& packets) {
+                // Occlusion queries read results from the GL context, so they stay on this thread. Posing, level of detail
+                // and emitting packets run on the workers, since posing only shares state through locks. Each instance
+                // is prepared by the one chunk holding it, so an instance must not be listed twice.
+                GatherInstances.clear();
+                for (const std::shared_ptr<J3DModelInstance>& instance : modelInstances) {
+                    if (J3DOcclusion::GetUseQueries() && J3DOcclusion::CheckOccluded(instance)) {
+                        continue;
+                    }
+
+                    GatherInstances.push_back(instance.get());
+                }
+
+                uint32_t instanceCount = (uint32_t)GatherInstances.size();
+                uint32_t chunkCount = std::min(pool->GetThreadCount() * CHUNKS_PER_THREAD, instanceCount);
+                if (chunkCount == 0) {
+                    packets.clear();
+                    return;
+                }
+
+                if (ChunkPackets.size() < chunkCount) {
+                    ChunkPackets.resize(chunkCount);
+                    ChunkBuckets.resize(chunkCount);
+                    ChunkBucketOffsets.resize(chunkCount);
+                }
+
+                GatherContext context { cameraPosition, frustum, chunkCount, &packets };
+
+                // Chunks are contiguous runs of instances, so concatenating them in order gives the packets a serial gather would.
+                pool->ParallelFor(chunkCount, [&context, instanceCount](uint32_t chunk) {
+                    RenderPacketVector& chunkPackets = ChunkPackets[chunk];
+                    chunkPackets.clear();
+
+                    uint32_t begin = (uint32_t)((uint64_t)instanceCount * chunk / context.ChunkCount);
+                    uint32_t end = (uint32_t)((uint64_t)instanceCount * (chunk + 1) / context.ChunkCount);
+
+                    for (uint32_t i = begin; i < end; i++) {
+                        J3DModelInstance* instance = GatherInstances[i];
+
+                        if (instance->PrepareRenderPackets(context.CameraPosition, context.Frustum)) {
+                            instance->EmitRenderPackets(chunkPackets, context.CameraPosition, context.Frustum);
+                        }
+                    }
+                });
+
+                if (UseRadixSort) {
+                    SortChunks(pool, context);
+                    return;
+                }
+
+                packets.clear();
+                for (uint32_t chunk = 0; chunk < chunkCount; chunk++) {
+                    packets.insert(packets.end(), ChunkPackets[chunk].begin(), ChunkPackets[chunk].end());
+                }
+
+                SortFunction(packets);
+            }
+
+            void GatherPackets(ModelInstanceVector& modelInstances, glm::vec3 cameraPosition, const J3DFrustum* frustum, RenderPacketVector& packets) {
+                // Queries queued by a gather that was never rendered would keep their instances alive and never be issued.
+                J3DOcclusion::ClearQueue();
+
+                J3DWorkerPool* pool = GetWorkerPool();
+                if (pool != nullptr && modelInstances.size() >= PARALLEL_GATHER_MIN_INSTANCES) {
+                    GatherPacketsParallel(pool, modelInstances, cameraPosition, frustum, packets);
+                    return;
+                }
+
+                packets.clear();
+
+                size_t materialCount = 0;
+                for (const std::shared_ptr<J3DModelInstance>& instance : modelInstances) {
+                    materialCount += instance->GetMaterials().size();
+                }
+
+                packets.reserve(materialCount);
+
+                for (const std::shared_ptr<J3DModelInstance>& instance : modelInstances) {
+                    if (J3DOcclusion::GetUseQueries() && J3DOcclusion::CheckOccluded(instance)) {
+                        continue;
+                    }
+
+                    if (frustum != nullptr) {
+                        instance->GatherRenderPackets(packets, cameraPosition, *frustum);
+                    }
+                    else {
+                        instance->GatherRenderPackets(packets, cameraPosition);
+                    }
+                }
+
+                SortFunction(packets);
+            }
         }
     }
 }
 
 void J3D::Rendering::SetSortFunction(std::function<void(RenderPacketVector&)> sortFunction) {
     if (sortFunction) {
+        void (* const* target)(RenderPacketVector&) = sortFunction.target<void(*)(RenderPacketVector&)>();
+
         SortFunction = sortFunction;
+        UseRadixSort = target != nullptr && *target == RadixSortPackets;
     }
 }
 
-J3D::Rendering::RenderPacketVector J3D::Rendering::SortPackets(ModelInstanceVector& modelInstances, glm::vec3 cameraPosition) {
-    std::vector<J3DRenderPacket> packets;
+void J3D::Rendering::SetWorkerThreadCount(uint32_t count) {
+    if (count != WorkerThreadCount) {
+        WorkerPool.reset();
+        WorkerThreadCount = count;
+    }
+}
+
+uint32_t J3D::Rendering::GetWorkerThreadCount() {
+    return WorkerThreadCount;
+}
+
+void J3D::Rendering::RadixSortPackets(RenderPacketVector& packets) {
+    uint32_t count = (uint32_t)packets.size();
+    if (count < 2) {
+        return;
+    }
 
-	size_t materialCount = 0;
-    for (std::shared_ptr<J3DModelInstance> instance : modelInstances) {
-        materialCount += instance->GetMaterials().size();
+    SortEntries.resize(count);
+    SortScratch.resize(count);
+
+    for (uint32_t i = 0; i < count; i++) {
+        SortEntries[i] = { ~packets[i].SortKey, i };
     }
 
-	packets.reserve(materialCount);
+    SortEntry* sorted = RadixSortEntries(SortEntries.data(), SortScratch.data(), count);
 
-    for (std::shared_ptr<J3DModelInstance> instance : modelInstances) {
-        instance->GatherRenderPackets(packets, cameraPosition);
+    PacketScratch.resize(count);
+    for (uint32_t i = 0; i < count; i++) {
+        PacketScratch[i] = packets[sorted[i].Index];
     }
 
-    SortFunction(packets);
+    // Both buffers keep their capacity, so the next sort doesn't allocate either.
+    packets.swap(PacketScratch);
+}
+
+J3D::Rendering::RenderPacketVector J3D::Rendering::SortPackets(ModelInstanceVector& modelInstances, glm::vec3 cameraPosition) {
+    RenderPacketVector packets;
+    SortPackets(modelInstances, cameraPosition, packets);
+
+    return packets;
+}
+
+J3D::Rendering::RenderPacketVector J3D::Rendering::SortPackets(ModelInstanceVector& modelInstances, glm::vec3 cameraPosition, const glm::mat4& viewProjMatrix) {
+    RenderPacketVector packets;
+    SortPackets(modelInstances, cameraPosition, viewProjMatrix, packets);
+
     return packets;
 }
 
+void J3D::Rendering::SortPackets(ModelInstanceVector& modelInstances, glm::vec3 cameraPosition, RenderPacketVector& packets) {
+    GatherPackets(modelInstances, cameraPosition, nullptr, packets);
+}
+
+void J3D::Rendering::SortPackets(ModelInstanceVector& modelInstances, glm::vec3 cameraPosition, const glm::mat4& viewProjMatrix, RenderPacketVector& packets) {
+    J3DFrustum frustum(viewProjMatrix);
+    GatherPackets(modelInstances, cameraPosition, &frustum, packets);
+}
+
 void J3D::Rendering::Render(float deltaTime, glm::mat4& viewMatrix, glm::mat4& projMatrix, RenderPacketVector& renderPackets, uint32_t materialShaderOverride) {
-    for (J3DRenderPacket packet : renderPackets) {
-        packet.Render(deltaTime, viewMatrix, projMatrix, materialShaderOverride);
+    // Envelope matrices uploaded last frame stay valid until now, so that StaticRender passes can reuse them.
+    J3DUniformBufferObject::ClearEnvelopeMatrices();
+
+    for (size_t i = 0; i < renderPackets.size();) {
+        // Culled packets that share their material state are drawn together, with one multi-draw of the ones that survived.
+        // Override shaders don't read the batch's envelopes, so they draw every packet on its own.
+        uint32_t batchSize = 1;
+        if (materialShaderOverride == 0) {
+            batchSize = J3DCulling::GetBatchSize(&renderPackets[i], (uint32_t)(renderPackets.size() - i));
+        }
+
+        if (batchSize > 1 && J3DRenderPacket::RenderBatch(&renderPackets[i], batchSize, deltaTime, viewMatrix, projMatrix)) {
+            i += batchSize;
+            continue;
+        }
+
+        for (size_t end = i + batchSize; i < end; i++) {
+            J3DCulling::SetDrawCommand(renderPackets[i].DrawCommand, renderPackets[i].CullGeneration);
+            renderPackets[i].RenderKeepArena(deltaTime, viewMatrix, projMatrix, materialShaderOverride);
+        }
     }
+
+    J3DCulling::SetDrawCommand(UINT32_MAX, 0);
+
+    // Query the instances against the depth the packets left, for the next frame's SortPackets.
+    J3DOcclusion::IssueQueries(viewMatrix, projMatrix);
+
+    // Packets leave their arena's VAO bound so that consecutive packets don't rebind it.
+    J3DGeometryArena::Unbind();
+
+    // Every instance has been posed for this frame, so the shared poses are no longer needed.
+    J3DPoseCache::Clear();
 }
 
 void J3D::Rendering::StaticRender(RenderPacketVector& renderPackets, uint32_t materialShaderOverride)
 {
-  for (J3DRenderPacket packet : renderPackets) {
-    packet.StaticRender(materialShaderOverride);
+  for (J3DRenderPacket& packet : renderPackets) {
+    J3DCulling::SetDrawCommand(packet.DrawCommand, packet.CullGeneration);
+    packet.StaticRenderKeepArena(materialShaderOverride);
   }
+
+  J3DCulling::SetDrawCommand(UINT32_MAX, 0);
+
+  J3DGeometryArena::Unbind();
+}
+
+void J3D::Rendering::NotifyCameraCut() {
+    J3DOcclusion::NotifyCameraCut();
+    J3DCulling::ClearDepthPyramid();
 }
@@ -0,0 +1,449 @@
+#include "J3D/Scene/J3DDynamicAABBTree.hpp"
+#include "J3D/Rendering/J3DFrustum.hpp"
+
+#include <algorithm>
+
+namespace {
+	float SurfaceArea(const glm::vec3& min, const glm::vec3& max) {
+		glm::vec3 size = max - min;
+		return 2.0f * (size.x * size.y + size.y * size.z + size.z * size.x);
+	}
+
+	bool BoxesOverlap(const glm::vec3& minA, const glm::vec3& maxA, const glm::vec3& minB, const glm::vec3& maxB) {
+		return minA.x <= maxB.x && minA.y <= maxB.y && minA.z <= maxB.z &&
+			minB.x <= maxA.x && minB.y <= maxA.y && minB.z <= maxA.z;
+	}
+
+	bool BoxContains(const glm::vec3& outerMin, const glm::vec3& outerMax, const glm::vec3& innerMin, const glm::vec3& innerMax) {
+		return outerMin.x <= innerMin.x && outerMin.y <= innerMin.y && outerMin.z <= innerMin.z &&
+			innerMax.x <= outerMax.x && innerMax.y <= outerMax.y && innerMax.z <= outerMax.z;
+	}
+
+	// Slab test. Sets entry to the distance at which the ray enters the box, or 0 if it starts inside.
+	bool RayIntersectsBox(const glm::vec3& origin, const glm::vec3& inverseDirection, float maxDistance, const glm::vec3& min, const glm::vec3& max, float& entry) {
+		glm::vec3 t1 = (min - origin) * inverseDirection;
+		glm::vec3 t2 = (max - origin) * inverseDirection;
+
+		glm::vec3 entries = glm::min(t1, t2);
+		glm::vec3 exits = glm::max(t1, t2);
+
+		float enter = std::max(std::max(entries.x, entries.y), std::max(entries.z, 0.0f));
+		float exit = std::min(std::min(exits.x, exits.y), std::min(exits.z, maxDistance));
+
+		entry = enter;
+		return enter <= exit;
+	}
+
+	// Stack size that covers any balanced tree of a realistic size without reallocating.
+	constexpr size_t QUERY_STACK_RESERVE = 64;
+}
+
+J3DDynamicAABBTree::J3DDynamicAABBTree(float margin) : mRoot(NULL_NODE), mFreeList(NULL_NODE), mMargin(margin) {
+
+}
+
+int32_t J3DDynamicAABBTree::AllocateNode() {
+	if (mFreeList == NULL_NODE) {
+		mNodes.push_back(J3DTreeNode());
+		mFreeList = (int32_t)mNodes.size() - 1;
+		mNodes[mFreeList].Parent = NULL_NODE;
+	}
+
+	int32_t node = mFreeList;
+	mFreeList = mNodes[node].Parent;
+
+	mNodes[node].Parent = NULL_NODE;
+	mNodes[node].Child1 = NULL_NODE;
+	mNodes[node].Child2 = NULL_NODE;
+	mNodes[node].Height = 0;
+	mNodes[node].UserData = 0;
+
+	return node;
+}
+
+void J3DDynamicAABBTree::FreeNode(int32_t node) {
+	mNodes[node].Parent = mFreeList;
+	mNodes[node].Height = -1;
+	mFreeList = node;
+}
+
+int32_t J3DDynamicAABBTree::CreateProxy(const glm::vec3& min, const glm::vec3& max, uint32_t userData) {
+	int32_t proxy = AllocateNode();
+
+	glm::vec3 margin = (max - min) * mMargin;
+	mNodes[proxy].Min = min - margin;
+	mNodes[proxy].Max = max + margin;
+	mNodes[proxy].UserData = userData;
+
+	InsertLeaf(proxy);
+	return proxy;
+}
+
+void J3DDynamicAABBTree::DestroyProxy(int32_t proxy) {
+	RemoveLeaf(proxy);
+	FreeNode(proxy);
+}
+
+bool J3DDynamicAABBTree::MoveProxy(int32_t proxy, const glm::vec3& min, const glm::vec3& max) {
+	J3DTreeNode& node = mNodes[proxy];
+	if (BoxContains(node.Min, node.Max, min, max)) {
+		return false;
+	}
+
+	RemoveLeaf(proxy);
+
+	glm::vec3 margin = (max - min) * mMargin;
+	mNodes[proxy].Min = min - margin;
+	mNodes[proxy].Max = max + margin;
+
+	InsertLeaf(proxy);
+	return true;
+}
+
+void J3DDynamicAABBTree::Clear() {
+	mNodes.clear();
+	mRoot = NULL_NODE;
+	mFreeList = NULL_NODE;
+}
+
+void J3DDynamicAABBTree::GetFatBox(int32_t proxy, glm::vec3& min, glm::vec3& max) const {
+	min = mNodes[proxy].Min;
+	max = mNodes[proxy].Max;
+}
+
+void J3DDynamicAABBTree::InsertLeaf(int32_t leaf) {
+	if (mRoot == NULL_NODE) {
+		mRoot = leaf;
+		mNodes[leaf].Parent = NULL_NODE;
+		return;
+	}
+
+	glm::vec3 leafMin = mNodes[leaf].Min;
+	glm::vec3 leafMax = mNodes[leaf].Max;
+
+	// Descend towards the sibling that grows the tree's total surface area the least.
+	int32_t index = mRoot;
+	while (!mNodes[index].IsLeaf()) {
+		const J3DTreeNode& node = mNodes[index];
+
+		float area = SurfaceArea(node.Min, node.Max);
+		float combinedArea = SurfaceArea(glm::min(node.Min, leafMin), glm::max(node.Max, leafMax));
+
+		// Cost of making the leaf a sibling of this node, and the cost every ancestor of a deeper sibling pays for growing.
+		float cost = 2.0f * combinedArea;
+		float inheritanceCost = 2.0f * (combinedArea - area);
+
+		float childCosts[2];
+		int32_t children[2] = { node.Child1, node.Child2 };
+
+		for (int i = 0; i < 2; i++) {
+			const J3DTreeNode& child = mNodes[children[i]];
+			float childCombinedArea = SurfaceArea(glm::min(child.Min, leafMin), glm::max(child.Max, leafMax));
+
+			childCosts[i] = child.IsLeaf() ? childCombinedArea + inheritanceCost :
+				childCombinedArea - SurfaceArea(child.Min, child.Max) + inheritanceCost;
+		}
+
+		if (cost < childCosts[0] && cost < childCosts[1]) {
+			break;
+		}
+
+		index = childCosts[0] < childCosts[1] ? children[0] : children[1];
+	}
+
+	int32_t sibling = index;
+
+	int32_t newParent = AllocateNode();
+	int32_t oldParent = mNodes[sibling].Parent;
+
+	mNodes[newParent].Parent = oldParent;
+	mNodes[newParent].Min = glm::min(mNodes[sibling].Min, leafMin);
+	mNodes[newParent].Max = glm::max(mNodes[sibling].Max, leafMax);
+	mNodes[newParent].Height = mNodes[sibling].Height + 1;
+	mNodes[newParent].Child1 = sibling;
+	mNodes[newParent].Child2 = leaf;
+
+	if (oldParent != NULL_NODE) {
+		if (mNodes[oldParent].Child1 == sibling) {
+			mNodes[oldParent].Child1 = newParent;
+		}
+		else {
+			mNodes[oldParent].Child2 = newParent;
+		}
+	}
+	else {
+		mRoot = newParent;
+	}
+
+	mNodes[sibling].Parent = newParent;
+	mNodes[leaf].Parent = newParent;
+
+	RefitAncestors(newParent);
+}
+
+void J3DDynamicAABBTree::RemoveLeaf(int32_t leaf) {
+	if (leaf == mRoot) {
+		mRoot = NULL_NODE;
+		return;
+	}
+
+	int32_t parent = mNodes[leaf].Parent;
+	int32_t grandParent = mNodes[parent].Parent;
+	int32_t sibling = mNodes[parent].Child1 == leaf ? mNodes[parent].Child2 : mNodes[parent].Child1;
+
+	// The sibling takes the parent's place.
+	if (grandParent != NULL_NODE) {
+		if (mNodes[grandParent].Child1 == parent) {
+			mNodes[grandParent].Child1 = sibling;
+		}
+		else {
+			mNodes[grandParent].Child2 = sibling;
+		}
+
+		mNodes[sibling].Parent = grandParent;
+		FreeNode(parent);
+
+		RefitAncestors(grandParent);
+	}
+	else {
+		mRoot = sibling;
+		mNodes[sibling].Parent = NULL_NODE;
+		FreeNode(parent);
+	}
+
+	mNodes[leaf].Parent = NULL_NODE;
+}
+
+void J3DDynamicAABBTree::RefitAncestors(int32_t node) {
+	int32_t index = node;
+
+	while (index != NULL_NODE) {
+		index = Balance(index);
+
+		J3DTreeNode& current = mNodes[index];
+		const J3DTreeNode& child1 = mNodes[current.Child1];
+		const J3DTreeNode& child2 = mNodes[current.Child2];
+
+		current.Height = 1 + std::max(child1.Height, child2.Height);
+		current.Min = glm::min(child1.Min, child2.Min);
+		current.Max = glm::max(child1.Max, child2.Max);
+
+		index = current.Parent;
+	}
+}
+
+int32_t J3DDynamicAABBTree::Balance(int32_t iA) {
+	J3DTreeNode& a = mNodes[iA];
+	if (a.IsLeaf() || a.Height < 2) {
+		return iA;
+	}
+
+	int32_t iB = a.Child1;
+	int32_t iC = a.Child2;
+	J3DTreeNode& b = mNodes[iB];
+	J3DTreeNode& c = mNodes[iC];
+
+	int32_t balance = c.Height - b.Height;
+
+	// The taller child replaces A, and A takes the taller child's shorter grandchild.
+	if (balance > 1) {
+		int32_t iF = c.Child1;
+		int32_t iG = c.Child2;
+		J3DTreeNode& f = mNodes[iF];
+		J3DTreeNode& g = mNodes[iG];
+
+		c.Child1 = iA;
+		c.Parent = a.Parent;
+		a.Parent = iC;
+
+		if (c.Parent != NULL_NODE) {
+			if (mNodes[c.Parent].Child1 == iA) {
+				mNodes[c.Parent].Child1 = iC;
+			}
+			else {
+				mNodes[c.Parent].Child2 = iC;
+			}
+		}
+		else {
+			mRoot = iC;
+		}
+
+		if (f.Height > g.Height) {
+			c.Child2 = iF;
+			a.Child2 = iG;
+			g.Parent = iA;
+
+			a.Min = glm::min(b.Min, g.Min);
+			a.Max = glm::max(b.Max, g.Max);
+			c.Min = glm::min(a.Min, f.Min);
+			c.Max = glm::max(a.Max, f.Max);
+
+			a.Height = 1 + std::max(b.Height, g.Height);
+			c.Height = 1 + std::max(a.Height, f.Height);
+		}
+		else {
+			c.Child2 = iG;
+			a.Child2 = iF;
+			f.Parent = iA;
+
+			a.Min = glm::min(b.Min, f.Min);
+			a.Max = glm::max(b.Max, f.Max);
+			c.Min = glm::min(a.Min, g.Min);
+			c.Max = glm::max(a.Max, g.Max);
+
+			a.Height = 1 + std::max(b.Height, f.Height);
+			c.Height = 1 + std::max(a.Height, g.Height);
+		}
+
+		return iC;
+	}
+
+	if (balance < -1) {
+		int32_t iD = b.Child1;
+		int32_t iE = b.Child2;
+		J3DTreeNode& d = mNodes[iD];
+		J3DTreeNode& e = mNodes[iE];
+
+		b.Child1 = iA;
+		b.Parent = a.Parent;
+		a.Parent = iB;
+
+		if (b.Parent != NULL_NODE) {
+			if (mNodes[b.Parent].Child1 == iA) {
+				mNodes[b.Parent].Child1 = iB;
+			}
+			else {
+				mNodes[b.Parent].Child2 = iB;
+			}
+		}
+		else {
+			mRoot = iB;
+		}
+
+		if (d.Height > e.Height) {
+			b.Child2 = iD;
+			a.Child1 = iE;
+			e.Parent = iA;
+
+			a.Min = glm::min(c.Min, e.Min);
+			a.Max = glm::max(c.Max, e.Max);
+			b.Min = glm::min(a.Min, d.Min);
+			b.Max = glm::max(a.Max, d.Max);
+
+			a.Height = 1 + std::max(c.Height, e.Height);
+			b.Height = 1 + std::max(a.Height, d.Height);
+		}
+		else {
+			b.Child2 = iE;
+			a.Child1 = iD;
+			d.Parent = iA;
+
+			a.Min = glm::min(c.Min, d.Min);
+			a.Max = glm::max(c.Max, d.Max);
+			b.Min = glm::min(a.Min, e.Min);
+			b.Max = glm::max(a.Max, e.Max);
+
+			a.Height = 1 + std::max(c.Height, d.Height);
+			b.Height = 1 + std::max(a.Height, e.Height);
+		}
+
+		return iB;
+	}
+
+	return iA;
+}
+
+void J3DDynamicAABBTree::QueryBox(const glm::vec3& min, const glm::vec3& max, std::vector<uint32_t>& results) const {
+	if (mRoot == NULL_NODE) {
+		return;
+	}
+
+	std::vector<int32_t> stack;
+	stack.reserve(QUERY_STACK_RESERVE);
+	stack.push_back(mRoot);
+
+	while (!stack.empty()) {
+		const J3DTreeNode& node = mNodes[stack.back()];
+		stack.pop_back();
+
+		if (!BoxesOverlap(node.Min, node.Max, min, max)) {
+			continue;
+		}
+
+		if (node.IsLeaf()) {
+			results.push_back(node.UserData);
+		}
+		else {
+			stack.push_back(node.Child1);
+			stack.push_back(node.Child2);
+		}
+	}
+}
+
+void J3DDynamicAABBTree::QueryFrustum(const J3DFrustum& frustum, std::vector<uint32_t>& results) const {
+	if (mRoot == NULL_NODE) {
+		return;
+	}
+
+	// Subtrees entirely inside the frustum are collected without testing their nodes.
+	std::vector<std::pair<int32_t, bool>> stack;
+	stack.reserve(QUERY_STACK_RESERVE);
+	stack.push_back({ mRoot, false });
+
+	while (!stack.empty()) {
+		auto [index, inside] = stack.back();
+		stack.pop_back();
+
+		const J3DTreeNode& node = mNodes[index];
+
+		if (!inside) {
+			if (!frustum.IntersectsBox(node.Min, node.Max)) {
+				continue;
+			}
+
+			inside = frustum.ContainsBox(node.Min, node.Max);
+		}
+
+		if (node.IsLeaf()) {
+			results.push_back(node.UserData);
+		}
+		else {
+			stack.push_back({ node.Child1, inside });
+			stack.push_back({ node.Child2, inside });
+		}
+	}
+}
+
+void J3DDynamicAABBTree::QueryRay(const glm::vec3& origin, const glm::vec3& direction, std::vector<std::pair<uint32_t, float>>& results, float maxDistance) const {
+	if (mRoot == NULL_NODE) {
+		return;
+	}
+
+	glm::vec3 inverseDirection = 1.0f / direction;
+
+	std::vector<int32_t> stack;
+	stack.reserve(QUERY_STACK_RESERVE);
+	stack.push_back(mRoot);
+
+	while (!stack.empty()) {
+		const J3DTreeNode& node = mNodes[stack.back()];
+		stack.pop_back();
+
+		float entry = 0.0f;
+		if (!RayIntersectsBox(origin, inverseDirection, maxDistance, node.Min, node.Max, entry)) {
+			continue;
+		}
+
+		if (node.IsLeaf()) {
+			results.push_back({ node.UserData, entry });
+		}
+		else {
+			stack.push_back(node.Child1);
+			stack.push_back(node.Child2);
+		}
+	}
+}
+
+int32_t J3DDynamicAABBTree::GetHeight() const {
+	return mRoot == NULL_NODE ? 0 : mNodes[mRoot].Height;
+}
@@ -0,0 +1,171 @@
+#include "J3D/Scene/J3DScene.hpp"
+#include "J3D/Data/J3DModelInstance.hpp"
+#include "J3D/Rendering/J3DFrustum.hpp"
+
+#include <algorithm>
+
+J3DScene::J3DScene() {
+
+}
+
+J3DScene::~J3DScene() {
+	Clear();
+}
+
+bool J3DScene::AddInstance(std::shared_ptr<J3DModelInstance> instance) {
+	if (instance == nullptr || instance->mScene != nullptr) {
+		return false;
+	}
+
+	uint32_t index = (uint32_t)mInstances.size();
+
+	glm::vec3 min, max;
+	instance->GetWorldBoundingBox(min, max);
+
+	instance->mScene = this;
+	instance->mSceneIndex = index;
+
+	mInstances.push_back(instance);
+	mProxies.push_back(mTree.CreateProxy(min, max, index));
+	mMoved.push_back(false);
+
+	return true;
+}
+
+bool J3DScene::RemoveInstance(const std::shared_ptr<J3DModelInstance>& instance) {
+	if (instance == nullptr || instance->mScene != this) {
+		return false;
+	}
+
+	// The argument may be a reference to the slot that the last instance is moved into.
+	std::shared_ptr<J3DModelInstance> removed = instance;
+
+	uint32_t index = removed->mSceneIndex;
+	uint32_t last = (uint32_t)mInstances.size() - 1;
+
+	mTree.DestroyProxy(mProxies[index]);
+
+	if (mMoved[index]) {
+		mMovedInstances.erase(std::find(mMovedInstances.begin(), mMovedInstances.end(), index));
+	}
+
+	// Move the last instance into the removed one's slot.
+	if (index != last) {
+		mInstances[index] = mInstances[last];
+		mProxies[index] = mProxies[last];
+		mMoved[index] = mMoved[last];
+
+		mInstances[index]->mSceneIndex = index;
+		mTree.SetUserData(mProxies[index], index);
+
+		if (mMoved[index]) {
+			*std::find(mMovedInstances.begin(), mMovedInstances.end(), last) = index;
+		}
+	}
+
+	mInstances.pop_back();
+	mProxies.pop_back();
+	mMoved.pop_back();
+
+	removed->mScene = nullptr;
+	removed->mSceneIndex = 0;
+
+	return true;
+}
+
+void J3DScene::Clear() {
+	for (std::shared_ptr<J3DModelInstance>& instance : mInstances) {
+		instance->mScene = nullptr;
+		instance->mSceneIndex = 0;
+	}
+
+	mInstances.clear();
+	mProxies.clear();
+	mMoved.clear();
+	mMovedInstances.clear();
+	mTree.Clear();
+}
+
+void J3DScene::MarkMoved(uint32_t index) {
+	std::lock_guard<std::mutex> lock(mMovedMutex);
+
+	if (mMoved[index]) {
+		return;
+	}
+
+	mMoved[index] = true;
+	mMovedInstances.push_back(index);
+}
+
+void J3DScene::RefitInstance(uint32_t index) {
+	glm::vec3 min, max;
+	mInstances[index]->GetWorldBoundingBox(min, max);
+
+	mTree.MoveProxy(mProxies[index], min, max);
+	mMoved[index] = false;
+}
+
+void J3DScene::Update() {
+	for (uint32_t index : mMovedInstances) {
+		RefitInstance(index);
+	}
+
+	mMovedInstances.clear();
+}
+
+void J3DScene::GatherInstances(const std::vector<uint32_t>& indices, std::vector<std::shared_ptr<J3DModelInstance>>& instances) const {
+	instances.reserve(instances.size() + indices.size());
+
+	for (uint32_t index : indices) {
+		instances.push_back(mInstances[index]);
+	}
+}
+
+void J3DScene::QueryFrustum(const J3DFrustum& frustum, std::vector<std::shared_ptr<J3DModelInstance>>& instances) {
+	Update();
+
+	mQueryIndices.clear();
+	mTree.QueryFrustum(frustum, mQueryIndices);
+
+	GatherInstances(mQueryIndices, instances);
+}
+
+void J3DScene::QueryBox(const glm::vec3& min, const glm::vec3& max, std::vector<std::shared_ptr<J3DModelInstance>>& instances) {
+	Update();
+
+	mQueryIndices.clear();
+	mTree.QueryBox(min, max, mQueryIndices);
+
+	GatherInstances(mQueryIndices, instances);
+}
+
+void J3DScene::QueryRay(const glm::vec3& origin, const glm::vec3& direction, std::vector<std::shared_ptr<J3DModelInstance>>& instances, float maxDistance) {
+	Update();
+
+	mQueryHits.clear();
+	mTree.QueryRay(origin, direction, mQueryHits, maxDistance);
+
+	std::sort(mQueryHits.begin(), mQueryHits.end(), [](const std::pair<uint32_t, float>& a, const std::pair<uint32_t, float>& b) { return a.second < b.second; });
+
+	instances.reserve(instances.size() + mQueryHits.size());
+	for (const std::pair<uint32_t, float>& hit : mQueryHits) {
+		instances.push_back(mInstances[hit.first]);
+	}
+}
+
+J3D::Rendering::RenderPacketVector J3DScene::SortPackets(glm::vec3 cameraPosition, const glm::mat4& viewProjMatrix) {
+	J3D::Rendering::RenderPacketVector packets;
+	SortPackets(cameraPosition, viewProjMatrix, packets);
+
+	return packets;
+}
+
+void J3DScene::SortPackets(glm::vec3 cameraPosition, const glm::mat4& viewProjMatrix, J3D::Rendering::RenderPacketVector& packets) {
+	mVisibleInstances.clear();
+	QueryFrustum(J3DFrustum(viewProjMatrix), mVisibleInstances);
+
+	J3D::Rendering::SortPackets(mVisibleInstances, cameraPosition, viewProjMatrix, packets);
+
+	// Don't keep removed instances alive until the next call.
+	mVisibleInstances.clear();
+}
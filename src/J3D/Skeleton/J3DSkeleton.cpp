@@ -1,6 +1,8 @@
 #include "J3D/Skeleton/J3DSkeleton.hpp"
 #include "J3D/Skeleton/J3DJoint.hpp"
 
+#include <algorithm>
+
 
 
 J3DSkeleton::J3DSkeleton() {
@@ -46,36 +48,103 @@ void J3DSkeleton::CalculateRestPose() {
         }
     }
     mRestPose.shrink_to_fit();
+
+    BuildPoseTables();
+}
+
+void J3DSkeleton::BuildPoseTables() {
+    mEnvelopeOffsets.assign(1, 0);
+    mEnvelopeJointIndices.clear();
+    mEnvelopeWeights.clear();
+
+    for (const J3DEnvelope& env : mJointEnvelopes) {
+        mEnvelopeJointIndices.insert(mEnvelopeJointIndices.end(), env.JointIndices.begin(), env.JointIndices.end());
+        mEnvelopeWeights.insert(mEnvelopeWeights.end(), env.Weights.begin(), env.Weights.end());
+        mEnvelopeOffsets.push_back((uint32_t)mEnvelopeWeights.size());
+    }
+
+    mJointParents.assign(mJoints.size(), -1);
+    std::vector<uint32_t> depths(mJoints.size(), 0);
+
+    for (const std::shared_ptr<J3DJoint>& joint : mJoints) {
+        std::shared_ptr<J3DJoint> parent = std::dynamic_pointer_cast<J3DJoint>(joint->GetParent().lock());
+        if (parent != nullptr) {
+            mJointParents[joint->GetJointID()] = parent->GetJointID();
+        }
+
+        for (; parent != nullptr; parent = std::dynamic_pointer_cast<J3DJoint>(parent->GetParent().lock())) {
+            depths[joint->GetJointID()]++;
+        }
+    }
+
+    mJointOrder.resize(mJoints.size());
+    for (uint32_t i = 0; i < mJointOrder.size(); i++) {
+        mJointOrder[i] = i;
+    }
+
+    std::stable_sort(mJointOrder.begin(), mJointOrder.end(), [&depths](uint32_t a, uint32_t b) { return depths[a] < depths[b]; });
+}
+
+void J3DSkeleton::CalculateJointWorldMatrices(const std::vector<glm::mat4>& localTransforms, std::vector<glm::mat4>& world, const std::vector<bool>* skip) const {
+    world.resize(mJointOrder.size());
+
+    // Parents are always visited before their children, so their world transforms are ready.
+    for (uint32_t jointIndex : mJointOrder) {
+        if (skip != nullptr && (*skip)[jointIndex]) {
+            continue;
+        }
+
+        int32_t parentIndex = mJointParents[jointIndex];
+        world[jointIndex] = parentIndex < 0 ? localTransforms[jointIndex] : world[parentIndex] * localTransforms[jointIndex];
+    }
 }
 
 std::vector<glm::mat4> J3DSkeleton::CalculateAnimJointPose(const std::vector<glm::mat4>& transforms) {
     std::vector<glm::mat4> animTransforms;
+    UpdateAnimJointPose(transforms, animTransforms);
+
+    return animTransforms;
+}
+
+void J3DSkeleton::UpdateAnimJointPose(const std::vector<glm::mat4>& transforms, std::vector<glm::mat4>& pose, const std::vector<bool>* skip) const {
+    pose.resize(mEnvelopeIndices.size());
 
     for (int i = 0; i < mEnvelopeIndices.size(); i++) {
+        if (skip != nullptr && (*skip)[i]) {
+            continue;
+        }
+
         if (mDrawBools[i] == false) {
-            animTransforms.push_back(transforms[mEnvelopeIndices[i]]);
+            pose[i] = transforms[mEnvelopeIndices[i]];
         }
         else {
             glm::mat4 matrix = glm::zero<glm::mat4>();
 
-            J3DEnvelope env = mJointEnvelopes[mEnvelopeIndices[i]];
-            float weightTotal = 0.f;
-
-            for (int j = 0; j < env.Weights.size(); j++) {
-                uint32_t jointIndex = env.JointIndices[j];
-
-                glm::mat4 ibm = mInverseBindMatrices[jointIndex];
-                glm::mat4 jointTransform = transforms[jointIndex];
+            uint16_t envelopeIndex = mEnvelopeIndices[i];
+            for (uint32_t j = mEnvelopeOffsets[envelopeIndex]; j < mEnvelopeOffsets[envelopeIndex + 1]; j++) {
+                uint16_t jointIndex = mEnvelopeJointIndices[j];
 
-                matrix += (jointTransform * ibm) * env.Weights[j];
-                weightTotal += env.Weights[j];
+                matrix += (transforms[jointIndex] * mInverseBindMatrices[jointIndex]) * mEnvelopeWeights[j];
             }
 
-            animTransforms.push_back(matrix);
+            pose[i] = matrix;
         }
     }
+}
 
-    animTransforms.shrink_to_fit();
+std::vector<bool> J3DSkeleton::GetStaticEnvelopes(const std::vector<bool>& staticJoints) const {
+    std::vector<bool> staticEnvelopes(mEnvelopeIndices.size(), false);
 
-    return animTransforms;
+    for (int i = 0; i < mEnvelopeIndices.size(); i++) {
+        if (mDrawBools[i] == false) {
+            staticEnvelopes[i] = staticJoints[mEnvelopeIndices[i]];
+            continue;
+        }
+
+        uint16_t envelopeIndex = mEnvelopeIndices[i];
+        staticEnvelopes[i] = std::all_of(mEnvelopeJointIndices.begin() + mEnvelopeOffsets[envelopeIndex], mEnvelopeJointIndices.begin() + mEnvelopeOffsets[envelopeIndex + 1],
+            [&staticJoints](uint16_t jointIndex) { return staticJoints[jointIndex]; });
+    }
+
+    return staticEnvelopes;
 }
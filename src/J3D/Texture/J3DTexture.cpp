@@ -3,7 +3,7 @@
 #include <bstream.h>
 #include <glad/glad.h>
 
-J3DTexture::J3DTexture() : TexHandle(UINT32_MAX) {
+J3DTexture::J3DTexture() : TexHandle(UINT32_MAX), SourceOffset(0) {
 
 }
 
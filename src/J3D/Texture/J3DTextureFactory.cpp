@@ -33,3 +33,13 @@ std::shared_ptr<J3DTexture> J3DTextureFactory::Create(bStream::CStream* stream,
   return btiLoader.Load(textureName, stream);
 }
 
+std::shared_ptr<J3DTexture> J3DTextureFactory::CreateDeferred(bStream::CStream* stream, uint32_t index, std::shared_ptr<std::vector<uint8_t>> blockData, uint32_t blockOffset) {
+  uint32_t dataOffset = mBlock->TexTableOffset + (index * TEXTURE_ENTRY_SIZE);
+  stream->seek(dataOffset);
+
+  std::string textureName = mNameTable.GetName(index);
+
+  J3DTextureLoader btiLoader{};
+  return btiLoader.LoadDeferred(textureName, stream, blockData, dataOffset - blockOffset);
+}
+
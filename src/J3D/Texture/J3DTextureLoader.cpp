@@ -77,6 +77,37 @@ std::shared_ptr<J3DTexture> J3DTextureLoader::Load(const std::string& textureNam
   texture->Deserialize(stream);
 
   texture->Name = textureName;
+  DecodeTexture(texture, stream, dataOffset);
+
+  return texture;
+}
+
+std::shared_ptr<J3DTexture> J3DTextureLoader::LoadDeferred(const std::string& textureName, bStream::CStream* stream,
+  std::shared_ptr<std::vector<uint8_t>> sourceData, uint32_t sourceOffset) {
+  std::shared_ptr<J3DTexture> texture = std::make_shared<J3DTexture>();
+  texture->Deserialize(stream);
+
+  texture->Name = textureName;
+  texture->SourceData = sourceData;
+  texture->SourceOffset = sourceOffset;
+
+  return texture;
+}
+
+void J3DTextureLoader::Materialize(std::shared_ptr<J3DTexture> texture) {
+  if (texture == nullptr || !texture->IsDecodePending()) {
+    return;
+  }
+
+  bStream::CMemoryStream stream(texture->SourceData->data(), texture->SourceData->size(), bStream::Big, bStream::In);
+
+  J3DTextureLoader btiLoader{};
+  btiLoader.DecodeTexture(texture, &stream, texture->SourceOffset);
+
+  texture->SourceData = nullptr;
+}
+
+void J3DTextureLoader::DecodeTexture(std::shared_ptr<J3DTexture> texture, bStream::CStream* stream, uint32_t dataOffset) {
   InitTexture(texture);
 
   // Load image data
@@ -141,8 +172,6 @@ std::shared_ptr<J3DTexture> J3DTextureLoader::Load(const std::string& textureNam
   }
 
   texture->ImageData.shrink_to_fit();
-
-  return texture;
 }
 
 void J3DTextureLoader::DecodeI4(bStream::CStream* stream, uint16_t width, uint16_t height, uint8_t* imageData) {
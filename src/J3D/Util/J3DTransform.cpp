@@ -4,6 +4,8 @@
 #include <glm/gtc/matrix_transform.hpp>
 #include <glm/gtx/transform.hpp>
 
+#include <cmath>
+
 float U16ToFloat(int16_t val) {
 	return val * (180 / 32768.0f);
 }
@@ -39,7 +41,7 @@ void J3DTransformInfo::Deserialize(bStream::CStream* stream) {
 	Translation.z = stream->readFloat();
 }
 
-glm::mat4 J3DTransformInfo::ToMat4() {
+glm::mat4 J3DTransformInfo::ToMat4() const {
 	return glm::translate(Translation) * glm::toMat4(Rotation) * glm::scale(Scale);
 }
 
@@ -86,3 +88,32 @@ bool J3DTextureSRTInfo::operator==(const J3DTextureSRTInfo& other) const {
 bool J3DTextureSRTInfo::operator!=(const J3DTextureSRTInfo& other) const {
 	return !operator==(other);
 }
+
+glm::mat4 J3DUtility::ComposeTransform(const glm::vec3& translation, const glm::vec3& eulerDegrees, const glm::vec3& scale) {
+	glm::vec3 radians = glm::radians(eulerDegrees);
+
+	float sx = std::sin(radians.x), cx = std::cos(radians.x);
+	float sy = std::sin(radians.y), cy = std::cos(radians.y);
+	float sz = std::sin(radians.z), cz = std::cos(radians.z);
+
+	// Columns of Rz * Ry * Rx, each multiplied by its scale component.
+	return glm::mat4(
+		glm::vec4(cy * cz, cy * sz, -sy, 0.0f) * scale.x,
+		glm::vec4(sx * sy * cz - cx * sz, sx * sy * sz + cx * cz, sx * cy, 0.0f) * scale.y,
+		glm::vec4(cx * sy * cz + sx * sz, cx * sy * sz - sx * cz, cx * cy, 0.0f) * scale.z,
+		glm::vec4(translation, 1.0f)
+	);
+}
+
+void J3DUtility::TransformBoundingBox(const glm::mat4& transform, const glm::vec3& min, const glm::vec3& max, glm::vec3& transformedMin, glm::vec3& transformedMax) {
+	glm::vec3 center = glm::vec3(transform * glm::vec4((min + max) * 0.5f, 1.0f));
+	glm::vec3 extent = (max - min) * 0.5f;
+
+	// Each axis of the transformed box's extent is the sum of the original extents projected onto it.
+	glm::vec3 transformedExtent = glm::abs(glm::vec3(transform[0])) * extent.x +
+		glm::abs(glm::vec3(transform[1])) * extent.y +
+		glm::abs(glm::vec3(transform[2])) * extent.z;
+
+	transformedMin = center - transformedExtent;
+	transformedMax = center + transformedExtent;
+}
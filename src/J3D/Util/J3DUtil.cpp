@@ -27,6 +27,39 @@ std::string J3DUtility::LoadTextFile(std::filesystem::path filePath) {
 	return shaderTxt;
 }
 
+bool J3DUtility::LoadBinaryFile(std::filesystem::path filePath, std::vector<uint8_t>& data) {
+	if (filePath.empty() || !std::filesystem::exists(filePath))
+		return false;
+
+	std::ifstream file(filePath, std::ios::binary | std::ios::ate);
+	if (!file.is_open()) {
+		std::cout << "Unable to load data from " << filePath << std::endl;
+		return false;
+	}
+
+	std::streamsize fileSize = file.tellg();
+	file.seekg(0, std::ios::beg);
+
+	data.resize(static_cast<size_t>(fileSize));
+	if (!file.read(reinterpret_cast<char*>(data.data()), fileSize)) {
+		data.clear();
+		return false;
+	}
+
+	return true;
+}
+
+uint64_t J3DUtility::HashBytes(const uint8_t* data, size_t size, uint64_t seed) {
+	uint64_t hash = seed;
+
+	for (size_t i = 0; i < size; i++) {
+		hash ^= data[i];
+		hash *= 0x100000001B3;
+	}
+
+	return hash;
+}
+
 void J3DUtility::PadStreamWithString(bStream::CStream* stream, uint32_t padValue, std::string str) {
 	uint32_t nextAligned = (uint32_t)((stream->tell() + ((size_t)padValue - 1)) & ~((size_t)padValue - 1));
 	uint32_t delta = (uint32_t)(nextAligned - stream->tell());
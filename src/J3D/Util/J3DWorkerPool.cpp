@@ -0,0 +1,81 @@
+#include "J3D/Util/J3DWorkerPool.hpp"
+
+J3DWorkerPool::J3DWorkerPool(uint32_t threadCount) : mTask(nullptr), mTaskCount(0), mNextTask(0), mBusyThreads(0), mGeneration(0), bStopping(false) {
+	mThreads.reserve(threadCount);
+
+	for (uint32_t i = 0; i < threadCount; i++) {
+		mThreads.emplace_back(&J3DWorkerPool::WorkerMain, this);
+	}
+}
+
+J3DWorkerPool::~J3DWorkerPool() {
+	{
+		std::lock_guard<std::mutex> lock(mMutex);
+		bStopping = true;
+	}
+
+	mWorkReady.notify_all();
+
+	for (std::thread& thread : mThreads) {
+		thread.join();
+	}
+}
+
+void J3DWorkerPool::WorkerMain() {
+	uint64_t generation = 0;
+
+	while (true) {
+		{
+			std::unique_lock<std::mutex> lock(mMutex);
+			mWorkReady.wait(lock, [this, generation]() { return bStopping || mGeneration != generation; });
+
+			if (bStopping) {
+				return;
+			}
+
+			generation = mGeneration;
+		}
+
+		RunTasks();
+
+		std::lock_guard<std::mutex> lock(mMutex);
+		if (--mBusyThreads == 0) {
+			mWorkDone.notify_one();
+		}
+	}
+}
+
+void J3DWorkerPool::RunTasks() {
+	for (uint32_t i = mNextTask++; i < mTaskCount; i = mNextTask++) {
+		(*mTask)(i);
+	}
+}
+
+void J3DWorkerPool::ParallelFor(uint32_t taskCount, const std::function<void(uint32_t)>& task) {
+	if (mThreads.empty() || taskCount < 2) {
+		for (uint32_t i = 0; i < taskCount; i++) {
+			task(i);
+		}
+
+		return;
+	}
+
+	{
+		std::lock_guard<std::mutex> lock(mMutex);
+		mTask = &task;
+		mTaskCount = taskCount;
+		mNextTask = 0;
+		mBusyThreads = (uint32_t)mThreads.size();
+		mGeneration++;
+	}
+
+	mWorkReady.notify_all();
+	RunTasks();
+
+	// Every thread has to check in before the loop's state can be replaced, even the ones that found no tasks left.
+	std::unique_lock<std::mutex> lock(mMutex);
+	mWorkDone.wait(lock, [this]() { return mBusyThreads == 0; });
+
+	mTask = nullptr;
+	mTaskCount = 0;
+}
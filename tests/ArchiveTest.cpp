@@ -0,0 +1,379 @@
+// Checks J3DYaz0::Decompress against a reference encoder, including back-references that overlap the bytes they write
+// and truncated input, and reads a small hand-built RARC archive with nested directories and a Yaz0-compressed file.
+
+#include "J3DTestCommon.hpp"
+
+#include "J3D/Archive/J3DArchive.hpp"
+#include "J3D/Archive/J3DYaz0.hpp"
+
+#include <algorithm>
+#include <string>
+#include <vector>
+
+namespace {
+    void WriteU16(std::vector<uint8_t>& data, uint16_t value) {
+        data.push_back((uint8_t)(value >> 8));
+        data.push_back((uint8_t)value);
+    }
+
+    void WriteU32(std::vector<uint8_t>& data, uint32_t value) {
+        WriteU16(data, (uint16_t)(value >> 16));
+        WriteU16(data, (uint16_t)value);
+    }
+
+    void Align(std::vector<uint8_t>& data, size_t alignment) {
+        while (data.size() % alignment != 0) {
+            data.push_back(0);
+        }
+    }
+
+    // Greedy Yaz0 encoder. Matches may run past the position they start copying from, which gives overlapping
+    // back-references for runs. Counts how many of those it emitted.
+    std::vector<uint8_t> CompressYaz0(const std::vector<uint8_t>& src, uint32_t& overlapCount) {
+        std::vector<uint8_t> dst;
+        WriteU32(dst, J3DYaz0::YAZ0_MAGIC);
+        WriteU32(dst, (uint32_t)src.size());
+        WriteU32(dst, 0);
+        WriteU32(dst, 0);
+
+        overlapCount = 0;
+        size_t pos = 0;
+
+        while (pos < src.size()) {
+            size_t groupHeader = dst.size();
+            dst.push_back(0);
+
+            for (uint32_t bit = 0; bit < 8 && pos < src.size(); bit++) {
+                size_t bestLength = 0;
+                size_t bestDistance = 0;
+
+                for (size_t distance = 1; distance <= std::min<size_t>(pos, 0x1000); distance++) {
+                    size_t length = 0;
+                    while (length < 0x111 && pos + length < src.size() && src[pos + length] == src[pos - distance + length]) {
+                        length++;
+                    }
+
+                    if (length > bestLength) {
+                        bestLength = length;
+                        bestDistance = distance;
+                    }
+                }
+
+                if (bestLength < 3) {
+                    dst[groupHeader] |= 0x80 >> bit;
+                    dst.push_back(src[pos++]);
+                    continue;
+                }
+
+                if (bestDistance < bestLength) {
+                    overlapCount++;
+                }
+
+                if (bestLength >= 0x12) {
+                    dst.push_back((uint8_t)((bestDistance - 1) >> 8));
+                    dst.push_back((uint8_t)(bestDistance - 1));
+                    dst.push_back((uint8_t)(bestLength - 0x12));
+                }
+                else {
+                    dst.push_back((uint8_t)(((bestLength - 2) << 4) | ((bestDistance - 1) >> 8)));
+                    dst.push_back((uint8_t)(bestDistance - 1));
+                }
+
+                pos += bestLength;
+            }
+        }
+
+        return dst;
+    }
+
+    std::vector<uint8_t> CompressYaz0(const std::vector<uint8_t>& src) {
+        uint32_t overlapCount = 0;
+        return CompressYaz0(src, overlapCount);
+    }
+
+    // Runs of one byte, short repeating patterns and noise, so that the encoder uses literals, short and long
+    // back-references, and back-references that overlap what they write.
+    std::vector<uint8_t> CreateTestData(J3DTest::Random& random, size_t size) {
+        std::vector<uint8_t> data;
+
+        while (data.size() < size) {
+            switch (random.Next() % 3) {
+                case 0:
+                    data.insert(data.end(), 1 + random.Next() % 400, (uint8_t)random.Next());
+                    break;
+                case 1:
+                {
+                    uint8_t pattern[4] = { (uint8_t)random.Next(), (uint8_t)random.Next(), (uint8_t)random.Next(), (uint8_t)random.Next() };
+                    uint32_t patternLength = 2 + random.Next() % 3;
+                    uint32_t count = random.Next() % 100;
+
+                    for (uint32_t i = 0; i < count; i++) {
+                        data.push_back(pattern[i % patternLength]);
+                    }
+                    break;
+                }
+                default:
+                {
+                    uint32_t count = random.Next() % 64;
+                    for (uint32_t i = 0; i < count; i++) {
+                        data.push_back((uint8_t)random.Next());
+                    }
+                    break;
+                }
+            }
+        }
+
+        data.resize(size);
+        return data;
+    }
+
+    void TestHandEncoded() {
+        // "ab", then 10 bytes copied from 2 back, which repeats "ab" while writing it.
+        std::vector<uint8_t> src;
+        WriteU32(src, J3DYaz0::YAZ0_MAGIC);
+        WriteU32(src, 12);
+        WriteU32(src, 0);
+        WriteU32(src, 0);
+        src.insert(src.end(), { 0xC0, 'a', 'b', 0x80, 0x01 });
+
+        std::vector<uint8_t> dst;
+        J3D_CHECK(J3DYaz0::Decompress(src.data(), src.size(), dst));
+        J3D_CHECK(std::string(dst.begin(), dst.end()) == "abababababab");
+
+        // A back-reference to before the start of the output is rejected.
+        src[src.size() - 1] = 0x02;
+        J3D_CHECK(!J3DYaz0::Decompress(src.data(), src.size(), dst));
+        J3D_CHECK(dst.empty());
+
+        // So is data without a Yaz0 header.
+        src[0] = 'X';
+        J3D_CHECK(!J3DYaz0::IsCompressed(src.data(), src.size()));
+        J3D_CHECK(!J3DYaz0::Decompress(src.data(), src.size(), dst));
+    }
+
+    void TestRoundTrip(J3DTest::Random& random) {
+        uint32_t totalOverlaps = 0;
+
+        for (uint32_t round = 0; round < 8; round++) {
+            std::vector<uint8_t> original = CreateTestData(random, 1000 + random.Next() % 8000);
+
+            uint32_t overlapCount = 0;
+            std::vector<uint8_t> compressed = CompressYaz0(original, overlapCount);
+            totalOverlaps += overlapCount;
+
+            J3D_CHECK(J3DYaz0::GetDecompressedSize(compressed.data(), compressed.size()) == original.size());
+
+            std::vector<uint8_t> decompressed;
+            J3D_CHECK(J3DYaz0::Decompress(compressed.data(), compressed.size(), decompressed));
+            J3D_CHECK(decompressed == original);
+
+            // Decompressing into a smaller buffer stops at its end.
+            std::vector<uint8_t> prefix(original.size() / 2);
+            J3D_CHECK(J3DYaz0::Decompress(compressed.data(), compressed.size(), prefix.data(), prefix.size()));
+            J3D_CHECK(std::equal(prefix.begin(), prefix.end(), original.begin()));
+        }
+
+        J3D_CHECK(totalOverlaps > 0);
+    }
+
+    void TestTruncated(J3DTest::Random& random) {
+        std::vector<uint8_t> original = CreateTestData(random, 3000);
+        std::vector<uint8_t> compressed = CompressYaz0(original);
+
+        // Every byte the encoder wrote is needed, so cutting any of them off must fail rather than read past the end.
+        for (size_t size = 0; size < compressed.size(); size++) {
+            std::vector<uint8_t> truncated(compressed.begin(), compressed.begin() + size);
+            std::vector<uint8_t> decompressed;
+
+            J3D_CHECK(!J3DYaz0::Decompress(truncated.data(), truncated.size(), decompressed));
+        }
+    }
+
+    struct J3DTestArchiveFile {
+        std::string Name;
+        std::vector<uint8_t> Data;
+        bool bCompressed;
+    };
+
+    struct J3DTestArchiveDirectory {
+        std::string Name;
+        int32_t Parent;
+        std::vector<J3DTestArchiveFile> Files;
+    };
+
+    // Builds a RARC archive. Each directory lists its files, then its subdirectories, then "." and "..".
+    std::vector<uint8_t> CreateArchive(const std::vector<J3DTestArchiveDirectory>& dirs) {
+        std::vector<uint8_t> strings;
+        auto addString = [&strings](const std::string& str) {
+            uint32_t offset = (uint32_t)strings.size();
+            strings.insert(strings.end(), str.begin(), str.end());
+            strings.push_back(0);
+            return offset;
+        };
+
+        uint32_t dotOffset = addString(".");
+        uint32_t dotDotOffset = addString("..");
+
+        std::vector<uint8_t> dirNodes;
+        std::vector<uint8_t> fileEntries;
+        std::vector<uint8_t> fileData;
+        uint32_t fileEntryCount = 0;
+
+        for (uint32_t d = 0; d < dirs.size(); d++) {
+            std::vector<uint32_t> children;
+            for (uint32_t c = 0; c < dirs.size(); c++) {
+                if (dirs[c].Parent == (int32_t)d) {
+                    children.push_back(c);
+                }
+            }
+
+            uint32_t nameOffset = addString(dirs[d].Name);
+            uint16_t entryCount = (uint16_t)(dirs[d].Files.size() + children.size() + 2);
+
+            WriteU32(dirNodes, d == 0 ? 0x524F4F54 : 0x44495220); // "ROOT" or "DIR "
+            WriteU32(dirNodes, nameOffset);
+            WriteU16(dirNodes, 0);
+            WriteU16(dirNodes, entryCount);
+            WriteU32(dirNodes, fileEntryCount);
+
+            for (const J3DTestArchiveFile& file : dirs[d].Files) {
+                std::vector<uint8_t> data = file.bCompressed ? CompressYaz0(file.Data) : file.Data;
+                uint8_t flags = file.bCompressed ? 0x85 : 0x01;
+
+                WriteU16(fileEntries, (uint16_t)fileEntryCount);
+                WriteU16(fileEntries, 0);
+                WriteU32(fileEntries, ((uint32_t)flags << 24) | addString(file.Name));
+                WriteU32(fileEntries, (uint32_t)fileData.size());
+                WriteU32(fileEntries, (uint32_t)data.size());
+                WriteU32(fileEntries, 0);
+
+                fileData.insert(fileData.end(), data.begin(), data.end());
+                Align(fileData, 0x20);
+                fileEntryCount++;
+            }
+
+            for (uint32_t child : children) {
+                WriteU16(fileEntries, 0xFFFF);
+                WriteU16(fileEntries, 0);
+                WriteU32(fileEntries, (0x02u << 24) | addString(dirs[child].Name));
+                WriteU32(fileEntries, child);
+                WriteU32(fileEntries, 0x10);
+                WriteU32(fileEntries, 0);
+                fileEntryCount++;
+            }
+
+            uint32_t specialTargets[2] = { d, dirs[d].Parent < 0 ? UINT32_MAX : (uint32_t)dirs[d].Parent };
+            uint32_t specialNames[2] = { dotOffset, dotDotOffset };
+            for (uint32_t i = 0; i < 2; i++) {
+                WriteU16(fileEntries, 0xFFFF);
+                WriteU16(fileEntries, 0);
+                WriteU32(fileEntries, (0x02u << 24) | specialNames[i]);
+                WriteU32(fileEntries, specialTargets[i]);
+                WriteU32(fileEntries, 0x10);
+                WriteU32(fileEntries, 0);
+                fileEntryCount++;
+            }
+        }
+
+        // Offsets in the header and info block are relative to the end of the header.
+        Align(dirNodes, 0x20);
+        Align(fileEntries, 0x20);
+        Align(strings, 0x20);
+
+        uint32_t dirOffset = 0x20;
+        uint32_t fileEntryOffset = dirOffset + (uint32_t)dirNodes.size();
+        uint32_t stringTableOffset = fileEntryOffset + (uint32_t)fileEntries.size();
+        uint32_t dataOffset = stringTableOffset + (uint32_t)strings.size();
+
+        std::vector<uint8_t> archive;
+        WriteU32(archive, 0x52415243); // RARC
+        WriteU32(archive, 0x20 + dataOffset + (uint32_t)fileData.size());
+        WriteU32(archive, 0x20);
+        WriteU32(archive, dataOffset);
+        WriteU32(archive, (uint32_t)fileData.size());
+        WriteU32(archive, (uint32_t)fileData.size());
+        WriteU32(archive, 0);
+        WriteU32(archive, 0);
+
+        WriteU32(archive, (uint32_t)dirs.size());
+        WriteU32(archive, dirOffset);
+        WriteU32(archive, fileEntryCount);
+        WriteU32(archive, fileEntryOffset);
+        WriteU32(archive, (uint32_t)strings.size());
+        WriteU32(archive, stringTableOffset);
+        WriteU32(archive, 0);
+        WriteU32(archive, 0);
+
+        archive.insert(archive.end(), dirNodes.begin(), dirNodes.end());
+        archive.insert(archive.end(), fileEntries.begin(), fileEntries.end());
+        archive.insert(archive.end(), strings.begin(), strings.end());
+        archive.insert(archive.end(), fileData.begin(), fileData.end());
+
+        return archive;
+    }
+
+    bool CheckFile(J3DArchive& archive, const std::string& path, const std::vector<uint8_t>& expected) {
+        const uint8_t* data = nullptr;
+        size_t size = 0;
+
+        return archive.GetFileData(path, data, size) && size == expected.size() && std::equal(data, data + size, expected.begin());
+    }
+
+    void TestArchive(J3DTest::Random& random) {
+        std::vector<uint8_t> readme(100, 'r');
+        std::vector<uint8_t> model = CreateTestData(random, 5000);
+        std::vector<uint8_t> anim = CreateTestData(random, 300);
+
+        std::vector<J3DTestArchiveDirectory> dirs = {
+            { "scene", -1, { { "readme.txt", readme, false } } },
+            { "Models", 0, { } },
+            { "player", 1, { { "Body.bmd", model, true }, { "walk.bck", anim, false } } },
+        };
+
+        std::vector<uint8_t> archiveData = CreateArchive(dirs);
+
+        for (uint32_t pass = 0; pass < 2; pass++) {
+            // The second pass opens the archive compressed as a whole, as a .szs file.
+            J3DArchive archive;
+            J3D_CHECK(archive.Open(pass == 0 ? std::vector<uint8_t>(archiveData) : CompressYaz0(archiveData)));
+
+            J3D_CHECK(archive.GetRootName() == "scene");
+            J3D_CHECK(archive.GetFileCount() == 3);
+
+            std::vector<std::string> paths = archive.GetFilePaths();
+            std::sort(paths.begin(), paths.end());
+            J3D_CHECK((paths == std::vector<std::string>{ "models/player/body.bmd", "models/player/walk.bck", "readme.txt" }));
+
+            J3D_CHECK(archive.Contains("Models/Player/Body.bmd"));
+            J3D_CHECK(archive.Contains("scene/models/player/walk.bck"));
+            J3D_CHECK(archive.Contains("/readme.txt"));
+            J3D_CHECK(!archive.Contains("models/body.bmd"));
+            J3D_CHECK(!archive.Contains("models/player"));
+
+            if (pass == 1) {
+                archive.PrefetchAll();
+            }
+
+            J3D_CHECK(CheckFile(archive, "readme.txt", readme));
+            J3D_CHECK(CheckFile(archive, "models/player/body.bmd", model));
+            J3D_CHECK(CheckFile(archive, "models/player/walk.bck", anim));
+        }
+
+        // Archives cut off before the end of their index or their file data are rejected.
+        for (size_t size : { (size_t)0x10, (size_t)0x60, archiveData.size() - 0x40 }) {
+            J3DArchive archive;
+            J3D_CHECK(!archive.Open(std::vector<uint8_t>(archiveData.begin(), archiveData.begin() + size)));
+        }
+    }
+}
+
+int main() {
+    J3DTest::Random random(0x59415A30);
+
+    TestHandEncoded();
+    TestRoundTrip(random);
+    TestTruncated(random);
+    TestArchive(random);
+
+    return J3D_TEST_RESULT();
+}
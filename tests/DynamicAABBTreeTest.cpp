@@ -0,0 +1,227 @@
+// Checks J3DDynamicAABBTree's box, frustum and ray queries against a brute-force scan of every live proxy's enlarged
+// box, while proxies are created, moved and destroyed at random.
+
+#include "J3DTestCommon.hpp"
+
+#include "J3D/Scene/J3DDynamicAABBTree.hpp"
+#include "J3D/Rendering/J3DFrustum.hpp"
+
+#include <glm/gtc/matrix_transform.hpp>
+
+#include <algorithm>
+#include <cmath>
+#include <utility>
+#include <vector>
+
+namespace {
+    const float WORLD_SIZE = 1000.0f;
+
+    struct J3DTestProxy {
+        int32_t Proxy = J3DDynamicAABBTree::NULL_NODE;
+        glm::vec3 Min;
+        glm::vec3 Max;
+    };
+
+    void RandomBox(J3DTest::Random& random, glm::vec3& min, glm::vec3& max) {
+        glm::vec3 center(random.Range(-WORLD_SIZE, WORLD_SIZE), random.Range(-WORLD_SIZE, WORLD_SIZE), random.Range(-WORLD_SIZE, WORLD_SIZE));
+        glm::vec3 extent(random.Range(0.5f, 20.0f), random.Range(0.5f, 20.0f), random.Range(0.5f, 20.0f));
+
+        min = center - extent;
+        max = center + extent;
+    }
+
+    bool BoxesOverlap(const glm::vec3& minA, const glm::vec3& maxA, const glm::vec3& minB, const glm::vec3& maxB) {
+        return minA.x <= maxB.x && minA.y <= maxB.y && minA.z <= maxB.z &&
+            minB.x <= maxA.x && minB.y <= maxA.y && minB.z <= maxA.z;
+    }
+
+    // Multiplies by the inverse direction, as the tree does, so that rays grazing a box round the same way in both.
+    bool RayEntersBox(const glm::vec3& origin, const glm::vec3& direction, float maxDistance, const glm::vec3& min, const glm::vec3& max, float& entry) {
+        glm::vec3 inverseDirection = 1.0f / direction;
+        float enter = 0.0f;
+        float exit = maxDistance;
+
+        for (int axis = 0; axis < 3; axis++) {
+            float t1 = (min[axis] - origin[axis]) * inverseDirection[axis];
+            float t2 = (max[axis] - origin[axis]) * inverseDirection[axis];
+
+            enter = std::max(enter, std::min(t1, t2));
+            exit = std::min(exit, std::max(t1, t2));
+        }
+
+        entry = enter;
+        return enter <= exit;
+    }
+
+    class J3DTreeChecker {
+        J3DDynamicAABBTree mTree;
+        std::vector<J3DTestProxy> mProxies;
+
+        void GetFatBox(uint32_t index, glm::vec3& min, glm::vec3& max) const {
+            mTree.GetFatBox(mProxies[index].Proxy, min, max);
+        }
+
+    public:
+        J3DTreeChecker() : mTree(0.1f) { }
+
+        void Create(J3DTest::Random& random) {
+            J3DTestProxy proxy;
+            RandomBox(random, proxy.Min, proxy.Max);
+            proxy.Proxy = mTree.CreateProxy(proxy.Min, proxy.Max, (uint32_t)mProxies.size());
+
+            mProxies.push_back(proxy);
+        }
+
+        void Move(J3DTest::Random& random) {
+            J3DTestProxy& proxy = mProxies[random.Next() % mProxies.size()];
+            if (proxy.Proxy == J3DDynamicAABBTree::NULL_NODE) {
+                return;
+            }
+
+            // Mostly small moves that stay inside the enlarged box, and some that leave it.
+            if (random.Next() % 4 == 0) {
+                RandomBox(random, proxy.Min, proxy.Max);
+            }
+            else {
+                glm::vec3 offset(random.Range(-1.0f, 1.0f), random.Range(-1.0f, 1.0f), random.Range(-1.0f, 1.0f));
+                proxy.Min += offset;
+                proxy.Max += offset;
+            }
+
+            mTree.MoveProxy(proxy.Proxy, proxy.Min, proxy.Max);
+        }
+
+        void Destroy(J3DTest::Random& random) {
+            J3DTestProxy& proxy = mProxies[random.Next() % mProxies.size()];
+            if (proxy.Proxy == J3DDynamicAABBTree::NULL_NODE) {
+                return;
+            }
+
+            mTree.DestroyProxy(proxy.Proxy);
+            proxy.Proxy = J3DDynamicAABBTree::NULL_NODE;
+        }
+
+        void CheckFatBoxes() const {
+            for (const J3DTestProxy& proxy : mProxies) {
+                if (proxy.Proxy == J3DDynamicAABBTree::NULL_NODE) {
+                    continue;
+                }
+
+                glm::vec3 fatMin, fatMax;
+                mTree.GetFatBox(proxy.Proxy, fatMin, fatMax);
+
+                J3D_CHECK(glm::all(glm::lessThanEqual(fatMin, proxy.Min)) && glm::all(glm::lessThanEqual(proxy.Max, fatMax)));
+            }
+        }
+
+        void CheckBoxQuery(J3DTest::Random& random) const {
+            glm::vec3 min, max;
+            RandomBox(random, min, max);
+            min -= glm::vec3(100.0f);
+            max += glm::vec3(100.0f);
+
+            std::vector<uint32_t> results;
+            mTree.QueryBox(min, max, results);
+
+            std::vector<uint32_t> expected;
+            for (uint32_t i = 0; i < mProxies.size(); i++) {
+                glm::vec3 fatMin, fatMax;
+                if (mProxies[i].Proxy != J3DDynamicAABBTree::NULL_NODE && (GetFatBox(i, fatMin, fatMax), BoxesOverlap(min, max, fatMin, fatMax))) {
+                    expected.push_back(i);
+                }
+            }
+
+            std::sort(results.begin(), results.end());
+            J3D_CHECK(results == expected);
+        }
+
+        void CheckFrustumQuery(J3DTest::Random& random) const {
+            glm::vec3 eye(random.Range(-WORLD_SIZE, WORLD_SIZE), random.Range(-WORLD_SIZE, WORLD_SIZE), random.Range(-WORLD_SIZE, WORLD_SIZE));
+            glm::vec3 target(random.Range(-WORLD_SIZE, WORLD_SIZE), random.Range(-WORLD_SIZE, WORLD_SIZE), random.Range(-WORLD_SIZE, WORLD_SIZE));
+
+            glm::mat4 view = glm::lookAt(eye, target, glm::vec3(0.0f, 1.0f, 0.0f));
+            glm::mat4 proj = glm::perspective(glm::radians(60.0f), 16.0f / 9.0f, 1.0f, WORLD_SIZE);
+            J3DFrustum frustum(proj * view);
+
+            std::vector<uint32_t> results;
+            mTree.QueryFrustum(frustum, results);
+
+            std::vector<uint32_t> expected;
+            for (uint32_t i = 0; i < mProxies.size(); i++) {
+                glm::vec3 fatMin, fatMax;
+                if (mProxies[i].Proxy != J3DDynamicAABBTree::NULL_NODE && (GetFatBox(i, fatMin, fatMax), frustum.IntersectsBox(fatMin, fatMax))) {
+                    expected.push_back(i);
+                }
+            }
+
+            std::sort(results.begin(), results.end());
+            J3D_CHECK(results == expected);
+        }
+
+        void CheckRayQuery(J3DTest::Random& random) const {
+            glm::vec3 origin(random.Range(-WORLD_SIZE, WORLD_SIZE), random.Range(-WORLD_SIZE, WORLD_SIZE), random.Range(-WORLD_SIZE, WORLD_SIZE));
+            glm::vec3 direction(random.Range(-1.0f, 1.0f), random.Range(-1.0f, 1.0f), random.Range(-1.0f, 1.0f));
+            float maxDistance = random.Range(10.0f, 4.0f * WORLD_SIZE);
+
+            std::vector<std::pair<uint32_t, float>> results;
+            mTree.QueryRay(origin, direction, results, maxDistance);
+
+            std::vector<std::pair<uint32_t, float>> expected;
+            for (uint32_t i = 0; i < mProxies.size(); i++) {
+                glm::vec3 fatMin, fatMax;
+                float entry = 0.0f;
+
+                if (mProxies[i].Proxy != J3DDynamicAABBTree::NULL_NODE && (GetFatBox(i, fatMin, fatMax), RayEntersBox(origin, direction, maxDistance, fatMin, fatMax, entry))) {
+                    expected.push_back({ i, entry });
+                }
+            }
+
+            std::sort(results.begin(), results.end());
+
+            J3D_CHECK(results.size() == expected.size());
+            for (size_t i = 0; i < results.size() && i < expected.size(); i++) {
+                J3D_CHECK(results[i].first == expected[i].first);
+                J3D_CHECK(std::fabs(results[i].second - expected[i].second) <= 1e-3f * std::max(1.0f, expected[i].second));
+            }
+        }
+
+        void CheckHeight() const {
+            uint32_t liveCount = (uint32_t)std::count_if(mProxies.begin(), mProxies.end(),
+                [](const J3DTestProxy& proxy) { return proxy.Proxy != J3DDynamicAABBTree::NULL_NODE; });
+
+            // Balancing keeps the height logarithmic. A height-balanced tree of n leaves is at most about 1.44 log2(n) + 1.1 high.
+            float bound = 2.0f * std::log2((float)liveCount + 2.0f) + 2.0f;
+            J3D_CHECK(mTree.GetHeight() <= (int32_t)bound);
+        }
+    };
+}
+
+int main() {
+    J3DTest::Random random(0x42564831);
+    J3DTreeChecker checker;
+
+    for (uint32_t round = 0; round < 50; round++) {
+        for (uint32_t i = 0; i < 100; i++) {
+            checker.Create(random);
+        }
+
+        for (uint32_t i = 0; i < 400; i++) {
+            checker.Move(random);
+        }
+
+        for (uint32_t i = 0; i < 30; i++) {
+            checker.Destroy(random);
+        }
+
+        checker.CheckFatBoxes();
+        checker.CheckHeight();
+
+        for (uint32_t i = 0; i < 10; i++) {
+            checker.CheckBoxQuery(random);
+            checker.CheckFrustumQuery(random);
+            checker.CheckRayQuery(random);
+        }
+    }
+
+    return J3D_TEST_RESULT();
+}
@@ -0,0 +1,69 @@
+// Checks that the envelope matrix storage stays the same size when models are drawn directly, frame after frame, without
+// J3D::Rendering::Render clearing it. Each frame allocates what an instance's draw does: its posed envelopes, and the
+// identity matrix that compute-skinned vertices use, reserved together. No GL context is created, so nothing is uploaded.
+
+#include "J3DTestCommon.hpp"
+
+#include "J3D/Material/J3DUniformBufferObject.hpp"
+
+#include <glm/gtc/matrix_transform.hpp>
+
+#include <vector>
+
+namespace {
+    const uint32_t FRAME_COUNT = 1000;
+
+    // Allocates one instance's envelopes as J3DModelInstance::SubmitEnvelopeMatrices does, and checks where they land.
+    void DrawInstance(const std::vector<glm::mat4>& pose, const glm::mat4& modelView) {
+        uint32_t count = (uint32_t)pose.size();
+        const glm::mat4 identity = glm::identity<glm::mat4>();
+
+        J3DUniformBufferObject::ReserveEnvelopeMatrices(count + 1);
+        uint32_t generation = J3DUniformBufferObject::GetEnvelopeGeneration();
+
+        uint32_t base = J3DUniformBufferObject::AllocateEnvelopeMatrices(pose.data(), count, modelView);
+        uint32_t identityBase = J3DUniformBufferObject::AllocateEnvelopeMatrices(&identity, 1, modelView);
+
+        J3D_CHECK(identityBase == base + count);
+        J3D_CHECK(identityBase < J3DUniformBufferObject::GetEnvelopeCapacity());
+        J3D_CHECK(J3DUniformBufferObject::GetEnvelopeGeneration() == generation);
+    }
+}
+
+int main() {
+    J3DTest::Random random(0x45564C50);
+
+    std::vector<glm::mat4> pose(37);
+    for (glm::mat4& matrix : pose) {
+        matrix = glm::translate(glm::mat4(1.0f), glm::vec3(random.Range(-10.0f, 10.0f), random.Range(-10.0f, 10.0f), random.Range(-10.0f, 10.0f)));
+    }
+
+    uint32_t capacity = J3DUniformBufferObject::GetEnvelopeCapacity();
+    uint32_t startGeneration = J3DUniformBufferObject::GetEnvelopeGeneration();
+
+    // The same instance, drawn directly every frame with a moving camera, so its matrices are allocated again each time.
+    for (uint32_t frame = 0; frame < FRAME_COUNT; frame++) {
+        glm::mat4 modelView = glm::translate(glm::mat4(1.0f), glm::vec3(0.0f, 0.0f, -(float)frame));
+
+        DrawInstance(pose, modelView);
+        J3D_CHECK(J3DUniformBufferObject::GetEnvelopeCapacity() == capacity);
+    }
+
+    // 38 matrices a frame for 1000 frames is more than the storage holds, so it must have started over.
+    J3D_CHECK(J3DUniformBufferObject::GetEnvelopeGeneration() != startGeneration);
+
+    // A model with more envelopes than the whole storage holds grows it, once.
+    std::vector<glm::mat4> largePose(capacity + 1, glm::mat4(1.0f));
+    DrawInstance(largePose, glm::mat4(1.0f));
+
+    uint32_t grownCapacity = J3DUniformBufferObject::GetEnvelopeCapacity();
+    J3D_CHECK(grownCapacity > capacity + 1);
+
+    for (uint32_t frame = 0; frame < 10; frame++) {
+        DrawInstance(largePose, glm::mat4(1.0f));
+        DrawInstance(pose, glm::mat4(1.0f));
+        J3D_CHECK(J3DUniformBufferObject::GetEnvelopeCapacity() == grownCapacity);
+    }
+
+    return J3D_TEST_RESULT();
+}
@@ -0,0 +1,160 @@
+// Checks that steady-state animation playback and pose sharing don't allocate. Global operator new is replaced with
+// one that counts calls; once every buffer has grown to its working size, playing further frames must not allocate.
+
+#include "J3DTestCommon.hpp"
+
+#include "J3D/Animation/J3DJointAnimationInstance.hpp"
+#include "J3D/Animation/J3DHermiteAnimationTrack.hpp"
+#include "J3D/Animation/J3DPoseCache.hpp"
+#include "J3D/Data/J3DModelData.hpp"
+
+#include <atomic>
+#include <cstdlib>
+#include <memory>
+#include <new>
+#include <vector>
+
+namespace {
+    std::atomic<uint64_t> sAllocationCount { 0 };
+}
+
+void* operator new(std::size_t size) {
+    sAllocationCount++;
+
+    if (void* memory = std::malloc(size != 0 ? size : 1)) {
+        return memory;
+    }
+
+    throw std::bad_alloc();
+}
+
+void operator delete(void* memory) noexcept {
+    std::free(memory);
+}
+
+void operator delete(void* memory, std::size_t) noexcept {
+    std::free(memory);
+}
+
+namespace {
+    using namespace J3DAnimation;
+
+    template<typename Func>
+    uint64_t CountAllocations(const Func& func) {
+        uint64_t before = sAllocationCount;
+        func();
+
+        return sAllocationCount - before;
+    }
+
+    std::shared_ptr<J3DJointAnimationClip> CreateClip(uint32_t jointCount, uint16_t length, J3DTest::Random& random) {
+        std::shared_ptr<J3DJointAnimationClip> clip = std::make_shared<J3DJointAnimationClip>();
+        clip->LoopMode = ELoopMode::Loop;
+        clip->Length = length;
+        clip->JointCount = jointCount;
+
+        for (uint32_t channel = 0; channel < jointCount * 9; channel++) {
+            J3DHermiteAnimationTrack track;
+
+            // Leave some channels constant, as real clips do.
+            uint32_t keyCount = channel % 4 == 3 ? 1 : 2 + random.Next() % 8;
+            for (uint32_t k = 0; k < keyCount; k++) {
+                J3DAnimationKey key;
+                key.Time = keyCount > 1 ? (float)length * k / (keyCount - 1) : 0.0f;
+                key.Value = random.Range(-10.0f, 10.0f);
+                key.InTangent = random.Range(-1.0f, 1.0f);
+                key.OutTangent = random.Range(-1.0f, 1.0f);
+
+                track.AddKey(key);
+            }
+
+            clip->PackedTracks.AddTrack(track);
+        }
+
+        clip->AnalyzeChannels();
+        return clip;
+    }
+
+    void PlayFrames(J3DJointAnimationInstance& instance, std::vector<glm::mat4>& transforms, const std::vector<bool>* skip, uint32_t frameCount) {
+        for (uint32_t i = 0; i < frameCount; i++) {
+            instance.Tick(0.5f);
+            instance.GetTransformsAtFrame(0.5f, transforms, skip);
+        }
+    }
+
+    void TestKeyframePlayback(const std::shared_ptr<J3DJointAnimationClip>& clip) {
+        J3DJointAnimationInstance instance(clip);
+        std::vector<glm::mat4> transforms;
+
+        std::vector<bool> skip(clip->JointCount, false);
+        for (size_t i = 0; i < skip.size(); i += 5) {
+            skip[i] = true;
+        }
+
+        // Play a full loop to grow the buffers, then several more that must reuse them.
+        PlayFrames(instance, transforms, nullptr, clip->Length * 2);
+        J3D_CHECK(CountAllocations([&]() { PlayFrames(instance, transforms, nullptr, clip->Length * 8); }) == 0);
+        J3D_CHECK(CountAllocations([&]() { PlayFrames(instance, transforms, &skip, clip->Length * 8); }) == 0);
+        J3D_CHECK(transforms.size() == clip->JointCount);
+    }
+
+    void TestBakedPlayback(const std::shared_ptr<J3DJointAnimationClip>& clip) {
+        J3DJointAnimationInstance instance(clip);
+        instance.Bake();
+        J3D_CHECK(instance.IsBaked());
+
+        std::vector<glm::mat4> transforms;
+
+        PlayFrames(instance, transforms, nullptr, clip->Length * 2);
+        J3D_CHECK(CountAllocations([&]() { PlayFrames(instance, transforms, nullptr, clip->Length * 8); }) == 0);
+        J3D_CHECK(transforms.size() == clip->JointCount);
+    }
+
+    void TestPoseSharing(const std::shared_ptr<J3DJointAnimationClip>& clip) {
+        const uint32_t modelCount = 16;
+        const uint32_t instancesPerModel = 8;
+
+        std::vector<std::shared_ptr<J3DModelData>> models;
+        std::vector<J3DPoseCache::Pose> poses;
+        for (uint32_t i = 0; i < modelCount; i++) {
+            models.push_back(std::make_shared<J3DModelData>());
+            poses.push_back(std::make_shared<const std::vector<glm::mat4>>(clip->JointCount, glm::mat4(1.0f)));
+        }
+
+        J3DPoseCache::Clear();
+
+        // Every instance looks its pose up, and the first instance of each model stores it, as in a rendered frame.
+        auto renderFrame = [&](float frame) {
+            for (uint32_t i = 0; i < modelCount; i++) {
+                for (uint32_t j = 0; j < instancesPerModel; j++) {
+                    if (J3DPoseCache::Find(clip, models[i].get(), frame) == nullptr) {
+                        J3DPoseCache::Store(clip, models[i].get(), frame, poses[i]);
+                    }
+                }
+            }
+
+            J3DPoseCache::Clear();
+        };
+
+        auto renderLoop = [&]() {
+            for (uint32_t frame = 0; frame < 240; frame++) {
+                renderFrame(frame * 0.5f);
+            }
+        };
+
+        // The cache is sharded, so play a full loop to grow every shard the loop's poses land in, then another that must reuse them.
+        renderLoop();
+        J3D_CHECK(CountAllocations(renderLoop) == 0);
+    }
+}
+
+int main() {
+    J3DTest::Random random(0x4A334455);
+    std::shared_ptr<J3DJointAnimationClip> clip = CreateClip(64, 120, random);
+
+    TestKeyframePlayback(clip);
+    TestBakedPlayback(clip);
+    TestPoseSharing(clip);
+
+    return J3D_TEST_RESULT();
+}
@@ -0,0 +1,93 @@
+// Times joint keyframe evaluation: per-track cursor evaluation against the batched packed evaluation that playback
+// uses, and checks that both give the same values. Prints the time per frame for each; only the check can fail.
+
+#include "J3DTestCommon.hpp"
+
+#include "J3D/Animation/J3DHermiteAnimationTrack.hpp"
+
+#include <chrono>
+#include <cmath>
+#include <vector>
+
+namespace {
+    using namespace J3DAnimation;
+
+    const uint32_t CHANNEL_COUNT = 64 * 9 * 16;
+    const float LENGTH = 240.0f;
+    const uint32_t FRAME_COUNT = 960;
+
+    template<typename Func>
+    double MeasureMicroseconds(const Func& func) {
+        auto start = std::chrono::steady_clock::now();
+        func();
+        auto end = std::chrono::steady_clock::now();
+
+        return std::chrono::duration<double, std::micro>(end - start).count();
+    }
+}
+
+int main() {
+    J3DTest::Random random(0x48524D54);
+
+    std::vector<J3DHermiteAnimationTrack> tracks(CHANNEL_COUNT);
+    J3DPackedHermiteTracks packed;
+
+    for (J3DHermiteAnimationTrack& track : tracks) {
+        uint32_t keyCount = 2 + random.Next() % 16;
+        for (uint32_t k = 0; k < keyCount; k++) {
+            J3DAnimationKey key;
+            key.Time = LENGTH * k / (keyCount - 1);
+            key.Value = random.Range(-100.0f, 100.0f);
+            key.InTangent = random.Range(-4.0f, 4.0f);
+            key.OutTangent = random.Range(-4.0f, 4.0f);
+
+            track.AddKey(key);
+        }
+
+        packed.AddTrack(track);
+    }
+
+    std::vector<uint32_t> trackCursors(CHANNEL_COUNT, 0);
+    std::vector<uint32_t> packedCursors(CHANNEL_COUNT, 0);
+    std::vector<float> p0(CHANNEL_COUNT), p1(CHANNEL_COUNT), m0(CHANNEL_COUNT), m1(CHANNEL_COUNT), t(CHANNEL_COUNT);
+    std::vector<float> trackValues(CHANNEL_COUNT), packedValues(CHANNEL_COUNT);
+
+    float maxError = 0.0f;
+
+    double trackTime = 0.0;
+    double packedTime = 0.0;
+
+    for (uint32_t frame = 0; frame < FRAME_COUNT; frame++) {
+        float frameTime = std::fmod(frame * 0.5f, LENGTH);
+
+        trackTime += MeasureMicroseconds([&]() {
+            for (uint32_t c = 0; c < CHANNEL_COUNT; c++) {
+                trackValues[c] = tracks[c].GetValue(frameTime, trackCursors[c]);
+            }
+        });
+
+        packedTime += MeasureMicroseconds([&]() {
+            for (uint32_t c = 0; c < CHANNEL_COUNT; c++) {
+                packed.GetSegment(c, frameTime, packedCursors[c], p0[c], p1[c], m0[c], m1[c], t[c]);
+            }
+
+            EvaluateHermiteSegments(p0.data(), p1.data(), m0.data(), m1.data(), t.data(), packedValues.data(), CHANNEL_COUNT);
+        });
+
+        for (uint32_t c = 0; c < CHANNEL_COUNT; c++) {
+            // The two evaluate the same polynomial in a different order, so allow for rounding relative to the size of its terms.
+            float scale = 1.0f + std::fabs(p0[c]) + std::fabs(p1[c]) + std::fabs(m0[c]) + std::fabs(m1[c]);
+            float error = std::fabs(trackValues[c] - packedValues[c]) / scale;
+            maxError = std::fmax(maxError, error);
+        }
+    }
+
+    std::printf("%u channels, %u frames\n", CHANNEL_COUNT, FRAME_COUNT);
+    std::printf("  per-track evaluation: %8.1f us/frame\n", trackTime / FRAME_COUNT);
+    std::printf("  packed evaluation:    %8.1f us/frame\n", packedTime / FRAME_COUNT);
+    std::printf("  largest relative difference: %g\n", maxError);
+
+    J3D_CHECK(maxError < 1e-5f);
+
+    return J3D_TEST_RESULT();
+}
@@ -0,0 +1,43 @@
+#pragma once
+
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+
+// Minimal checks for the standalone test executables. A failed check is reported and counted, and the test returns
+// J3D_TEST_RESULT() from main so that CTest sees the failure.
+namespace J3DTest {
+    inline int& FailureCount() {
+        static int failures = 0;
+        return failures;
+    }
+
+    // Deterministic pseudo-random numbers, so that failures reproduce.
+    struct Random {
+        uint32_t State;
+
+        explicit Random(uint32_t seed) : State(seed) { }
+
+        uint32_t Next() {
+            State ^= State << 13;
+            State ^= State >> 17;
+            State ^= State << 5;
+            return State;
+        }
+
+        // Returns a float in [min, max).
+        float Range(float min, float max) {
+            return min + (max - min) * ((Next() & 0xFFFFFF) / 16777216.0f);
+        }
+    };
+}
+
+#define J3D_CHECK(condition)                                                                  \
+    do {                                                                                      \
+        if (!(condition)) {                                                                   \
+            std::fprintf(stderr, "%s:%d: check failed: %s\n", __FILE__, __LINE__, #condition); \
+            J3DTest::FailureCount()++;                                                        \
+        }                                                                                     \
+    } while (0)
+
+#define J3D_TEST_RESULT() (J3DTest::FailureCount() == 0 ? EXIT_SUCCESS : EXIT_FAILURE)
@@ -0,0 +1,223 @@
+// Round-trips a model through its cache file. The model is a minimal BMD with an INF1 block and a TEX1 block of textures
+// that are loaded lazily, so that loading it needs no GL context. Checks that a fresh cache file is used as is, and that
+// a truncated or stale one is ignored and rewritten.
+
+#include "J3DTestCommon.hpp"
+
+#include "J3D/J3DModelLoader.hpp"
+#include "J3D/Data/J3DModelData.hpp"
+#include "J3D/Texture/J3DTexture.hpp"
+
+#include <chrono>
+#include <filesystem>
+#include <fstream>
+#include <memory>
+#include <string>
+#include <vector>
+
+namespace {
+    struct J3DTestTexture {
+        std::string Name;
+        uint16_t Width;
+        uint16_t Height;
+    };
+
+    void WriteU8(std::vector<uint8_t>& data, uint8_t value) {
+        data.push_back(value);
+    }
+
+    void WriteU16(std::vector<uint8_t>& data, uint16_t value) {
+        data.push_back((uint8_t)(value >> 8));
+        data.push_back((uint8_t)value);
+    }
+
+    void WriteU32(std::vector<uint8_t>& data, uint32_t value) {
+        WriteU16(data, (uint16_t)(value >> 16));
+        WriteU16(data, (uint16_t)value);
+    }
+
+    void PatchU32(std::vector<uint8_t>& data, size_t offset, uint32_t value) {
+        std::vector<uint8_t> bytes;
+        WriteU32(bytes, value);
+        std::copy(bytes.begin(), bytes.end(), data.begin() + offset);
+    }
+
+    void Align(std::vector<uint8_t>& data, size_t alignment) {
+        while (data.size() % alignment != 0) {
+            data.push_back(0);
+        }
+    }
+
+    // Builds a BMD3 file holding an empty scene graph and the given textures. The texture headers point at no image
+    // data, which only matters once a texture is decoded.
+    std::vector<uint8_t> CreateModelFile(const std::vector<J3DTestTexture>& textures) {
+        std::vector<uint8_t> data;
+
+        WriteU32(data, 0x4A334432); // J3D2
+        WriteU32(data, 0x626D6433); // bmd3
+        WriteU32(data, 0);
+        WriteU32(data, 2);
+        data.resize(0x20, 0xFF);
+
+        // INF1, with a hierarchy that only holds the exit node
+        size_t infoStart = data.size();
+        WriteU32(data, 0x494E4631);
+        WriteU32(data, 0);
+        WriteU16(data, 0);
+        WriteU16(data, 0xFFFF);
+        WriteU32(data, 0);
+        WriteU32(data, 0);
+        WriteU32(data, 0x18);
+        WriteU16(data, 0);
+        WriteU16(data, 0);
+        Align(data, 0x20);
+        PatchU32(data, infoStart + 4, (uint32_t)(data.size() - infoStart));
+
+        // TEX1
+        size_t textureStart = data.size();
+        WriteU32(data, 0x54455831);
+        WriteU32(data, 0);
+        WriteU16(data, (uint16_t)textures.size());
+        WriteU16(data, 0xFFFF);
+        WriteU32(data, 0x20);
+        WriteU32(data, 0);
+        Align(data, 0x20);
+
+        for (const J3DTestTexture& texture : textures) {
+            WriteU8(data, 0x06); // RGBA8
+            WriteU8(data, 1);
+            WriteU16(data, texture.Width);
+            WriteU16(data, texture.Height);
+            WriteU8(data, 0);
+            WriteU8(data, 0);
+            WriteU8(data, 0);
+            WriteU8(data, 0);
+            WriteU16(data, 0);
+            WriteU32(data, 0);
+            WriteU8(data, 0);
+            WriteU8(data, 0);
+            WriteU8(data, 0);
+            WriteU8(data, 0);
+            WriteU8(data, 1);
+            WriteU8(data, 1);
+            WriteU8(data, 0);
+            WriteU8(data, 0);
+            WriteU8(data, 1);
+            WriteU8(data, 0);
+            WriteU16(data, 0);
+            WriteU32(data, 0);
+        }
+
+        size_t nameTableStart = data.size();
+        PatchU32(data, textureStart + 0x10, (uint32_t)(nameTableStart - textureStart));
+
+        WriteU16(data, (uint16_t)textures.size());
+        WriteU16(data, 0xFFFF);
+
+        uint16_t nameOffset = (uint16_t)(4 + textures.size() * 4);
+        for (const J3DTestTexture& texture : textures) {
+            WriteU16(data, 0);
+            WriteU16(data, nameOffset);
+            nameOffset += (uint16_t)(texture.Name.size() + 1);
+        }
+        for (const J3DTestTexture& texture : textures) {
+            data.insert(data.end(), texture.Name.begin(), texture.Name.end());
+            data.push_back(0);
+        }
+
+        Align(data, 0x20);
+        PatchU32(data, textureStart + 4, (uint32_t)(data.size() - textureStart));
+        PatchU32(data, 8, (uint32_t)data.size());
+
+        return data;
+    }
+
+    void WriteFile(const std::filesystem::path& path, const std::vector<uint8_t>& data) {
+        std::ofstream file(path, std::ios::binary | std::ios::trunc);
+        file.write(reinterpret_cast<const char*>(data.data()), data.size());
+    }
+
+    std::shared_ptr<J3DModelData> LoadModel(const std::filesystem::path& path) {
+        J3DModelLoader loader;
+        return loader.Load(path, FLAGS_USE_CACHE_FILE | FLAGS_LAZY_MATERIALIZATION);
+    }
+
+    void CheckTextures(const std::shared_ptr<J3DModelData>& model, const std::vector<J3DTestTexture>& expected) {
+        J3D_CHECK(model != nullptr);
+        if (model == nullptr) {
+            return;
+        }
+
+        shared_vector<J3DTexture>& textures = model->GetTextures();
+        J3D_CHECK(textures.size() == expected.size());
+
+        for (size_t i = 0; i < textures.size() && i < expected.size(); i++) {
+            J3D_CHECK(textures[i]->Name == expected[i].Name);
+            J3D_CHECK(textures[i]->Width == expected[i].Width);
+            J3D_CHECK(textures[i]->Height == expected[i].Height);
+            J3D_CHECK(textures[i]->IsDecodePending());
+        }
+    }
+
+    // Moves the cache file's modification time back, so that a rewrite of it can be told apart from a read.
+    void AgeFile(const std::filesystem::path& path) {
+        std::filesystem::last_write_time(path, std::filesystem::last_write_time(path) - std::chrono::hours(1));
+    }
+}
+
+int main() {
+    std::filesystem::path modelPath = std::filesystem::temp_directory_path() / "J3DModelCacheTest.bmd";
+    std::filesystem::path cachePath = modelPath;
+    cachePath += CACHE_FILE_EXTENSION;
+
+    std::filesystem::remove(cachePath);
+
+    std::vector<J3DTestTexture> textures = { { "grass", 64, 32 }, { "stone_wall", 16, 16 } };
+    WriteFile(modelPath, CreateModelFile(textures));
+
+    // The first load writes the cache file, and the second reads it back.
+    std::shared_ptr<J3DModelData> sourceModel = LoadModel(modelPath);
+    CheckTextures(sourceModel, textures);
+    J3D_CHECK(std::filesystem::exists(cachePath));
+
+    AgeFile(cachePath);
+    std::filesystem::file_time_type cacheTime = std::filesystem::last_write_time(cachePath);
+    uintmax_t cacheSize = std::filesystem::file_size(cachePath);
+
+    std::shared_ptr<J3DModelData> cachedModel = LoadModel(modelPath);
+    CheckTextures(cachedModel, textures);
+    J3D_CHECK(std::filesystem::last_write_time(cachePath) == cacheTime);
+
+    if (sourceModel != nullptr && cachedModel != nullptr) {
+        for (size_t i = 0; i < textures.size(); i++) {
+            const std::shared_ptr<J3DTexture>& source = sourceModel->GetTextures()[i];
+            const std::shared_ptr<J3DTexture>& cached = cachedModel->GetTextures()[i];
+
+            J3D_CHECK(cached->SourceOffset == source->SourceOffset);
+            J3D_CHECK(*cached->SourceData == *source->SourceData);
+        }
+    }
+
+    // A truncated cache file is ignored and rewritten.
+    std::filesystem::resize_file(cachePath, cacheSize / 2);
+    AgeFile(cachePath);
+    cacheTime = std::filesystem::last_write_time(cachePath);
+
+    CheckTextures(LoadModel(modelPath), textures);
+    J3D_CHECK(std::filesystem::file_size(cachePath) == cacheSize);
+    J3D_CHECK(std::filesystem::last_write_time(cachePath) != cacheTime);
+
+    // Changing the source, even without changing its size, makes the cache file stale.
+    textures[0].Width = 32;
+    textures[0].Height = 64;
+    WriteFile(modelPath, CreateModelFile(textures));
+    std::filesystem::last_write_time(modelPath, std::filesystem::last_write_time(modelPath) + std::chrono::hours(1));
+
+    CheckTextures(LoadModel(modelPath), textures);
+    CheckTextures(LoadModel(modelPath), textures);
+
+    std::filesystem::remove(modelPath);
+    std::filesystem::remove(cachePath);
+
+    return J3D_TEST_RESULT();
+}
@@ -0,0 +1,105 @@
+// Times J3D::Rendering::RadixSortPackets on 50k packets, against std::stable_sort by descending key, and checks that both
+// give the same order. Keys are laid out as J3DModelInstance::CalculateSortKey builds them. Prints the time per sort for each;
+// only the check can fail. Gathering needs loaded models and a GL context, so it isn't timed here.
+
+#include "J3DTestCommon.hpp"
+
+#include "J3D/Rendering/J3DRendering.hpp"
+#include "J3D/Rendering/J3DRenderPacket.hpp"
+
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+#include <vector>
+
+namespace {
+    const uint32_t PACKET_COUNT = 50000;
+    const uint32_t ITERATION_COUNT = 100;
+
+    // A key like the ones instances build: mostly opaque packets grouped by a few programs and textures, drawn front to back.
+    uint64_t CreateSceneKey(J3DTest::Random& random) {
+        float distanceSquared = random.Range(1.0f, 1000000.0f);
+        uint32_t distanceBits;
+        std::memcpy(&distanceBits, &distanceSquared, sizeof(float));
+
+        uint64_t depth = (distanceBits >> 8) & 0x7FFFFF;
+        uint64_t program = random.Next() % 64;
+        uint64_t texture = random.Next() % 256;
+
+        uint64_t sortKey = 0;
+        if (random.Next() % 10 != 0) {
+            sortKey |= 1ull << 55;
+            sortKey |= (program << 39) | (texture << 23) | (0x7FFFFF - depth);
+        }
+        else {
+            sortKey |= (depth << 32) | (program << 16) | texture;
+        }
+
+        return sortKey;
+    }
+
+    uint64_t CreateRandomKey(J3DTest::Random& random) {
+        return ((uint64_t)random.Next() << 32) | random.Next();
+    }
+
+    template<typename Func>
+    double MeasureMicroseconds(const Func& func) {
+        auto start = std::chrono::steady_clock::now();
+        func();
+        auto end = std::chrono::steady_clock::now();
+
+        return std::chrono::duration<double, std::micro>(end - start).count();
+    }
+
+    template<typename KeyFunc>
+    void RunBenchmark(const char* name, J3DTest::Random& random, const KeyFunc& createKey) {
+        J3D::Rendering::RenderPacketVector input(PACKET_COUNT);
+        for (uint32_t i = 0; i < PACKET_COUNT; i++) {
+            input[i].SortKey = createKey(random);
+            input[i].Instance = nullptr;
+            // Tags each packet with its gathering order, to check that equal keys keep it.
+            input[i].MaterialIndex = i;
+        }
+
+        J3D::Rendering::RenderPacketVector radixPackets;
+        J3D::Rendering::RenderPacketVector stablePackets;
+
+        // The first sort grows the scratch buffers, as the first frame would.
+        radixPackets = input;
+        J3D::Rendering::RadixSortPackets(radixPackets);
+
+        double radixTime = 0.0;
+        double stableTime = 0.0;
+
+        for (uint32_t iteration = 0; iteration < ITERATION_COUNT; iteration++) {
+            radixPackets = input;
+            stablePackets = input;
+
+            radixTime += MeasureMicroseconds([&]() { J3D::Rendering::RadixSortPackets(radixPackets); });
+            stableTime += MeasureMicroseconds([&]() {
+                std::stable_sort(stablePackets.begin(), stablePackets.end(),
+                    [](const J3DRenderPacket& a, const J3DRenderPacket& b) { return a.SortKey > b.SortKey; });
+            });
+        }
+
+        bool sameOrder = true;
+        for (uint32_t i = 0; i < PACKET_COUNT; i++) {
+            sameOrder = sameOrder && radixPackets[i].SortKey == stablePackets[i].SortKey && radixPackets[i].MaterialIndex == stablePackets[i].MaterialIndex;
+        }
+
+        std::printf("%s, %u packets\n", name, PACKET_COUNT);
+        std::printf("  RadixSortPackets: %8.1f us/sort\n", radixTime / ITERATION_COUNT);
+        std::printf("  std::stable_sort: %8.1f us/sort\n", stableTime / ITERATION_COUNT);
+
+        J3D_CHECK(sameOrder);
+    }
+}
+
+int main() {
+    J3DTest::Random random(0x534F5254);
+
+    RunBenchmark("Scene-like keys", random, CreateSceneKey);
+    RunBenchmark("Random keys", random, CreateRandomKey);
+
+    return J3D_TEST_RESULT();
+}
@@ -0,0 +1,142 @@
+// Checks that gathering packets on worker threads gives exactly the packets, in exactly the order, that gathering on the
+// calling thread and sorting with RadixSortPackets does. Instances draw from material tables of their own, so no model
+// file or GL context is needed.
+
+#include "J3DTestCommon.hpp"
+
+#include "J3D/Data/J3DModelData.hpp"
+#include "J3D/Data/J3DModelInstance.hpp"
+#include "J3D/Material/J3DMaterial.hpp"
+#include "J3D/Material/J3DMaterialTable.hpp"
+#include "J3D/Rendering/J3DRendering.hpp"
+#include "J3D/Rendering/J3DRenderPacket.hpp"
+
+#include <GXGeometryData.hpp>
+
+#include <glm/gtc/matrix_transform.hpp>
+
+#include <memory>
+#include <vector>
+
+namespace {
+    const uint32_t INSTANCE_COUNT = 2000;
+    const uint32_t TABLE_COUNT = 8;
+    const uint32_t WORKER_THREAD_COUNT = 3;
+
+    struct J3DTestScene {
+        std::shared_ptr<J3DModelData> ModelData;
+        std::vector<std::shared_ptr<GXShape>> Shapes;
+        std::vector<std::shared_ptr<J3DMaterialTable>> Tables;
+        std::vector<std::shared_ptr<J3DModelInstance>> Instances;
+    };
+
+    void CreateScene(J3DTestScene& scene, J3DTest::Random& random) {
+        scene.ModelData = std::make_shared<J3DModelData>();
+
+        for (uint32_t t = 0; t < TABLE_COUNT; t++) {
+            std::shared_ptr<J3DMaterialTable> table = std::make_shared<J3DMaterialTable>();
+
+            uint32_t materialCount = 1 + random.Next() % 6;
+            for (uint32_t m = 0; m < materialCount; m++) {
+                std::shared_ptr<J3DMaterial> material = std::make_shared<J3DMaterial>();
+                material->PEMode = random.Next() % 4 == 0 ? EPixelEngineMode::Translucent : EPixelEngineMode::Opaque;
+                material->TevBlock->mTextureIndices.push_back((uint16_t)(random.Next() % 32));
+
+                // Materials without a shape emit no packets.
+                if (random.Next() % 8 != 0) {
+                    std::shared_ptr<GXShape> shape = std::make_shared<GXShape>();
+                    material->SetShape(shape);
+                    scene.Shapes.push_back(shape);
+                }
+
+                table->GetMaterials().push_back(material);
+            }
+
+            scene.Tables.push_back(table);
+        }
+
+        std::vector<J3DAnimationLODLevel> levels(3);
+        levels[0].MinProjectedSize = 0.1f;
+        levels[1].MinProjectedSize = 0.02f;
+        levels[1].UpdateInterval = 2;
+        levels[2].UpdateInterval = 4;
+
+        for (uint32_t i = 0; i < INSTANCE_COUNT; i++) {
+            std::shared_ptr<J3DModelInstance> instance = std::make_shared<J3DModelInstance>(scene.ModelData, (uint16_t)i);
+
+            instance->SetInstanceMaterialTable(scene.Tables[random.Next() % TABLE_COUNT]);
+            instance->SetUseInstanceMaterialTable(true);
+            instance->SetTranslation(glm::vec3(random.Range(-5000.0f, 5000.0f), random.Range(-500.0f, 500.0f), random.Range(-5000.0f, 5000.0f)));
+            instance->SetSortBias((uint8_t)(random.Next() % 3));
+            instance->SetCulled(random.Next() % 16 == 0);
+
+            if (random.Next() % 2 == 0) {
+                instance->SetAnimationLODLevels(levels);
+            }
+
+            scene.Instances.push_back(instance);
+        }
+    }
+
+    bool CheckSamePackets(const J3D::Rendering::RenderPacketVector& a, const J3D::Rendering::RenderPacketVector& b) {
+        if (a.size() != b.size()) {
+            return false;
+        }
+
+        for (size_t i = 0; i < a.size(); i++) {
+            if (a[i].SortKey != b[i].SortKey || a[i].Instance != b[i].Instance || a[i].MaterialIndex != b[i].MaterialIndex) {
+                return false;
+            }
+        }
+
+        return true;
+    }
+
+    void TestGather(const J3DTestScene& scene, const glm::vec3& cameraPosition, const glm::mat4* viewProjMatrix) {
+        J3D::Rendering::RenderPacketVector serialPackets;
+        J3D::Rendering::RenderPacketVector parallelPackets;
+
+        J3D::Rendering::SetWorkerThreadCount(0);
+        if (viewProjMatrix != nullptr) {
+            J3D::Rendering::SortPackets(scene.Instances, cameraPosition, *viewProjMatrix, serialPackets);
+        }
+        else {
+            J3D::Rendering::SortPackets(scene.Instances, cameraPosition, serialPackets);
+        }
+
+        J3D::Rendering::SetWorkerThreadCount(WORKER_THREAD_COUNT);
+        if (viewProjMatrix != nullptr) {
+            J3D::Rendering::SortPackets(scene.Instances, cameraPosition, *viewProjMatrix, parallelPackets);
+        }
+        else {
+            J3D::Rendering::SortPackets(scene.Instances, cameraPosition, parallelPackets);
+        }
+
+        J3D_CHECK(!serialPackets.empty());
+        J3D_CHECK(CheckSamePackets(serialPackets, parallelPackets));
+    }
+}
+
+int main() {
+    J3DTest::Random random(0x50475448);
+
+    J3DTestScene scene;
+    CreateScene(scene, random);
+
+    J3D::Rendering::SetSortFunction(J3D::Rendering::RadixSortPackets);
+
+    for (uint32_t frame = 0; frame < 8; frame++) {
+        glm::vec3 cameraPosition(random.Range(-5000.0f, 5000.0f), random.Range(0.0f, 1000.0f), random.Range(-5000.0f, 5000.0f));
+        glm::vec3 target(random.Range(-5000.0f, 5000.0f), 0.0f, random.Range(-5000.0f, 5000.0f));
+
+        glm::mat4 view = glm::lookAt(cameraPosition, target, glm::vec3(0.0f, 1.0f, 0.0f));
+        glm::mat4 viewProj = glm::perspective(glm::radians(60.0f), 16.0f / 9.0f, 1.0f, 20000.0f) * view;
+
+        TestGather(scene, cameraPosition, nullptr);
+        TestGather(scene, cameraPosition, &viewProj);
+    }
+
+    J3D::Rendering::SetWorkerThreadCount(0);
+
+    return J3D_TEST_RESULT();
+}